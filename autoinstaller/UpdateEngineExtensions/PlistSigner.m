@@ -105,26 +105,30 @@ static NSString *const kSignatureKey = @"Signature";
   // In order to sign/very plists on both Tiger and Leoaprd, we need to
   // serialize the plist into an NSData, but this will contain an XML comment
   // of either "Apple" or "Apple Computer" (Tiger), which will screw up 
-  // signatures. So, we need to convert this XML to a big string, strip off
-  // the first two lines (which are comments), then return the remainder of the
-  // XML as a big data blob.
+  // signatures. So, we strip off the first two lines (the XML declaration and
+  // the DOCTYPE), and return the remainder of the XML as the data blob.
+  //
+  // The XML serialization is deterministic (dictionary keys are written in
+  // sorted order), so the blob is a canonical encoding of the plist. Rather
+  // than round-tripping the XML through strings and line arrays, the blob
+  // is just the bytes after the second newline of the serialized data.
   
   NSData *plistData = [NSPropertyListSerialization
                        dataFromPropertyList:plist
                        format:NSPropertyListXMLFormat_v1_0
                        errorDescription:NULL];
+  if (plistData == nil) return nil;
   
-  NSString *plistString = [[[NSString alloc]
-                            initWithData:plistData
-                                encoding:NSUTF8StringEncoding] autorelease];
-  
-  NSArray *lines = [plistString componentsSeparatedByString:@"\n"];
-  
-  NSRange range = NSMakeRange(2, [lines count] - 2);
-  NSArray *trimmedLines = [lines subarrayWithRange:range];
+  const char *bytes = [plistData bytes];
+  NSUInteger length = [plistData length];
+  NSUInteger offset = 0;
+  for (int newlines = 0; newlines < 2; newlines++) {
+    const char *newline = memchr(bytes + offset, '\n', length - offset);
+    if (newline == NULL) return nil;
+    offset = (newline - bytes) + 1;
+  }
   
-  NSString *trimmedString = [trimmedLines componentsJoinedByString:@"\n"];
-  return [trimmedString dataUsingEncoding:NSUTF8StringEncoding];
+  return [plistData subdataWithRange:NSMakeRange(offset, length - offset)];
 }
 
 @end
@@ -151,6 +151,32 @@ static NSString *const kSignedTigerPlist =
 ;
 
 
+@interface PlistSigner (PlistSignerTestPrivateMethods)
+- (NSData *)blobFromDictionary:(NSDictionary *)plist;
+@end
+
+
+// The blob as PlistSigner used to make it, by splitting the XML into lines.
+static NSData *LineSplittingBlobFromDictionary(NSDictionary *plist) {
+  NSData *plistData = [NSPropertyListSerialization
+                       dataFromPropertyList:plist
+                       format:NSPropertyListXMLFormat_v1_0
+                       errorDescription:NULL];
+  
+  NSString *plistString = [[[NSString alloc]
+                            initWithData:plistData
+                                encoding:NSUTF8StringEncoding] autorelease];
+  
+  NSArray *lines = [plistString componentsSeparatedByString:@"\n"];
+  
+  NSRange range = NSMakeRange(2, [lines count] - 2);
+  NSArray *trimmedLines = [lines subarrayWithRange:range];
+  
+  NSString *trimmedString = [trimmedLines componentsJoinedByString:@"\n"];
+  return [trimmedString dataUsingEncoding:NSUTF8StringEncoding];
+}
+
+
 @interface PlistSignerTest : SenTestCase {
  @private
   Signer *signer_;
@@ -241,4 +267,69 @@ static NSString *const kSignedTigerPlist =
   STAssertTrue([plistSigner isPlistSigned], nil);
 }
 
+- (void)testBlobMatchesLineSplitting {
+  // Signatures made by earlier versions must still verify, so the blob must
+  // be byte-for-byte what splitting the XML into lines produced
+  NSMutableDictionary *rules = [[[kSignedPlist propertyList] mutableCopy] autorelease];
+  [rules removeObjectForKey:@"Signature"];
+
+  NSArray *plists = [NSArray arrayWithObjects:
+                     [NSDictionary dictionary],
+                     [NSDictionary dictionaryWithObject:@"foo" forKey:@"bar"],
+                     [NSDictionary dictionaryWithObjectsAndKeys:
+                      @"caf\u00e9 \u2603", @"unicode",
+                      [NSArray arrayWithObjects:@"a", @"b", nil], @"array",
+                      [NSData dataWithBytes:"\n\n\n" length:3], @"data",
+                      nil],
+                     rules,
+                     nil];
+
+  PlistSigner *plistSigner = [[[PlistSigner alloc]
+                               initWithSigner:signer_
+                                        plist:[NSDictionary dictionary]] autorelease];
+  NSEnumerator *plistEnum = [plists objectEnumerator];
+  NSDictionary *plist;
+  while ((plist = [plistEnum nextObject])) {
+    STAssertEqualObjects([plistSigner blobFromDictionary:plist],
+                         LineSplittingBlobFromDictionary(plist),
+                         @"blob for %@", plist);
+  }
+}
+
+- (void)testVerificationPerformance {
+  // Verifies the rules plist repeatedly, first as PlistSigner used to (line
+  // splitting, with the public key parsed for each verification), then with
+  // one PlistSigner's signer and its parsed key
+  const int kIterations = 500;
+  NSDictionary *plist = [kSignedPlist propertyList];
+  NSMutableDictionary *unsignedPlist = [[plist mutableCopy] autorelease];
+  NSData *signature = [unsignedPlist objectForKey:@"Signature"];
+  [unsignedPlist removeObjectForKey:@"Signature"];
+  NSData *publicKey = [signer_ publicKey];
+
+  NSDate *startDate = [NSDate date];
+  for (int i = 0; i < kIterations; i++) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    Signer *signer = [Signer signerWithPublicKey:publicKey privateKey:nil];
+    NSData *blob = LineSplittingBlobFromDictionary(unsignedPlist);
+    STAssertTrue([signer isSignature:signature validForData:blob], nil);
+    [pool drain];
+  }
+  NSTimeInterval previousTime = -[startDate timeIntervalSinceNow];
+
+  startDate = [NSDate date];
+  for (int i = 0; i < kIterations; i++) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    PlistSigner *plistSigner = [[[PlistSigner alloc]
+                                 initWithSigner:signer_
+                                          plist:plist] autorelease];
+    STAssertTrue([plistSigner isPlistSigned], nil);
+    [pool drain];
+  }
+  NSTimeInterval currentTime = -[startDate timeIntervalSinceNow];
+
+  NSLog(@"%d verifications: previous %.3fs, with cached key %.3fs",
+        kIterations, previousTime, currentTime);
+}
+
 @end
@@ -56,10 +56,17 @@
 // NSData *signature = [signer signData:someData];
 // assert([signer isSignature:signature validForData:someData]);
 // 
+// The keys are parsed the first time they're used, and the parsed keys are
+// kept until the Signer is released or its keys are replaced, so a Signer
+// used for many signatures should be kept rather than recreated.
+//
 @interface Signer : NSObject {
  @private
   NSData *publicKey_;
   NSData *privateKey_;
+  // parsed keys; EVP_PKEY pointers or SecKeyRefs, depending on the SDK
+  void *publicKeyRef_;
+  void *privateKeyRef_;
 }
 
 // Convenience method that returns an autoreleased instance.
@@ -19,6 +19,77 @@
 #import <Security/Security.h>
 #endif
 
+#if MAC_OS_X_VERSION_MIN_REQUIRED < 1070
+typedef EVP_PKEY *SignerKeyRef;
+#else
+typedef SecKeyRef SignerKeyRef;
+#endif
+
+// Returns a parsed key for the DER key data, or NULL. The caller must release
+// the key with ReleaseKey().
+static SignerKeyRef CreateKey(NSData *keyData, BOOL isPrivate) {
+  if (keyData == nil)
+    return NULL;
+
+#if MAC_OS_X_VERSION_MIN_REQUIRED < 1070
+#if MAC_OS_X_VERSION_MAX_ALLOWED < 1060
+  unsigned char *bytes = (unsigned char *)[keyData bytes];
+#else
+  const unsigned char *bytes = (unsigned char *)[keyData bytes];
+#endif
+  RSA *rsa;
+  if (isPrivate)
+    rsa = d2i_RSAPrivateKey(NULL, &bytes, [keyData length]);
+  else
+    rsa = d2i_RSA_PUBKEY(NULL, &bytes, [keyData length]);
+  if (!rsa)
+    return NULL;
+
+  EVP_PKEY *key = EVP_PKEY_new();
+  if (!key || !EVP_PKEY_assign_RSA(key, rsa)) {
+    if (key)
+      EVP_PKEY_free(key);
+    RSA_free(rsa);
+    return NULL;
+  }
+  return key;
+#else
+  SecExternalFormat inputFormat = kSecFormatOpenSSL;
+  SecExternalItemType itemType = (isPrivate ? kSecItemTypePrivateKey
+                                            : kSecItemTypePublicKey);
+  CFArrayRef outItems = NULL;
+
+  OSStatus status = SecItemImport((CFDataRef)keyData, NULL, &inputFormat, &itemType, 0, NULL, NULL, &outItems);
+  if (status != errSecSuccess || !outItems || CFArrayGetCount(outItems) == 0) {
+    if (outItems) {
+      CFRelease(outItems);
+    }
+    return NULL;
+  }
+
+  SecKeyRef key = (SecKeyRef)CFRetain(CFArrayGetValueAtIndex(outItems, 0));
+  CFRelease(outItems);
+  return key;
+#endif
+}
+
+static void ReleaseKey(SignerKeyRef key) {
+  if (!key)
+    return;
+#if MAC_OS_X_VERSION_MIN_REQUIRED < 1070
+  EVP_PKEY_free(key);
+#else
+  CFRelease(key);
+#endif
+}
+
+
+@interface Signer (PrivateMethods)
+- (SignerKeyRef)publicKeyRef;
+- (SignerKeyRef)privateKeyRef;
+@end
+
+
 @implementation Signer
 
 + (id)signerWithPublicKey:(NSData *)publicKey
@@ -41,6 +112,8 @@
 }
 
 - (void)dealloc {
+  ReleaseKey((SignerKeyRef)publicKeyRef_);
+  ReleaseKey((SignerKeyRef)privateKeyRef_);
   [publicKey_ release];
   [privateKey_ release];
   [super dealloc];
@@ -51,8 +124,12 @@
 }
 
 - (void)setPublicKey:(NSData *)publicKey {
-  [publicKey_ autorelease];
-  publicKey_ = [publicKey retain];
+  @synchronized (self) {
+    [publicKey_ autorelease];
+    publicKey_ = [publicKey retain];
+    ReleaseKey((SignerKeyRef)publicKeyRef_);
+    publicKeyRef_ = NULL;
+  }
 }
 
 - (NSData *)privateKey {
@@ -60,8 +137,12 @@
 }
 
 - (void)setPrivateKey:(NSData *)privateKey {
-  [privateKey_ autorelease];
-  privateKey_ = [privateKey retain];
+  @synchronized (self) {
+    [privateKey_ autorelease];
+    privateKey_ = [privateKey retain];
+    ReleaseKey((SignerKeyRef)privateKeyRef_);
+    privateKeyRef_ = NULL;
+  }
 }
 
 - (NSData *)signData:(NSData *)data {
@@ -72,12 +153,8 @@
   int success = 0;
   NSMutableData *signature = nil;
   
-  const unsigned char *bytes = (const unsigned char *)[privateKey_ bytes];
-  RSA *rsa = d2i_RSAPrivateKey(NULL, &bytes, [privateKey_ length]);
-  if (rsa) {
-    EVP_PKEY *keyWrapper = EVP_PKEY_new();
-    EVP_PKEY_set1_RSA(keyWrapper, rsa);
-    
+  EVP_PKEY *keyWrapper = [self privateKeyRef];
+  if (keyWrapper) {
     EVP_MD_CTX context;
     EVP_MD_CTX_init(&context);
     
@@ -93,29 +170,16 @@
     }
     
     EVP_MD_CTX_cleanup(&context);
-    EVP_PKEY_free(keyWrapper);
-    RSA_free(rsa);
   }
   
   return success == 1 ? signature : nil;
 #else
-  SecExternalFormat inputFormat = kSecFormatOpenSSL;
-  SecExternalItemType itemType = kSecItemTypePrivateKey;
-  CFArrayRef outItems = NULL;
-  
-  OSStatus status = SecItemImport((CFDataRef)privateKey_, NULL, &inputFormat, &itemType, 0, NULL, NULL, &outItems);
-  if (status != errSecSuccess || !outItems || CFArrayGetCount(outItems) == 0) {
-    if (outItems) {
-      CFRelease(outItems);
-    }
+  SecKeyRef privateKey = [self privateKeyRef];
+  if (!privateKey) {
     return nil;
   }
-
-  SecKeyRef privateKey = (SecKeyRef)CFRetain(CFArrayGetValueAtIndex(outItems, 0));
-  CFRelease(outItems);
   
   SecTransformRef signer = SecSignTransformCreate(privateKey, NULL);
-  CFRelease(privateKey);
   if (!signer) {
     return nil;
   }
@@ -139,16 +203,8 @@
 #if MAC_OS_X_VERSION_MIN_REQUIRED < 1070
   int success = 0;
 
-#if MAC_OS_X_VERSION_MAX_ALLOWED < 1060
-  unsigned char *bytes = (unsigned char *)[publicKey_ bytes];
-#else
-  const unsigned char *bytes = (unsigned char *)[publicKey_ bytes];
-#endif
-  RSA *rsa = d2i_RSA_PUBKEY(NULL, &bytes, [publicKey_ length]);
-  if (rsa) {    
-    EVP_PKEY *keyWrapper = EVP_PKEY_new();
-    EVP_PKEY_set1_RSA(keyWrapper, rsa);
-    
+  EVP_PKEY *keyWrapper = [self publicKeyRef];
+  if (keyWrapper) {
     EVP_MD_CTX context;
     EVP_MD_CTX_init(&context);
     
@@ -159,29 +215,16 @@
     }
     
     EVP_MD_CTX_cleanup(&context);
-    EVP_PKEY_free(keyWrapper);
-    RSA_free(rsa);
   }
   
   return (success == 1);
 #else
-  SecExternalFormat inputFormat = kSecFormatOpenSSL;
-  SecExternalItemType itemType = kSecItemTypePublicKey;
-  CFArrayRef outItems = NULL;
-  
-  OSStatus status = SecItemImport((CFDataRef)publicKey_, NULL, &inputFormat, &itemType, 0, NULL, NULL, &outItems);
-  if (status != errSecSuccess || !outItems || CFArrayGetCount(outItems) == 0) {
-    if (outItems) {
-      CFRelease(outItems);
-    }
+  SecKeyRef publicKey = [self publicKeyRef];
+  if (!publicKey) {
     return NO;
   }
-
-  SecKeyRef publicKey = (SecKeyRef)CFRetain(CFArrayGetValueAtIndex(outItems, 0));
-  CFRelease(outItems);
   
   SecTransformRef verifier = SecVerifyTransformCreate(publicKey, (CFDataRef)signature, NULL);
-  CFRelease(publicKey);
   if (!verifier) {
     return NO;
   }
@@ -204,3 +247,26 @@
 }
 
 @end
+
+
+@implementation Signer (PrivateMethods)
+
+- (SignerKeyRef)publicKeyRef {
+  @synchronized (self) {
+    if (!publicKeyRef_)
+      publicKeyRef_ = CreateKey(publicKey_, NO);
+    return (SignerKeyRef)publicKeyRef_;
+  }
+  return NULL;
+}
+
+- (SignerKeyRef)privateKeyRef {
+  @synchronized (self) {
+    if (!privateKeyRef_)
+      privateKeyRef_ = CreateKey(privateKey_, YES);
+    return (SignerKeyRef)privateKeyRef_;
+  }
+  return NULL;
+}
+
+@end
@@ -15,19 +15,122 @@
 
 
 static void Usage(void) {
-  printf("Usage: plist_signer {-s|-v} -k <key> <plist>\n"
-         "  --sign,-s    Signs the specified plist file using the *private*\n"
+  printf("Usage: plist_signer {-s|-v} -k <key> [-j <jobs>] <plist> ...\n"
+         "  --sign,-s    Signs the specified plist files using the *private*\n"
          "                key specified with -k\n"
-         "  --verify,-v  Verifies the signature of the specified plist using\n"
+         "  --verify,-v  Verifies the signature of the specified plists using\n"
          "               *public* key specified with -k\n"
          "  --key,-k <f> Specifies the path to a DER key file. This path can\n"
          "               be either a public or a private key, depending on\n"
          "               whether signing (private) or verifying (public) was\n"
          "               requested with either -s or -v\n"
+         "  --jobs,-j <n> Number of plists to process at once when more than\n"
+         "               one is given (default: the number of processors)\n"
   );
 }
 
 
+// Signs or verifies the plist at |path|, returning YES on success and the
+// line to print in |message|.
+static BOOL ProcessPlist(Signer *signer, NSString *path, BOOL sign,
+                         NSString **message) {
+  NSDictionary *plist = [NSDictionary dictionaryWithContentsOfFile:path];
+  PlistSigner *plistSigner = [[[PlistSigner alloc]
+                               initWithSigner:signer
+                                        plist:plist] autorelease];
+  BOOL ok;
+  if (sign) {
+    ok = ([plistSigner signPlist]
+          && [[plistSigner plist] writeToFile:path atomically:YES]);
+    if (ok) {
+      *message = [NSString stringWithFormat:@"%@: Signature OK\n", path];
+    } else {
+      *message = [NSString stringWithFormat:@"Failed to sign %@\n", path];
+    }
+  } else {
+    ok = [plistSigner isPlistSigned];
+    *message = [NSString stringWithFormat:@"%@: %s\n", path,
+                (ok ? "Signature OK" : "Signature Invalid")];
+  }
+  return ok;
+}
+
+
+// PlistJob processes every |stride|th plist of a batch, starting with
+// |first|. Each job has its own Signer, so the parsed key is made once per
+// job and never shared between threads.
+@interface PlistJob : NSOperation {
+ @private
+  NSArray *paths_;
+  NSData *key_;
+  BOOL sign_;
+  NSUInteger first_;
+  NSUInteger stride_;
+  NSMutableDictionary *messages_;  // NSNumber path index -> NSString
+  int failures_;
+}
+- (id)initWithPaths:(NSArray *)paths
+                key:(NSData *)key
+               sign:(BOOL)sign
+              first:(NSUInteger)first
+             stride:(NSUInteger)stride;
+- (NSDictionary *)messages;
+- (int)failures;
+@end
+
+@implementation PlistJob
+
+- (id)initWithPaths:(NSArray *)paths
+                key:(NSData *)key
+               sign:(BOOL)sign
+              first:(NSUInteger)first
+             stride:(NSUInteger)stride {
+  if ((self = [super init])) {
+    paths_ = [paths retain];
+    key_ = [key retain];
+    sign_ = sign;
+    first_ = first;
+    stride_ = stride;
+    messages_ = [[NSMutableDictionary alloc] init];
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [paths_ release];
+  [key_ release];
+  [messages_ release];
+  [super dealloc];
+}
+
+- (void)main {
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  Signer *signer = [Signer signerWithPublicKey:key_ privateKey:key_];
+
+  for (NSUInteger i = first_; i < [paths_ count]; i += stride_) {
+    NSAutoreleasePool *plistPool = [[NSAutoreleasePool alloc] init];
+    NSString *message = nil;
+    if (!ProcessPlist(signer, [paths_ objectAtIndex:i], sign_, &message))
+      failures_++;
+    [messages_ setObject:message
+                  forKey:[NSNumber numberWithUnsignedInteger:i]];
+    [plistPool release];
+  }
+
+  [pool release];
+}
+
+- (NSDictionary *)messages {
+  return messages_;
+}
+
+- (int)failures {
+  return failures_;
+}
+
+@end
+
+
 int main(int argc, char **argv) {
   NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
   int rc = 0;
@@ -36,13 +139,15 @@ int main(int argc, char **argv) {
     { "key",           required_argument, NULL, 'k' },
     { "verify",        no_argument,       NULL, 'v' },
     { "sign",          no_argument,       NULL, 's' },
+    { "jobs",          required_argument, NULL, 'j' },
     {  NULL,           0,                 NULL,  0  },
   };
   
   BOOL verify = NO, sign = NO;
   NSString *keyPath = nil;
+  int jobs = [[NSProcessInfo processInfo] activeProcessorCount];
   int ch = 0;
-  while ((ch = getopt_long(argc, argv, "k:vs", kLongOpts, NULL)) != -1) {
+  while ((ch = getopt_long(argc, argv, "k:vsj:", kLongOpts, NULL)) != -1) {
     switch (ch) {
       case 'k':
         keyPath = [NSString stringWithUTF8String:optarg];
@@ -53,6 +158,9 @@ int main(int argc, char **argv) {
       case 's':
         sign = YES;
         break;
+      case 'j':
+        jobs = atoi(optarg);
+        break;
       default:
         Usage();
         goto done;
@@ -62,34 +170,69 @@ int main(int argc, char **argv) {
   argc -= optind;
   argv += optind;
   
-  if (argc != 1 || !(sign || verify)) {
+  if (argc < 1 || !(sign || verify) || jobs < 1) {
     Usage();
     goto done;
   }
+
+#if MAC_OS_X_VERSION_MIN_REQUIRED < 1070
+  // OpenSSL isn't set up here for use from several threads
+  jobs = 1;
+#endif
   
-  NSString *plistPath = [NSString stringWithUTF8String:argv[0]];
-  NSDictionary *plist = [NSDictionary dictionaryWithContentsOfFile:plistPath];
+  NSMutableArray *plistPaths = [NSMutableArray array];
+  for (int i = 0; i < argc; i++) {
+    [plistPaths addObject:[NSString stringWithUTF8String:argv[i]]];
+  }
+  if (jobs > argc) jobs = argc;
 
   NSData *key = [NSData dataWithContentsOfFile:keyPath];
-  Signer *signer = [Signer signerWithPublicKey:key privateKey:key];
-  
-  PlistSigner *plistSigner = [[[PlistSigner alloc]
-                               initWithSigner:signer
-                                        plist:plist] autorelease];
-  
-  if (sign) {
-    if ([plistSigner signPlist]) {
-      [[plistSigner plist] writeToFile:plistPath atomically:YES];
-      printf("%s: Signature OK\n", [plistPath UTF8String]);
-    } else {
-      printf("Failed to sign %s\n", [plistPath UTF8String]);
-      rc = 1;
+
+  if (jobs == 1) {
+    Signer *signer = [Signer signerWithPublicKey:key privateKey:key];
+    NSEnumerator *pathEnum = [plistPaths objectEnumerator];
+    NSString *plistPath;
+    while ((plistPath = [pathEnum nextObject])) {
+      NSAutoreleasePool *plistPool = [[NSAutoreleasePool alloc] init];
+      NSString *message = nil;
+      if (!ProcessPlist(signer, plistPath, sign, &message))
+        rc = 1;
+      printf("%s", [message UTF8String]);
+      [plistPool release];
     }
-  } else if (verify) {
-    BOOL ok = [plistSigner isPlistSigned];
-    printf("%s: %s\n", [plistPath UTF8String],
-           (ok ? "Signature OK" : "Signature Invalid"));
-    if (!ok) rc = 1;
+  } else {
+    NSDate *startDate = [NSDate date];
+    NSOperationQueue *queue = [[[NSOperationQueue alloc] init] autorelease];
+    [queue setMaxConcurrentOperationCount:jobs];
+
+    NSMutableArray *plistJobs = [NSMutableArray array];
+    for (int i = 0; i < jobs; i++) {
+      PlistJob *job = [[[PlistJob alloc] initWithPaths:plistPaths
+                                                   key:key
+                                                  sign:sign
+                                                 first:i
+                                                stride:jobs] autorelease];
+      [plistJobs addObject:job];
+      [queue addOperation:job];
+    }
+    [queue waitUntilAllOperationsAreFinished];
+
+    // Print the results in the order the plists were given
+    NSMutableDictionary *messages = [NSMutableDictionary dictionary];
+    NSEnumerator *jobEnum = [plistJobs objectEnumerator];
+    PlistJob *job;
+    while ((job = [jobEnum nextObject])) {
+      [messages addEntriesFromDictionary:[job messages]];
+      if ([job failures] > 0) rc = 1;
+    }
+    for (int i = 0; i < argc; i++) {
+      NSNumber *index = [NSNumber numberWithUnsignedInteger:i];
+      NSString *message = [messages objectForKey:index];
+      printf("%s", [message UTF8String]);
+    }
+
+    fprintf(stderr, "%d plists in %.3fs with %d jobs\n", argc,
+            -[startDate timeIntervalSinceNow], jobs);
   }
   
 done:
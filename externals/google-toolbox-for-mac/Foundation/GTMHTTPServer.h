@@ -131,6 +131,9 @@ enum {
 @interface GTMHTTPResponseMessage : NSObject {
  @private
   CFHTTPMessageRef message_;
+  int bodyFD_;          // file the body is sent from, or -1
+  off_t bodyOffset_;    // where in bodyFD_ the body starts
+  off_t bodyLength_;    // how many bytes of bodyFD_ to send
 }
 + (id)responseWithString:(NSString *)plainText;
 + (id)responseWithHTMLString:(NSString *)htmlString;
@@ -138,6 +141,22 @@ enum {
            contentType:(NSString *)contentType
             statusCode:(int)statusCode;
 + (id)emptyResponseWithCode:(int)statusCode;
+// Returns a response whose body is the file at |path|, or nil if there is no
+// regular file there.  The file is never read into memory; it is sent
+// straight from disk with sendfile(2), so it may be as large as you like.
+// The response has an ETag (from the file's inode, size and modification
+// date), a Last-Modified date and "Accept-Ranges: bytes", and honors these
+// headers of |request| (which may be nil):
+//   If-None-Match, If-Modified-Since: 304 if the file matches (dates must
+//     match exactly, as clients are meant to echo back Last-Modified).
+//   Range: a single "bytes=first-last", "bytes=first-" or "bytes=-suffix"
+//     range gets a 206 with a Content-Range, or a 416 if it starts past the
+//     end of the file.  Multiple ranges are ignored, and the whole file sent.
+//   If-Range: the Range is ignored unless this matches the ETag or date.
+// A HEAD request gets the same headers, but no body.
++ (id)responseWithContentsOfFile:(NSString *)path
+                     contentType:(NSString *)contentType
+                      forRequest:(GTMHTTPRequestMessage *)request;
 // TODO: class method for redirections?
 // TODO: add helper for expire/no-cache
 - (void)setValue:(NSString*)value forHeaderField:(NSString*)headerField;
@@ -19,8 +19,15 @@
 //  http://developer.apple.com/samplecode/CocoaHTTPServer/index.html
 //
 
+#import <errno.h>
+#import <fcntl.h>
 #import <netinet/in.h>
+#import <poll.h>
 #import <sys/socket.h>
+#import <sys/stat.h>
+#import <sys/types.h>
+#import <sys/uio.h>
+#import <time.h>
 #import <unistd.h>
 
 #define GTMHTTPSERVER_DEFINE_GLOBALS
@@ -58,6 +65,10 @@ static NSString *kResponse = @"Response";
        contentType:(NSString *)contentType
         statusCode:(int)statusCode;
 - (NSData*)serializedData;
+- (void)setBodyFileDescriptor:(int)fd
+                       offset:(off_t)offset
+                       length:(off_t)length;
+- (BOOL)sendBodyToSocket:(int)socketFD;
 @end
 
 @implementation GTMHTTPServer
@@ -411,6 +422,10 @@ startFailed:
     NSFileHandle *connectionHandle = [connDict objectForKey:kFileHandle];
     NSData *serialized = [response serializedData];
     [connectionHandle writeData:serialized];
+    // file backed bodies go out after the headers, straight from the file
+    if (![response sendBodyToSocket:[connectionHandle fileDescriptor]]) {
+      _GTMDevLog(@"failed to send the body of %@ (errno=%d)", response, errno);
+    }
   } @catch (NSException *e) {  // COV_NF_START - causing an exception here is to hard in a test
     // TODO: let the delegate know about the exception (but do it on the main
     // thread)
@@ -522,6 +537,116 @@ startFailed:
 
 #pragma mark -
 
+typedef enum {
+  kByteRangeIgnored,
+  kByteRangeUnsatisfiable,
+  kByteRangeSatisfiable,
+} ByteRangeResult;
+
+// Parses a Range header value for a file of |size| bytes.  Only a single
+// range is understood; anything else is ignored, so the whole file is sent.
+static ByteRangeResult ParseByteRange(NSString *rangeSpec, off_t size,
+                                      off_t *first, off_t *last) {
+  NSString *prefix = @"bytes=";
+  if (![rangeSpec hasPrefix:prefix]) return kByteRangeIgnored;
+  NSString *spec = [rangeSpec substringFromIndex:[prefix length]];
+  if ([spec rangeOfString:@","].location != NSNotFound) {
+    return kByteRangeIgnored;
+  }
+  NSScanner *scanner = [NSScanner scannerWithString:spec];
+  [scanner setCharactersToBeSkipped:nil];
+  long long start = -1;
+  long long end = -1;
+  // scanLongLong: takes a sign, so don't let it eat a suffix range's dash
+  if (![spec hasPrefix:@"-"] && ![scanner scanLongLong:&start]) {
+    return kByteRangeIgnored;
+  }
+  if (![scanner scanString:@"-" intoString:NULL]) return kByteRangeIgnored;
+  if (![scanner scanLongLong:&end]) end = -1;
+  if (![scanner isAtEnd]) return kByteRangeIgnored;
+
+  if (start < 0) {
+    // "-suffix" is the last |suffix| bytes
+    if (end < 0) return kByteRangeIgnored;
+    if (end == 0 || size == 0) return kByteRangeUnsatisfiable;
+    *first = (end < size) ? size - end : 0;
+    *last = size - 1;
+  } else {
+    if (end >= 0 && end < start) return kByteRangeIgnored;
+    if (start >= size) return kByteRangeUnsatisfiable;
+    *first = start;
+    *last = (end < 0 || end >= size) ? size - 1 : end;
+  }
+  return kByteRangeSatisfiable;
+}
+
+// Returns YES if the If-None-Match value |tags| lists |etag| or is "*".
+static BOOL ETagListMatches(NSString *tags, NSString *etag) {
+  NSCharacterSet *whitespace = [NSCharacterSet whitespaceCharacterSet];
+  NSString *tag;
+  GTM_FOREACH_OBJECT(tag, [tags componentsSeparatedByString:@","]) {
+    tag = [tag stringByTrimmingCharactersInSet:whitespace];
+    // we only make strong tags, but compare weak ones loosely
+    if ([tag hasPrefix:@"W/"]) {
+      tag = [tag substringFromIndex:2];
+    }
+    if ([tag isEqualToString:@"*"] || [tag isEqualToString:etag]) {
+      return YES;
+    }
+  }
+  return NO;
+}
+
+// Formats |time| as an RFC 1123 date, without regard to the locale.
+static NSString *HTTPDateString(time_t time) {
+  static const char *const kDays[] = {
+    "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"
+  };
+  static const char *const kMonths[] = {
+    "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+    "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+  };
+  struct tm tm;
+  gmtime_r(&time, &tm);
+  return [NSString stringWithFormat:@"%s, %02d %s %d %02d:%02d:%02d GMT",
+          kDays[tm.tm_wday], tm.tm_mday, kMonths[tm.tm_mon],
+          tm.tm_year + 1900, tm.tm_hour, tm.tm_min, tm.tm_sec];
+}
+
+// Copies |length| bytes at |offset| in |fd| to |socketFD| with plain reads and
+// writes, for files sendfile(2) can't handle.
+static BOOL CopyFileRange(int fd, int socketFD, off_t offset, off_t length) {
+  const size_t kBufferSize = 64 * 1024;
+  char *buffer = malloc(kBufferSize);
+  if (!buffer) return NO;  // COV_NF_LINE
+  BOOL result = YES;
+  while (length > 0) {
+    size_t wanted =
+      (length < (off_t)kBufferSize) ? (size_t)length : kBufferSize;
+    ssize_t got = pread(fd, buffer, wanted, offset);
+    if (got < 0 && errno == EINTR) continue;
+    if (got <= 0) {
+      result = NO;
+      break;
+    }
+    ssize_t written = 0;
+    while (written < got) {
+      ssize_t n = write(socketFD, buffer + written, got - written);
+      if (n < 0 && errno == EINTR) continue;
+      if (n <= 0) {
+        result = NO;
+        break;
+      }
+      written += n;
+    }
+    if (!result) break;
+    offset += got;
+    length -= got;
+  }
+  free(buffer);
+  return result;
+}
+
 @implementation GTMHTTPResponseMessage
 
 - (id)init {
@@ -532,9 +657,21 @@ startFailed:
   if (message_) {
     CFRelease(message_);
   }
+  if (bodyFD_ >= 0) {
+    close(bodyFD_);
+  }
   [super dealloc];
 }
 
+#if GTM_SUPPORT_GC
+- (void)finalize {
+  if (bodyFD_ >= 0) {
+    close(bodyFD_);
+  }
+  [super finalize];
+}
+#endif
+
 + (id)responseWithString:(NSString *)plainText {
   NSData *body = [plainText dataUsingEncoding:NSUTF8StringEncoding];
   return [self responseWithBody:body
@@ -562,6 +699,92 @@ startFailed:
                                   statusCode:statusCode] autorelease];
 }
 
++ (id)responseWithContentsOfFile:(NSString *)path
+                     contentType:(NSString *)contentType
+                      forRequest:(GTMHTTPRequestMessage *)request {
+  if ([path length] == 0) return nil;
+  int fd = open([path fileSystemRepresentation], O_RDONLY);
+  if (fd < 0) return nil;
+  struct stat sb;
+  if ((fstat(fd, &sb) != 0) || !S_ISREG(sb.st_mode)) {
+    close(fd);
+    return nil;
+  }
+  off_t size = sb.st_size;
+  NSString *etag = [NSString stringWithFormat:@"\"%llx-%llx-%lx\"",
+                    (unsigned long long)sb.st_ino, (unsigned long long)size,
+                    (long)sb.st_mtimespec.tv_sec];
+  NSString *lastModified = HTTPDateString(sb.st_mtimespec.tv_sec);
+
+  int statusCode = 200;
+  off_t first = 0;
+  off_t last = size - 1;
+  NSString *ifNoneMatch = [request headerFieldValueForKey:@"If-None-Match"];
+  NSString *ifModifiedSince =
+    [request headerFieldValueForKey:@"If-Modified-Since"];
+  NSString *rangeSpec = [request headerFieldValueForKey:@"Range"];
+  NSString *ifRange = [request headerFieldValueForKey:@"If-Range"];
+  if (ifNoneMatch) {
+    if (ETagListMatches(ifNoneMatch, etag)) statusCode = 304;
+  } else if ([ifModifiedSince isEqualToString:lastModified]) {
+    statusCode = 304;
+  }
+  if (statusCode == 200 && rangeSpec &&
+      (!ifRange || [ifRange isEqualToString:etag] ||
+       [ifRange isEqualToString:lastModified])) {
+    switch (ParseByteRange(rangeSpec, size, &first, &last)) {
+      case kByteRangeSatisfiable:
+        statusCode = 206;
+        break;
+      case kByteRangeUnsatisfiable:
+        statusCode = 416;
+        break;
+      case kByteRangeIgnored:
+        first = 0;
+        last = size - 1;
+        break;
+    }
+  }
+
+  GTMHTTPResponseMessage *response =
+    [[[[self class] alloc] initWithBody:nil
+                            contentType:contentType
+                             statusCode:statusCode] autorelease];
+  if (!response) {
+    // COV_NF_START
+    close(fd);
+    return nil;
+    // COV_NF_END
+  }
+  [response setValue:etag forHeaderField:@"ETag"];
+  [response setValue:lastModified forHeaderField:@"Last-Modified"];
+  [response setValue:@"bytes" forHeaderField:@"Accept-Ranges"];
+  off_t length = 0;
+  if (statusCode == 200 || statusCode == 206) {
+    length = last - first + 1;
+  }
+  if (statusCode == 206) {
+    NSString *contentRange =
+      [NSString stringWithFormat:@"bytes %lld-%lld/%lld",
+       (long long)first, (long long)last, (long long)size];
+    [response setValue:contentRange forHeaderField:@"Content-Range"];
+  } else if (statusCode == 416) {
+    NSString *contentRange =
+      [NSString stringWithFormat:@"bytes */%lld", (long long)size];
+    [response setValue:contentRange forHeaderField:@"Content-Range"];
+  }
+  NSString *lengthString =
+    [NSString stringWithFormat:@"%lld", (long long)length];
+  [response setValue:lengthString forHeaderField:@"Content-Length"];
+
+  if (length > 0 && ![[request method] isEqualToString:@"HEAD"]) {
+    [response setBodyFileDescriptor:fd offset:first length:length];
+  } else {
+    close(fd);
+  }
+  return response;
+}
+
 - (void)setValue:(NSString*)value forHeaderField:(NSString*)headerField {
   if ([headerField length] == 0) return;
   if (value == nil) {
@@ -588,6 +811,7 @@ startFailed:
         statusCode:(int)statusCode {
   self = [super init];
   if (self) {
+    bodyFD_ = -1;
     if ((statusCode < 100) || (statusCode > 599)) {
       [self release];
       return nil;
@@ -621,4 +845,52 @@ startFailed:
   return GTMCFAutorelease(CFHTTPMessageCopySerializedMessage(message_));
 }
 
+- (void)setBodyFileDescriptor:(int)fd
+                       offset:(off_t)offset
+                       length:(off_t)length {
+  if (bodyFD_ >= 0) {
+    close(bodyFD_);  // COV_NF_LINE - only set once
+  }
+  bodyFD_ = fd;
+  bodyOffset_ = offset;
+  bodyLength_ = length;
+}
+
+- (BOOL)sendBodyToSocket:(int)socketFD {
+  if (bodyFD_ < 0) return YES;
+
+  // a client hanging up part way through shouldn't kill the process
+  int yes = 1;
+  setsockopt(socketFD, SOL_SOCKET, SO_NOSIGPIPE,
+             (void *)&yes, (socklen_t)sizeof(yes));
+
+  off_t offset = bodyOffset_;
+  off_t remaining = bodyLength_;
+  while (remaining > 0) {
+    // on return |sent| holds what went out, even if we were interrupted
+    off_t sent = remaining;
+    int result = sendfile(bodyFD_, socketFD, offset, &sent, NULL, 0);
+    offset += sent;
+    remaining -= sent;
+    if (result == 0) {
+      if (sent == 0) return NO;  // the file got shorter
+      continue;
+    }
+    if (errno == EINTR) continue;
+    if (errno == EAGAIN) {
+      struct pollfd pfd = { socketFD, POLLOUT, 0 };
+      poll(&pfd, 1, -1);
+      continue;
+    }
+    if (errno == ENOTSUP || errno == EOPNOTSUPP || errno == ENOTSOCK ||
+        errno == EINVAL) {
+      // COV_NF_START - only for files and sockets sendfile can't handle
+      return CopyFileRange(bodyFD_, socketFD, offset, remaining);
+      // COV_NF_END
+    }
+    return NO;
+  }
+  return YES;
+}
+
 @end
@@ -16,6 +16,7 @@
 //  the License.
 //
 
+#import <errno.h>
 #import <netinet/in.h>
 #import <sys/socket.h>
 #import <unistd.h>
@@ -28,6 +29,8 @@
 @interface GTMHTTPServerTest : GTMTestCase {
   CFHTTPMessageRef fetchedMessage_;
   BOOL complete_;
+  NSUInteger finishedFetches_;       // for testFileThroughput
+  unsigned long long fetchedBytes_;  // for testFileThroughput
 }
 @end
 
@@ -39,6 +42,12 @@
                                   payload:(NSString *)payload
                                 chunkSize:(NSUInteger)chunkSize;
 - (void)readData:(NSNotification *)notification;
+- (NSData *)fetchFileFromPort:(unsigned short)port
+                      headers:(NSString *)headers
+                   statusCode:(CFIndex *)statusCode
+                  headerValue:(NSString **)value
+                       forKey:(NSString *)key;
+- (void)fetchOnThread:(NSNumber *)port;
 @end
 
 // helper class
@@ -58,6 +67,15 @@
                          handleRequest:(GTMHTTPRequestMessage *)request;
 @end
 
+// helper that answers every request with the contents of a file
+@interface TestFileServerDelegate : TestServerDelegate {
+  NSString *path_;
+}
+- (id)initWithPath:(NSString *)path;
+- (GTMHTTPResponseMessage *)httpServer:(GTMHTTPServer *)server
+                         handleRequest:(GTMHTTPRequestMessage *)request;
+@end
+
 // The timings used for waiting for replies
 const NSTimeInterval kGiveUpInterval = 5.0;
 const NSTimeInterval kRunLoopInterval = 0.01;
@@ -375,6 +393,242 @@ const NSTimeInterval kSendChunkInterval = 0.05;
   [server stop];
 }
 
+- (void)testFileResponses {
+  // no file, or not a regular one
+  NSString *tempDir = NSTemporaryDirectory();
+  NSString *missing = [tempDir stringByAppendingPathComponent:
+                       @"GTMHTTPServerTest-missing"];
+  STAssertNil([GTMHTTPResponseMessage responseWithContentsOfFile:missing
+                                                     contentType:nil
+                                                      forRequest:nil], nil);
+  STAssertNil([GTMHTTPResponseMessage responseWithContentsOfFile:tempDir
+                                                     contentType:nil
+                                                      forRequest:nil], nil);
+
+  // a file w/ a different value in every nearby byte
+  NSMutableData *contents = [NSMutableData dataWithLength:100000];
+  unsigned char *bytes = [contents mutableBytes];
+  for (NSUInteger x = 0; x < [contents length]; ++x) {
+    bytes[x] = (unsigned char)(x % 251);
+  }
+  NSString *path = [tempDir stringByAppendingPathComponent:
+                    @"GTMHTTPServerTest-file"];
+  STAssertTrue([contents writeToFile:path atomically:NO], nil);
+
+  TestFileServerDelegate *delegate =
+    [[[TestFileServerDelegate alloc] initWithPath:path] autorelease];
+  STAssertNotNil(delegate, nil);
+  GTMHTTPServer *server =
+    [[[GTMHTTPServer alloc] initWithDelegate:delegate] autorelease];
+  STAssertNotNil(server, nil);
+  NSError *error = nil;
+  STAssertTrue([server start:&error], @"failed to start (error=%@)", error);
+  STAssertNil(error, @"error: %@", error);
+  unsigned short port = [server port];
+
+  // the whole file
+  CFIndex status = 0;
+  NSString *etag = nil;
+  NSData *body = [self fetchFileFromPort:port
+                                 headers:@""
+                              statusCode:&status
+                             headerValue:&etag
+                                  forKey:@"ETag"];
+  STAssertEquals(status, (CFIndex)200, nil);
+  STAssertEqualObjects(body, contents, nil);
+  STAssertTrue([etag hasPrefix:@"\""], @"ETag: %@", etag);
+  NSString *value = nil;
+  [self fetchFileFromPort:port
+                  headers:@""
+               statusCode:&status
+              headerValue:&value
+                   forKey:@"Accept-Ranges"];
+  STAssertEqualObjects(value, @"bytes", nil);
+  NSString *lastModified = nil;
+  [self fetchFileFromPort:port
+                  headers:@""
+               statusCode:&status
+              headerValue:&lastModified
+                   forKey:@"Last-Modified"];
+  STAssertTrue([lastModified hasSuffix:@" GMT"], @"Date: %@", lastModified);
+
+  // ranges
+  body = [self fetchFileFromPort:port
+                         headers:@"Range: bytes=100-199\r\n"
+                      statusCode:&status
+                     headerValue:&value
+                          forKey:@"Content-Range"];
+  STAssertEquals(status, (CFIndex)206, nil);
+  STAssertEqualObjects(value, @"bytes 100-199/100000", nil);
+  STAssertEqualObjects(body, [contents subdataWithRange:NSMakeRange(100, 100)],
+                       nil);
+  body = [self fetchFileFromPort:port
+                         headers:@"Range: bytes=99990-\r\n"
+                      statusCode:&status
+                     headerValue:&value
+                          forKey:@"Content-Range"];
+  STAssertEquals(status, (CFIndex)206, nil);
+  STAssertEqualObjects(value, @"bytes 99990-99999/100000", nil);
+  STAssertEqualObjects(body, [contents subdataWithRange:NSMakeRange(99990, 10)],
+                       nil);
+  body = [self fetchFileFromPort:port
+                         headers:@"Range: bytes=-50\r\n"
+                      statusCode:&status
+                     headerValue:&value
+                          forKey:@"Content-Range"];
+  STAssertEquals(status, (CFIndex)206, nil);
+  STAssertEqualObjects(value, @"bytes 99950-99999/100000", nil);
+  STAssertEqualObjects(body, [contents subdataWithRange:NSMakeRange(99950, 50)],
+                       nil);
+  // past the end gets trimmed, starting past the end can't be done
+  body = [self fetchFileFromPort:port
+                         headers:@"Range: bytes=99000-200000\r\n"
+                      statusCode:&status
+                     headerValue:&value
+                          forKey:@"Content-Range"];
+  STAssertEquals(status, (CFIndex)206, nil);
+  STAssertEqualObjects(value, @"bytes 99000-99999/100000", nil);
+  STAssertEquals([body length], (NSUInteger)1000, nil);
+  body = [self fetchFileFromPort:port
+                         headers:@"Range: bytes=100000-\r\n"
+                      statusCode:&status
+                     headerValue:&value
+                          forKey:@"Content-Range"];
+  STAssertEquals(status, (CFIndex)416, nil);
+  STAssertEqualObjects(value, @"bytes */100000", nil);
+  STAssertEquals([body length], (NSUInteger)0, nil);
+  // multiple or garbage ranges get the whole file
+  body = [self fetchFileFromPort:port
+                         headers:@"Range: bytes=0-1,5-6\r\n"
+                      statusCode:&status
+                     headerValue:NULL
+                          forKey:nil];
+  STAssertEquals(status, (CFIndex)200, nil);
+  STAssertEqualObjects(body, contents, nil);
+  body = [self fetchFileFromPort:port
+                         headers:@"Range: bytes=9-1\r\n"
+                      statusCode:&status
+                     headerValue:NULL
+                          forKey:nil];
+  STAssertEquals(status, (CFIndex)200, nil);
+  STAssertEqualObjects(body, contents, nil);
+
+  // conditional gets
+  NSString *headers =
+    [NSString stringWithFormat:@"If-None-Match: \"nope\", %@\r\n", etag];
+  body = [self fetchFileFromPort:port
+                         headers:headers
+                      statusCode:&status
+                     headerValue:NULL
+                          forKey:nil];
+  STAssertEquals(status, (CFIndex)304, nil);
+  STAssertEquals([body length], (NSUInteger)0, nil);
+  body = [self fetchFileFromPort:port
+                         headers:@"If-None-Match: \"nope\"\r\n"
+                      statusCode:&status
+                     headerValue:NULL
+                          forKey:nil];
+  STAssertEquals(status, (CFIndex)200, nil);
+  STAssertEqualObjects(body, contents, nil);
+  headers =
+    [NSString stringWithFormat:@"If-Modified-Since: %@\r\n", lastModified];
+  [self fetchFileFromPort:port
+                  headers:headers
+               statusCode:&status
+              headerValue:NULL
+                   forKey:nil];
+  STAssertEquals(status, (CFIndex)304, nil);
+
+  // If-Range only lets the range through if the file hasn't changed
+  headers = [NSString stringWithFormat:@"Range: bytes=10-19\r\n"
+                                       @"If-Range: %@\r\n", etag];
+  body = [self fetchFileFromPort:port
+                         headers:headers
+                      statusCode:&status
+                     headerValue:NULL
+                          forKey:nil];
+  STAssertEquals(status, (CFIndex)206, nil);
+  STAssertEqualObjects(body, [contents subdataWithRange:NSMakeRange(10, 10)],
+                       nil);
+  body = [self fetchFileFromPort:port
+                         headers:@"Range: bytes=10-19\r\n"
+                                 @"If-Range: \"stale\"\r\n"
+                      statusCode:&status
+                     headerValue:NULL
+                          forKey:nil];
+  STAssertEquals(status, (CFIndex)200, nil);
+  STAssertEqualObjects(body, contents, nil);
+
+  [server stop];
+  unlink([path fileSystemRepresentation]);
+}
+
+- (void)testFileThroughput {
+  // Not a pass/fail test, logs how fast a large file goes out to several
+  // clients at once, so regressions in the send path show up in the logs.
+  const NSUInteger kFileSize = 64 * 1024 * 1024;
+  NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:
+                    @"GTMHTTPServerTest-large"];
+  STAssertTrue([[NSFileManager defaultManager] createFileAtPath:path
+                                                       contents:nil
+                                                     attributes:nil], nil);
+  NSFileHandle *file = [NSFileHandle fileHandleForWritingAtPath:path];
+  STAssertNotNil(file, nil);
+  NSData *chunk = [NSMutableData dataWithLength:1024 * 1024];
+  for (NSUInteger x = 0; x < kFileSize; x += [chunk length]) {
+    [file writeData:chunk];
+  }
+  [file closeFile];
+
+  TestFileServerDelegate *delegate =
+    [[[TestFileServerDelegate alloc] initWithPath:path] autorelease];
+  GTMHTTPServer *server =
+    [[[GTMHTTPServer alloc] initWithDelegate:delegate] autorelease];
+  NSError *error = nil;
+  STAssertTrue([server start:&error], @"failed to start (error=%@)", error);
+  NSNumber *port = [NSNumber numberWithUnsignedShort:[server port]];
+
+  const NSUInteger kClients[] = { 1, 4, 8 };
+  for (size_t i = 0; i < sizeof(kClients) / sizeof(kClients[0]); ++i) {
+    NSUInteger clients = kClients[i];
+    @synchronized(self) {
+      finishedFetches_ = 0;
+      fetchedBytes_ = 0;
+    }
+    NSDate *start = [NSDate date];
+    for (NSUInteger x = 0; x < clients; ++x) {
+      [NSThread detachNewThreadSelector:@selector(fetchOnThread:)
+                               toTarget:self
+                             withObject:port];
+    }
+    // the server needs the run loop to accept and read the requests
+    NSDate *giveUpDate = [NSDate dateWithTimeIntervalSinceNow:60.0];
+    BOOL done = NO;
+    while (!done && [giveUpDate timeIntervalSinceNow] > 0) {
+      NSDate *loopIntervalDate =
+        [NSDate dateWithTimeIntervalSinceNow:kRunLoopInterval];
+      [[NSRunLoop currentRunLoop] runUntilDate:loopIntervalDate];
+      @synchronized(self) {
+        done = (finishedFetches_ == clients);
+      }
+    }
+    NSTimeInterval elapsed = -[start timeIntervalSinceNow];
+    STAssertTrue(done, @"%lu clients didn't finish", (unsigned long)clients);
+    unsigned long long bytes;
+    @synchronized(self) {
+      bytes = fetchedBytes_;
+    }
+    STAssertGreaterThanOrEqual(bytes, (unsigned long long)kFileSize * clients,
+                               nil);
+    NSLog(@"GTMHTTPServer file response: %lu clients x %lu MB, %.1f MB/s",
+          (unsigned long)clients, (unsigned long)(kFileSize / (1024 * 1024)),
+          bytes / (elapsed * 1024 * 1024));
+  }
+
+  [server stop];
+  unlink([path fileSystemRepresentation]);
+}
+
 - (void)testRequstEdgeCases {
   // test all the odd things about requests
 
@@ -577,6 +831,74 @@ const NSTimeInterval kSendChunkInterval = 0.05;
       }
     }
   }
+  // bodies sent from files come after the headers, so may take a few reads
+  if (!complete_ && [readData length] > 0) {
+    [[notification object] readInBackgroundAndNotify];
+  }
+}
+
+- (NSData *)fetchFileFromPort:(unsigned short)port
+                      headers:(NSString *)headers
+                   statusCode:(CFIndex *)statusCode
+                  headerValue:(NSString **)value
+                       forKey:(NSString *)key {
+  NSString *payload =
+    [NSString stringWithFormat:@"GET /file HTTP/1.0\r\n%@\r\n", headers];
+  NSData *responseData = [self fetchFromPort:port
+                                     payload:payload
+                                   chunkSize:0];
+  STAssertNotNil(responseData, @"request: %@", payload);
+  *statusCode = 0;
+  if (value) *value = nil;
+  if (!responseData) return nil;
+  CFHTTPMessageRef message = CFHTTPMessageCreateEmpty(NULL, false);
+  CFHTTPMessageAppendBytes(message,
+                           [responseData bytes], [responseData length]);
+  *statusCode = CFHTTPMessageGetResponseStatusCode(message);
+  if (value && key) {
+    CFStringRef cfValue =
+      CFHTTPMessageCopyHeaderFieldValue(message, (CFStringRef)key);
+    *value = GTMCFAutorelease(cfValue);
+  }
+  NSData *body = GTMCFAutorelease(CFHTTPMessageCopyBody(message));
+  CFRelease(message);
+  if (!body) body = [NSData data];
+  return body;
+}
+
+- (void)fetchOnThread:(NSNumber *)port {
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  unsigned long long total = 0;
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd >= 0) {
+    struct sockaddr_in addr;
+    bzero(&addr, sizeof(addr));
+    addr.sin_len    = sizeof(addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port   = htons([port unsignedShortValue]);
+    addr.sin_addr.s_addr = htonl(0x7F000001);
+    if (connect(fd, (struct sockaddr*)(&addr), (socklen_t)sizeof(addr)) == 0) {
+      const char request[] = "GET /large HTTP/1.0\r\n\r\n";
+      if (write(fd, request, sizeof(request) - 1) > 0) {
+        // the server closes the connection once it's sent everything
+        char buffer[64 * 1024];
+        ssize_t got;
+        while ((got = read(fd, buffer, sizeof(buffer))) != 0) {
+          if (got < 0) {
+            if (errno == EINTR) continue;
+            break;
+          }
+          total += got;
+        }
+      }
+    }
+    close(fd);
+  }
+  @synchronized(self) {
+    fetchedBytes_ += total;
+    ++finishedFetches_;
+  }
+  [pool release];
 }
 
 @end
@@ -636,6 +958,35 @@ const NSTimeInterval kSendChunkInterval = 0.05;
 
 // ----------------------------------------------------------------------------
 
+@implementation TestFileServerDelegate
+
+- (id)initWithPath:(NSString *)path {
+  self = [super init];
+  if (self) {
+    path_ = [path copy];
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [path_ release];
+  [super dealloc];
+}
+
+- (GTMHTTPResponseMessage *)httpServer:(GTMHTTPServer *)server
+                         handleRequest:(GTMHTTPRequestMessage *)request {
+  // let the base do its normal work for counts, etc.
+  [super httpServer:server handleRequest:request];
+  return [GTMHTTPResponseMessage
+           responseWithContentsOfFile:path_
+                          contentType:@"application/octet-stream"
+                           forRequest:request];
+}
+
+@end
+
+// ----------------------------------------------------------------------------
+
 @implementation TestThrowingServerDelegate
 
 - (GTMHTTPResponseMessage *)httpServer:(GTMHTTPServer *)server
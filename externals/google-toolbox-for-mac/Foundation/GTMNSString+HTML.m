@@ -19,6 +19,9 @@
 
 #import "GTMDefines.h"
 #import "GTMNSString+HTML.h"
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 typedef struct {
   NSString *escapeSequence;
@@ -355,6 +358,17 @@ static HTMLEscapeMap gUnicodeHTMLEscapeMap[] = {
 };
 
 
+// Direct index of the escapes for the ASCII range, a NULL entry means the
+// character goes as is.  Both tables above have the same ASCII entries, so
+// this covers the ASCII lookups for either of them without a bsearch.
+static const char *const gHTMLAsciiEscapes[128] = {
+  ['"'] = "&quot;",
+  ['&'] = "&amp;",
+  ['\''] = "&apos;",
+  ['<'] = "&lt;",
+  ['>'] = "&gt;",
+};
+
 // Utility function for Bsearching table above
 static int EscapeMapCompare(const void *ucharVoid, const void *mapVoid) {
   const unichar *uchar = (const unichar*)ucharVoid;
@@ -370,6 +384,93 @@ static int EscapeMapCompare(const void *ucharVoid, const void *mapVoid) {
   return val;
 }
 
+// Returns the index of the first unichar at or after |start| that is either
+// an ASCII char with an escape or outside of ASCII (the caller has to decide
+// about those), or |length| if there aren't any.
+static NSUInteger HTMLScanForCandidate(const unichar *buffer,
+                                       NSUInteger start,
+                                       NSUInteger length) {
+  NSUInteger i = start;
+#if defined(__SSE2__)
+  // Check 8 unichars at a time, almost all text is runs of chars that go
+  // as is, so this is where the time goes.
+  const __m128i kZero = _mm_setzero_si128();
+  const __m128i kAsciiMax = _mm_set1_epi16(0x7F);
+  const __m128i kQuot = _mm_set1_epi16('"');
+  const __m128i kAmp = _mm_set1_epi16('&');
+  const __m128i kApos = _mm_set1_epi16('\'');
+  const __m128i kLT = _mm_set1_epi16('<');
+  const __m128i kGT = _mm_set1_epi16('>');
+  for (; i + 8 <= length; i += 8) {
+    __m128i chars = _mm_loadu_si128((const __m128i *)(buffer + i));
+    // non zero for anything over 0x7F
+    __m128i hits = _mm_subs_epu16(chars, kAsciiMax);
+    hits = _mm_or_si128(hits, _mm_cmpeq_epi16(chars, kQuot));
+    hits = _mm_or_si128(hits, _mm_cmpeq_epi16(chars, kAmp));
+    hits = _mm_or_si128(hits, _mm_cmpeq_epi16(chars, kApos));
+    hits = _mm_or_si128(hits, _mm_cmpeq_epi16(chars, kLT));
+    hits = _mm_or_si128(hits, _mm_cmpeq_epi16(chars, kGT));
+    int clearMask = _mm_movemask_epi8(_mm_cmpeq_epi16(hits, kZero));
+    if (clearMask != 0xFFFF) {
+      // two mask bits per unichar
+      return i + (__builtin_ctz(~clearMask & 0xFFFF) / 2);
+    }
+  }
+#endif  // __SSE2__
+  for (; i < length; ++i) {
+    unichar c = buffer[i];
+    if (c > 0x7F || gHTMLAsciiEscapes[c]) {
+      return i;
+    }
+  }
+  return length;
+}
+
+// Returns the index of the next unichar at or after |start| that has to be
+// escaped or |length| if there aren't any.  For non ASCII chars |outMapEntry|
+// gets the table entry (NULL if there is none and escapeUnicode is set).
+static NSUInteger HTMLNextEscapeIndex(const unichar *buffer,
+                                      NSUInteger start,
+                                      NSUInteger length,
+                                      HTMLEscapeMap *table,
+                                      NSUInteger size,
+                                      BOOL escapeUnicode,
+                                      HTMLEscapeMap **outMapEntry) {
+  NSUInteger i = start;
+  *outMapEntry = NULL;
+  while ((i = HTMLScanForCandidate(buffer, i, length)) < length) {
+    unichar c = buffer[i];
+    if (c <= 0x7F) {
+      // an ASCII char with an escape
+      return i;
+    }
+    HTMLEscapeMap *val = bsearch(&buffer[i], table,
+                                 size / sizeof(HTMLEscapeMap),
+                                 sizeof(HTMLEscapeMap), EscapeMapCompare);
+    if (val || escapeUnicode) {
+      *outMapEntry = val;
+      return i;
+    }
+    // non ASCII without an escape, keep going
+    ++i;
+  }
+  return length;
+}
+
+// Makes sure there is room for |needed| more unichars in the output buffer.
+static BOOL HTMLEnsureCapacity(unichar **output,
+                               NSUInteger *capacity,
+                               NSUInteger used,
+                               NSUInteger needed) {
+  if (used + needed <= *capacity) return YES;
+  NSUInteger newCapacity = MAX(*capacity * 2, used + needed);
+  unichar *newOutput = realloc(*output, newCapacity * sizeof(unichar));
+  if (!newOutput) return NO;  // COV_NF_LINE - Memory fail case
+  *output = newOutput;
+  *capacity = newCapacity;
+  return YES;
+}
+
 @implementation NSString (GTMNSStringHTMLAdditions)
 
 - (NSString *)gtm_stringByEscapingHTMLUsingTable:(HTMLEscapeMap*)table 
@@ -379,9 +480,6 @@ static int EscapeMapCompare(const void *ucharVoid, const void *mapVoid) {
   if (!length) {
     return self;
   }
-  
-  NSMutableString *finalString = [NSMutableString string];
-  NSMutableData *data2 = [NSMutableData dataWithCapacity:sizeof(unichar) * length];
 
   // this block is common between GTMNSString+HTML and GTMNSString+XML but
   // it's so short that it isn't really worth trying to share.
@@ -399,46 +497,85 @@ static int EscapeMapCompare(const void *ucharVoid, const void *mapVoid) {
     buffer = [data bytes];
   }
 
-  if (!buffer || !data2) {
-    // COV_NF_START
-    _GTMDevLog(@"Unable to allocate buffer or data2");
+  HTMLEscapeMap *val = NULL;
+  NSUInteger escapeIndex = HTMLNextEscapeIndex(buffer, 0, length, table, size,
+                                               escapeUnicode, &val);
+  if (escapeIndex == length) {
+    // Nothing to escape, hand back the string (copied in case it's mutable)
+    return [[self copy] autorelease];
+  }
+
+  // Most strings only grow a little, so start with a bit of slack and
+  // double when we run out.
+  NSUInteger capacity = length + (length / 8) + 16;
+  NSUInteger used = 0;
+  unichar *output = malloc(capacity * sizeof(unichar));
+  if (!output) {
+    // COV_NF_START  - Memory fail case
+    _GTMDevLog(@"Unable to allocate output buffer");
     return nil;
     // COV_NF_END
   }
-  
-  unichar *buffer2 = (unichar *)[data2 mutableBytes];
-  
-  NSUInteger buffer2Length = 0;
-  
-  for (NSUInteger i = 0; i < length; ++i) {
-    HTMLEscapeMap *val = bsearch(&buffer[i], table, 
-                                 size / sizeof(HTMLEscapeMap), 
-                                 sizeof(HTMLEscapeMap), EscapeMapCompare);
-    if (val || (escapeUnicode && buffer[i] > 127)) {
-      if (buffer2Length) {
-        CFStringAppendCharacters((CFMutableStringRef)finalString, 
-                                 buffer2, 
-                                 buffer2Length);
-        buffer2Length = 0;
-      }
-      if (val) {
-        [finalString appendString:val->escapeSequence];
-      }
-      else {
-        _GTMDevAssert(escapeUnicode && buffer[i] > 127, @"Illegal Character");
-        [finalString appendFormat:@"&#%d;", buffer[i]];
-      }
+
+  BOOL outOfMemory = NO;
+  NSUInteger runStart = 0;
+  while (runStart < length) {
+    // copy the run of chars that go as is
+    NSUInteger runLength = escapeIndex - runStart;
+    if (!HTMLEnsureCapacity(&output, &capacity, used, runLength)) {
+      outOfMemory = YES;  // COV_NF_LINE - Memory fail case
+      break;  // COV_NF_LINE
+    }
+    memcpy(output + used, buffer + runStart, runLength * sizeof(unichar));
+    used += runLength;
+    if (escapeIndex == length) break;
+
+    // then the escape for the char that stopped it
+    unichar c = buffer[escapeIndex];
+    char numericEscape[16];
+    const char *asciiEscape = NULL;
+    NSString *escape = nil;
+    NSUInteger escapeLength;
+    if (c <= 0x7F) {
+      asciiEscape = gHTMLAsciiEscapes[c];
+      escapeLength = strlen(asciiEscape);
+    } else if (val) {
+      escape = val->escapeSequence;
+      escapeLength = [escape length];
     } else {
-      buffer2[buffer2Length] = buffer[i];
-      buffer2Length += 1;
+      _GTMDevAssert(escapeUnicode && c > 127, @"Illegal Character");
+      snprintf(numericEscape, sizeof(numericEscape), "&#%d;", c);
+      asciiEscape = numericEscape;
+      escapeLength = strlen(asciiEscape);
     }
+    if (!HTMLEnsureCapacity(&output, &capacity, used, escapeLength)) {
+      outOfMemory = YES;  // COV_NF_LINE - Memory fail case
+      break;  // COV_NF_LINE
+    }
+    if (escape) {
+      [escape getCharacters:output + used];
+      used += escapeLength;
+    } else {
+      for (NSUInteger j = 0; j < escapeLength; ++j) {
+        output[used++] = (unichar)asciiEscape[j];
+      }
+    }
+
+    runStart = escapeIndex + 1;
+    escapeIndex = HTMLNextEscapeIndex(buffer, runStart, length, table, size,
+                                      escapeUnicode, &val);
   }
-  if (buffer2Length) {
-    CFStringAppendCharacters((CFMutableStringRef)finalString, 
-                             buffer2, 
-                             buffer2Length);
+
+  if (outOfMemory) {
+    // COV_NF_START  - Memory fail case
+    _GTMDevLog(@"Unable to grow output buffer");
+    free(output);
+    return nil;
+    // COV_NF_END
   }
-  return finalString;
+  return [[[NSString alloc] initWithCharactersNoCopy:output
+                                              length:used
+                                        freeWhenDone:YES] autorelease];
 }
 
 - (NSString *)gtm_stringByEscapingForHTML {
@@ -60,6 +60,72 @@
   STAssertEqualObjects([@"" gtm_stringByEscapingForHTML], @"", nil);
 } // testStringByEscapingHTML
 
+- (void)testStringByEscapingHTMLFastPaths {
+  // nothing to escape hands back the same string
+  NSString *clean = @"nothing to escape in here, not even a tag";
+  STAssertEquals([clean gtm_stringByEscapingForHTML], clean, nil);
+  NSString *cleanUnicode = [NSString stringWithUTF8String:"パン・ド・カンパーニュ"];
+  STAssertEquals([cleanUnicode gtm_stringByEscapingForHTML], cleanUnicode, nil);
+  // but not a mutable one, since it could change under the caller
+  NSMutableString *mutable = [NSMutableString stringWithString:clean];
+  NSString *escaped = [mutable gtm_stringByEscapingForHTML];
+  STAssertNotEquals(escaped, (NSString *)mutable, nil);
+  STAssertEqualObjects(escaped, clean, nil);
+  [mutable appendString:@"<"];
+  STAssertEqualObjects(escaped, clean, nil);
+
+  // escapes at every offset within and across the 8 char blocks the scanner
+  // works in, and at both ends of the string
+  for (NSUInteger x = 0; x < 20; ++x) {
+    NSMutableString *input = [NSMutableString string];
+    NSMutableString *expected = [NSMutableString string];
+    for (NSUInteger y = 0; y < 20; ++y) {
+      if (y == x) {
+        [input appendString:@"<"];
+        [expected appendString:@"&lt;"];
+      } else {
+        [input appendString:@"a"];
+        [expected appendString:@"a"];
+      }
+    }
+    STAssertEqualObjects([input gtm_stringByEscapingForHTML], expected,
+                         @"offset %lu", (unsigned long)x);
+  }
+
+  // lots of escapes has to grow the output buffer
+  NSMutableString *input = [NSMutableString string];
+  NSMutableString *expected = [NSMutableString string];
+  for (NSUInteger x = 0; x < 1000; ++x) {
+    [input appendString:@"\"&'<>"];
+    [expected appendString:@"&quot;&amp;&apos;&lt;&gt;"];
+  }
+  STAssertEqualObjects([input gtm_stringByEscapingForHTML], expected, nil);
+} // testStringByEscapingHTMLFastPaths
+
+- (void)testStringByEscapingHTMLPerformance {
+  // Not a pass/fail test, logs the timings for clean and dirty text so
+  // regressions in the fast paths show up in the build logs.
+  NSMutableString *clean = [NSMutableString string];
+  NSMutableString *dirty = [NSMutableString string];
+  for (NSUInteger x = 0; x < 20000; ++x) {
+    [clean appendString:@"The quick brown fox jumps over the lazy dog. "];
+    [dirty appendString:@"The <quick> brown & \"fox\" jumps over the dog. "];
+  }
+  NSDate *start = [NSDate date];
+  for (NSUInteger x = 0; x < 10; ++x) {
+    STAssertNotNil([clean gtm_stringByEscapingForHTML], nil);
+  }
+  NSTimeInterval cleanTime = -[start timeIntervalSinceNow];
+  start = [NSDate date];
+  for (NSUInteger x = 0; x < 10; ++x) {
+    STAssertNotNil([dirty gtm_stringByEscapingForHTML], nil);
+  }
+  NSTimeInterval dirtyTime = -[start timeIntervalSinceNow];
+  NSLog(@"gtm_stringByEscapingForHTML: %.1f MB/s clean, %.1f MB/s dirty",
+        (10.0 * [clean length] * sizeof(unichar)) / (cleanTime * 1024 * 1024),
+        (10.0 * [dirty length] * sizeof(unichar)) / (dirtyTime * 1024 * 1024));
+} // testStringByEscapingHTMLPerformance
+
 - (void)testStringByEscapingAsciiHTML {
   unichar chars[] =  
   { 34, 38, 39, 60, 62, 160, 161, 162, 163, 164, 165, 166, 167, 168, 169, 170,
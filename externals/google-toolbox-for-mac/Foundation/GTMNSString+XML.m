@@ -19,6 +19,9 @@
 #import "GTMDefines.h"
 #import "GTMNSString+XML.h"
 #import "GTMGarbageCollection.h"
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 enum {
   kGTMXMLCharModeEncodeQUOT  = 0,
@@ -31,15 +34,36 @@ enum {
 };
 typedef NSUInteger GTMXMLCharMode;
 
-static NSString *gXMLEntityList[] = {
+static const char *const gXMLEntityList[] = {
   // this must match the above order
-  @"&quot;",
-  @"&amp;",
-  @"&apos;",
-  @"&lt;",
-  @"&gt;",
+  "&quot;",
+  "&amp;",
+  "&apos;",
+  "&lt;",
+  "&gt;",
 };
 
+// Direct index of XMLModeForUnichar() for the ASCII range.
+#define V_ kGTMXMLCharModeValid
+#define I_ kGTMXMLCharModeInvalid
+static const unsigned char gXMLAsciiModes[128] = {
+  // 0x00 - 0x1F, only tab, newline and return are valid
+  I_, I_, I_, I_, I_, I_, I_, I_, I_, V_, V_, I_, I_, V_, I_, I_,
+  I_, I_, I_, I_, I_, I_, I_, I_, I_, I_, I_, I_, I_, I_, I_, I_,
+  // 0x20 - 0x3F
+  V_, V_, kGTMXMLCharModeEncodeQUOT, V_, V_, V_, kGTMXMLCharModeEncodeAMP,
+  kGTMXMLCharModeEncodeAPOS, V_, V_, V_, V_, V_, V_, V_, V_,
+  V_, V_, V_, V_, V_, V_, V_, V_, V_, V_, V_, V_,
+  kGTMXMLCharModeEncodeLT, V_, kGTMXMLCharModeEncodeGT, V_,
+  // 0x40 - 0x7F
+  V_, V_, V_, V_, V_, V_, V_, V_, V_, V_, V_, V_, V_, V_, V_, V_,
+  V_, V_, V_, V_, V_, V_, V_, V_, V_, V_, V_, V_, V_, V_, V_, V_,
+  V_, V_, V_, V_, V_, V_, V_, V_, V_, V_, V_, V_, V_, V_, V_, V_,
+  V_, V_, V_, V_, V_, V_, V_, V_, V_, V_, V_, V_, V_, V_, V_, V_,
+};
+#undef V_
+#undef I_
+
 GTM_INLINE GTMXMLCharMode XMLModeForUnichar(UniChar c) {
 
   // Per XML spec Section 2.2 Characters
@@ -91,6 +115,75 @@ GTM_INLINE GTMXMLCharMode XMLModeForUnichar(UniChar c) {
 } // XMLModeForUnichar
 
 
+// Returns the index of the first UniChar at or after |start| that might not
+// go as is (control chars, the chars with entities, and everything from the
+// surrogates up), or |length| if there aren't any.
+static NSUInteger XMLScanForCandidate(const UniChar *buffer,
+                                      NSUInteger start,
+                                      NSUInteger length) {
+  NSUInteger i = start;
+#if defined(__SSE2__)
+  // Check 8 UniChars at a time, almost all text is runs of chars that go
+  // as is, so this is where the time goes.
+  const __m128i kZero = _mm_setzero_si128();
+  const __m128i kSpace = _mm_set1_epi16(0x20);
+  const __m128i kBMPValidMax = _mm_set1_epi16((short)0xD7FF);
+  const __m128i kQuot = _mm_set1_epi16('"');
+  const __m128i kAmp = _mm_set1_epi16('&');
+  const __m128i kApos = _mm_set1_epi16('\'');
+  const __m128i kLT = _mm_set1_epi16('<');
+  const __m128i kGT = _mm_set1_epi16('>');
+  for (; i + 8 <= length; i += 8) {
+    __m128i chars = _mm_loadu_si128((const __m128i *)(buffer + i));
+    // non zero for anything under 0x20 or over 0xD7FF
+    __m128i hits = _mm_or_si128(_mm_subs_epu16(kSpace, chars),
+                                _mm_subs_epu16(chars, kBMPValidMax));
+    hits = _mm_or_si128(hits, _mm_cmpeq_epi16(chars, kQuot));
+    hits = _mm_or_si128(hits, _mm_cmpeq_epi16(chars, kAmp));
+    hits = _mm_or_si128(hits, _mm_cmpeq_epi16(chars, kApos));
+    hits = _mm_or_si128(hits, _mm_cmpeq_epi16(chars, kLT));
+    hits = _mm_or_si128(hits, _mm_cmpeq_epi16(chars, kGT));
+    int clearMask = _mm_movemask_epi8(_mm_cmpeq_epi16(hits, kZero));
+    if (clearMask != 0xFFFF) {
+      // two mask bits per UniChar
+      return i + (__builtin_ctz(~clearMask & 0xFFFF) / 2);
+    }
+  }
+#endif  // __SSE2__
+  for (; i < length; ++i) {
+    UniChar c = buffer[i];
+    if (c > 0xD7FF || (c < 0x80 && gXMLAsciiModes[c] != kGTMXMLCharModeValid)) {
+      return i;
+    }
+  }
+  return length;
+}
+
+// Returns the index of the next UniChar at or after |start| that has to be
+// encoded or dropped, or |length| if there aren't any.  |outMode| gets the
+// mode for the char at the returned index.
+static NSUInteger XMLNextSpecialIndex(const UniChar *buffer,
+                                      NSUInteger start,
+                                      NSUInteger length,
+                                      BOOL escaping,
+                                      GTMXMLCharMode *outMode) {
+  NSUInteger i = start;
+  while ((i = XMLScanForCandidate(buffer, i, length)) < length) {
+    UniChar c = buffer[i];
+    GTMXMLCharMode cMode =
+      (c < 0x80) ? gXMLAsciiModes[c] : XMLModeForUnichar(c);
+    // valid chars go as is, and if we aren't doing entities, then
+    // everything goes as is.
+    if ((cMode != kGTMXMLCharModeValid) &&
+        (escaping || (cMode == kGTMXMLCharModeInvalid))) {
+      *outMode = cMode;
+      return i;
+    }
+    ++i;
+  }
+  return length;
+}
+
 static NSString *AutoreleasedCloneForXML(NSString *src, BOOL escaping) {
   //
   // NOTE:
@@ -106,8 +199,6 @@ static NSString *AutoreleasedCloneForXML(NSString *src, BOOL escaping) {
   if (!length) {
     return src;
   }
-  
-  NSMutableString *finalString = [NSMutableString string];
 
   // this block is common between GTMNSString+HTML and GTMNSString+XML but
   // it's so short that it isn't really worth trying to share.
@@ -124,49 +215,53 @@ static NSString *AutoreleasedCloneForXML(NSString *src, BOOL escaping) {
     [src getCharacters:[data mutableBytes]];
     buffer = [data bytes];
   }
-  
-  const UniChar *goodRun = buffer;
-  NSUInteger goodRunLength = 0;
-  
-  for (NSUInteger i = 0; i < length; ++i) {
-    
-    GTMXMLCharMode cMode = XMLModeForUnichar(buffer[i]);
-    
-    // valid chars go as is, and if we aren't doing entities, then
-    // everything goes as is.
-    if ((cMode == kGTMXMLCharModeValid) ||
-        (!escaping && (cMode != kGTMXMLCharModeInvalid))) {
-      // goes as is
-      goodRunLength += 1;
-    } else {
-      // it's something we have to encode or something invalid
-      
-      // start by adding what we already collected (if anything)
-      if (goodRunLength) {
-        CFStringAppendCharacters((CFMutableStringRef)finalString, 
-                                 goodRun, 
-                                 goodRunLength);
-        goodRunLength = 0;
-      }
-      
-      // if it wasn't invalid, add the encoded version
-      if (cMode != kGTMXMLCharModeInvalid) {
-        // add this encoded
-        [finalString appendString:gXMLEntityList[cMode]];
+
+  GTMXMLCharMode cMode = kGTMXMLCharModeValid;
+  NSUInteger specialIndex = XMLNextSpecialIndex(buffer, 0, length,
+                                                escaping, &cMode);
+  if (specialIndex == length) {
+    // Nothing to do, hand back the string (copied in case it's mutable)
+    return [[src copy] autorelease];
+  }
+
+  // Entities are at most 6 chars, so this is the most we could ever need;
+  // allocate it up front rather than growing as we go.
+  NSUInteger capacity = length;
+  if (escaping) {
+    capacity = specialIndex + ((length - specialIndex) * 6);
+  }
+  UniChar *output = malloc(capacity * sizeof(UniChar));
+  if (!output) {
+    // COV_NF_START  - Memory fail case
+    _GTMDevLog(@"Unable to allocate output buffer");
+    return nil;
+    // COV_NF_END
+  }
+  NSUInteger used = 0;
+
+  NSUInteger runStart = 0;
+  while (runStart < length) {
+    // copy the run of chars that go as is
+    NSUInteger runLength = specialIndex - runStart;
+    memcpy(output + used, buffer + runStart, runLength * sizeof(UniChar));
+    used += runLength;
+    if (specialIndex == length) break;
+
+    // if it wasn't invalid, add the encoded version
+    if (cMode != kGTMXMLCharModeInvalid) {
+      for (const char *entity = gXMLEntityList[cMode]; *entity; ++entity) {
+        output[used++] = (UniChar)*entity;
       }
-      
-      // update goodRun to point to the next UniChar
-      goodRun = buffer + i + 1;
     }
+
+    runStart = specialIndex + 1;
+    specialIndex = XMLNextSpecialIndex(buffer, runStart, length,
+                                       escaping, &cMode);
   }
-  
-  // anything left to add?
-  if (goodRunLength) {
-    CFStringAppendCharacters((CFMutableStringRef)finalString, 
-                             goodRun, 
-                             goodRunLength);
-  }
-  return finalString;
+
+  return [[[NSString alloc] initWithCharactersNoCopy:output
+                                              length:used
+                                        freeWhenDone:YES] autorelease];
 } // AutoreleasedCloneForXML
 
 @implementation NSString (GTMNSStringXMLAdditions)
@@ -90,4 +90,74 @@
   STAssertEqualObjects([@"" gtm_stringBySanitizingToXMLSpec], @"", nil);
 }
 
+- (void)testXMLFastPaths {
+  // nothing to do hands back the same string
+  NSString *clean = @"nothing to escape\tin here\n";
+  STAssertEquals([clean gtm_stringBySanitizingAndEscapingForXML], clean, nil);
+  STAssertEquals([clean gtm_stringBySanitizingToXMLSpec], clean, nil);
+  NSString *quotes = @"\"quotes\" & <tags> are fine unescaped";
+  STAssertEquals([quotes gtm_stringBySanitizingToXMLSpec], quotes, nil);
+  // but not a mutable one, since it could change under the caller
+  NSMutableString *mutable = [NSMutableString stringWithString:clean];
+  NSString *escaped = [mutable gtm_stringBySanitizingAndEscapingForXML];
+  STAssertNotEquals(escaped, (NSString *)mutable, nil);
+  STAssertEqualObjects(escaped, clean, nil);
+
+  // specials at every offset within and across the 8 char blocks the scanner
+  // works in, and at both ends of the string
+  for (NSUInteger x = 0; x < 20; ++x) {
+    UniChar chars[20];
+    for (NSUInteger y = 0; y < 20; ++y) {
+      chars[y] = (y == x) ? 0xFFFE : 'a';
+    }
+    NSString *input = [NSString stringWithCharacters:chars length:20];
+    NSString *expected = [@"" stringByPaddingToLength:19
+                                           withString:@"a"
+                                      startingAtIndex:0];
+    STAssertEqualObjects([input gtm_stringBySanitizingToXMLSpec], expected,
+                         @"offset %lu", (unsigned long)x);
+    chars[x] = '&';
+    input = [NSString stringWithCharacters:chars length:20];
+    expected = [NSString stringWithFormat:@"%@&amp;%@",
+                [expected substringToIndex:x], [expected substringFromIndex:x]];
+    STAssertEqualObjects([input gtm_stringBySanitizingAndEscapingForXML],
+                         expected, @"offset %lu", (unsigned long)x);
+  }
+
+  // every char escaped is the worst case for the output buffer
+  NSMutableString *input = [NSMutableString string];
+  NSMutableString *expected = [NSMutableString string];
+  for (NSUInteger x = 0; x < 1000; ++x) {
+    [input appendString:@"\"'"];
+    [expected appendString:@"&quot;&apos;"];
+  }
+  STAssertEqualObjects([input gtm_stringBySanitizingAndEscapingForXML],
+                       expected, nil);
+}
+
+- (void)testXMLPerformance {
+  // Not a pass/fail test, logs the timings for clean and dirty text so
+  // regressions in the fast paths show up in the build logs.
+  NSMutableString *clean = [NSMutableString string];
+  NSMutableString *dirty = [NSMutableString string];
+  for (NSUInteger x = 0; x < 20000; ++x) {
+    [clean appendString:@"The quick brown fox jumps over the lazy dog. "];
+    [dirty appendString:@"The <quick> brown & \"fox\" jumps over the dog. "];
+  }
+  NSDate *start = [NSDate date];
+  for (NSUInteger x = 0; x < 10; ++x) {
+    STAssertNotNil([clean gtm_stringBySanitizingAndEscapingForXML], nil);
+  }
+  NSTimeInterval cleanTime = -[start timeIntervalSinceNow];
+  start = [NSDate date];
+  for (NSUInteger x = 0; x < 10; ++x) {
+    STAssertNotNil([dirty gtm_stringBySanitizingAndEscapingForXML], nil);
+  }
+  NSTimeInterval dirtyTime = -[start timeIntervalSinceNow];
+  NSLog(@"gtm_stringBySanitizingAndEscapingForXML: %.1f MB/s clean, "
+        @"%.1f MB/s dirty",
+        (10.0 * [clean length] * sizeof(UniChar)) / (cleanTime * 1024 * 1024),
+        (10.0 * [dirty length] * sizeof(UniChar)) / (dirtyTime * 1024 * 1024));
+}
+
 @end
@@ -129,6 +129,18 @@ _EXTERN NSString* kGTMRegexPatternErrorErrorString _INITIALIZE_AS(@"patternError
                options:(GTMRegexOptions)options
              withError:(NSError **)outErrorOrNULL;
 
+/// Returns a shared, compiled regex for the pattern and options from a process wide cache, compiling and caching it on first use.
+//
+// GTMRegex objects are immutable once created and regexec(3) is safe to call
+// from multiple threads, so the returned object may be used on any thread.
+// The cache is bounded, when it fills up it is emptied and refilled as
+// patterns are used again.  Invalid patterns are never cached (and log each
+// time like -initWithPattern:options:).  The NSString helpers below use this
+// cache, so repeated calls with the same pattern don't pay for regcomp.
+//
++ (id)cachedRegexWithPattern:(NSString *)pattern
+                     options:(GTMRegexOptions)options;
+
 /// Returns a new, autoreleased copy of |str| w/ any pattern chars in it escaped so they have no meaning when used w/in a pattern.
 + (NSString *)escapedPatternForString:(NSString *)str;
 
@@ -178,6 +190,13 @@ _EXTERN NSString* kGTMRegexPatternErrorErrorString _INITIALIZE_AS(@"patternError
 /// Returns YES if this pattern some substring of |str|.
 - (BOOL)matchesSubStringInString:(NSString *)str;
 
+/// Returns YES if this pattern matches some substring of the NUL terminated UTF-8 string |utf8Str|.
+//
+// Use this when running several patterns over the same string to do the
+// UTF-8 conversion only once (see also GTMRegexSet).
+//
+- (BOOL)matchesSubStringInUTF8String:(const char *)utf8Str;
+
 /// Returns a new, autoreleased enumerator that will walk segments (GTMRegexStringSegment) of |str| based on the pattern.
 //
 // This will split the string into "segments" using the given pattern.  You get
@@ -213,6 +232,54 @@ _EXTERN NSString* kGTMRegexPatternErrorErrorString _INITIALIZE_AS(@"patternError
 
 @end
 
+/// Class for checking a string against many patterns at once
+//
+// The patterns are joined into one alternation and compiled once, so checking
+// a string against N patterns is a single regexec(3) over a single UTF-8
+// conversion of the string instead of N of each.  Patterns should not use
+// back references (\1, ...) since the sub pattern numbers shift when they are
+// joined.
+//
+// Example usage:
+//
+//   NSArray *patterns = [NSArray arrayWithObjects:@"^ERROR", @"timed? ?out",
+//                                                 @"[Ff]ailed", nil];
+//   GTMRegexSet *interesting = [GTMRegexSet regexSetWithPatterns:patterns];
+//   for (NSString *line in logLines) {
+//     NSUInteger idx = [interesting indexOfPatternMatchingSubStringInString:line];
+//     if (idx != NSNotFound) {
+//       // line matched [patterns objectAtIndex:idx]
+//       ....
+//     }
+//   }
+//
+@interface GTMRegexSet : NSObject {
+ @private
+  NSArray *patterns_;
+  GTMRegex *combinedRegex_;
+  NSUInteger *patternSubPatternIndexes_;  // STRONG: ie-we call free
+}
+
+/// Create a new, autoreleased set w/ the given patterns with the default options
++ (id)regexSetWithPatterns:(NSArray *)patterns;
+
+/// Create a new, autoreleased set w/ the given patterns and specify the matching options
++ (id)regexSetWithPatterns:(NSArray *)patterns options:(GTMRegexOptions)options;
+
+/// Initialize a new set w/ the given patterns and specify the matching options.  Returns nil if |patterns| is empty or any pattern fails to compile.
+- (id)initWithPatterns:(NSArray *)patterns options:(GTMRegexOptions)options;
+
+/// Returns the patterns the set was created with
+- (NSArray *)patterns;
+
+/// Returns YES if any of the patterns matches some substring of |str|.
+- (BOOL)matchesSubStringInString:(NSString *)str;
+
+/// Returns the index of the pattern that produced the leftmost match in |str|, or NSNotFound if no pattern matches.
+- (NSUInteger)indexOfPatternMatchingSubStringInString:(NSString *)str;
+
+@end
+
 /// Class returned by the nextObject for the enumerators from GTMRegex
 //
 // The two enumerators on from GTMRegex return objects of this type.  This object
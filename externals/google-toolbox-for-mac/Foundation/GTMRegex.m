@@ -31,6 +31,15 @@ static NSString *const kReplacementPattern =
 #define kReplacementPatternLeadingTextIndex       1
 #define kReplacementPatternSubpatternNumberIndex  5
 
+// Process wide cache of compiled regexes for +cachedRegexWithPattern:options:,
+// keyed by options and then by pattern.  Guarded by @synchronized on the
+// GTMRegex class.
+static NSMutableDictionary *gRegexCache = nil;
+static NSUInteger gRegexCacheCount = 0;
+// Past this many patterns the cache is flushed; a process using more distinct
+// patterns than this is better off holding onto its own GTMRegex objects.
+static const NSUInteger kRegexCacheLimit = 256;
+
 @interface GTMRegex (PrivateMethods)
 - (NSString *)errorMessage:(int)errCode;
 - (BOOL)runRegexOnUTF8:(const char*)utf8Str
@@ -81,6 +90,42 @@ static NSString *const kReplacementPattern =
                               withError:outErrorOrNULL] autorelease];
 }
 
++ (id)cachedRegexWithPattern:(NSString *)pattern
+                     options:(GTMRegexOptions)options {
+  if ([pattern length] == 0)
+    return nil;
+
+  GTMRegex *result = nil;
+  NSNumber *optionsKey = [NSNumber numberWithUnsignedInt:(unsigned int)options];
+  @synchronized([GTMRegex class]) {
+    NSMutableDictionary *patterns = [gRegexCache objectForKey:optionsKey];
+    result = [[[patterns objectForKey:pattern] retain] autorelease];
+    if (!result) {
+      // compile while holding the lock so two threads asking for the same new
+      // pattern don't both pay for regcomp.
+      result = [[[GTMRegex alloc] initWithPattern:pattern
+                                          options:options] autorelease];
+      if (result) {
+        if (gRegexCacheCount >= kRegexCacheLimit) {
+          [gRegexCache removeAllObjects];
+          gRegexCacheCount = 0;
+          patterns = nil;
+        }
+        if (!gRegexCache) {
+          gRegexCache = [[NSMutableDictionary alloc] init];
+        }
+        if (!patterns) {
+          patterns = [NSMutableDictionary dictionary];
+          [gRegexCache setObject:patterns forKey:optionsKey];
+        }
+        [patterns setObject:result forKey:pattern];
+        ++gRegexCacheCount;
+      }
+    }
+  }
+  return result;
+}
+
 + (NSString *)escapedPatternForString:(NSString *)str {
   if (str == nil)
     return nil;
@@ -220,7 +265,8 @@ static NSString *const kReplacementPattern =
 
 - (BOOL)matchesString:(NSString *)str {
   regmatch_t regMatch;
-  if (![self runRegexOnUTF8:[str UTF8String]
+  const char *utf8Str = [str UTF8String];
+  if (![self runRegexOnUTF8:utf8Str
                      nmatch:1
                      pmatch:&regMatch
                       flags:0]) {
@@ -228,9 +274,10 @@ static NSString *const kReplacementPattern =
     return NO;
   }
 
-  // make sure the match is the full string
+  // make sure the match is the full string.  regexec stops at the terminator,
+  // so measure the buffer we already have rather than converting again.
   return (regMatch.rm_so == 0) &&
-    (regMatch.rm_eo == (regoff_t)[str lengthOfBytesUsingEncoding:NSUTF8StringEncoding]);
+    (regMatch.rm_eo == (regoff_t)strlen(utf8Str));
 }
 
 - (NSArray *)subPatternsOfString:(NSString *)str {
@@ -254,7 +301,7 @@ static NSString *const kReplacementPattern =
 
     // make sure the match is the full string
     if ((regMatches[0].rm_so != 0) ||
-        (regMatches[0].rm_eo != (regoff_t)[str lengthOfBytesUsingEncoding:NSUTF8StringEncoding])) {
+        (regMatches[0].rm_eo != (regoff_t)strlen(utf8Str))) {
       // only matched a sub part of the string
       return nil;
     }
@@ -307,15 +354,15 @@ static NSString *const kReplacementPattern =
 }
 
 - (BOOL)matchesSubStringInString:(NSString *)str {
-  regmatch_t regMatch;
-  if ([self runRegexOnUTF8:[str UTF8String]
-                    nmatch:1
-                    pmatch:&regMatch
-                     flags:0]) {
-    // don't really care what matched, just report the match
-    return YES;
-  }
-  return NO;
+  return [self matchesSubStringInUTF8String:[str UTF8String]];
+}
+
+- (BOOL)matchesSubStringInUTF8String:(const char *)utf8Str {
+  // don't really care what matched, so let regexec skip reporting it
+  return [self runRegexOnUTF8:utf8Str
+                       nmatch:0
+                       pmatch:NULL
+                        flags:0];
 }
 
 - (NSEnumerator *)segmentEnumeratorForString:(NSString *)str {
@@ -341,8 +388,8 @@ static NSString *const kReplacementPattern =
   if ([replacementPattern length]) {
     // don't need newline support, just match the start of the pattern for '^'
     GTMRegex *replacementRegex =
-      [GTMRegex regexWithPattern:kReplacementPattern
-                         options:kGTMRegexOptionSupressNewlineSupport];
+      [GTMRegex cachedRegexWithPattern:kReplacementPattern
+                               options:kGTMRegexOptionSupressNewlineSupport];
 #ifdef DEBUG
     if (!replacementRegex) {
       _GTMDevLog(@"failed to parse out replacement regex!!!"); // COV_NF_LINE
@@ -763,25 +810,147 @@ static NSString *const kReplacementPattern =
 
 @end
 
+@implementation GTMRegexSet
+
++ (id)regexSetWithPatterns:(NSArray *)patterns {
+  return [[[self alloc] initWithPatterns:patterns options:0] autorelease];
+}
+
++ (id)regexSetWithPatterns:(NSArray *)patterns options:(GTMRegexOptions)options {
+  return [[[self alloc] initWithPatterns:patterns
+                                 options:options] autorelease];
+}
+
+- (id)init {
+  return [self initWithPatterns:nil options:0];
+}
+
+- (id)initWithPatterns:(NSArray *)patterns options:(GTMRegexOptions)options {
+  self = [super init];
+  if (!self) return nil;
+
+  NSUInteger count = [patterns count];
+  if (count == 0) {
+    [self release];
+    return nil;
+  }
+
+  patterns_ = [patterns copy];
+  patternSubPatternIndexes_ = malloc(sizeof(NSUInteger) * count);
+  if (!patternSubPatternIndexes_) {
+    // COV_NF_START - no real way to force this in a unittest
+    [self release];
+    return nil;
+    // COV_NF_END
+  }
+
+  // Compile each pattern on its own first, that validates it (so one bad
+  // pattern can't unbalance the alternation) and gives us its sub pattern
+  // count, which is how we know which group each alternative ends up as.
+  NSMutableString *combined = [NSMutableString string];
+  NSUInteger subPatternIndex = 1;
+  for (NSUInteger x = 0; x < count; ++x) {
+    NSString *pattern = [patterns_ objectAtIndex:x];
+    GTMRegex *regex = [GTMRegex cachedRegexWithPattern:pattern options:options];
+    if (!regex) {
+      [self release];
+      return nil;
+    }
+    if (x > 0)
+      [combined appendString:@"|"];
+    [combined appendFormat:@"(%@)", pattern];
+    patternSubPatternIndexes_[x] = subPatternIndex;
+    subPatternIndex += [regex subPatternCount] + 1;
+  }
+
+  combinedRegex_ = [[GTMRegex alloc] initWithPattern:combined options:options];
+  if (!combinedRegex_) {
+    // COV_NF_START - each piece compiled, so the whole should
+    [self release];
+    return nil;
+    // COV_NF_END
+  }
+
+  return self;
+}
+
+#if GTM_SUPPORT_GC
+- (void)finalize {
+  // patternSubPatternIndexes_ comes from malloc, so the collector won't
+  // reclaim it for us
+  free(patternSubPatternIndexes_);
+  patternSubPatternIndexes_ = NULL;
+  [super finalize];
+}
+#endif
+
+- (void)dealloc {
+  free(patternSubPatternIndexes_);
+  [patterns_ release];
+  [combinedRegex_ release];
+  [super dealloc];
+}
+
+- (NSArray *)patterns {
+  return patterns_;
+}
+
+- (BOOL)matchesSubStringInString:(NSString *)str {
+  return [combinedRegex_ matchesSubStringInString:str];
+}
+
+- (NSUInteger)indexOfPatternMatchingSubStringInString:(NSString *)str {
+  NSUInteger result = NSNotFound;
+
+  NSUInteger count = [combinedRegex_ subPatternCount] + 1;
+  regmatch_t *regMatches = malloc(sizeof(regmatch_t) * count);
+  if (!regMatches)
+    return NSNotFound; // COV_NF_LINE - no real way to force this in a unittest
+
+  if ([combinedRegex_ runRegexOnUTF8:[str UTF8String]
+                              nmatch:count
+                              pmatch:regMatches
+                               flags:0]) {
+    // the alternative that matched is the only one w/ its group filled in
+    NSUInteger patternCount = [patterns_ count];
+    for (NSUInteger x = 0; x < patternCount; ++x) {
+      if (regMatches[patternSubPatternIndexes_[x]].rm_so != -1) {
+        result = x;
+        break;
+      }
+    }
+  }
+  free(regMatches);
+
+  return result;
+}
+
+- (NSString *)description {
+  return [NSString stringWithFormat:@"%@<%p> { patterns=%@, regex=%@ }",
+    [self class], self, patterns_, combinedRegex_];
+}
+
+@end
+
 @implementation NSString (GTMRegexAdditions)
 
 - (BOOL)gtm_matchesPattern:(NSString *)pattern {
-  GTMRegex *regex = [GTMRegex regexWithPattern:pattern];
+  GTMRegex *regex = [GTMRegex cachedRegexWithPattern:pattern options:0];
   return [regex matchesString:self];
 }
 
 - (NSArray *)gtm_subPatternsOfPattern:(NSString *)pattern {
-  GTMRegex *regex = [GTMRegex regexWithPattern:pattern];
+  GTMRegex *regex = [GTMRegex cachedRegexWithPattern:pattern options:0];
   return [regex subPatternsOfString:self];
 }
 
 - (NSString *)gtm_firstSubStringMatchedByPattern:(NSString *)pattern {
-  GTMRegex *regex = [GTMRegex regexWithPattern:pattern];
+  GTMRegex *regex = [GTMRegex cachedRegexWithPattern:pattern options:0];
   return [regex firstSubStringMatchedInString:self];
 }
 
 - (BOOL)gtm_subStringMatchesPattern:(NSString *)pattern {
-  GTMRegex *regex = [GTMRegex regexWithPattern:pattern];
+  GTMRegex *regex = [GTMRegex cachedRegexWithPattern:pattern options:0];
   return [regex matchesSubStringInString:self];
 }
 
@@ -792,18 +961,18 @@ static NSString *const kReplacementPattern =
 }
 
 - (NSEnumerator *)gtm_segmentEnumeratorForPattern:(NSString *)pattern {
-  GTMRegex *regex = [GTMRegex regexWithPattern:pattern];
+  GTMRegex *regex = [GTMRegex cachedRegexWithPattern:pattern options:0];
   return [regex segmentEnumeratorForString:self];
 }
 
 - (NSEnumerator *)gtm_matchSegmentEnumeratorForPattern:(NSString *)pattern {
-  GTMRegex *regex = [GTMRegex regexWithPattern:pattern];
+  GTMRegex *regex = [GTMRegex cachedRegexWithPattern:pattern options:0];
   return [regex matchSegmentEnumeratorForString:self];
 }
 
 - (NSString *)gtm_stringByReplacingMatchesOfPattern:(NSString *)pattern
                                     withReplacement:(NSString *)replacementPattern {
-  GTMRegex *regex = [GTMRegex regexWithPattern:pattern];
+  GTMRegex *regex = [GTMRegex cachedRegexWithPattern:pattern options:0];
   return [regex stringByReplacingMatchesInString:self
                                  withReplacement:replacementPattern];
 }
@@ -903,6 +903,161 @@
   STAssertNotNil(regex, nil);
   STAssertGreaterThan([[regex description] length], (NSUInteger)10,
                       @"failed to get a reasonable description for regex w/ options");
+  // regex set
+  GTMRegexSet *regexSet =
+    [GTMRegexSet regexSetWithPatterns:[NSArray arrayWithObjects:@"a+", @"b", nil]];
+  STAssertNotNil(regexSet, nil);
+  STAssertGreaterThan([[regexSet description] length], (NSUInteger)10,
+                      @"failed to get a reasonable description for regex set");
+}
+
+- (void)testCachedRegexWithPattern {
+  // fail cases
+  STAssertNil([GTMRegex cachedRegexWithPattern:nil options:0], nil);
+  STAssertNil([GTMRegex cachedRegexWithPattern:@"" options:0], nil);
+  [GTMUnitTestDevLog expectString:@"Invalid pattern \"(\", error: \"parentheses not balanced\""];
+  STAssertNil([GTMRegex cachedRegexWithPattern:@"(" options:0], nil);
+  // not cached, so it logs again
+  [GTMUnitTestDevLog expectString:@"Invalid pattern \"(\", error: \"parentheses not balanced\""];
+  STAssertNil([GTMRegex cachedRegexWithPattern:@"(" options:0], nil);
+
+  // same pattern and options give the same object
+  GTMRegex *regex = [GTMRegex cachedRegexWithPattern:@"foo+" options:0];
+  STAssertNotNil(regex, nil);
+  STAssertEquals(regex, [GTMRegex cachedRegexWithPattern:@"foo+" options:0],
+                 nil);
+  // different options are different regexes
+  GTMRegex *regexIgnoreCase =
+    [GTMRegex cachedRegexWithPattern:@"foo+"
+                             options:kGTMRegexOptionIgnoreCase];
+  STAssertNotNil(regexIgnoreCase, nil);
+  STAssertNotEquals(regex, regexIgnoreCase, nil);
+  STAssertFalse([regex matchesString:@"FOO"], nil);
+  STAssertTrue([regexIgnoreCase matchesString:@"FOO"], nil);
+
+  // overflowing the cache flushes it, but everything still works
+  for (int x = 0; x < 300; ++x) {
+    NSString *pattern = [NSString stringWithFormat:@"flush%d", x];
+    STAssertTrue([pattern gtm_matchesPattern:pattern], nil);
+  }
+  STAssertTrue([[GTMRegex cachedRegexWithPattern:@"foo+" options:0]
+                  matchesString:@"fooo"], nil);
+}
+
+- (void)testMatchesSubStringInUTF8String {
+  GTMRegex *regex = [GTMRegex regexWithPattern:@"foo+"];
+  STAssertNotNil(regex, nil);
+  STAssertTrue([regex matchesSubStringInUTF8String:"zzfooozz"], nil);
+  STAssertFalse([regex matchesSubStringInUTF8String:"zzfozz"], nil);
+  STAssertFalse([regex matchesSubStringInUTF8String:""], nil);
+  STAssertFalse([regex matchesSubStringInUTF8String:NULL], nil);
+}
+
+- (void)testRegexSet {
+  // fail cases
+  STAssertNil([[[GTMRegexSet alloc] init] autorelease], nil);
+  STAssertNil([GTMRegexSet regexSetWithPatterns:nil], nil);
+  STAssertNil([GTMRegexSet regexSetWithPatterns:[NSArray array]], nil);
+  [GTMUnitTestDevLog expectString:@"Invalid pattern \"(b\", error: \"parentheses not balanced\""];
+  STAssertNil([GTMRegexSet regexSetWithPatterns:
+               [NSArray arrayWithObjects:@"foo", @"(b", nil]], nil);
+
+  NSArray *patterns = [NSArray arrayWithObjects:
+                       @"^ERROR", @"(time[sd]?) ?out", @"fail(ed|ure)", nil];
+  GTMRegexSet *regexSet = [GTMRegexSet regexSetWithPatterns:patterns];
+  STAssertNotNil(regexSet, nil);
+  STAssertEqualObjects([regexSet patterns], patterns, nil);
+
+  STAssertTrue([regexSet matchesSubStringInString:@"ERROR: disk full"], nil);
+  STAssertTrue([regexSet matchesSubStringInString:@"connection timed out"], nil);
+  STAssertFalse([regexSet matchesSubStringInString:@"all is well"], nil);
+  STAssertFalse([regexSet matchesSubStringInString:@""], nil);
+  STAssertFalse([regexSet matchesSubStringInString:nil], nil);
+
+  STAssertEquals([regexSet indexOfPatternMatchingSubStringInString:@"ERROR: x"],
+                 (NSUInteger)0, nil);
+  STAssertEquals([regexSet indexOfPatternMatchingSubStringInString:@"x timeout"],
+                 (NSUInteger)1, nil);
+  STAssertEquals([regexSet indexOfPatternMatchingSubStringInString:@"x failure"],
+                 (NSUInteger)2, nil);
+  // sub patterns in earlier patterns don't confuse the index
+  STAssertEquals([regexSet indexOfPatternMatchingSubStringInString:@"failed"],
+                 (NSUInteger)2, nil);
+  // leftmost match wins
+  STAssertEquals([regexSet indexOfPatternMatchingSubStringInString:
+                  @"failed after times out"],
+                 (NSUInteger)2, nil);
+  STAssertEquals([regexSet indexOfPatternMatchingSubStringInString:@"fine"],
+                 (NSUInteger)NSNotFound, nil);
+  // '^' is per line in the default options
+  STAssertEquals([regexSet indexOfPatternMatchingSubStringInString:
+                  @"ok\nERROR here"],
+                 (NSUInteger)0, nil);
+
+  // options apply to every pattern
+  regexSet = [GTMRegexSet regexSetWithPatterns:patterns
+                                       options:kGTMRegexOptionIgnoreCase];
+  STAssertEquals([regexSet indexOfPatternMatchingSubStringInString:@"FAILED"],
+                 (NSUInteger)2, nil);
+}
+
+- (void)testLogScanningPerformance {
+  // Not a pass/fail test, logs the timings for scanning log lines w/ the
+  // compile-per-call helpers vs. cached patterns vs. a pattern set.
+  NSArray *patterns = [NSArray arrayWithObjects:
+                       @"^E[0-9]+ ", @"timed out after [0-9]+ms",
+                       @"status=(4|5)[0-9][0-9]", @"panic:", nil];
+  NSMutableArray *lines = [NSMutableArray array];
+  for (int x = 0; x < 5000; ++x) {
+    [lines addObject:
+     [NSString stringWithFormat:@"I%06d 12:00:00.%03d worker[%d] GET /a/b/%d "
+                                @"status=%d bytes=%d", x, x % 1000, x % 16, x,
+                                ((x % 97) ? 200 : 503), x * 7]];
+  }
+  NSUInteger patternCount = [patterns count];
+  NSString *line = nil;
+
+  NSUInteger uncachedHits = 0;
+  NSDate *start = [NSDate date];
+  GTM_FOREACH_OBJECT(line, lines) {
+    for (NSUInteger x = 0; x < patternCount; ++x) {
+      GTMRegex *regex = [GTMRegex regexWithPattern:[patterns objectAtIndex:x]];
+      if ([regex matchesSubStringInString:line]) {
+        ++uncachedHits;
+        break;
+      }
+    }
+  }
+  NSTimeInterval uncached = -[start timeIntervalSinceNow];
+
+  NSUInteger cachedHits = 0;
+  start = [NSDate date];
+  GTM_FOREACH_OBJECT(line, lines) {
+    for (NSUInteger x = 0; x < patternCount; ++x) {
+      if ([line gtm_subStringMatchesPattern:[patterns objectAtIndex:x]]) {
+        ++cachedHits;
+        break;
+      }
+    }
+  }
+  NSTimeInterval cached = -[start timeIntervalSinceNow];
+
+  NSUInteger setHits = 0;
+  GTMRegexSet *regexSet = [GTMRegexSet regexSetWithPatterns:patterns];
+  start = [NSDate date];
+  GTM_FOREACH_OBJECT(line, lines) {
+    if ([regexSet matchesSubStringInString:line]) {
+      ++setHits;
+    }
+  }
+  NSTimeInterval set = -[start timeIntervalSinceNow];
+
+  STAssertEquals(uncachedHits, cachedHits, nil);
+  STAssertEquals(uncachedHits, setHits, nil);
+  NSLog(@"GTMRegex: scanned %lu lines w/ %lu patterns, compile per call %.3fs, "
+        @"cached %.3fs, GTMRegexSet %.3fs",
+        (unsigned long)[lines count], (unsigned long)patternCount,
+        uncached, cached, set);
 }
 
 @end
@@ -101,6 +101,32 @@
 #import <Foundation/Foundation.h>
 #import <sqlite3.h>
 
+@class GTMSQLiteStatement;
+
+//  Options that may be applied when a file-based database is opened.
+//
+//  kGTMSQLiteOpenWriteAheadLog: Switch the database to the write-ahead log
+//    journal mode (SQLite 3.7.0+). Readers no longer block writers, and
+//    commits only append to the log, which makes bulk loads much cheaper.
+//  kGTMSQLiteOpenMemoryMapped: Ask SQLite to access the database file through
+//    mmap (SQLite 3.7.17+), up to kGTMSQLiteDefaultMMapSize bytes.
+//
+//  Both options are silently ignored by SQLite versions that do not support
+//  them, and by in-memory databases.
+enum {
+  kGTMSQLiteOpenOptionsNone = 0,
+  kGTMSQLiteOpenWriteAheadLog = 1 << 0,
+  kGTMSQLiteOpenMemoryMapped = 1 << 1,
+};
+typedef NSUInteger GTMSQLiteOpenOptions;
+
+//  The mmap size requested by kGTMSQLiteOpenMemoryMapped (256MB).
+extern const long long kGTMSQLiteDefaultMMapSize;
+
+//  The number of prepared statements kept by -cachedStatementWithSQL:errorCode:
+//  unless changed with -setStatementCacheSize:.
+extern const NSUInteger kGTMSQLiteDefaultStatementCacheSize;
+
 /// Wrapper for SQLite with release/retain semantics and CFString convenience features
 @interface GTMSQLiteDatabase : NSObject {
  @protected
@@ -111,6 +137,9 @@
   CFOptionFlags likeOptions_;
   CFOptionFlags globOptions_;
   NSMutableArray *userArgDataPool_;  // strong
+  NSMutableDictionary *statementCache_;  // strong, SQL -> GTMSQLiteStatement
+  NSMutableArray *statementCacheOrder_;  // strong, SQL, least recent first
+  NSUInteger statementCacheSize_;
 }
 
 //  Get the numeric version number of the SQLite library (compiled in value
@@ -146,6 +175,21 @@
               utf8:(BOOL)useUTF8
          errorCode:(int *)err;
 
+//  Create and open a database instance on a file-based database, applying
+//  the given open options.
+//
+//  Args:
+//    path, withCFAdditions, utf8, err: See
+//      [... initWithPath:withCFAdditions:utf8:errorCode:]
+//    options: Bitwise OR of GTMSQLiteOpenOptions values. Failing to apply an
+//             option is not considered an error.
+//
+- (id)initWithPath:(NSString *)path
+   withCFAdditions:(BOOL)additions
+              utf8:(BOOL)useUTF8
+       openOptions:(GTMSQLiteOpenOptions)options
+         errorCode:(int *)err;
+
 //  Create and open a memory-based database. Memory-based databases
 //  cannot be shared amongst threads, and each instance is unique. See
 //  SQLite documentation for details.
@@ -314,6 +358,70 @@
 //
 - (BOOL)commit;
 
+#pragma mark Statement Cache
+
+//  Set the maximum number of prepared statements held by the statement cache.
+//  When the cache is full the least recently used statement is finalized.
+//  Setting the size to 0 finalizes and disables all cached statements.
+//
+//  Args:
+//    size: Maximum number of cached statements
+//
+- (void)setStatementCacheSize:(NSUInteger)size;
+
+//  Get the maximum number of prepared statements held by the statement cache.
+//
+//  Returns:
+//    Cache size, defaults to kGTMSQLiteDefaultStatementCacheSize
+//
+- (NSUInteger)statementCacheSize;
+
+//  Get a prepared statement for the SQL from the statement cache, preparing
+//  and caching it if needed. The statement is reset and its bindings are
+//  cleared before it is returned.
+//
+//  NOTE: The statement is owned by the database. Do NOT call
+//  [finalizeStatement] on it, and do not hold on to it across another
+//  call with the same SQL since the same instance is handed out again.
+//  If the cache is disabled a new autoreleased statement is returned that
+//  the caller must finalize as usual.
+//
+//  Args:
+//    sql: Raw SQL statement to prepare, see
+//         [GTMSQLiteStatement initWithSQL:inDatabase:errorCode:]
+//    err: Result code from SQLite. If NULL no result code is reported.
+//
+//  Returns:
+//    GTMSQLiteStatement or nil on error
+//
+- (GTMSQLiteStatement *)cachedStatementWithSQL:(NSString *)sql
+                                     errorCode:(int *)err;
+
+//  Finalize and remove all statements in the statement cache.
+//
+- (void)clearStatementCache;
+
+#pragma mark Batch Execution
+
+//  Execute a single SQL statement once per row of values, reusing one
+//  prepared statement and wrapping all rows in a single transaction. If a
+//  transaction is already open the rows run inside it and it is left open.
+//
+//  Args:
+//    sql: Raw SQL statement with positional or named parameters.
+//    rows: Array of rows. Each row is either an NSArray of values bound by
+//          position, or an NSDictionary of values bound by parameter name.
+//          Names may omit the leading ':' of the parameter, and parameters
+//          a dictionary row leaves out are bound to NULL. Values may be
+//          NSString, NSNumber, NSData, NSDate (bound as a time interval
+//          since 1970) or NSNull.
+//
+//  Returns:
+//    SQLite result code, SQLITE_OK if all rows were executed and committed.
+//    On error the transaction is rolled back (if this call opened it).
+//
+- (int)executeSQL:(NSString *)sql withRows:(NSArray *)rows;
+
 @end
 
 //  Wrapper class for SQLite statements with retain/release semantics.
@@ -536,6 +644,29 @@
 //
 - (int)bindStringAtPosition:(int)position string:(NSString *)string;
 
+//  Bind a Foundation object at the given position, choosing the binding from
+//  the class of the object (NSString, NSNumber, NSData, NSDate or NSNull).
+//  NSNumbers holding floating point values are bound as doubles, all other
+//  NSNumbers as 64-bit integers. NSDates are bound as doubles holding
+//  the time interval since 1970.
+//
+//  Args:
+//    position: Parameter position (1-based index)
+//    object: Object to bind, nil binds NULL
+//
+//  Returns:
+//    SQLite result code, SQLITE_OK on no error, SQLITE_MISMATCH for
+//    unsupported classes.
+//
+- (int)bindFoundationObjectAtPosition:(int)position object:(id)object;
+
+//  Reset all parameter bindings to NULL. See sqlite3_clear_bindings().
+//
+//  Returns:
+//    SQLite result code, SQLITE_OK on no error
+//
+- (int)clearBindings;
+
 #pragma mark Results
 
 //  Get the number of result columns per row this statement will generate.
@@ -126,11 +126,16 @@ static void Glob16(sqlite3_context *context, int argc, sqlite3_value **argv);
 //  The CFLocale of the current user at process start
 static CFLocaleRef gCurrentLocale = NULL;
 
+const long long kGTMSQLiteDefaultMMapSize = 256 * 1024 * 1024;
+const NSUInteger kGTMSQLiteDefaultStatementCacheSize = 16;
+
 // Private methods
 @interface GTMSQLiteDatabase (PrivateMethods)
 
 - (int)installCFAdditions;
 - (void)collationArgumentRetain:(NSData *)collationArgs;
+- (void)applyOpenOptions:(GTMSQLiteOpenOptions)options;
+- (int)bindRow:(id)row toStatement:(GTMSQLiteStatement *)statement;
 //  Convenience method to clean up resources.  Called from both
 //  dealloc & finalize
 //
@@ -164,10 +169,23 @@ static CFLocaleRef gCurrentLocale = NULL;
    withCFAdditions:(BOOL)additions
               utf8:(BOOL)useUTF8
          errorCode:(int *)err {
+  return [self initWithPath:path
+            withCFAdditions:additions
+                       utf8:useUTF8
+                openOptions:kGTMSQLiteOpenOptionsNone
+                  errorCode:err];
+}
+
+- (id)initWithPath:(NSString *)path
+   withCFAdditions:(BOOL)additions
+              utf8:(BOOL)useUTF8
+       openOptions:(GTMSQLiteOpenOptions)options
+         errorCode:(int *)err {
   int rc = SQLITE_INTERNAL;
 
   if ((self = [super init])) {
     path_ = [path copy];
+    statementCacheSize_ = kGTMSQLiteDefaultStatementCacheSize;
     if (useUTF8) {
       rc = sqlite3_open([path_ fileSystemRepresentation], &db_);
     } else {
@@ -200,6 +218,9 @@ static CFLocaleRef gCurrentLocale = NULL;
         }
         rc = [self installCFAdditions];
       }
+      if (rc == SQLITE_OK) {
+        [self applyOpenOptions:options];
+      }
     }
 
     if (err) *err = rc;
@@ -237,6 +258,12 @@ static CFLocaleRef gCurrentLocale = NULL;
 }
 
 - (void)cleanupDB {
+  // Cached statements would keep the database from closing
+  [self clearStatementCache];
+  [statementCache_ release];
+  statementCache_ = nil;
+  [statementCacheOrder_ release];
+  statementCacheOrder_ = nil;
   if (db_) {
     int rc = sqlite3_close(db_);
     if (rc != SQLITE_OK) {
@@ -398,6 +425,34 @@ static CFLocaleRef gCurrentLocale = NULL;
   return SQLITE_OK;
 }
 
+//  Private method to apply the journal and mmap options requested at open
+//  time. Older SQLite versions ignore pragmas they do not know, so failures
+//  are only logged.
+- (void)applyOpenOptions:(GTMSQLiteOpenOptions)options {
+  if ([path_ isEqualToString:@":memory:"]) return;
+  if (options & kGTMSQLiteOpenWriteAheadLog) {
+    int rc = [self executeSQL:@"PRAGMA journal_mode = WAL;"];
+    if (rc != SQLITE_OK) {
+      // COV_NF_START
+      _GTMDevLog(@"Unable to enable WAL on \"%@\", error code: %d",
+                 self, rc);
+      // COV_NF_END
+    }
+  }
+  if (options & kGTMSQLiteOpenMemoryMapped) {
+    NSString *pragma =
+      [NSString stringWithFormat:@"PRAGMA mmap_size = %lld;",
+       kGTMSQLiteDefaultMMapSize];
+    int rc = [self executeSQL:pragma];
+    if (rc != SQLITE_OK) {
+      // COV_NF_START
+      _GTMDevLog(@"Unable to enable mmap on \"%@\", error code: %d",
+                 self, rc);
+      // COV_NF_END
+    }
+  }
+}
+
 // Private method used by collation creation callback
 - (void)collationArgumentRetain:(NSData *)collationArgs {
   [userArgDataPool_ addObject:collationArgs];
@@ -521,6 +576,157 @@ static CFLocaleRef gCurrentLocale = NULL;
   return [NSString stringWithFormat:@"<%@: %p - %@>", 
           [self class], self, path_];
 }
+
+#pragma mark Statement Cache
+
+- (void)setStatementCacheSize:(NSUInteger)size {
+  statementCacheSize_ = size;
+  // Trim the least recently used statements that no longer fit
+  while ([statementCacheOrder_ count] > statementCacheSize_) {
+    NSString *sql = [statementCacheOrder_ objectAtIndex:0];
+    [[statementCache_ objectForKey:sql] finalizeStatement];
+    [statementCache_ removeObjectForKey:sql];
+    [statementCacheOrder_ removeObjectAtIndex:0];
+  }
+}
+
+- (NSUInteger)statementCacheSize {
+  return statementCacheSize_;
+}
+
+- (GTMSQLiteStatement *)cachedStatementWithSQL:(NSString *)sql
+                                     errorCode:(int *)err {
+  if (!sql) {
+    if (err) *err = SQLITE_MISUSE;
+    return nil;
+  }
+  if (!statementCacheSize_) {
+    return [GTMSQLiteStatement statementWithSQL:sql
+                                     inDatabase:self
+                                      errorCode:err];
+  }
+
+  GTMSQLiteStatement *statement = [statementCache_ objectForKey:sql];
+  if (statement) {
+    // Move to the most recently used end. The cache is small enough that
+    // the linear search is cheaper than preparing the statement again.
+    NSUInteger index = [statementCacheOrder_ indexOfObject:sql];
+    if (index != [statementCacheOrder_ count] - 1) {
+      [statementCacheOrder_ removeObjectAtIndex:index];
+      [statementCacheOrder_ addObject:sql];
+    }
+    [statement reset];
+    [statement clearBindings];
+    if (err) *err = SQLITE_OK;
+    return statement;
+  }
+
+  statement = [GTMSQLiteStatement statementWithSQL:sql
+                                        inDatabase:self
+                                         errorCode:err];
+  if (!statement) return nil;
+
+  if (!statementCache_) {
+    statementCache_ = [[NSMutableDictionary alloc] init];
+    statementCacheOrder_ = [[NSMutableArray alloc] init];
+  }
+  // Key on an immutable copy so callers can't mutate the key under us
+  sql = [[sql copy] autorelease];
+  [statementCache_ setObject:statement forKey:sql];
+  [statementCacheOrder_ addObject:sql];
+  // Evict down to size
+  [self setStatementCacheSize:statementCacheSize_];
+  return statement;
+}
+
+- (void)clearStatementCache {
+  NSEnumerator *statementEnum = [statementCache_ objectEnumerator];
+  GTMSQLiteStatement *statement;
+  while ((statement = [statementEnum nextObject])) {
+    [statement finalizeStatement];
+  }
+  [statementCache_ removeAllObjects];
+  [statementCacheOrder_ removeAllObjects];
+}
+
+#pragma mark Batch Execution
+
+//  Private helper to bind one row of a batch, see executeSQL:withRows:
+- (int)bindRow:(id)row toStatement:(GTMSQLiteStatement *)statement {
+  int rc = SQLITE_OK;
+  if ([row isKindOfClass:[NSArray class]]) {
+    int count = (int)[row count];
+    if (count != [statement parameterCount]) return SQLITE_RANGE;
+    for (int i = 0; (i < count) && (rc == SQLITE_OK); i++) {
+      rc = [statement bindFoundationObjectAtPosition:(i + 1)
+                                              object:[row objectAtIndex:i]];
+    }
+  } else if ([row isKindOfClass:[NSDictionary class]]) {
+    NSEnumerator *keyEnum = [row keyEnumerator];
+    NSString *name;
+    while ((rc == SQLITE_OK) && (name = [keyEnum nextObject])) {
+      int position = [statement positionOfParameterNamed:name];
+      if (position < 1) {
+        NSString *prefixedName = [@":" stringByAppendingString:name];
+        position = [statement positionOfParameterNamed:prefixedName];
+      }
+      if (position < 1) return SQLITE_RANGE;
+      rc = [statement bindFoundationObjectAtPosition:position
+                                              object:[row objectForKey:name]];
+    }
+  } else {
+    rc = SQLITE_MISUSE;
+  }
+  return rc;
+}
+
+- (int)executeSQL:(NSString *)sql withRows:(NSArray *)rows {
+  if (!sql || !rows) return SQLITE_MISUSE;
+
+  int rc = SQLITE_OK;
+  GTMSQLiteStatement *statement = [self cachedStatementWithSQL:sql
+                                                     errorCode:&rc];
+  if (!statement) return rc;
+  BOOL ownsStatement = ([statementCache_ objectForKey:sql] != statement);
+
+  // Only manage the transaction if the caller hasn't opened one
+  BOOL ownsTransaction = (sqlite3_get_autocommit(db_) != 0);
+  if (ownsTransaction && ![self beginDeferredTransaction]) {
+    rc = [self lastErrorCode];
+  }
+
+  NSEnumerator *rowEnum = [rows objectEnumerator];
+  id row;
+  while ((rc == SQLITE_OK) && (row = [rowEnum nextObject])) {
+    // Reset leaves the previous row's values bound, so parameters a
+    // dictionary row leaves out would silently reuse them instead of NULL
+    [statement clearBindings];
+    rc = [self bindRow:row toStatement:statement];
+    if (rc != SQLITE_OK) break;
+    rc = [statement stepRow];
+    if ((rc == SQLITE_DONE) || (rc == SQLITE_ROW)) {
+      rc = [statement reset];
+    }
+  }
+  // Don't leave the cached statement holding references to the row values
+  [statement reset];
+  [statement clearBindings];
+  if (ownsStatement) {
+    [statement finalizeStatement];
+  }
+
+  if (ownsTransaction) {
+    if (rc == SQLITE_OK) {
+      if (![self commit]) {
+        rc = [self lastErrorCode];
+        [self rollback];
+      }
+    } else {
+      [self rollback];
+    }
+  }
+  return rc;
+}
 @end
 
 
@@ -1844,6 +2050,44 @@ static void Glob16(sqlite3_context *context, int argc, sqlite3_value **argv) {
                            SQLITE_TRANSIENT);
 }
 
+- (int)bindFoundationObjectAtPosition:(int)position object:(id)object {
+  if (!statement_) return SQLITE_MISUSE;
+  if (!object || [object isKindOfClass:[NSNull class]]) {
+    return [self bindSQLNullAtPosition:position];
+  } else if ([object isKindOfClass:[NSString class]]) {
+    return [self bindStringAtPosition:position string:object];
+  } else if ([object isKindOfClass:[NSNumber class]]) {
+    const char *type = [object objCType];
+    if ((strcmp(type, @encode(double)) == 0) ||
+        (strcmp(type, @encode(float)) == 0)) {
+      return [self bindNumberAsDoubleAtPosition:position number:object];
+    }
+    return [self bindNumberAsLongLongAtPosition:position number:object];
+  } else if ([object isKindOfClass:[NSData class]]) {
+    if (![object length]) {
+      // Empty blobs are MISUSE for bindBlobAtPosition:, bind zero length
+      return sqlite3_bind_blob(statement_, position, "", 0, SQLITE_STATIC);
+    }
+    return [self bindBlobAtPosition:position data:object];
+  } else if ([object isKindOfClass:[NSDate class]]) {
+    return [self bindDoubleAtPosition:position
+                                value:[object timeIntervalSince1970]];
+  }
+  return SQLITE_MISMATCH;
+}
+
+- (int)clearBindings {
+  if (!statement_) return SQLITE_MISUSE;
+  // sqlite3_clear_bindings() isn't available on the Tiger SQLite, binding
+  // NULL explicitly does the same thing.
+  int rc = SQLITE_OK;
+  int count = sqlite3_bind_parameter_count(statement_);
+  for (int i = 1; (i <= count) && (rc == SQLITE_OK); i++) {
+    rc = sqlite3_bind_null(statement_, i);
+  }
+  return rc;
+}
+
 #pragma mark Results
 
 - (int)resultColumnCount {
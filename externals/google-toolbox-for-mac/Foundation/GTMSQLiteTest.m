@@ -1126,6 +1126,235 @@ static void TestUpperLower16Impl(sqlite3_context *context,
   STAssertNotNil([db8 description], nil);
 }
 
+- (void)testStatementCache {
+  int err;
+  GTMSQLiteDatabase *db =
+    [[[GTMSQLiteDatabase alloc] initInMemoryWithCFAdditions:YES
+                                                       utf8:YES
+                                                  errorCode:&err]
+      autorelease];
+  STAssertNotNil(db, @"Failed to create database");
+  STAssertEquals([db statementCacheSize], kGTMSQLiteDefaultStatementCacheSize,
+                 nil);
+
+  STAssertNil([db cachedStatementWithSQL:nil errorCode:&err], nil);
+  STAssertEquals(err, SQLITE_MISUSE, nil);
+  STAssertNil([db cachedStatementWithSQL:@"select * from nope"
+                               errorCode:&err], nil);
+  STAssertNotEquals(err, SQLITE_OK, nil);
+
+  GTMSQLiteStatement *statement = [db cachedStatementWithSQL:@"select ?"
+                                                   errorCode:&err];
+  STAssertNotNil(statement, nil);
+  STAssertEquals(err, SQLITE_OK, nil);
+  STAssertEquals([statement bindInt32AtPosition:1 value:7], SQLITE_OK, nil);
+  STAssertEquals([statement stepRow], SQLITE_ROW, nil);
+  STAssertEquals([statement resultInt32AtPosition:0], 7, nil);
+
+  // Same SQL hands back the same statement, reset with bindings cleared
+  GTMSQLiteStatement *statement2 = [db cachedStatementWithSQL:@"select ?"
+                                                    errorCode:&err];
+  STAssertEquals(statement2, statement, nil);
+  STAssertEquals([statement2 stepRow], SQLITE_ROW, nil);
+  STAssertEquals([statement2 resultColumnTypeAtPosition:0], SQLITE_NULL, nil);
+
+  // Shrinking the cache evicts the least recently used statements
+  GTMSQLiteStatement *statement3 = [db cachedStatementWithSQL:@"select 3"
+                                                    errorCode:&err];
+  STAssertNotNil(statement3, nil);
+  [db setStatementCacheSize:1];
+  STAssertTrue([statement sqlite3Statement] == NULL,
+               @"LRU statement not evicted");
+  STAssertTrue([statement3 sqlite3Statement] != NULL, nil);
+  [db clearStatementCache];
+  STAssertTrue([statement3 sqlite3Statement] == NULL, nil);
+
+  // A disabled cache returns a statement the caller owns
+  [db setStatementCacheSize:0];
+  statement = [db cachedStatementWithSQL:@"select 1" errorCode:&err];
+  STAssertNotNil(statement, nil);
+  statement2 = [db cachedStatementWithSQL:@"select 1" errorCode:&err];
+  STAssertNotEquals(statement2, statement, nil);
+  [statement finalizeStatement];
+  [statement2 finalizeStatement];
+}
+
+- (void)testBatchExecution {
+  int err;
+  GTMSQLiteDatabase *db =
+    [[[GTMSQLiteDatabase alloc] initInMemoryWithCFAdditions:YES
+                                                       utf8:YES
+                                                  errorCode:&err]
+      autorelease];
+  err = [db executeSQL:@"CREATE TABLE foo (a INTEGER, b TEXT, c REAL, d BLOB);"];
+  STAssertEquals(err, SQLITE_OK, @"Failed to create table");
+
+  STAssertEquals([db executeSQL:nil withRows:[NSArray array]],
+                 SQLITE_MISUSE, nil);
+  STAssertEquals([db executeSQL:@"INSERT INTO foo (a) VALUES (?);"
+                       withRows:nil],
+                 SQLITE_MISUSE, nil);
+
+  NSData *blob = [@"blob" dataUsingEncoding:NSUTF8StringEncoding];
+  NSArray *rows = [NSArray arrayWithObjects:
+                   [NSArray arrayWithObjects:[NSNumber numberWithInt:1],
+                    @"one", [NSNumber numberWithDouble:1.5], blob, nil],
+                   [NSArray arrayWithObjects:[NSNumber numberWithInt:2],
+                    [NSNull null], [NSNumber numberWithDouble:2.5],
+                    [NSData data], nil],
+                   nil];
+  err = [db executeSQL:@"INSERT INTO foo (a, b, c, d) VALUES (?, ?, ?, ?);"
+              withRows:rows];
+  STAssertEquals(err, SQLITE_OK, nil);
+
+  rows = [NSArray arrayWithObjects:
+          [NSDictionary dictionaryWithObjectsAndKeys:
+           [NSNumber numberWithInt:3], @":a", @"three", @"b", nil],
+          [NSDictionary dictionaryWithObject:[NSNumber numberWithInt:4]
+                                      forKey:@"a"],
+          nil];
+  err = [db executeSQL:@"INSERT INTO foo (a, b) VALUES (:a, :b);"
+              withRows:rows];
+  STAssertEquals(err, SQLITE_OK, nil);
+
+  GTMSQLiteStatement *statement =
+    [db cachedStatementWithSQL:@"SELECT a, b, c FROM foo ORDER BY a;"
+                     errorCode:&err];
+  NSMutableArray *results = [NSMutableArray array];
+  while ([statement stepRow] == SQLITE_ROW) {
+    [results addObject:[statement resultRowArray]];
+  }
+  STAssertEquals([results count], (NSUInteger)4, nil);
+  STAssertEqualObjects([[results objectAtIndex:0] objectAtIndex:1], @"one",
+                       nil);
+  STAssertEqualObjects([[results objectAtIndex:1] objectAtIndex:1],
+                       [NSNull null], nil);
+  STAssertEqualObjects([[results objectAtIndex:1] objectAtIndex:2],
+                       [NSNumber numberWithDouble:2.5], nil);
+  STAssertEqualObjects([[results objectAtIndex:2] objectAtIndex:1], @"three",
+                       nil);
+  // A parameter the row leaves out is NULL, not the previous row's value
+  STAssertEqualObjects([[results objectAtIndex:3] objectAtIndex:1],
+                       [NSNull null], nil);
+
+  // A bad row rolls back every row of the batch
+  rows = [NSArray arrayWithObjects:
+          [NSArray arrayWithObject:[NSNumber numberWithInt:4]],
+          [NSArray arrayWithObject:[NSArray array]],
+          nil];
+  err = [db executeSQL:@"INSERT INTO foo (a) VALUES (?);" withRows:rows];
+  STAssertEquals(err, SQLITE_MISMATCH, nil);
+  rows = [NSArray arrayWithObject:[NSArray array]];
+  err = [db executeSQL:@"INSERT INTO foo (a) VALUES (?);" withRows:rows];
+  STAssertEquals(err, SQLITE_RANGE, nil);
+  rows = [NSArray arrayWithObject:
+          [NSDictionary dictionaryWithObject:@"x" forKey:@"nope"]];
+  err = [db executeSQL:@"INSERT INTO foo (a) VALUES (:a);" withRows:rows];
+  STAssertEquals(err, SQLITE_RANGE, nil);
+  statement = [db cachedStatementWithSQL:@"SELECT count(*) FROM foo;"
+                               errorCode:&err];
+  STAssertEquals([statement stepRow], SQLITE_ROW, nil);
+  STAssertEquals([statement resultInt32AtPosition:0], 4, nil);
+
+  // Inside a caller's transaction the batch leaves the transaction open
+  STAssertTrue([db beginDeferredTransaction], nil);
+  rows = [NSArray arrayWithObject:
+          [NSArray arrayWithObject:[NSNumber numberWithInt:5]]];
+  err = [db executeSQL:@"INSERT INTO foo (a) VALUES (?);" withRows:rows];
+  STAssertEquals(err, SQLITE_OK, nil);
+  STAssertTrue([db rollback], nil);
+  statement = [db cachedStatementWithSQL:@"SELECT count(*) FROM foo;"
+                               errorCode:&err];
+  STAssertEquals([statement stepRow], SQLITE_ROW, nil);
+  STAssertEquals([statement resultInt32AtPosition:0], 4, nil);
+}
+
+- (void)testOpenOptions {
+  NSString *dbPath =
+    [NSTemporaryDirectory() stringByAppendingPathComponent:
+     [NSString stringWithFormat:@"GTMSQLiteTest-%d.db", getpid()]];
+  int err;
+  GTMSQLiteDatabase *db =
+    [[GTMSQLiteDatabase alloc] initWithPath:dbPath
+                            withCFAdditions:YES
+                                       utf8:YES
+                                openOptions:(kGTMSQLiteOpenWriteAheadLog |
+                                             kGTMSQLiteOpenMemoryMapped)
+                                  errorCode:&err];
+  STAssertNotNil(db, nil);
+  STAssertEquals(err, SQLITE_OK, nil);
+  GTMSQLiteStatement *statement =
+    [db cachedStatementWithSQL:@"PRAGMA journal_mode;" errorCode:&err];
+  STAssertEquals([statement stepRow], SQLITE_ROW, nil);
+  // WAL arrived in SQLite 3.7.0
+  if ([GTMSQLiteDatabase sqliteVersionNumber] >= 3007000) {
+    STAssertEqualObjects([[statement resultStringAtPosition:0] lowercaseString],
+                         @"wal", nil);
+  }
+  [db release];
+  NSFileManager *fm = [NSFileManager defaultManager];
+  NSArray *suffixes = [NSArray arrayWithObjects:@"", @"-wal", @"-shm", nil];
+  for (NSUInteger i = 0; i < [suffixes count]; i++) {
+    NSString *path =
+      [dbPath stringByAppendingString:[suffixes objectAtIndex:i]];
+    [fm removeFileAtPath:path handler:nil];
+  }
+}
+
+- (void)testBulkLoadPerformance {
+  // Not a pass/fail test, logs the rates so regressions in the statement
+  // cache or batch binding show up in the build logs.
+  const int kRowCount = 10000;
+  int err;
+  GTMSQLiteDatabase *db =
+    [[[GTMSQLiteDatabase alloc] initInMemoryWithCFAdditions:NO
+                                                       utf8:YES
+                                                  errorCode:&err]
+      autorelease];
+  err = [db executeSQL:@"CREATE TABLE perf (id INTEGER PRIMARY KEY, v TEXT);"];
+  STAssertEquals(err, SQLITE_OK, nil);
+
+  // Prepare per row with autocommit, the pre-cache usage pattern
+  NSString *insertSQL = @"INSERT INTO perf (id, v) VALUES (?, ?);";
+  NSDate *start = [NSDate date];
+  for (int i = 0; i < kRowCount; i++) {
+    GTMSQLiteStatement *statement =
+      [GTMSQLiteStatement statementWithSQL:insertSQL
+                                inDatabase:db
+                                 errorCode:&err];
+    [statement bindInt32AtPosition:1 value:i];
+    [statement bindStringAtPosition:2 string:@"value"];
+    [statement stepRow];
+    [statement finalizeStatement];
+  }
+  NSTimeInterval uncached = -[start timeIntervalSinceNow];
+  STAssertEquals([db executeSQL:@"DELETE FROM perf;"], SQLITE_OK, nil);
+
+  NSMutableArray *rows = [NSMutableArray arrayWithCapacity:kRowCount];
+  for (int i = 0; i < kRowCount; i++) {
+    [rows addObject:[NSArray arrayWithObjects:
+                     [NSNumber numberWithInt:i], @"value", nil]];
+  }
+  start = [NSDate date];
+  err = [db executeSQL:insertSQL withRows:rows];
+  NSTimeInterval batched = -[start timeIntervalSinceNow];
+  STAssertEquals(err, SQLITE_OK, nil);
+
+  start = [NSDate date];
+  for (int i = 0; i < kRowCount; i++) {
+    GTMSQLiteStatement *statement =
+      [db cachedStatementWithSQL:@"SELECT v FROM perf WHERE id = ?;"
+                       errorCode:&err];
+    [statement bindInt32AtPosition:1 value:i];
+    STAssertEquals([statement stepRow], SQLITE_ROW, nil);
+  }
+  NSTimeInterval queries = -[start timeIntervalSinceNow];
+
+  NSLog(@"GTMSQLite: %.0f inserts/sec uncached, %.0f inserts/sec batched, "
+        @"%.0f point queries/sec cached",
+        kRowCount / uncached, kRowCount / batched, kRowCount / queries);
+}
+
 // // From GTMSQLite.m
 // CFStringEncoding SqliteTextEncodingToCFStringEncoding(int enc);
 
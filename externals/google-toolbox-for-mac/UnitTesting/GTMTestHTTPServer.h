@@ -30,7 +30,10 @@
 }
 
 // Any url that isn't a specific server request (login, etc.), will be fetched
-// off |docRoot| (to allow canned repsonses).
+// off |docRoot| (to allow canned repsonses).  Files are sent from disk rather
+// than memory, and support byte ranges and ETags; see GTMHTTPResponseMessage's
+// +responseWithContentsOfFile:contentType:forRequest:.  Last-Modified is
+// always "thursday", so use the ETag with If-Range.
 - (id)initWithDocRoot:(NSString *)docRoot;
 
 // fetch the port the server is running on
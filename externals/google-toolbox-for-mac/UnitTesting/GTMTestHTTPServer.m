@@ -60,7 +60,7 @@ static NSArray *GetSubPatternsOfFirstStringMatchedByPattern(NSString *stringToSe
                          handleRequest:(GTMHTTPRequestMessage *)request {
   _GTMDevAssert(server == server_, @"how'd we get a different server?!");
   UInt32 resultStatus = 0;
-  NSData *data = nil;
+  GTMHTTPResponseMessage *response = nil;
   // clients should treat dates as opaque, generally
   NSString *modifiedDate = @"thursday";
   
@@ -143,20 +143,23 @@ static NSArray *GetSubPatternsOfFirstStringMatchedByPattern(NSString *stringToSe
     } else if ([ifModifiedSince isEqualToString:modifiedDate]) {
       resultStatus = 304;
     } else {
+      // served straight from the file, so large files and byte ranges work
       NSString *docPath = [docRoot_ stringByAppendingPathComponent:path];
-      data = [NSData dataWithContentsOfFile:docPath];
-      if (data) {
-        resultStatus = 200;
-      } else {
+      response =
+        [GTMHTTPResponseMessage responseWithContentsOfFile:docPath
+                                               contentType:@"text/plain"
+                                                forRequest:request];
+      if (!response) {
         resultStatus = 404; 
       }
     }
   }
 
-  GTMHTTPResponseMessage *response =
-    [GTMHTTPResponseMessage responseWithBody:data
-                                 contentType:@"text/plain"
-                                  statusCode:resultStatus];
+  if (!response) {
+    response = [GTMHTTPResponseMessage responseWithBody:nil
+                                            contentType:@"text/plain"
+                                             statusCode:resultStatus];
+  }
   [response setValue:modifiedDate forHeaderField:@"Last-Modified"];
   [response setValue:[NSString stringWithFormat:@"TestCookie=%@", [path lastPathComponent]]
       forHeaderField:@"Set-Cookie"];
@@ -102,8 +102,8 @@
 
 // Returns YES if the action is currently running, NO otherwise. Subclasses
 // should NOT need to override this method. It returns YES if this action (self)
-// is the "current action" on its |processor|, NO otherwise. This should be the
-// correct "isRunning" status for the majority of KSAction subclasses.
+// is being run by its |processor|, NO otherwise. This should be the correct
+// "isRunning" status for the majority of KSAction subclasses.
 - (BOOL)isRunning;
 
 //
@@ -144,4 +144,10 @@
 // send that message.
 - (void)terminateAction;
 
+// Returns arguments describing this action for its KSTrace span, such as the
+// product ID, URL or byte count it worked on, or nil. Values should be
+// strings or numbers. This is only sent while tracing, when the action
+// finishes or is terminated. The default returns nil.
+- (NSDictionary *)traceArguments;
+
 @end
@@ -68,7 +68,7 @@
 }
 
 - (BOOL)isRunning {
-  return [[self processor] currentAction] == self;
+  return [[self processor] isRunningAction:self];
 }
 
 // COV_NF_START
@@ -90,4 +90,8 @@
   // do special cleanup when their action is being terminated.
 }
 
+- (NSDictionary *)traceArguments {
+  return nil;
+}
+
 @end
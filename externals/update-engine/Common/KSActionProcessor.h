@@ -101,6 +101,10 @@
 // Returns the KSAction that is currently being processed.
 - (KSAction *)currentAction;
 
+// Returns YES if |action| is currently being processed. Subclasses that run
+// more than one action at a time override this.
+- (BOOL)isRunningAction:(KSAction *)action;
+
 // Returns the total number of actions we have ever completed processing on.
 // Helpful for unit testing.
 - (int)actionsCompleted;
@@ -14,6 +14,7 @@
 
 #import "KSActionProcessor.h"
 #import "KSAction.h"
+#import "KSTrace.h"
 #import "GTMDefines.h"
 #import "GTMLogger.h"
 
@@ -91,6 +92,8 @@
 
     // Stop the current action then set it to nil (which will release it)
     [currentAction_ terminateAction];
+    if (currentAction_ && KSTraceIsEnabled())
+      [KSTrace endSpanForAction:currentAction_ outcome:@"terminated"];
     [currentAction_ setProcessor:nil];
     [self setCurrentAction:nil];
 
@@ -111,6 +114,10 @@
   return [[currentAction_ retain] autorelease];
 }
 
+- (BOOL)isRunningAction:(KSAction *)action {
+  return action != nil && action == currentAction_;
+}
+
 - (int)actionsCompleted {
   return actionsCompleted_;
 }
@@ -143,6 +150,10 @@
       // COV_NF_END
     }
         
+    if (KSTraceIsEnabled())
+      [KSTrace endSpanForAction:action
+                        outcome:(wasOK ? @"success" : @"failure")];
+
     [self updateProgressWithFraction:1.0f];
     
     SEL sel = @selector(processor:finishedAction:successfully:);
@@ -216,6 +227,8 @@
         [delegate_ processor:self startingAction:action];
 
       // Start the action
+      if (KSTraceIsEnabled())
+        [KSTrace beginSpanForAction:action parent:delegate_];
       [action performAction];
     } else {
       isProcessing_ = NO;
@@ -28,6 +28,11 @@
 //   /* [di isMounted] == YES */
 //   [di unmount];
 //
+// -isEncrypted, -hasLicense and mounting all need the image's metadata, which
+// costs a run of "hdiutil imageinfo". It is probed once and cached for the
+// whole process, keyed by the image's path, and is probed again only if the
+// file's size or modification time changes (or -removeLicense changes it).
+//
 @interface KSDiskImage : NSObject {
  @private
   NSString *path_;
@@ -79,6 +84,38 @@
 // Unmounts the disk image.
 - (BOOL)unmount;
 
+// Mounts the disk image, as -mount: does, on another thread. When done,
+// |delegate| is sent -diskImage:mountedAtPath: on the thread that called
+// this method, which must be running its run loop. Neither this object nor
+// the DMG should be used until then.
+- (void)mount:(NSString *)mountPoint delegate:(id)delegate;
+
+// Unmounts the disk image, as -unmount does, on another thread. When done,
+// |delegate| is sent -diskImage:unmounted: on the thread that called this
+// method, which must be running its run loop.
+- (void)unmountWithDelegate:(id)delegate;
+
+// Forgets all cached disk image metadata, so it's probed again when next
+// needed.
++ (void)flushInfoCache;
+
+@end
+
+
+// KSDiskImageDelegate
+//
+// Methods that the delegate of an asynchronous mount or unmount implements.
+@interface NSObject (KSDiskImageDelegate)
+
+// Sent when an asynchronous mount is done. |mountPoint| is nil if the disk
+// image couldn't be mounted.
+- (void)diskImage:(KSDiskImage *)diskImage
+    mountedAtPath:(NSString *)mountPoint;
+
+// Sent when an asynchronous unmount is done. |success| is NO if the disk
+// image couldn't be unmounted.
+- (void)diskImage:(KSDiskImage *)diskImage unmounted:(BOOL)success;
+
 @end
 
 
@@ -100,6 +137,10 @@
 //
 @interface KSHDIUtilTask : NSObject
 
+// Sets the program that hdiutil tasks run, so tests can stand in a fake one.
+// A nil |path| restores /usr/bin/hdiutil.
++ (void)setLaunchPath:(NSString *)path;
+
 // Returns an autoreleased hdiutil task instance. The hdiutil task will not
 // be running yet, this is just a handle for running it with the
 // -runWithArgs:input:output: command.
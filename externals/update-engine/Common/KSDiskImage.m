@@ -13,12 +13,66 @@
 // limitations under the License.
 
 #import "KSDiskImage.h"
+#import <sys/stat.h>
 #import "GTMDefines.h"
 #import "GTMLogger.h"
 
 
+// The program KSHDIUtilTask runs, or nil for /usr/bin/hdiutil. Guarded by
+// @synchronized ([KSHDIUtilTask class]).
+static NSString *gHDIUtilPath = nil;
+
+// "hdiutil imageinfo" results, keyed by disk image path. Each entry holds the
+// info (NSNull if hdiutil couldn't read the image) and a stamp of the file it
+// came from. Guarded by @synchronized ([KSDiskImage class]).
+static NSMutableDictionary *gInfoCache = nil;
+static NSString *const kInfoCacheInfoKey = @"info";
+static NSString *const kInfoCacheStampKey = @"stamp";
+
+// The cache is emptied when it reaches this size, so a long-running process
+// doesn't hold on to the info for every update it has ever installed.
+static const NSUInteger kMaxInfoCacheEntries = 64;
+
+// Keys for the dictionaries passed to and from the threads that do
+// asynchronous mounts and unmounts.
+static NSString *const kRequestThreadKey = @"thread";
+static NSString *const kRequestDelegateKey = @"delegate";
+static NSString *const kRequestMountPointKey = @"mountPoint";
+static NSString *const kRequestResultKey = @"result";
+
+
+@interface KSDiskImage (PrivateMethods)
+
+// Returns a string that changes whenever the file at path_ is changed or
+// replaced, or nil if it can't be stat'ed.
+- (NSString *)fileStamp;
+
+// Returns the image's "hdiutil imageinfo" dictionary, probing for it only if
+// it isn't cached for the file as it is now. Returns nil if hdiutil couldn't
+// read the image.
+- (NSDictionary *)imageInfo;
+
+// Forgets the image's cached info.
+- (void)flushInfo;
+
+// Thread bodies for the asynchronous mount and unmount, and the methods they
+// send back to the calling thread with their results.
+- (void)mountWithRequest:(NSDictionary *)request;
+- (void)finishMountWithResult:(NSDictionary *)result;
+- (void)unmountWithRequest:(NSDictionary *)request;
+- (void)finishUnmountWithResult:(NSDictionary *)result;
+
+@end
+
+
 @implementation KSDiskImage
 
++ (void)flushInfoCache {
+  @synchronized ([KSDiskImage class]) {
+    [gInfoCache removeAllObjects];
+  }
+}
+
 + (id)diskImageWithPath:(NSString *)path {
   return [[[self alloc] initWithPath:path] autorelease];
 }
@@ -58,47 +112,20 @@
 }
 
 - (BOOL)isEncrypted {
-  _GTMDevAssert(path_ != nil, @"path_ must not be nil");
+  // hdiutil can't read an encrypted image's info without its password; see
+  // -imageInfo.
+  NSDictionary *info = [self imageInfo];
+  if (info == nil) return YES;
 
-  NSArray *args = [NSArray arrayWithObjects:
-                   @"imageinfo", @"-plist", @"-stdinpass", path_, nil];
-
-  // I know this looks weird, so let me explain... The "isencrypted" verb to
-  // hdiutil is not available on Tiger, so we need to use some other method for
-  // finding out if a disk image is encrypted. The "imageinfo" verb provides
-  // this information on both Tiger and Leopard, however it requires an
-  // encrypted DMG's password to tell if its encrypted (yes, you read that
-  // correctly). So, our approach is to try to get the imageinfo from hdiutil
-  // by providing it a bogus password, and if it fails, then we assume the DMG
-  // was encrypted. If it actually succeeds, then we'll parse the imageinfo
-  // plist to to check the Properties/Encrypted bool.
-  NSString *plist = nil;
-  [[KSHDIUtilTask hdiutil] runWithArgs:args
-                           inputString:@"t0p_z3cr3t"
-                          outputString:&plist];
-
-  if (plist == nil) return YES;
-
-  NSDictionary *resultDict = [plist propertyList];
-  NSNumber *isEncrypted = [resultDict valueForKeyPath:@"Properties.Encrypted"];
+  NSNumber *isEncrypted = [info valueForKeyPath:@"Properties.Encrypted"];
   return isEncrypted && [isEncrypted boolValue];
 }
 
 - (BOOL)hasLicense {
-  _GTMDevAssert(path_ != nil, @"path_ must not be nil");
+  NSDictionary *info = [self imageInfo];
+  if (info == nil) return YES;
 
-  NSString *plist = nil;
-  NSArray *args = [NSArray arrayWithObjects:
-                   @"imageinfo", @"-plist", @"-stdinpass", path_, nil];
-
-  [[KSHDIUtilTask hdiutil] runWithArgs:args
-                           inputString:@"t0p_z3cr3t"
-                          outputString:&plist];
-
-  if (plist == nil) return YES;
-
-  NSDictionary *resultDict = [plist propertyList];
-  NSNumber *hasSLA = [resultDict valueForKeyPath:
+  NSNumber *hasSLA = [info valueForKeyPath:
                       @"Properties.Software License Agreement"];
 
   return hasSLA && [hasSLA boolValue];
@@ -114,6 +141,9 @@
   int status = [[KSHDIUtilTask hdiutil] runWithArgs:args
                                         inputString:nil
                                        outputString:nil];
+  // Whether or not that worked, the image may have changed in ways its size
+  // and modification time don't show within the same second.
+  [self flushInfo];
   if (status != 0) return;
 
   // now remove the LPic 5000 resource to neuter the SLA
@@ -133,6 +163,7 @@
       UseResFile(saveResRefNum);
     }
   }
+  [self flushInfo];
 }
 
 // Common mount method, used by all other mount: methods.
@@ -222,11 +253,166 @@
   return NO;  // COV_NF_LINE
 }
 
+- (void)mount:(NSString *)mountPoint delegate:(id)delegate {
+  // |mountPoint| may be nil, so it goes last
+  NSDictionary *request = [NSDictionary dictionaryWithObjectsAndKeys:
+                           [NSThread currentThread], kRequestThreadKey,
+                           delegate, kRequestDelegateKey,
+                           mountPoint, kRequestMountPointKey,
+                           nil];
+  [NSThread detachNewThreadSelector:@selector(mountWithRequest:)
+                           toTarget:self
+                         withObject:request];
+}
+
+- (void)unmountWithDelegate:(id)delegate {
+  NSDictionary *request = [NSDictionary dictionaryWithObjectsAndKeys:
+                           [NSThread currentThread], kRequestThreadKey,
+                           delegate, kRequestDelegateKey,
+                           nil];
+  [NSThread detachNewThreadSelector:@selector(unmountWithRequest:)
+                           toTarget:self
+                         withObject:request];
+}
+
 @end
 
 
+@implementation KSDiskImage (PrivateMethods)
+
+- (NSString *)fileStamp {
+  struct stat sb;
+  if (stat([path_ fileSystemRepresentation], &sb) != 0) return nil;
+  return [NSString stringWithFormat:@"%llu:%lld:%ld.%09ld",
+          (unsigned long long)sb.st_ino, (long long)sb.st_size,
+          (long)sb.st_mtimespec.tv_sec, (long)sb.st_mtimespec.tv_nsec];
+}
+
+- (NSDictionary *)imageInfo {
+  _GTMDevAssert(path_ != nil, @"path_ must not be nil");
+
+  NSString *stamp = [self fileStamp];
+  if (stamp) {
+    @synchronized ([KSDiskImage class]) {
+      NSDictionary *entry = [gInfoCache objectForKey:path_];
+      if ([stamp isEqualToString:[entry objectForKey:kInfoCacheStampKey]]) {
+        id info = [entry objectForKey:kInfoCacheInfoKey];
+        if (info == [NSNull null]) return nil;
+        return [[info retain] autorelease];
+      }
+    }
+  }
+
+  NSArray *args = [NSArray arrayWithObjects:
+                   @"imageinfo", @"-plist", @"-stdinpass", path_, nil];
+
+  // I know this looks weird, so let me explain... The "isencrypted" verb to
+  // hdiutil is not available on Tiger, so we need to use some other method for
+  // finding out if a disk image is encrypted. The "imageinfo" verb provides
+  // this information on both Tiger and Leopard, however it requires an
+  // encrypted DMG's password to tell if its encrypted (yes, you read that
+  // correctly). So, our approach is to try to get the imageinfo from hdiutil
+  // by providing it a bogus password, and if it fails, then we assume the DMG
+  // was encrypted. If it actually succeeds, then we'll parse the imageinfo
+  // plist to to check the Properties/Encrypted bool.
+  NSString *plist = nil;
+  [[KSHDIUtilTask hdiutil] runWithArgs:args
+                           inputString:@"t0p_z3cr3t"
+                          outputString:&plist];
+
+  NSDictionary *info = nil;
+  if (plist != nil) {
+    @try {
+      info = [plist propertyList];
+    }
+    @catch (id ex) {
+      GTMLoggerError(@"Failed to parse imageinfo for %@: %@", path_, ex);
+    }
+    if (![info isKindOfClass:[NSDictionary class]]) info = nil;
+  }
+
+  if (stamp) {
+    NSDictionary *entry = [NSDictionary dictionaryWithObjectsAndKeys:
+                           (info ? (id)info : [NSNull null]), kInfoCacheInfoKey,
+                           stamp, kInfoCacheStampKey,
+                           nil];
+    @synchronized ([KSDiskImage class]) {
+      if (gInfoCache == nil) {
+        gInfoCache = [[NSMutableDictionary alloc] init];
+      } else if ([gInfoCache count] >= kMaxInfoCacheEntries) {
+        [gInfoCache removeAllObjects];
+      }
+      [gInfoCache setObject:entry forKey:path_];
+    }
+  }
+
+  return info;
+}
+
+- (void)flushInfo {
+  @synchronized ([KSDiskImage class]) {
+    [gInfoCache removeObjectForKey:path_];
+  }
+}
+
+- (void)mountWithRequest:(NSDictionary *)request {
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+
+  NSString *mountPoint = [self mount:
+                          [request objectForKey:kRequestMountPointKey]];
+  NSMutableDictionary *result = [[request mutableCopy] autorelease];
+  if (mountPoint) [result setObject:mountPoint forKey:kRequestResultKey];
+  [self performSelector:@selector(finishMountWithResult:)
+               onThread:[request objectForKey:kRequestThreadKey]
+             withObject:result
+          waitUntilDone:NO];
+
+  [pool release];
+}
+
+- (void)finishMountWithResult:(NSDictionary *)result {
+  id delegate = [result objectForKey:kRequestDelegateKey];
+  if ([delegate respondsToSelector:@selector(diskImage:mountedAtPath:)]) {
+    [delegate diskImage:self
+          mountedAtPath:[result objectForKey:kRequestResultKey]];
+  }
+}
+
+- (void)unmountWithRequest:(NSDictionary *)request {
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+
+  BOOL success = [self unmount];
+  NSMutableDictionary *result = [[request mutableCopy] autorelease];
+  [result setObject:[NSNumber numberWithBool:success]
+             forKey:kRequestResultKey];
+  [self performSelector:@selector(finishUnmountWithResult:)
+               onThread:[request objectForKey:kRequestThreadKey]
+             withObject:result
+          waitUntilDone:NO];
+
+  [pool release];
+}
+
+- (void)finishUnmountWithResult:(NSDictionary *)result {
+  id delegate = [result objectForKey:kRequestDelegateKey];
+  if ([delegate respondsToSelector:@selector(diskImage:unmounted:)]) {
+    [delegate diskImage:self
+              unmounted:[[result objectForKey:kRequestResultKey] boolValue]];
+  }
+}
+
+@end  // PrivateMethods
+
+
 @implementation KSHDIUtilTask
 
++ (void)setLaunchPath:(NSString *)path {
+  @synchronized ([KSHDIUtilTask class]) {
+    [gHDIUtilPath autorelease];
+    gHDIUtilPath = [path copy];
+  }
+}
+
 + (id)hdiutil {
   return [[[self alloc] init] autorelease];
 }
@@ -236,7 +422,9 @@
       outputString:(NSString **)output {
 
   NSTask *task = [[[NSTask alloc] init] autorelease];
-  [task setLaunchPath:@"/usr/bin/hdiutil"];
+  @synchronized ([KSHDIUtilTask class]) {
+    [task setLaunchPath:(gHDIUtilPath ? gHDIUtilPath : @"/usr/bin/hdiutil")];
+  }
 
   if (args)
     [task setArguments:args];
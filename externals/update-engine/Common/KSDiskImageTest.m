@@ -24,10 +24,29 @@
   NSString *encryptedDmgPath_;
   NSString *slaDmgPath_;
   NSString *testMountPoint_;
+  NSString *fakeDir_;             // Holds the fake hdiutil and its log.
+  BOOL gotCallback_;              // Set by the KSDiskImageDelegate methods.
+  NSString *callbackMountPoint_;
+  BOOL callbackSuccess_;
 }
 @end
 
 
+// Returns how many times the fake hdiutil logging to |logPath| was run with
+// |verb|.
+static int CountHDIUtilRuns(NSString *logPath, NSString *verb) {
+  NSString *log = [NSString stringWithContentsOfFile:logPath];
+  int count = 0;
+  NSEnumerator *lineEnum =
+    [[log componentsSeparatedByString:@"\n"] objectEnumerator];
+  NSString *line;
+  while ((line = [lineEnum nextObject])) {
+    if ([line isEqualToString:verb]) count++;
+  }
+  return count;
+}
+
+
 @implementation KSDiskImageTest
 
 - (void)setUp {
@@ -57,6 +76,15 @@
 }
 
 - (void)tearDown {
+  [KSHDIUtilTask setLaunchPath:nil];
+  [KSDiskImage flushInfoCache];
+  if (fakeDir_) {
+    [[NSFileManager defaultManager] removeFileAtPath:fakeDir_ handler:nil];
+    [fakeDir_ release];
+    fakeDir_ = nil;
+  }
+  [callbackMountPoint_ release];
+  callbackMountPoint_ = nil;
   [[NSFileManager defaultManager] removeFileAtPath:slaDmgPath_ handler:nil];
   [basicDmgPath_ release];
   [encryptedDmgPath_ release];
@@ -142,6 +170,125 @@
   [self runMountTestsWithMountPoint:testMountPoint_ browsable:YES];
 }
 
+// Makes a fake hdiutil in fakeDir_, which logs each verb it's run with to
+// fakeDir_/log and pretends to mount at |mountPoint|, and has KSHDIUtilTask
+// run it. Returns the path of a file for it to treat as a disk image.
+- (NSString *)setUpFakeHDIUtilWithMountPoint:(NSString *)mountPoint {
+  fakeDir_ = [[NSString alloc] initWithFormat:
+              @"/tmp/KSDiskImageTest_fake_%@", [KSUUID uuidString]];
+  NSFileManager *fm = [NSFileManager defaultManager];
+  STAssertTrue([fm createDirectoryAtPath:fakeDir_ attributes:nil], nil);
+
+  NSString *logPath = [fakeDir_ stringByAppendingPathComponent:@"log"];
+  NSString *script = [NSString stringWithFormat:
+    @"#!/bin/sh\n"
+    @"echo \"$1\" >> '%@'\n"
+    @"case \"$1\" in\n"
+    @"  imageinfo)\n"
+    @"    cat > /dev/null\n"
+    @"    echo '<plist version=\"1.0\"><dict><key>Properties</key><dict>"
+    @"<key>Encrypted</key><false/>"
+    @"<key>Software License Agreement</key><false/>"
+    @"</dict></dict></plist>' ;;\n"
+    @"  attach)\n"
+    @"    echo '<plist version=\"1.0\"><dict>"
+    @"<key>system-entities</key><array><dict>"
+    @"<key>content-hint</key><string>Apple_HFS</string>"
+    @"<key>mount-point</key><string>%@</string>"
+    @"</dict></array></dict></plist>' ;;\n"
+    @"esac\n"
+    @"exit 0\n", logPath, mountPoint];
+  NSString *hdiutil = [fakeDir_ stringByAppendingPathComponent:@"hdiutil"];
+  STAssertTrue([script writeToFile:hdiutil atomically:YES], nil);
+  chmod([hdiutil fileSystemRepresentation], 0755);
+  [KSHDIUtilTask setLaunchPath:hdiutil];
+  [KSDiskImage flushInfoCache];
+
+  NSString *dmg = [fakeDir_ stringByAppendingPathComponent:@"fake.dmg"];
+  STAssertTrue([@"not really a dmg" writeToFile:dmg atomically:YES], nil);
+  return dmg;
+}
+
+- (void)testInfoIsProbedOnce {
+  NSString *dmg = [self setUpFakeHDIUtilWithMountPoint:testMountPoint_];
+  NSString *log = [fakeDir_ stringByAppendingPathComponent:@"log"];
+
+  // Everything mounting needs to know comes from one imageinfo
+  KSDiskImage *di = [KSDiskImage diskImageWithPath:dmg];
+  STAssertFalse([di isEncrypted], nil);
+  STAssertFalse([di hasLicense], nil);
+  STAssertEqualObjects([di mount:testMountPoint_],
+                       [testMountPoint_ stringByStandardizingPath], nil);
+  STAssertTrue([di unmount], nil);
+  STAssertEquals(CountHDIUtilRuns(log, @"imageinfo"), 1, nil);
+  STAssertEquals(CountHDIUtilRuns(log, @"attach"), 1, nil);
+  STAssertEquals(CountHDIUtilRuns(log, @"detach"), 1, nil);
+
+  // Other instances for the same file share it
+  KSDiskImage *di2 = [KSDiskImage diskImageWithPath:dmg];
+  STAssertFalse([di2 isEncrypted], nil);
+  STAssertEquals(CountHDIUtilRuns(log, @"imageinfo"), 1, nil);
+
+  // Changing the file means probing again
+  STAssertTrue([@"still not really a dmg" writeToFile:dmg atomically:NO], nil);
+  STAssertFalse([di2 hasLicense], nil);
+  STAssertEquals(CountHDIUtilRuns(log, @"imageinfo"), 2, nil);
+
+  [KSDiskImage flushInfoCache];
+  STAssertFalse([di isEncrypted], nil);
+  STAssertEquals(CountHDIUtilRuns(log, @"imageinfo"), 3, nil);
+}
+
+- (void)diskImage:(KSDiskImage *)diskImage
+    mountedAtPath:(NSString *)mountPoint {
+  gotCallback_ = YES;
+  [callbackMountPoint_ release];
+  callbackMountPoint_ = [mountPoint copy];
+}
+
+- (void)diskImage:(KSDiskImage *)diskImage unmounted:(BOOL)success {
+  gotCallback_ = YES;
+  callbackSuccess_ = success;
+}
+
+// Runs the run loop until a KSDiskImageDelegate method is called, or a while
+// has passed.
+- (void)waitForCallback {
+  NSDate *timeout = [NSDate dateWithTimeIntervalSinceNow:10];
+  while (!gotCallback_ && [timeout timeIntervalSinceNow] > 0) {
+    NSDate *spin = [NSDate dateWithTimeIntervalSinceNow:0.1];
+    [[NSRunLoop currentRunLoop] runUntilDate:spin];
+  }
+  STAssertTrue(gotCallback_, nil);
+  gotCallback_ = NO;
+}
+
+- (void)testAsyncMounting {
+  NSString *dmg = [self setUpFakeHDIUtilWithMountPoint:testMountPoint_];
+  NSString *log = [fakeDir_ stringByAppendingPathComponent:@"log"];
+
+  KSDiskImage *di = [KSDiskImage diskImageWithPath:dmg];
+  [di mount:testMountPoint_ delegate:self];
+  [self waitForCallback];
+  STAssertEqualObjects(callbackMountPoint_,
+                       [testMountPoint_ stringByStandardizingPath], nil);
+  STAssertTrue([di isMounted], nil);
+
+  [di unmountWithDelegate:self];
+  [self waitForCallback];
+  STAssertTrue(callbackSuccess_, nil);
+  STAssertFalse([di isMounted], nil);
+
+  STAssertEquals(CountHDIUtilRuns(log, @"imageinfo"), 1, nil);
+  STAssertEquals(CountHDIUtilRuns(log, @"attach"), 1, nil);
+  STAssertEquals(CountHDIUtilRuns(log, @"detach"), 1, nil);
+
+  // Failures are reported too
+  [di unmountWithDelegate:self];
+  [self waitForCallback];
+  STAssertFalse(callbackSuccess_, nil);
+}
+
 - (void)testHDIUtilTaskCreation {
   KSHDIUtilTask *hdiutil = [KSHDIUtilTask hdiutil];
   STAssertNotNil(hdiutil, nil);
@@ -58,4 +58,9 @@
 // nil.
 - (KSActionProcessor *)subProcessor;
 
+// Replaces the subProcessor with |processor| (a KSParallelActionProcessor, for
+// example), and makes this action its delegate. Must be called before any
+// sub actions are enqueued. nil is ignored.
+- (void)setSubProcessor:(KSActionProcessor *)processor;
+
 @end
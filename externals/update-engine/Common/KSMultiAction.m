@@ -63,4 +63,12 @@
   return subProcessor_;
 }
 
+- (void)setSubProcessor:(KSActionProcessor *)processor {
+  if (processor == nil || processor == subProcessor_) return;
+  [subProcessor_ setDelegate:nil];
+  [subProcessor_ autorelease];
+  subProcessor_ = [processor retain];
+  [subProcessor_ setDelegate:self];
+}
+
 @end
@@ -0,0 +1,79 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#import <Foundation/Foundation.h>
+#import "KSActionProcessor.h"
+
+// KSParallelActionProcessor
+//
+// A KSActionProcessor that runs more than one KSAction at a time. The actions
+// in the queue form a dependency graph whose edges come from their
+// KSActionPipes: an action waits for every action enqueued before it that
+// writes its input pipe, or that reads or writes its output pipe. Actions
+// that share no pipes with earlier, unfinished actions are independent, and
+// up to -maxConcurrentActions of them are run at once. Pipe contents
+// therefore flow between actions exactly as they would with a
+// KSActionProcessor, and with a width of 1 the actions run in FIFO order.
+//
+// Actions are sent -performAction on the thread that starts them, as with
+// KSActionProcessor, so the concurrency comes from asynchronous actions
+// (downloads, tasks, timers) being outstanding together. Actions need no
+// changes to run here; they send -finishedProcessing:successfully: and
+// -runningAction:progress: to their processor as usual, and the delegate
+// receives the same KSActionProcessorDelegate messages, with the
+// -processor:startingAction: and -processor:finishedAction:successfully:
+// messages for independent actions interleaved.
+//
+// Actions enqueued while processing are considered when a running action
+// finishes, so an action may set up the pipes of the actions it enqueues
+// before they can start.
+//
+// Sample usage
+// ------------
+//   KSParallelActionProcessor *ap =
+//     [[KSParallelActionProcessor alloc] initWithDelegate:self];
+//   [ap setMaxConcurrentActions:8];
+//   for (NSURL *url in urls) {
+//     [ap enqueueAction:[DownloadAction actionWithURL:url]];
+//   }
+//   [ap startProcessing];
+@interface KSParallelActionProcessor : KSActionProcessor {
+ @private
+  NSMutableArray *pendingActions_;    // in enqueue order
+  NSMutableArray *runningActions_;    // in start order
+  NSMutableArray *runningProgress_;   // NSNumbers, parallel to runningActions_
+  int maxConcurrentActions_;
+  // KSActionProcessor's own state is private, so these are kept separately
+  BOOL isProcessingGraph_;
+  BOOL isStartingActions_;
+  BOOL needsStartingPass_;
+  float graphProgress_;
+  int graphActionsCompleted_;
+}
+
+// Returns the largest number of actions run at once. The default is 4.
+- (int)maxConcurrentActions;
+
+// Sets the largest number of actions run at once. Values less than 1 are
+// treated as 1.
+- (void)setMaxConcurrentActions:(int)count;
+
+// Returns the actions that are currently running, in the order they were
+// started.
+- (NSArray *)runningActions;
+
+// -actions returns the actions that have not yet started, and -currentAction
+// returns the running action that was started first.
+
+@end
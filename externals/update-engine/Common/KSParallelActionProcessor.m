@@ -0,0 +1,357 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#import "KSParallelActionProcessor.h"
+#import "KSAction.h"
+#import "KSActionPipe.h"
+#import "KSTrace.h"
+#import "GTMDefines.h"
+#import "GTMLogger.h"
+
+static const int kDefaultMaxConcurrentActions = 4;
+
+@interface KSParallelActionProcessor (PrivateMethods)
+- (void)updateProgress;
+- (void)startReadyActions;
+- (void)startReadyActionsPass;
+- (void)startAction:(KSAction *)action;
+- (void)terminateRunningActions;
+@end
+
+
+@implementation KSParallelActionProcessor
+
+- (id)initWithDelegate:(id)delegate {
+  if ((self = [super initWithDelegate:delegate])) {
+    pendingActions_ = [[NSMutableArray alloc] init];
+    runningActions_ = [[NSMutableArray alloc] init];
+    runningProgress_ = [[NSMutableArray alloc] init];
+    maxConcurrentActions_ = kDefaultMaxConcurrentActions;
+  }
+  return self;
+}
+
+- (void)dealloc {
+  // KSActionProcessor's -dealloc sends -stopProcessing, which tells the
+  // delegate; here we only need to stop the actions before releasing them
+  [self terminateRunningActions];
+  [pendingActions_ release];
+  pendingActions_ = nil;
+  [runningActions_ release];
+  runningActions_ = nil;
+  [runningProgress_ release];
+  runningProgress_ = nil;
+  [super dealloc];
+}
+
+- (int)maxConcurrentActions {
+  return maxConcurrentActions_;
+}
+
+- (void)setMaxConcurrentActions:(int)count {
+  @synchronized (self) {
+    maxConcurrentActions_ = (count < 1) ? 1 : count;
+  }
+}
+
+- (NSArray *)runningActions {
+  @synchronized (self) {
+    return [[runningActions_ copy] autorelease];
+  }
+  return nil;  // COV_NF_LINE
+}
+
+- (void)enqueueAction:(KSAction *)action {
+  if (action == nil) return;
+  @synchronized (self) {
+    [pendingActions_ addObject:action];
+    [action setProcessor:self];
+    id delegate = [self delegate];
+    if ([delegate respondsToSelector:@selector(processor:enqueuedAction:)])
+      [delegate processor:self enqueuedAction:action];
+  }
+}
+
+- (NSArray *)actions {
+  @synchronized (self) {
+    return [[pendingActions_ copy] autorelease];
+  }
+  return nil;  // COV_NF_LINE
+}
+
+- (void)startProcessing {
+  @synchronized (self) {
+    if (isProcessingGraph_)
+      return;
+
+    isProcessingGraph_ = YES;
+
+    id delegate = [self delegate];
+    if ([delegate respondsToSelector:@selector(processingStarted:)])
+      [delegate processingStarted:self];
+
+    [self startReadyActions];
+  }
+}
+
+- (void)stopProcessing {
+  @synchronized (self) {
+    isProcessingGraph_ = NO;
+
+    [self terminateRunningActions];
+
+    id delegate = [self delegate];
+    if ([delegate respondsToSelector:@selector(processingStopped:)])
+      [delegate processingStopped:self];
+  }
+}
+
+- (BOOL)isProcessing {
+  return isProcessingGraph_;
+}
+
+- (float)progress {
+  return graphProgress_;
+}
+
+- (KSAction *)currentAction {
+  @synchronized (self) {
+    if ([runningActions_ count] > 0)
+      return [[[runningActions_ objectAtIndex:0] retain] autorelease];
+  }
+  return nil;
+}
+
+- (BOOL)isRunningAction:(KSAction *)action {
+  @synchronized (self) {
+    return [runningActions_ indexOfObjectIdenticalTo:action] != NSNotFound;
+  }
+  return NO;  // COV_NF_LINE
+}
+
+- (int)actionsCompleted {
+  return graphActionsCompleted_;
+}
+
+- (NSString *)description {
+  return [NSString stringWithFormat:
+          @"<%@:%p isProcessing=%d actions=%d running=%d max=%d>",
+          [self class], self, isProcessingGraph_, [pendingActions_ count],
+          [runningActions_ count], maxConcurrentActions_];
+}
+
+@end  // KSParallelActionProcessor
+
+
+@implementation KSParallelActionProcessor (KSActionProcessorCallbacks)
+
+- (void)runningAction:(KSAction *)action progress:(float)progress {
+  @synchronized (self) {
+    NSUInteger index = [runningActions_ indexOfObjectIdenticalTo:action];
+    if (index != NSNotFound) {
+      [runningProgress_ replaceObjectAtIndex:index
+                                  withObject:[NSNumber numberWithFloat:progress]];
+      [self updateProgress];
+    }
+  }
+  id delegate = [self delegate];
+  SEL sel = @selector(processor:runningAction:progress:);
+  if ([delegate respondsToSelector:sel])
+    [delegate processor:self runningAction:action progress:progress];
+}
+
+- (void)finishedProcessing:(KSAction *)action successfully:(BOOL)wasOK {
+  @synchronized (self) {
+    NSUInteger index = [runningActions_ indexOfObjectIdenticalTo:action];
+    if (index == NSNotFound) {
+      // COV_NF_START
+      GTMLoggerError(@"finished processing %@, which was not a running action"
+                     @" (%@)", action, runningActions_);
+      return;
+      // COV_NF_END
+    }
+
+    if (KSTraceIsEnabled())
+      [KSTrace endSpanForAction:action
+                        outcome:(wasOK ? @"success" : @"failure")];
+
+    [runningProgress_ replaceObjectAtIndex:index
+                                withObject:[NSNumber numberWithFloat:1.0f]];
+    [self updateProgress];
+
+    id delegate = [self delegate];
+    SEL sel = @selector(processor:finishedAction:successfully:);
+    if ([delegate respondsToSelector:sel])
+      [delegate processor:self finishedAction:action successfully:wasOK];
+
+    // The action is done; the delegate may have changed our arrays, so look
+    // it up again before removing it
+    [[action retain] autorelease];
+    [action setProcessor:nil];
+    index = [runningActions_ indexOfObjectIdenticalTo:action];
+    if (index != NSNotFound) {
+      [runningActions_ removeObjectAtIndex:index];
+      [runningProgress_ removeObjectAtIndex:index];
+    }
+
+    graphActionsCompleted_++;
+
+    // Start whatever this action was holding up
+    if (isProcessingGraph_)
+      [self startReadyActions];
+  }
+}
+
+@end  // KSActionProcessorCallbacks
+
+
+@implementation KSParallelActionProcessor (PrivateMethods)
+
+- (void)updateProgress {
+  @synchronized (self) {
+    NSUInteger totalActions = [pendingActions_ count] + [runningActions_ count]
+                              + graphActionsCompleted_;
+    if (totalActions == 0) {
+      graphProgress_ = 0.0f;
+      return;
+    }
+
+    float done = graphActionsCompleted_;
+    NSNumber *fraction;
+    NSEnumerator *fractionEnum = [runningProgress_ objectEnumerator];
+    while ((fraction = [fractionEnum nextObject])) {
+      done += [fraction floatValue];
+    }
+
+    graphProgress_ = done / totalActions;
+    // ensures 0.0 < graphProgress_ < 1.0
+    graphProgress_ = (graphProgress_ > 1.0f) ? 1.0f : graphProgress_;
+    graphProgress_ = (graphProgress_ < 0.0f) ? 0.0f : graphProgress_;
+  }
+}
+
+// Starts actions until the width is used up or no pending action is ready,
+// then finishes processing if nothing is left. Synchronous actions finish
+// inside -performAction, which calls back here; rather than recursing once
+// per action, the nested call asks the outermost one for another pass.
+- (void)startReadyActions {
+  @synchronized (self) {
+    if (isStartingActions_) {
+      needsStartingPass_ = YES;
+      return;
+    }
+
+    isStartingActions_ = YES;
+    do {
+      needsStartingPass_ = NO;
+      [self startReadyActionsPass];
+    } while (needsStartingPass_ && isProcessingGraph_);
+    isStartingActions_ = NO;
+
+    if (isProcessingGraph_
+        && [runningActions_ count] == 0 && [pendingActions_ count] == 0) {
+      isProcessingGraph_ = NO;
+      // Tell the delegate that we're done processing
+      id delegate = [self delegate];
+      if ([delegate respondsToSelector:@selector(processingDone:)])
+        [delegate processingDone:self];
+
+      [self stopProcessing];
+    }
+  }
+}
+
+- (void)startReadyActionsPass {
+  // Walk the pending actions in enqueue order, collecting the pipes that
+  // unfinished actions read and write. An action must wait if an earlier
+  // unfinished action writes its input, or reads or writes its output.
+  NSMutableSet *readPipes = [NSMutableSet set];
+  NSMutableSet *writtenPipes = [NSMutableSet set];
+
+  KSAction *action;
+  NSEnumerator *actionEnum = [runningActions_ objectEnumerator];
+  while ((action = [actionEnum nextObject])) {
+    [readPipes addObject:[action inPipe]];
+    [writtenPipes addObject:[action outPipe]];
+  }
+
+  // Actions started below may finish and enqueue more actions before
+  // returning, so walk a snapshot
+  NSArray *candidates = [[pendingActions_ copy] autorelease];
+  actionEnum = [candidates objectEnumerator];
+  while ((action = [actionEnum nextObject])) {
+    if (!isProcessingGraph_
+        || (int)[runningActions_ count] >= maxConcurrentActions_)
+      break;
+
+    KSActionPipe *inPipe = [action inPipe];
+    KSActionPipe *outPipe = [action outPipe];
+
+    BOOL isReady = (![writtenPipes containsObject:inPipe]
+                    && ![writtenPipes containsObject:outPipe]
+                    && ![readPipes containsObject:outPipe]);
+
+    // Whether or not it starts, this action comes before any later ones
+    [readPipes addObject:inPipe];
+    [writtenPipes addObject:outPipe];
+
+    if (isReady)
+      [self startAction:action];
+  }
+}
+
+- (void)startAction:(KSAction *)action {
+  // Make sure the action we're about to run isn't already running. This
+  // would be illegal, so we'll log and scream if it happens.
+  if ([self isRunningAction:action]) {
+    // COV_NF_START
+    [self stopProcessing];
+    _GTMDevAssert(NO, @"%@ can't run %@ because it's already running!",
+                  self, action);
+    return;
+    // COV_NF_END
+  }
+
+  [runningActions_ addObject:action];
+  [runningProgress_ addObject:[NSNumber numberWithFloat:0.0f]];
+  [pendingActions_ removeObjectIdenticalTo:action];
+
+  id delegate = [self delegate];
+  if ([delegate respondsToSelector:@selector(processor:startingAction:)])
+    [delegate processor:self startingAction:action];
+
+  // Start the action
+  if (KSTraceIsEnabled())
+    [KSTrace beginSpanForAction:action parent:delegate];
+  [action performAction];
+}
+
+- (void)terminateRunningActions {
+  @synchronized (self) {
+    NSArray *actions = [[runningActions_ copy] autorelease];
+    [runningActions_ removeAllObjects];
+    [runningProgress_ removeAllObjects];
+
+    KSAction *action;
+    NSEnumerator *actionEnum = [actions objectEnumerator];
+    while ((action = [actionEnum nextObject])) {
+      [action terminateAction];
+      if (KSTraceIsEnabled())
+        [KSTrace endSpanForAction:action outcome:@"terminated"];
+      [action setProcessor:nil];
+    }
+  }
+}
+
+@end  // PrivateMethods
@@ -0,0 +1,419 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#import <SenTestingKit/SenTestingKit.h>
+#import "KSParallelActionProcessor.h"
+#import "KSAction.h"
+#import "KSActionPipe.h"
+#import "GTMLogger.h"
+
+
+@interface KSParallelActionProcessorTest : SenTestCase
+@end
+
+
+// An action that finishes after a timer fires, appending its name to the
+// contents of its input pipe and writing the result to its output pipe.
+@interface KSParallelTimerAction : KSAction {
+  NSString *name_;
+  NSTimeInterval delay_;
+  NSMutableArray *log_;  // weak
+  NSTimer *timer_;
+}
+- (id)initWithName:(NSString *)name
+             delay:(NSTimeInterval)delay
+               log:(NSMutableArray *)log;
+@end
+
+@implementation KSParallelTimerAction
+
+- (id)initWithName:(NSString *)name
+             delay:(NSTimeInterval)delay
+               log:(NSMutableArray *)log {
+  if ((self = [super init])) {
+    name_ = [name copy];
+    delay_ = delay;
+    log_ = log;
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [timer_ invalidate];
+  [timer_ release];
+  [name_ release];
+  [super dealloc];
+}
+
+- (void)performAction {
+  [log_ addObject:[@"start " stringByAppendingString:name_]];
+  timer_ = [[NSTimer scheduledTimerWithTimeInterval:delay_
+                                             target:self
+                                           selector:@selector(fire:)
+                                           userInfo:nil
+                                            repeats:NO] retain];
+}
+
+- (void)fire:(NSTimer *)timer {
+  [timer_ release];
+  timer_ = nil;
+
+  NSString *input = [[self inPipe] contents];
+  NSString *output = input ? [input stringByAppendingString:name_] : name_;
+  [[self outPipe] setContents:output];
+
+  [log_ addObject:[@"finish " stringByAppendingString:name_]];
+  [[self processor] finishedProcessing:self successfully:YES];
+}
+
+- (void)terminateAction {
+  [timer_ invalidate];
+  [timer_ release];
+  timer_ = nil;
+  [log_ addObject:[@"terminate " stringByAppendingString:name_]];
+}
+
+@end  // KSParallelTimerAction
+
+
+// A synchronous action that enqueues another one until |count| run.
+@interface KSParallelChainAction : KSAction {
+  int num_;
+  int count_;
+}
+- (id)initWithNum:(int)num count:(int)count;
+@end
+
+@implementation KSParallelChainAction
+
+- (id)initWithNum:(int)num count:(int)count {
+  if ((self = [super init])) {
+    num_ = num;
+    count_ = count;
+  }
+  return self;
+}
+
+- (void)performAction {
+  if (num_ < count_) {
+    KSAction *next = [[[KSParallelChainAction alloc] initWithNum:num_ + 1
+                                                           count:count_]
+                      autorelease];
+    [[self processor] enqueueAction:next];
+  }
+  [[self processor] finishedProcessing:self successfully:YES];
+}
+
+@end  // KSParallelChainAction
+
+
+// Delegate that records how many actions run at once, and the calls it gets.
+@interface KSParallelDelegate : NSObject {
+  int running_;
+  int maxRunning_;
+  int doneCount_;
+  NSMutableArray *calls_;
+}
+- (int)maxRunning;
+- (int)doneCount;
+- (NSArray *)calls;
+@end
+
+@implementation KSParallelDelegate
+
+- (id)init {
+  if ((self = [super init])) {
+    calls_ = [[NSMutableArray alloc] init];
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [calls_ release];
+  [super dealloc];
+}
+
+- (int)maxRunning {
+  return maxRunning_;
+}
+
+- (int)doneCount {
+  return doneCount_;
+}
+
+- (NSArray *)calls {
+  return calls_;
+}
+
+- (void)processingStarted:(KSActionProcessor *)processor {
+  [calls_ addObject:NSStringFromSelector(_cmd)];
+}
+
+- (void)processingDone:(KSActionProcessor *)processor {
+  doneCount_++;
+  [calls_ addObject:NSStringFromSelector(_cmd)];
+}
+
+- (void)processingStopped:(KSActionProcessor *)processor {
+  [calls_ addObject:NSStringFromSelector(_cmd)];
+}
+
+- (void)processor:(KSActionProcessor *)processor
+   enqueuedAction:(KSAction *)action {
+  [calls_ addObject:NSStringFromSelector(_cmd)];
+}
+
+- (void)processor:(KSActionProcessor *)processor
+   startingAction:(KSAction *)action {
+  running_++;
+  if (running_ > maxRunning_) maxRunning_ = running_;
+  [calls_ addObject:NSStringFromSelector(_cmd)];
+}
+
+- (void)processor:(KSActionProcessor *)processor
+   finishedAction:(KSAction *)action
+     successfully:(BOOL)wasOK {
+  running_--;
+  [calls_ addObject:NSStringFromSelector(_cmd)];
+}
+
+@end  // KSParallelDelegate
+
+
+@implementation KSParallelActionProcessorTest
+
+// Spins the run loop until |ap| stops processing, returning NO on timeout.
+- (BOOL)waitForProcessor:(KSActionProcessor *)ap timeout:(NSTimeInterval)timeout {
+  NSDate *giveUpDate = [NSDate dateWithTimeIntervalSinceNow:timeout];
+  while ([ap isProcessing] && [giveUpDate timeIntervalSinceNow] > 0) {
+    NSDate *quick = [NSDate dateWithTimeIntervalSinceNow:0.005];
+    [[NSRunLoop currentRunLoop] runUntilDate:quick];
+  }
+  return ![ap isProcessing];
+}
+
+- (void)testBasic {
+  KSParallelActionProcessor *ap =
+    [[[KSParallelActionProcessor alloc] init] autorelease];
+  STAssertNotNil(ap, nil);
+  STAssertEquals([ap maxConcurrentActions], 4, nil);
+
+  [ap setMaxConcurrentActions:0];
+  STAssertEquals([ap maxConcurrentActions], 1, nil);
+  [ap setMaxConcurrentActions:16];
+  STAssertEquals([ap maxConcurrentActions], 16, nil);
+
+  STAssertTrue([[ap actions] count] == 0, nil);
+  [ap enqueueAction:nil];
+  STAssertTrue([[ap actions] count] == 0, nil);
+
+  KSAction *action = [[[KSAction alloc] init] autorelease];
+  [ap enqueueAction:action];
+  STAssertTrue([[ap actions] count] == 1, nil);
+  STAssertTrue([action processor] == ap, nil);
+  STAssertFalse([action isRunning], nil);
+  STAssertNil([ap currentAction], nil);
+  STAssertTrue([[ap runningActions] count] == 0, nil);
+  STAssertTrue([[ap description] length] > 1, nil);
+}
+
+- (void)testSynchronousChain {
+  // A width of 1 runs synchronous actions in the same order, with the same
+  // delegate calls, as KSActionProcessor
+  KSParallelDelegate *parallelDelegate = [[[KSParallelDelegate alloc] init] autorelease];
+  KSParallelActionProcessor *ap =
+    [[[KSParallelActionProcessor alloc] initWithDelegate:parallelDelegate] autorelease];
+  [ap setMaxConcurrentActions:1];
+
+  KSParallelDelegate *serialDelegate = [[[KSParallelDelegate alloc] init] autorelease];
+  KSActionProcessor *serial =
+    [[[KSActionProcessor alloc] initWithDelegate:serialDelegate] autorelease];
+
+  [ap enqueueAction:[[[KSParallelChainAction alloc] initWithNum:1 count:500] autorelease]];
+  [serial enqueueAction:[[[KSParallelChainAction alloc] initWithNum:1 count:500] autorelease]];
+  [ap startProcessing];
+  [serial startProcessing];
+
+  STAssertFalse([ap isProcessing], nil);
+  STAssertEquals([ap actionsCompleted], 500, nil);
+  STAssertEqualsWithAccuracy([ap progress], 1.0f, 0.01, nil);
+  STAssertEquals([parallelDelegate doneCount], 1, nil);
+  STAssertEquals([parallelDelegate maxRunning], 1, nil);
+  STAssertEqualObjects([parallelDelegate calls], [serialDelegate calls], nil);
+
+  // with a wider processor, the same chain still runs one action at a time
+  // since each action is enqueued by the one before it
+  parallelDelegate = [[[KSParallelDelegate alloc] init] autorelease];
+  ap = [[[KSParallelActionProcessor alloc] initWithDelegate:parallelDelegate] autorelease];
+  [ap enqueueAction:[[[KSParallelChainAction alloc] initWithNum:1 count:10] autorelease]];
+  [ap startProcessing];
+  STAssertEquals([ap actionsCompleted], 10, nil);
+  STAssertEquals([parallelDelegate maxRunning], 1, nil);
+}
+
+- (void)testIndependentActionsRunConcurrently {
+  KSParallelDelegate *parallelDelegate = [[[KSParallelDelegate alloc] init] autorelease];
+  KSParallelActionProcessor *ap =
+    [[[KSParallelActionProcessor alloc] initWithDelegate:parallelDelegate] autorelease];
+  [ap setMaxConcurrentActions:3];
+
+  NSMutableArray *log = [NSMutableArray array];
+  for (int i = 0; i < 7; i++) {
+    NSString *name = [NSString stringWithFormat:@"%d", i];
+    KSAction *action = [[[KSParallelTimerAction alloc] initWithName:name
+                                                              delay:0.1
+                                                                log:log]
+                        autorelease];
+    [ap enqueueAction:action];
+  }
+
+  [ap startProcessing];
+  STAssertTrue([[ap runningActions] count] == 3, nil);
+  STAssertTrue([[ap actions] count] == 4, nil);
+  STAssertTrue([[ap currentAction] isRunning], nil);
+
+  STAssertTrue([self waitForProcessor:ap timeout:5.0], nil);
+  STAssertEquals([ap actionsCompleted], 7, nil);
+  STAssertEquals([parallelDelegate maxRunning], 3, nil);
+  STAssertEquals([parallelDelegate doneCount], 1, nil);
+  STAssertEqualsWithAccuracy([ap progress], 1.0f, 0.01, nil);
+  STAssertEqualObjects([[parallelDelegate calls] lastObject],
+                       @"processingStopped:", nil);
+}
+
+- (void)testPipeDependencies {
+  KSParallelDelegate *parallelDelegate = [[[KSParallelDelegate alloc] init] autorelease];
+  KSParallelActionProcessor *ap =
+    [[[KSParallelActionProcessor alloc] initWithDelegate:parallelDelegate] autorelease];
+  [ap setMaxConcurrentActions:8];
+
+  // a -> b -> c is a pipeline; x is independent; y reads a's output too, and
+  // z writes the pipe b reads from, so z must wait for b to read it
+  NSMutableArray *log = [NSMutableArray array];
+  KSAction *a = [[[KSParallelTimerAction alloc] initWithName:@"a" delay:0.1 log:log] autorelease];
+  KSAction *b = [[[KSParallelTimerAction alloc] initWithName:@"b" delay:0.1 log:log] autorelease];
+  KSAction *c = [[[KSParallelTimerAction alloc] initWithName:@"c" delay:0.1 log:log] autorelease];
+  KSAction *x = [[[KSParallelTimerAction alloc] initWithName:@"x" delay:0.05 log:log] autorelease];
+  KSAction *y = [[[KSParallelTimerAction alloc] initWithName:@"y" delay:0.05 log:log] autorelease];
+  KSAction *z = [[[KSParallelTimerAction alloc] initWithName:@"z" delay:0.05 log:log] autorelease];
+
+  [KSActionPipe bondFrom:a to:b];
+  [KSActionPipe bondFrom:b to:c];
+  [y setInPipe:[a outPipe]];
+  [z setOutPipe:[a outPipe]];
+
+  NSEnumerator *actionEnum = [[NSArray arrayWithObjects:a, b, c, x, y, z, nil]
+                              objectEnumerator];
+  KSAction *action;
+  while ((action = [actionEnum nextObject])) {
+    [ap enqueueAction:action];
+  }
+
+  [ap startProcessing];
+  NSArray *running = [ap runningActions];
+  STAssertTrue([running count] == 2, @"running: %@", running);
+  STAssertTrue([running containsObject:a], nil);
+  STAssertTrue([running containsObject:x], nil);
+
+  STAssertTrue([self waitForProcessor:ap timeout:5.0], nil);
+  STAssertEquals([ap actionsCompleted], 6, nil);
+
+  STAssertEqualObjects([[c outPipe] contents], @"abc", nil);
+  STAssertEqualObjects([[y outPipe] contents], @"ay", nil);
+
+  // b and y both read a's output before z replaced it
+  NSUInteger finishA = [log indexOfObject:@"finish a"];
+  NSUInteger startB = [log indexOfObject:@"start b"];
+  NSUInteger startY = [log indexOfObject:@"start y"];
+  NSUInteger startZ = [log indexOfObject:@"start z"];
+  NSUInteger finishY = [log indexOfObject:@"finish y"];
+  STAssertTrue(finishA < startB, @"%@", log);
+  STAssertTrue(finishA < startY, @"%@", log);
+  STAssertTrue(startB < startZ, @"%@", log);
+  STAssertTrue(finishY < startZ, @"%@", log);
+  STAssertEqualObjects([[a outPipe] contents], @"z", nil);
+}
+
+- (void)testStopProcessing {
+  KSParallelDelegate *parallelDelegate = [[[KSParallelDelegate alloc] init] autorelease];
+  KSParallelActionProcessor *ap =
+    [[[KSParallelActionProcessor alloc] initWithDelegate:parallelDelegate] autorelease];
+
+  NSMutableArray *log = [NSMutableArray array];
+  KSAction *a = [[[KSParallelTimerAction alloc] initWithName:@"a" delay:5.0 log:log] autorelease];
+  KSAction *b = [[[KSParallelTimerAction alloc] initWithName:@"b" delay:5.0 log:log] autorelease];
+  [ap enqueueAction:a];
+  [ap enqueueAction:b];
+  [ap startProcessing];
+  STAssertTrue([a isRunning], nil);
+  STAssertTrue([b isRunning], nil);
+
+  [ap stopProcessing];
+  STAssertFalse([ap isProcessing], nil);
+  STAssertFalse([a isRunning], nil);
+  STAssertNil([a processor], nil);
+  STAssertTrue([log containsObject:@"terminate a"], nil);
+  STAssertTrue([log containsObject:@"terminate b"], nil);
+  STAssertEquals([parallelDelegate doneCount], 0, nil);
+  STAssertEquals([ap actionsCompleted], 0, nil);
+}
+
+// Runs 1 to 64 independent timer actions through a KSActionProcessor and
+// through KSParallelActionProcessors of a few widths, and logs the times.
+- (void)testScaling {
+  const NSTimeInterval kActionDelay = 0.02;
+  int widths[] = { 4, 16, 64 };
+  int numberOfWidths = sizeof(widths) / sizeof(widths[0]);
+
+  for (int count = 1; count <= 64; count *= 2) {
+    NSMutableString *result = [NSMutableString stringWithFormat:
+                               @"%2d actions:", count];
+
+    for (int w = -1; w < numberOfWidths; w++) {
+      KSActionProcessor *ap;
+      if (w < 0) {
+        ap = [[[KSActionProcessor alloc] init] autorelease];
+      } else {
+        KSParallelActionProcessor *pap =
+          [[[KSParallelActionProcessor alloc] init] autorelease];
+        [pap setMaxConcurrentActions:widths[w]];
+        ap = pap;
+      }
+
+      NSMutableArray *log = [NSMutableArray array];
+      for (int i = 0; i < count; i++) {
+        KSAction *action = [[[KSParallelTimerAction alloc] initWithName:@"t"
+                                                                  delay:kActionDelay
+                                                                    log:log]
+                            autorelease];
+        [ap enqueueAction:action];
+      }
+
+      NSDate *startDate = [NSDate date];
+      [ap startProcessing];
+      STAssertTrue([self waitForProcessor:ap timeout:10.0], nil);
+      NSTimeInterval elapsed = -[startDate timeIntervalSinceNow];
+      STAssertEquals([ap actionsCompleted], count, nil);
+
+      if (w < 0) {
+        [result appendFormat:@"  serial %6.3fs", elapsed];
+      } else {
+        [result appendFormat:@"  width %2d %6.3fs", widths[w], elapsed];
+      }
+    }
+    GTMLoggerInfo(@"%@", result);
+  }
+}
+
+@end
@@ -0,0 +1,82 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#import <Foundation/Foundation.h>
+
+@class KSAction;
+
+// Set while tracing; use KSTraceIsEnabled() rather than reading it directly.
+extern BOOL gKSTraceIsEnabled;
+
+// Returns YES if spans are being recorded. Callers should check this before
+// gathering anything for a span, so that tracing costs a single load when
+// it's off.
+static inline BOOL KSTraceIsEnabled(void) {
+  return gKSTraceIsEnabled;
+}
+
+// KSTrace
+//
+// Records nested, timed spans of work for profiling, and writes them out in
+// the Chrome trace-event JSON format, which chrome://tracing can load.
+//
+// A span belongs to an object (an action, say) and lasts from
+// +beginSpanForObject:name:parent: until +endSpanForObject:arguments:. Its
+// parent is the span of another object that is open when it begins, so
+// spans nest even when the work is asynchronous. Each span records its start
+// on the monotonic clock, its duration, the thread that began it, and the
+// arguments given when it ends, such as a product ID, URL or byte count. An
+// object may only have one open span at a time.
+//
+// KSActionProcessor records a span for every action it runs, whose parent is
+// the processor's delegate; actions that run a sub-processor (such as
+// KSMultiAction and KSCompositeAction subclasses) are that delegate, so their
+// sub-actions nest inside them. Actions describe themselves with
+// -[KSAction traceArguments].
+//
+// All methods are thread safe. Spans begun or ended while tracing is off are
+// ignored.
+//
+// Sample usage
+// ------------
+//   [KSTrace startTracing];
+//   ... run an action processor ...
+//   NSData *json = [KSTrace stopTracing];
+//   [json writeToFile:@"/tmp/update.json" atomically:YES];
+@interface KSTrace : NSObject
+
+// Discards any spans recorded so far and starts recording.
++ (void)startTracing;
+
+// Stops recording and returns the spans recorded since +startTracing as
+// trace-event JSON, or nil if tracing wasn't on. Spans that are still open
+// are ended now, with an "unfinished" argument.
++ (NSData *)stopTracing;
+
+// Begins a span named |name| for |object|. |parent| may be nil, or an object
+// whose span is open.
++ (void)beginSpanForObject:(id)object name:(NSString *)name parent:(id)parent;
+
+// Ends |object|'s span, recording |args|, whose values should be strings or
+// numbers. Does nothing if |object| has no open span.
++ (void)endSpanForObject:(id)object arguments:(NSDictionary *)args;
+
+// Begins a span for |action|, named after its class.
++ (void)beginSpanForAction:(KSAction *)action parent:(id)parent;
+
+// Ends |action|'s span with its -traceArguments and an "outcome" argument
+// of |outcome| (such as "success", "failure" or "terminated").
++ (void)endSpanForAction:(KSAction *)action outcome:(NSString *)outcome;
+
+@end
@@ -0,0 +1,228 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#import "KSTrace.h"
+#import "KSAction.h"
+#import <mach/mach_time.h>
+#import <pthread.h>
+#import <unistd.h>
+
+BOOL gKSTraceIsEnabled = NO;
+
+// Guarded by @synchronized ([KSTrace class]).
+static CFMutableDictionaryRef gOpenSpans = NULL;  // object -> KSTraceSpan
+static NSMutableArray *gFinishedSpans = nil;
+static unsigned long gLastSpanID = 0;
+static uint64_t gTraceStart = 0;
+
+
+// One span, open or finished. Times are mach_absolute_time() units.
+@interface KSTraceSpan : NSObject {
+ @public
+  NSString *name_;
+  unsigned long spanID_;
+  unsigned long parentID_;  // 0 for none
+  unsigned int threadID_;
+  uint64_t start_;
+  uint64_t end_;
+  NSDictionary *args_;
+}
+@end
+
+@implementation KSTraceSpan
+
+- (void)dealloc {
+  [name_ release];
+  [args_ release];
+  [super dealloc];
+}
+
+@end
+
+
+// Converts mach_absolute_time() units to microseconds.
+static double MicrosecondsFromTicks(uint64_t ticks) {
+  static mach_timebase_info_data_t timebase;
+  if (timebase.denom == 0) mach_timebase_info(&timebase);
+  return (double)ticks * timebase.numer / timebase.denom / 1000.0;
+}
+
+// Appends |string| to |json| as a quoted, escaped JSON string.
+static void AppendJSONString(NSMutableString *json, NSString *string) {
+  [json appendString:@"\""];
+  NSUInteger length = [string length];
+  for (NSUInteger i = 0; i < length; i++) {
+    unichar c = [string characterAtIndex:i];
+    if (c == '"' || c == '\\') {
+      [json appendFormat:@"\\%C", c];
+    } else if (c < 0x20) {
+      [json appendFormat:@"\\u%04x", c];
+    } else {
+      [json appendFormat:@"%C", c];
+    }
+  }
+  [json appendString:@"\""];
+}
+
+// Appends |span| to |json| as a complete ("X") trace event.
+static void AppendSpanEvent(NSMutableString *json, KSTraceSpan *span,
+                            int pid) {
+  [json appendString:@"{\"name\":"];
+  AppendJSONString(json, span->name_);
+  [json appendFormat:@",\"cat\":\"update\",\"ph\":\"X\",\"pid\":%d,"
+                     @"\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,"
+                     @"\"args\":{\"span\":%lu,\"parent\":%lu",
+   pid, span->threadID_,
+   MicrosecondsFromTicks(span->start_ - gTraceStart),
+   MicrosecondsFromTicks(span->end_ - span->start_),
+   span->spanID_, span->parentID_];
+
+  NSEnumerator *keyEnum = [span->args_ keyEnumerator];
+  id key;
+  while ((key = [keyEnum nextObject])) {
+    id value = [span->args_ objectForKey:key];
+    [json appendString:@","];
+    AppendJSONString(json, [key description]);
+    [json appendString:@":"];
+    if ([value isKindOfClass:[NSNumber class]]) {
+      [json appendString:[value stringValue]];
+    } else {
+      AppendJSONString(json, [value description]);
+    }
+  }
+  [json appendString:@"}}"];
+}
+
+
+@implementation KSTrace
+
++ (void)startTracing {
+  @synchronized ([KSTrace class]) {
+    if (gOpenSpans == NULL) {
+      gOpenSpans = CFDictionaryCreateMutable(NULL, 0, NULL,
+                                             &kCFTypeDictionaryValueCallBacks);
+    }
+    CFDictionaryRemoveAllValues(gOpenSpans);
+    [gFinishedSpans release];
+    gFinishedSpans = [[NSMutableArray alloc] init];
+    gLastSpanID = 0;
+    gTraceStart = mach_absolute_time();
+    gKSTraceIsEnabled = YES;
+  }
+}
+
++ (NSData *)stopTracing {
+  @synchronized ([KSTrace class]) {
+    if (!gKSTraceIsEnabled) return nil;
+    gKSTraceIsEnabled = NO;
+
+    // Close whatever is still open, so it shows up at all
+    uint64_t now = mach_absolute_time();
+    NSDictionary *unfinished =
+      [NSDictionary dictionaryWithObject:[NSNumber numberWithBool:YES]
+                                  forKey:@"unfinished"];
+    CFIndex count = CFDictionaryGetCount(gOpenSpans);
+    if (count > 0) {
+      KSTraceSpan **spans = malloc(count * sizeof(KSTraceSpan *));
+      CFDictionaryGetKeysAndValues(gOpenSpans, NULL, (const void **)spans);
+      for (CFIndex i = 0; i < count; i++) {
+        spans[i]->end_ = now;
+        spans[i]->args_ = [unfinished retain];
+        [gFinishedSpans addObject:spans[i]];
+      }
+      free(spans);
+      CFDictionaryRemoveAllValues(gOpenSpans);
+    }
+
+    int pid = getpid();
+    NSMutableString *json = [NSMutableString stringWithString:
+                             @"{\"displayTimeUnit\":\"ms\",\"traceEvents\":["];
+    NSEnumerator *spanEnum = [gFinishedSpans objectEnumerator];
+    KSTraceSpan *span;
+    BOOL first = YES;
+    while ((span = [spanEnum nextObject])) {
+      if (!first) [json appendString:@",\n"];
+      first = NO;
+      AppendSpanEvent(json, span, pid);
+    }
+    [json appendString:@"]}\n"];
+
+    [gFinishedSpans release];
+    gFinishedSpans = nil;
+
+    return [json dataUsingEncoding:NSUTF8StringEncoding];
+  }
+  return nil;  // COV_NF_LINE
+}
+
++ (void)beginSpanForObject:(id)object name:(NSString *)name parent:(id)parent {
+  if (!KSTraceIsEnabled() || object == nil) return;
+
+  uint64_t start = mach_absolute_time();
+  unsigned int threadID = pthread_mach_thread_np(pthread_self());
+
+  @synchronized ([KSTrace class]) {
+    if (!gKSTraceIsEnabled) return;
+
+    KSTraceSpan *span = [[KSTraceSpan alloc] init];
+    span->name_ = [name copy];
+    span->spanID_ = ++gLastSpanID;
+    span->threadID_ = threadID;
+    span->start_ = start;
+    if (parent) {
+      KSTraceSpan *parentSpan =
+        (KSTraceSpan *)CFDictionaryGetValue(gOpenSpans, parent);
+      if (parentSpan) span->parentID_ = parentSpan->spanID_;
+    }
+    CFDictionarySetValue(gOpenSpans, object, span);
+    [span release];
+  }
+}
+
++ (void)endSpanForObject:(id)object arguments:(NSDictionary *)args {
+  if (!KSTraceIsEnabled() || object == nil) return;
+
+  uint64_t end = mach_absolute_time();
+
+  @synchronized ([KSTrace class]) {
+    if (!gKSTraceIsEnabled) return;
+
+    KSTraceSpan *span =
+      (KSTraceSpan *)CFDictionaryGetValue(gOpenSpans, object);
+    if (span == nil) return;
+
+    span->end_ = end;
+    span->args_ = [args copy];
+    [gFinishedSpans addObject:span];
+    CFDictionaryRemoveValue(gOpenSpans, object);
+  }
+}
+
++ (void)beginSpanForAction:(KSAction *)action parent:(id)parent {
+  if (!KSTraceIsEnabled()) return;
+  [self beginSpanForObject:action
+                      name:NSStringFromClass([action class])
+                    parent:parent];
+}
+
++ (void)endSpanForAction:(KSAction *)action outcome:(NSString *)outcome {
+  if (!KSTraceIsEnabled()) return;
+  NSMutableDictionary *args = [NSMutableDictionary dictionary];
+  NSDictionary *actionArgs = [action traceArguments];
+  if (actionArgs) [args addEntriesFromDictionary:actionArgs];
+  if (outcome) [args setObject:outcome forKey:@"outcome"];
+  [self endSpanForObject:action arguments:args];
+}
+
+@end
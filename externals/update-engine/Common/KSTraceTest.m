@@ -0,0 +1,179 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#import <SenTestingKit/SenTestingKit.h>
+#import "KSTrace.h"
+#import "KSAction.h"
+#import "KSActionProcessor.h"
+#import "KSCompositeAction.h"
+#import "GTMLogger.h"
+
+
+@interface KSTraceTest : SenTestCase
+@end
+
+
+// Synchronous action that describes itself for traces.
+@interface TraceTestAction : KSAction
+@end
+
+@implementation TraceTestAction
+
+- (void)performAction {
+  [[self processor] finishedProcessing:self successfully:YES];
+}
+
+- (NSDictionary *)traceArguments {
+  return [NSDictionary dictionaryWithObject:@"com.google.test"
+                                     forKey:@"productID"];
+}
+
+@end  // TraceTestAction
+
+
+// Returns the trace recorded since +startTracing as a string.
+static NSString *StopTracing(void) {
+  NSData *data = [KSTrace stopTracing];
+  if (data == nil) return nil;
+  return [[[NSString alloc] initWithData:data
+                                encoding:NSUTF8StringEncoding] autorelease];
+}
+
+// Returns the number of times |substring| occurs in |string|.
+static int CountOccurrences(NSString *string, NSString *substring) {
+  return [[string componentsSeparatedByString:substring] count] - 1;
+}
+
+
+@implementation KSTraceTest
+
+- (void)tearDown {
+  // Don't leave tracing on for other tests
+  [KSTrace stopTracing];
+}
+
+- (void)testDisabled {
+  STAssertFalse(KSTraceIsEnabled(), nil);
+  STAssertNil([KSTrace stopTracing], nil);
+
+  // Spans while tracing is off are dropped
+  NSObject *obj = [[[NSObject alloc] init] autorelease];
+  [KSTrace beginSpanForObject:obj name:@"off" parent:nil];
+  [KSTrace startTracing];
+  STAssertTrue(KSTraceIsEnabled(), nil);
+  [KSTrace endSpanForObject:obj arguments:nil];
+  NSString *trace = StopTracing();
+  STAssertFalse(KSTraceIsEnabled(), nil);
+  STAssertNotNil(trace, nil);
+  STAssertTrue([trace hasPrefix:@"{\"displayTimeUnit\":\"ms\","
+                                @"\"traceEvents\":[]}"], trace);
+}
+
+- (void)testNestedSpans {
+  NSObject *parent = [[[NSObject alloc] init] autorelease];
+  NSObject *child = [[[NSObject alloc] init] autorelease];
+
+  [KSTrace startTracing];
+  [KSTrace beginSpanForObject:parent name:@"parent" parent:nil];
+  [KSTrace beginSpanForObject:child name:@"child" parent:parent];
+  NSDictionary *args = [NSDictionary dictionaryWithObjectsAndKeys:
+                        @"http://example.com/\"q\"", @"url",
+                        [NSNumber numberWithInt:1234], @"bytes",
+                        nil];
+  [KSTrace endSpanForObject:child arguments:args];
+  [KSTrace endSpanForObject:parent arguments:nil];
+
+  // Ending a span twice, or one that was never begun, does nothing
+  [KSTrace endSpanForObject:child arguments:nil];
+  [KSTrace endSpanForObject:self arguments:nil];
+
+  NSString *trace = StopTracing();
+  STAssertEquals(CountOccurrences(trace, @"\"ph\":\"X\""), 2, trace);
+  STAssertTrue([trace rangeOfString:
+                @"\"name\":\"parent\""].location != NSNotFound, trace);
+  STAssertTrue([trace rangeOfString:
+                @"\"args\":{\"span\":1,\"parent\":0}"].location != NSNotFound,
+               trace);
+  STAssertTrue([trace rangeOfString:
+                @"\"span\":2,\"parent\":1"].location != NSNotFound, trace);
+  STAssertTrue([trace rangeOfString:
+                @"\"bytes\":1234"].location != NSNotFound, trace);
+  STAssertTrue([trace rangeOfString:
+                @"\"url\":\"http://example.com/\\\"q\\\"\""].location
+                != NSNotFound, trace);
+}
+
+- (void)testUnfinishedSpans {
+  NSObject *obj = [[[NSObject alloc] init] autorelease];
+  [KSTrace startTracing];
+  [KSTrace beginSpanForObject:obj name:@"open" parent:nil];
+  NSString *trace = StopTracing();
+  STAssertTrue([trace rangeOfString:
+                @"\"unfinished\":1"].location != NSNotFound, trace);
+
+  // Starting again discards the old spans
+  [KSTrace startTracing];
+  trace = StopTracing();
+  STAssertEquals(CountOccurrences(trace, @"\"ph\":\"X\""), 0, trace);
+}
+
+- (void)testActionProcessorSpans {
+  NSArray *actions = [NSArray arrayWithObjects:
+                      [[[TraceTestAction alloc] init] autorelease],
+                      [[[TraceTestAction alloc] init] autorelease],
+                      nil];
+  KSCompositeAction *composite =
+    [KSCompositeAction actionWithActions:actions];
+  KSActionProcessor *ap = [[[KSActionProcessor alloc] init] autorelease];
+  [ap enqueueAction:composite];
+
+  [KSTrace startTracing];
+  [ap startProcessing];
+  NSString *trace = StopTracing();
+
+  // The composite has no parent, and its sub-actions nest inside it
+  STAssertEquals(CountOccurrences(trace, @"\"ph\":\"X\""), 3, trace);
+  STAssertEquals(CountOccurrences(trace, @"\"name\":\"KSCompositeAction\""),
+                 1, trace);
+  STAssertEquals(CountOccurrences(trace, @"\"name\":\"TraceTestAction\""),
+                 2, trace);
+  STAssertEquals(CountOccurrences(trace, @"\"parent\":1,"), 2, trace);
+  STAssertEquals(CountOccurrences(trace, @"\"productID\":\"com.google.test\""),
+                 2, trace);
+  STAssertEquals(CountOccurrences(trace, @"\"outcome\":\"success\""),
+                 3, trace);
+}
+
+- (void)testOverhead {
+  // Not a pass/fail test; logs what tracing adds to running actions. The
+  // actions are synchronous, so each one nests a little deeper in the stack.
+  const int kActions = 1000;
+  for (int pass = 0; pass < 2; pass++) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    KSActionProcessor *ap = [[[KSActionProcessor alloc] init] autorelease];
+    for (int i = 0; i < kActions; i++) {
+      [ap enqueueAction:[[[TraceTestAction alloc] init] autorelease]];
+    }
+    if (pass == 1) [KSTrace startTracing];
+    NSDate *start = [NSDate date];
+    [ap startProcessing];
+    NSTimeInterval elapsed = -[start timeIntervalSinceNow];
+    NSData *trace = [KSTrace stopTracing];
+    GTMLoggerInfo(@"%d actions with tracing %s: %.3fs (%u bytes of trace)",
+                  kActions, (pass ? "on" : "off"), elapsed, [trace length]);
+    [pool release];
+  }
+}
+
+@end
@@ -34,4 +34,24 @@
 //
 - (NSData *)SHA1Hash;
 
+// Generate an SHA-256 hash for the supplied data.
+//
+//  Returns:
+//    Autoreleased NSData of the hash
+//
+- (NSData *)SHA256Hash;
+
+// Generate the hashes of the file at |path|, reading it a chunk at a time
+// so that it never needs to fit in memory.  The SHA-1 hash is returned in
+// |sha1|, the SHA-256 hash in |sha256| and the number of bytes read in
+// |size|; any of these may be NULL if the value isn't wanted.
+//
+//  Returns:
+//    YES if the whole file was read, NO if it couldn't be
+//
++ (BOOL)getSHA1Hash:(NSData **)sha1
+         SHA256Hash:(NSData **)sha256
+               size:(unsigned long long *)size
+       ofFileAtPath:(NSString *)path;
+
 @end
@@ -15,6 +15,12 @@
 #import "NSData+Hash.h"
 
 #import <CommonCrypto/CommonDigest.h>
+#import <errno.h>
+#import <fcntl.h>
+#import <unistd.h>
+
+// Size of the reads when hashing a file.
+static const size_t kFileHashChunkSize = 1024 * 1024;
 
 @implementation NSData (KSDataHashAdditions)
 
@@ -29,4 +35,68 @@
   return [NSData dataWithBytes:hash length:sizeof(hash)];
 }
 
+- (NSData *)SHA256Hash {
+  CC_SHA256_CTX sha256Context;
+  unsigned char hash[CC_SHA256_DIGEST_LENGTH];
+
+  CC_SHA256_Init(&sha256Context);
+  CC_SHA256_Update(&sha256Context, [self bytes], [self length]);
+  CC_SHA256_Final(hash, &sha256Context);
+
+  return [NSData dataWithBytes:hash length:sizeof(hash)];
+}
+
++ (BOOL)getSHA1Hash:(NSData **)sha1
+         SHA256Hash:(NSData **)sha256
+               size:(unsigned long long *)size
+       ofFileAtPath:(NSString *)path {
+  if (path == nil) return NO;
+
+  int fd = open([path fileSystemRepresentation], O_RDONLY);
+  if (fd < 0) return NO;
+
+  // Each file is usually read just once, so keep it out of the buffer cache
+  fcntl(fd, F_NOCACHE, 1);
+
+  unsigned char *buffer = malloc(kFileHashChunkSize);
+  if (buffer == NULL) {
+    close(fd);  // COV_NF_LINE
+    return NO;  // COV_NF_LINE
+  }
+
+  CC_SHA1_CTX sha1Context;
+  CC_SHA256_CTX sha256Context;
+  CC_SHA1_Init(&sha1Context);
+  CC_SHA256_Init(&sha256Context);
+  unsigned long long total = 0;
+
+  ssize_t nread;
+  do {
+    nread = read(fd, buffer, kFileHashChunkSize);
+    if (nread > 0) {
+      if (sha1) CC_SHA1_Update(&sha1Context, buffer, (CC_LONG)nread);
+      if (sha256) CC_SHA256_Update(&sha256Context, buffer, (CC_LONG)nread);
+      total += nread;
+    }
+  } while (nread > 0 || (nread < 0 && errno == EINTR));
+
+  free(buffer);
+  close(fd);
+  if (nread < 0) return NO;
+
+  if (sha1) {
+    unsigned char hash[CC_SHA1_DIGEST_LENGTH];
+    CC_SHA1_Final(hash, &sha1Context);
+    *sha1 = [NSData dataWithBytes:hash length:sizeof(hash)];
+  }
+  if (sha256) {
+    unsigned char hash[CC_SHA256_DIGEST_LENGTH];
+    CC_SHA256_Final(hash, &sha256Context);
+    *sha256 = [NSData dataWithBytes:hash length:sizeof(hash)];
+  }
+  if (size) *size = total;
+
+  return YES;
+}
+
 @end
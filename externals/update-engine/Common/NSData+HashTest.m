@@ -45,4 +45,60 @@
 
 }  // testBasics
 
+
+- (void)testSHA256 {
+  NSData *data = [NSData data];
+  NSString *hashString = [GTMBase64 stringByEncodingData:[data SHA256Hash]];
+  STAssertEqualObjects(hashString,
+                       @"47DEQpj8HBSa+/TImW+5JCeuQeRkm5NMpJWZG3hSuFU=", nil);
+
+  data = [@"abc" dataUsingEncoding:NSUTF8StringEncoding];
+  hashString = [GTMBase64 stringByEncodingData:[data SHA256Hash]];
+  STAssertEqualObjects(hashString,
+                       @"ungWv48Bz+pBQUDeXa4iI7ADYaOWF3qctBD/YfIAFa0=", nil);
+}  // testSHA256
+
+
+- (void)testFileHashes {
+  NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:
+                    @"NSData+HashTest.data"];
+
+  // Bigger than one read, and not a multiple of its size
+  NSMutableData *data = [NSMutableData dataWithLength:(3 * 1024 * 1024 + 17)];
+  unsigned char *bytes = [data mutableBytes];
+  for (NSUInteger i = 0; i < [data length]; i++) {
+    bytes[i] = (unsigned char)(i * 31);
+  }
+  STAssertTrue([data writeToFile:path atomically:YES], nil);
+
+  NSData *sha1 = nil, *sha256 = nil;
+  unsigned long long size = 0;
+  STAssertTrue([NSData getSHA1Hash:&sha1
+                        SHA256Hash:&sha256
+                              size:&size
+                      ofFileAtPath:path], nil);
+  STAssertEqualObjects(sha1, [data SHA1Hash], nil);
+  STAssertEqualObjects(sha256, [data SHA256Hash], nil);
+  STAssertEquals(size, (unsigned long long)[data length], nil);
+
+  // Only the SHA-1
+  sha1 = nil;
+  STAssertTrue([NSData getSHA1Hash:&sha1
+                        SHA256Hash:NULL
+                              size:NULL
+                      ofFileAtPath:path], nil);
+  STAssertEqualObjects(sha1, [data SHA1Hash], nil);
+
+  [[NSFileManager defaultManager] removeItemAtPath:path error:NULL];
+
+  STAssertFalse([NSData getSHA1Hash:&sha1
+                         SHA256Hash:NULL
+                               size:NULL
+                       ofFileAtPath:path], nil);
+  STAssertFalse([NSData getSHA1Hash:&sha1
+                         SHA256Hash:NULL
+                               size:NULL
+                       ofFileAtPath:nil], nil);
+}  // testFileHashes
+
 @end  // NSData_HashTest
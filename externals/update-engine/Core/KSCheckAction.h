@@ -15,7 +15,7 @@
 #import <Foundation/Foundation.h>
 #import "KSMultiAction.h"
 
-@class KSUpdateEngine;
+@class KSFetcherFactory, KSPrefetchAction, KSUpdateEngine;
 
 // KSCheckAction
 //
@@ -48,6 +48,9 @@
 // ALL the sub-KSUpdateCheckActions fail, we do want to report that this multi-
 // action failed.
 //
+// The aggregate output lists each server's results in the order the servers'
+// checks were created, however long each check takes.
+//
 @interface KSCheckAction : KSMultiAction {
  @private
   NSArray *tickets_;
@@ -56,6 +59,10 @@
   NSDictionary *params_;
   KSUpdateEngine *engine_;
   BOOL wasSuccessful_;
+  NSMutableArray *checkers_;  // In the order they were created
+  NSMutableSet *succeededCheckers_;
+  KSPrefetchAction *prefetch_;  // Streamed to, if not nil
+  KSFetcherFactory *fetcherFactory_;
 }
 
 // Returns an autoreleased KSCheckAction. See the designated initializer for
@@ -79,6 +86,20 @@
 - (id)initWithTickets:(NSArray *)tickets params:(NSDictionary *)params;
 - (id)initWithTickets:(NSArray *)tickets;
 
+// Returns the KSPrefetchAction that updates are streamed to, or nil.
+- (KSPrefetchAction *)prefetchAction;
+
+// If |prefetch| is not nil, each server's updates are handed to its
+// -prefetchUpdates: as soon as that server's check finishes, and the checks
+// run side by side rather than one after another, so prefetching the updates
+// from quick servers doesn't have to wait for the slowest one. This action's
+// output is the same either way. Must be set before this action runs.
+- (void)setPrefetchAction:(KSPrefetchAction *)prefetch;
+
+// Sets the KSFetcherFactory the update checks fetch with. The default, nil,
+// uses +[KSFetcherFactory factory]. Useful for testing.
+- (void)setFetcherFactory:(KSFetcherFactory *)fetcherFactory;
+
 @end
 
 
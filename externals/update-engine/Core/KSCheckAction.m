@@ -17,8 +17,11 @@
 #import "KSActionConstants.h"
 #import "KSActionPipe.h"
 #import "KSActionProcessor.h"
+#import "KSExistenceEvaluator.h"
 #import "KSFrameworkStats.h"
+#import "KSParallelActionProcessor.h"
 #import "KSPlistServer.h"
+#import "KSPrefetchAction.h"
 #import "KSTicket.h"
 #import "KSTicketStore.h"
 #import "KSUpdateCheckAction.h"
@@ -56,6 +59,8 @@ static Class gServerClass;  // Weak
     engine_ = [engine retain];
     updateInfos_ = [[NSMutableArray alloc] init];
     outOfBandData_ = [[NSMutableDictionary alloc] init];
+    checkers_ = [[NSMutableArray alloc] init];
+    succeededCheckers_ = [[NSMutableSet alloc] init];
   }
   return self;
 }
@@ -74,9 +79,27 @@ static Class gServerClass;  // Weak
   [outOfBandData_ release];
   [params_ release];
   [engine_ release];
+  [checkers_ release];
+  [succeededCheckers_ release];
+  [prefetch_ release];
+  [fetcherFactory_ release];
   [super dealloc];
 }
 
+- (KSPrefetchAction *)prefetchAction {
+  return prefetch_;
+}
+
+- (void)setPrefetchAction:(KSPrefetchAction *)prefetch {
+  [prefetch_ autorelease];
+  prefetch_ = [prefetch retain];
+}
+
+- (void)setFetcherFactory:(KSFetcherFactory *)fetcherFactory {
+  [fetcherFactory_ autorelease];
+  fetcherFactory_ = [fetcherFactory retain];
+}
+
 - (void)performAction {
   NSDictionary *tixMap = [tickets_ ticketsByURL];
   if (tixMap == nil) {
@@ -86,6 +109,21 @@ static Class gServerClass;  // Weak
     return;
   }
 
+  // Run every ticket's existence check up front, as one batch, so checks
+  // shared between URLs run once and slow ones run side by side.
+  KSExistenceEvaluator *evaluator = [KSExistenceEvaluator evaluator];
+  [evaluator existingTickets:tickets_];
+
+  // When streaming, a slow server shouldn't hold up the others' results
+  if (prefetch_ && ![[self subProcessor] isKindOfClass:
+                     [KSParallelActionProcessor class]]) {
+    KSActionProcessor *parallel =
+      [[[KSParallelActionProcessor alloc] initWithDelegate:self] autorelease];
+    [self setSubProcessor:parallel];
+  }
+  [checkers_ removeAllObjects];
+  [succeededCheckers_ removeAllObjects];
+
   NSURL *url = nil;
   NSEnumerator *tixMapEnumerator = [tixMap keyEnumerator];
 
@@ -97,10 +135,7 @@ static Class gServerClass;  // Weak
     // We don't want to check for products that are currently not installed, so
     // we need to filter the array of tickets to only those ticktes whose
     // existence checker indicates that they are currently installed.
-    // NSPredicate makes this very easy.
-    NSArray *filteredTickets =
-      [tickets filteredArrayUsingPredicate:
-       [NSPredicate predicateWithFormat:@"existenceChecker.exists == YES"]];
+    NSArray *filteredTickets = [evaluator existingTickets:tickets];
 
     if ([filteredTickets count] == 0)
       continue;
@@ -116,8 +151,17 @@ static Class gServerClass;  // Weak
     KSServer *server = [[[serverClass alloc] initWithURL:url
                                                   params:params_
                                                   engine:engine_] autorelease];
-    KSAction *checker = [KSUpdateCheckAction checkerWithServer:server
-                                                       tickets:filteredTickets];
+    KSAction *checker = nil;
+    if (fetcherFactory_) {
+      checker = [[[KSUpdateCheckAction alloc]
+                  initWithFetcherFactory:fetcherFactory_
+                                  server:server
+                                 tickets:filteredTickets] autorelease];
+    } else {
+      checker = [KSUpdateCheckAction checkerWithServer:server
+                                               tickets:filteredTickets];
+    }
+    [checkers_ addObject:checker];
     [[self subProcessor] enqueueAction:checker];
   }
 
@@ -129,7 +173,7 @@ static Class gServerClass;  // Weak
 
   // Our output needs to be the aggregate of all our sub-action checkers' output
   // For now, we'll just set our output to a dictionary holding
-  // |updateInfos_| and |outOfBandData_|.  When subactions complete,
+  // |updateInfos_| and |outOfBandData_|.  When all the subactions are done,
   // we'll add their output to these two structures.
 
   [updateInfos_ removeAllObjects];
@@ -150,19 +194,15 @@ static Class gServerClass;  // Weak
      successfully:(BOOL)wasOK {
   [[KSFrameworkStats sharedStats] incrementStat:kStatChecks];
   if (wasOK) {
-    // Get the checker's output contents and append it to our own output.
-    NSDictionary *checkerOutput = [[action outPipe] contents];
-
-    NSDictionary *oobData =
-      [checkerOutput objectForKey:KSActionOutOfBandDataKey];
-    NSURL *url = [checkerOutput objectForKey:KSActionServerURLKey];
-    if (oobData && url) {
-      [outOfBandData_ setObject:oobData forKey:[url description]];
-    }
+    // The checker's output is added to our own once every checker is done,
+    // so that it comes out in the same order however the checks were run.
+    [succeededCheckers_ addObject:action];
 
+    // Hand the updates straight on, if we're streaming them
+    NSDictionary *checkerOutput = [[action outPipe] contents];
     NSArray *infos = [checkerOutput objectForKey:KSActionUpdateInfosKey];
-    if (infos) {
-      [updateInfos_ addObjectsFromArray:infos];
+    if (prefetch_ && [infos count] > 0) {
+      [prefetch_ prefetchUpdates:infos];
     }
 
     // See header comments about why this gets set to YES here.
@@ -176,9 +216,47 @@ static Class gServerClass;  // Weak
 // We tell our parent processor that we succeeded if *any* of our subactions
 // succeeded.
 - (void)processingDone:(KSActionProcessor *)processor {
+  // Append each successful checker's output contents to our own output.
+  NSEnumerator *checkerEnumerator = [checkers_ objectEnumerator];
+  KSAction *checker = nil;
+  while ((checker = [checkerEnumerator nextObject])) {
+    if (![succeededCheckers_ containsObject:checker])
+      continue;
+    NSDictionary *checkerOutput = [[checker outPipe] contents];
+
+    NSDictionary *oobData =
+      [checkerOutput objectForKey:KSActionOutOfBandDataKey];
+    NSURL *url = [checkerOutput objectForKey:KSActionServerURLKey];
+    if (oobData && url) {
+      [outOfBandData_ setObject:oobData forKey:[url description]];
+    }
+
+    NSArray *infos = [checkerOutput objectForKey:KSActionUpdateInfosKey];
+    if (infos) {
+      [updateInfos_ addObjectsFromArray:infos];
+    }
+  }
+  [checkers_ removeAllObjects];
+  [succeededCheckers_ removeAllObjects];
+
   [[self processor] finishedProcessing:self successfully:wasSuccessful_];
 }
 
+// Overridden from KSMultiAction. Streamed downloads run on the prefetch
+// action's subProcessor while we're still the current action, so stopping us
+// has to stop them too.
+- (void)terminateAction {
+  [super terminateAction];
+  [prefetch_ terminateAction];
+}
+
+- (NSDictionary *)traceArguments {
+  return [NSDictionary dictionaryWithObjectsAndKeys:
+          [NSNumber numberWithUnsignedInt:[tickets_ count]], @"tickets",
+          [NSNumber numberWithUnsignedInt:[updateInfos_ count]], @"updates",
+          nil];
+}
+
 @end
 
 
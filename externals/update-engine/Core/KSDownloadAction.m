@@ -373,6 +373,14 @@ static void MarkFileDescriptorsCloseOnExec(void) {
                    [self class], self, url_, size_, hash_];
 }
 
+- (NSDictionary *)traceArguments {
+  return [NSDictionary dictionaryWithObjectsAndKeys:
+          [url_ absoluteString], @"url",
+          [NSNumber numberWithUnsignedLongLong:size_], @"bytes",
+          path_, @"path",
+          nil];
+}
+
 @end  // KSDownloadAction
 
 
@@ -428,14 +436,16 @@ static void MarkFileDescriptorsCloseOnExec(void) {
 }
 
 // Reads in a whole file and returns the base64 encoded SHA-1 hash of the data.
-// If we start working with HUGE files, then we may need to change this method
-// to stream the data from the file and hash it w/o reading the whole thing in.
-// For now, this should work fine.
+// Streams the file through the hash, so big downloads aren't read into
+// memory all at once.
 - (NSString *)hashOfFileAtPath:(NSString *)path {
-  if (path == nil) return nil;
-
-  NSData *data = [NSData dataWithContentsOfFile:path];
-  NSData *hash = [data SHA1Hash];
+  NSData *hash = nil;
+  if (![NSData getSHA1Hash:&hash
+                SHA256Hash:NULL
+                      size:NULL
+              ofFileAtPath:path]) {
+    return nil;
+  }
 
   return [GTMBase64 stringByEncodingData:hash];
 }
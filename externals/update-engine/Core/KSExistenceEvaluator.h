@@ -0,0 +1,74 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#import <Foundation/Foundation.h>
+
+@class KSExistenceChecker;
+
+// How long, in seconds, a KSExistenceEvaluator trusts a result by default.
+#define KS_DEFAULT_EXISTENCE_TTL 30.0
+
+// KSExistenceEvaluator
+//
+// Runs the existence checks for many tickets as one batch. Checkers that
+// check the same thing (that is, are -isEqual:) are only run once; the rest
+// are run concurrently on a few worker threads, since each may block on the
+// disk, LaunchServices or a Spotlight query. Results are cached for a short
+// time, so one evaluator can answer for the same checker again and again
+// during an update run without re-checking.
+//
+// An evaluator is not thread safe; use it from one thread. The checkers
+// themselves are run on other threads, so their -exists must be thread safe,
+// as those of all the KSExistenceChecker subclasses are.
+//
+// Sample usage
+// ------------
+//   KSExistenceEvaluator *evaluator = [KSExistenceEvaluator evaluator];
+//   NSArray *installed = [evaluator existingTickets:tickets];
+@interface KSExistenceEvaluator : NSObject {
+ @private
+  NSTimeInterval ttl_;
+  int maxConcurrentChecks_;
+  CFMutableDictionaryRef results_;  // KSExistenceChecker -> result
+}
+
+// Returns an autoreleased evaluator whose results last
+// KS_DEFAULT_EXISTENCE_TTL seconds.
++ (id)evaluator;
+
+// Designated initializer. Results last |ttl| seconds; a |ttl| of 0 means
+// every check is run afresh, though checkers are still run once per batch.
+- (id)initWithTimeToLive:(NSTimeInterval)ttl;
+
+// The most checks to run at once. Defaults to twice the number of active
+// processors, since most checks wait rather than compute.
+- (int)maxConcurrentChecks;
+- (void)setMaxConcurrentChecks:(int)count;
+
+// Runs every distinct checker in |checkers| that doesn't have a current
+// result, and records the results. |checkers| may contain NSNull, which
+// never exists.
+- (void)evaluateCheckers:(NSArray *)checkers;
+
+// Returns |checker|'s current result, running it now if there is none.
+- (BOOL)exists:(KSExistenceChecker *)checker;
+
+// Returns the tickets in |tickets| whose existence checkers say they exist,
+// in the same order, running all the checks that are needed as one batch.
+- (NSArray *)existingTickets:(NSArray *)tickets;
+
+// Forgets all results.
+- (void)flush;
+
+@end
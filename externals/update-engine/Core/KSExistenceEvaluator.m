@@ -0,0 +1,240 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#import "KSExistenceEvaluator.h"
+#import "KSExistenceChecker.h"
+#import "KSTicket.h"
+
+
+// Batches smaller than this are checked on the calling thread; starting
+// threads for them would cost more than the checks.
+static const NSUInteger kMinConcurrentBatch = 16;
+
+
+// One checker's result, and when it was found.
+@interface KSExistenceResult : NSObject {
+ @public
+  BOOL exists_;
+  CFAbsoluteTime time_;
+}
+@end
+
+@implementation KSExistenceResult
+@end
+
+
+// Runs every |stride|th checker, starting at |start|, and stores each
+// result at the checker's index in |results|. The operations of one batch
+// share |checkers| and |results|, but never touch the same index.
+@interface KSExistenceCheckOperation : NSOperation {
+ @private
+  NSArray *checkers_;
+  BOOL *results_;
+  NSUInteger start_;
+  NSUInteger stride_;
+}
+
+- (id)initWithCheckers:(NSArray *)checkers
+               results:(BOOL *)results
+                 start:(NSUInteger)start
+                stride:(NSUInteger)stride;
+
+@end
+
+@implementation KSExistenceCheckOperation
+
+- (id)initWithCheckers:(NSArray *)checkers
+               results:(BOOL *)results
+                 start:(NSUInteger)start
+                stride:(NSUInteger)stride {
+  if ((self = [super init])) {
+    checkers_ = [checkers retain];
+    results_ = results;
+    start_ = start;
+    stride_ = stride;
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [checkers_ release];
+  [super dealloc];
+}
+
+- (void)main {
+  NSUInteger count = [checkers_ count];
+  for (NSUInteger i = start_; i < count; i += stride_) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    results_[i] = [[checkers_ objectAtIndex:i] exists];
+    [pool release];
+  }
+}
+
+@end
+
+
+@interface KSExistenceEvaluator (PrivateMethods)
+
+// Returns |checker|'s result if there is one younger than ttl_, else nil.
+- (KSExistenceResult *)currentResultForChecker:(KSExistenceChecker *)checker
+                                           now:(CFAbsoluteTime)now;
+
+@end
+
+
+@implementation KSExistenceEvaluator
+
++ (id)evaluator {
+  return [[[self alloc] init] autorelease];
+}
+
+- (id)init {
+  return [self initWithTimeToLive:KS_DEFAULT_EXISTENCE_TTL];
+}
+
+- (id)initWithTimeToLive:(NSTimeInterval)ttl {
+  if ((self = [super init])) {
+    ttl_ = ttl;
+    maxConcurrentChecks_ =
+      2 * [[NSProcessInfo processInfo] activeProcessorCount];
+    // The standard callbacks compare keys with -isEqual: and -hash, and
+    // unlike NSMutableDictionary don't need the checkers to support NSCopying.
+    results_ = CFDictionaryCreateMutable(NULL, 0,
+                                         &kCFTypeDictionaryKeyCallBacks,
+                                         &kCFTypeDictionaryValueCallBacks);
+  }
+  return self;
+}
+
+- (void)dealloc {
+  if (results_) CFRelease(results_);
+  [super dealloc];
+}
+
+- (int)maxConcurrentChecks {
+  return maxConcurrentChecks_;
+}
+
+- (void)setMaxConcurrentChecks:(int)count {
+  maxConcurrentChecks_ = (count > 0) ? count : 1;
+}
+
+- (void)evaluateCheckers:(NSArray *)checkers {
+  CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+
+  // Collect the distinct checkers that need running
+  NSMutableSet *seen = [NSMutableSet set];
+  NSMutableArray *pending = [NSMutableArray array];
+  NSEnumerator *checkerEnum = [checkers objectEnumerator];
+  id checker;
+  while ((checker = [checkerEnum nextObject])) {
+    if (![checker isKindOfClass:[KSExistenceChecker class]]) continue;
+    if ([seen containsObject:checker]) continue;
+    [seen addObject:checker];
+    if ([self currentResultForChecker:checker now:now] == nil) {
+      [pending addObject:checker];
+    }
+  }
+
+  NSUInteger count = [pending count];
+  if (count == 0) return;
+
+  BOOL *exists = calloc(count, sizeof(BOOL));
+  if (exists == NULL) return;  // COV_NF_LINE
+
+  NSUInteger jobs = maxConcurrentChecks_;
+  if (count < kMinConcurrentBatch) jobs = 1;
+  if (jobs > count) jobs = count;
+
+  if (jobs == 1) {
+    KSExistenceCheckOperation *op =
+      [[[KSExistenceCheckOperation alloc] initWithCheckers:pending
+                                                   results:exists
+                                                     start:0
+                                                    stride:1] autorelease];
+    [op main];
+  } else {
+    NSOperationQueue *queue = [[[NSOperationQueue alloc] init] autorelease];
+    [queue setMaxConcurrentOperationCount:jobs];
+    for (NSUInteger i = 0; i < jobs; i++) {
+      KSExistenceCheckOperation *op =
+        [[[KSExistenceCheckOperation alloc] initWithCheckers:pending
+                                                     results:exists
+                                                       start:i
+                                                      stride:jobs]
+          autorelease];
+      [queue addOperation:op];
+    }
+    [queue waitUntilAllOperationsAreFinished];
+  }
+
+  // Results are stamped with when the batch finished, so slow checks don't
+  // come back already stale.
+  now = CFAbsoluteTimeGetCurrent();
+  for (NSUInteger i = 0; i < count; i++) {
+    KSExistenceResult *result = [[KSExistenceResult alloc] init];
+    result->exists_ = exists[i];
+    result->time_ = now;
+    CFDictionarySetValue(results_, [pending objectAtIndex:i], result);
+    [result release];
+  }
+  free(exists);
+}
+
+- (BOOL)exists:(KSExistenceChecker *)checker {
+  if (checker == nil) return NO;
+  KSExistenceResult *result =
+    [self currentResultForChecker:checker now:CFAbsoluteTimeGetCurrent()];
+  if (result == nil) {
+    [self evaluateCheckers:[NSArray arrayWithObject:checker]];
+    result = (KSExistenceResult *)CFDictionaryGetValue(results_, checker);
+  }
+  return result ? result->exists_ : NO;
+}
+
+- (NSArray *)existingTickets:(NSArray *)tickets {
+  // -valueForKey: gives NSNull for tickets without a checker
+  [self evaluateCheckers:[tickets valueForKey:@"existenceChecker"]];
+
+  NSMutableArray *existing = [NSMutableArray arrayWithCapacity:[tickets count]];
+  NSEnumerator *ticketEnum = [tickets objectEnumerator];
+  KSTicket *ticket;
+  while ((ticket = [ticketEnum nextObject])) {
+    KSExistenceChecker *checker = [ticket existenceChecker];
+    if (checker == nil) continue;
+    KSExistenceResult *result =
+      (KSExistenceResult *)CFDictionaryGetValue(results_, checker);
+    if (result && result->exists_) [existing addObject:ticket];
+  }
+  return existing;
+}
+
+- (void)flush {
+  CFDictionaryRemoveAllValues(results_);
+}
+
+@end
+
+
+@implementation KSExistenceEvaluator (PrivateMethods)
+
+- (KSExistenceResult *)currentResultForChecker:(KSExistenceChecker *)checker
+                                           now:(CFAbsoluteTime)now {
+  KSExistenceResult *result =
+    (KSExistenceResult *)CFDictionaryGetValue(results_, checker);
+  if (result == nil || now - result->time_ >= ttl_) return nil;
+  return result;
+}
+
+@end
@@ -0,0 +1,206 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#import <SenTestingKit/SenTestingKit.h>
+#import <libkern/OSAtomic.h>
+#import "KSExistenceEvaluator.h"
+#import "KSExistenceChecker.h"
+#import "KSTicket.h"
+#import "GTMLogger.h"
+
+
+@interface KSExistenceEvaluatorTest : SenTestCase
+@end
+
+
+// Number of times any CountingChecker has been run.
+static volatile int32_t gCheckCount = 0;
+
+// Existence checker that counts its runs, and exists if its name starts
+// with "yes".
+@interface CountingChecker : KSExistenceChecker {
+ @private
+  NSString *name_;
+}
++ (id)checkerWithName:(NSString *)name;
+@end
+
+@implementation CountingChecker
+
++ (id)checkerWithName:(NSString *)name {
+  CountingChecker *checker = [[[self alloc] init] autorelease];
+  checker->name_ = [name copy];
+  return checker;
+}
+
+- (void)dealloc {
+  [name_ release];
+  [super dealloc];
+}
+
+- (NSUInteger)hash {
+  return [name_ hash];
+}
+
+- (BOOL)isEqual:(id)other {
+  if (![other isKindOfClass:[CountingChecker class]]) return NO;
+  return [name_ isEqualToString:((CountingChecker *)other)->name_];
+}
+
+- (BOOL)exists {
+  OSAtomicIncrement32(&gCheckCount);
+  return [name_ hasPrefix:@"yes"];
+}
+
+@end  // CountingChecker
+
+
+// Returns a ticket for |productID| with |checker|.
+static KSTicket *TicketWithChecker(NSString *productID,
+                                   KSExistenceChecker *checker) {
+  NSURL *url = [NSURL URLWithString:@"https://www.google.com/check"];
+  return [KSTicket ticketWithProductID:productID
+                               version:@"1.0"
+                      existenceChecker:checker
+                             serverURL:url];
+}
+
+
+@implementation KSExistenceEvaluatorTest
+
+- (void)setUp {
+  gCheckCount = 0;
+}
+
+- (void)testCreation {
+  KSExistenceEvaluator *evaluator = [KSExistenceEvaluator evaluator];
+  STAssertNotNil(evaluator, nil);
+  STAssertTrue([evaluator maxConcurrentChecks] > 0, nil);
+  [evaluator setMaxConcurrentChecks:0];
+  STAssertEquals([evaluator maxConcurrentChecks], 1, nil);
+
+  STAssertFalse([evaluator exists:nil], nil);
+  STAssertTrue([[evaluator existingTickets:nil] count] == 0, nil);
+  [evaluator evaluateCheckers:nil];
+}
+
+- (void)testDuplicatesRunOnce {
+  KSExistenceEvaluator *evaluator = [KSExistenceEvaluator evaluator];
+  NSArray *checkers = [NSArray arrayWithObjects:
+                       [CountingChecker checkerWithName:@"yes1"],
+                       [CountingChecker checkerWithName:@"no1"],
+                       [CountingChecker checkerWithName:@"yes1"],
+                       [CountingChecker checkerWithName:@"no1"],
+                       [NSNull null],
+                       nil];
+  [evaluator evaluateCheckers:checkers];
+  STAssertEquals(gCheckCount, 2, nil);
+
+  // Equal checkers share results, and the results are cached
+  STAssertTrue([evaluator exists:
+                [CountingChecker checkerWithName:@"yes1"]], nil);
+  STAssertFalse([evaluator exists:
+                 [CountingChecker checkerWithName:@"no1"]], nil);
+  [evaluator evaluateCheckers:checkers];
+  STAssertEquals(gCheckCount, 2, nil);
+
+  // Until flushed
+  [evaluator flush];
+  STAssertTrue([evaluator exists:
+                [CountingChecker checkerWithName:@"yes1"]], nil);
+  STAssertEquals(gCheckCount, 3, nil);
+}
+
+- (void)testTimeToLive {
+  KSExistenceEvaluator *evaluator =
+    [[[KSExistenceEvaluator alloc] initWithTimeToLive:0] autorelease];
+  KSExistenceChecker *checker = [CountingChecker checkerWithName:@"yes"];
+  NSArray *tickets = [NSArray arrayWithObjects:
+                      TicketWithChecker(@"a", checker),
+                      TicketWithChecker(@"b", checker),
+                      nil];
+
+  // Still once per batch, but never cached
+  STAssertEquals([[evaluator existingTickets:tickets] count],
+                 (NSUInteger)2, nil);
+  STAssertEquals(gCheckCount, 1, nil);
+  STAssertTrue([evaluator exists:checker], nil);
+  STAssertEquals(gCheckCount, 2, nil);
+}
+
+- (void)testExistingTickets {
+  KSExistenceEvaluator *evaluator = [KSExistenceEvaluator evaluator];
+  [evaluator setMaxConcurrentChecks:4];
+
+  // Enough for the checks to be spread over several threads
+  NSMutableArray *tickets = [NSMutableArray array];
+  NSMutableArray *expected = [NSMutableArray array];
+  for (int i = 0; i < 100; i++) {
+    NSString *name = [NSString stringWithFormat:@"%@%d",
+                      (i % 3 ? @"no" : @"yes"), i % 50];
+    KSTicket *ticket =
+      TicketWithChecker([NSString stringWithFormat:@"com.google.test%d", i],
+                        [CountingChecker checkerWithName:name]);
+    [tickets addObject:ticket];
+    if (i % 3 == 0) [expected addObject:ticket];
+  }
+  [tickets addObject:TicketWithChecker(@"true",
+                                       [KSExistenceChecker trueChecker])];
+  [tickets addObject:TicketWithChecker(@"false",
+                                       [KSExistenceChecker falseChecker])];
+  [expected addObject:[tickets objectAtIndex:100]];
+
+  STAssertEqualObjects([evaluator existingTickets:tickets], expected, nil);
+}
+
+- (void)testManyPathTickets {
+  // Not a pass/fail test; logs the time to filter many path-based tickets
+  // one at a time, as KSCheckAction used to, and as one batch.
+  const int kTickets = 10000;
+  NSMutableArray *tickets = [NSMutableArray arrayWithCapacity:kTickets];
+  for (int i = 0; i < kTickets; i++) {
+    // Some are installed, some aren't, and many share an app
+    NSString *path;
+    if (i % 2) {
+      path = [NSString stringWithFormat:@"/tmp/KSExistenceEvaluatorTest/%d",
+              i];
+    } else {
+      path = [NSString stringWithFormat:@"/Applications/App%d.app", i % 100];
+    }
+    [tickets addObject:
+     TicketWithChecker([NSString stringWithFormat:@"com.google.test%d", i],
+                       [KSPathExistenceChecker checkerWithPath:path])];
+  }
+
+  NSDate *start = [NSDate date];
+  NSArray *serial =
+    [tickets filteredArrayUsingPredicate:
+     [NSPredicate predicateWithFormat:@"existenceChecker.exists == YES"]];
+  NSTimeInterval serialTime = -[start timeIntervalSinceNow];
+
+  start = [NSDate date];
+  KSExistenceEvaluator *evaluator = [KSExistenceEvaluator evaluator];
+  NSArray *batched = [evaluator existingTickets:tickets];
+  NSTimeInterval batchTime = -[start timeIntervalSinceNow];
+
+  start = [NSDate date];
+  [evaluator existingTickets:tickets];
+  NSTimeInterval cachedTime = -[start timeIntervalSinceNow];
+
+  STAssertEqualObjects(batched, serial, nil);
+  GTMLoggerInfo(@"%d path tickets: %.3fs one at a time, %.3fs batched, "
+                @"%.3fs cached", kTickets, serialTime, batchTime, cachedTime);
+}
+
+@end
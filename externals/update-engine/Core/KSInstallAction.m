@@ -264,6 +264,14 @@ bail_no_unmount:
                    [self class], self, [self inPipe], [self outPipe]];
 }
 
+- (NSDictionary *)traceArguments {
+  // |updateInfo_| may be nil, so it goes last
+  return [NSDictionary dictionaryWithObjectsAndKeys:
+          [self dmgPath], @"dmgPath",
+          [updateInfo_ productID], @"productID",
+          nil];
+}
+
 @end  // KSInstallAction
 
 
@@ -34,5 +34,11 @@
 + (KSMockFetcherFactory *)alwaysFinishWithData:(NSData *)data;
 + (KSMockFetcherFactory *)alwaysFailWithError:(NSError *)error;
 
+// Like +alwaysFinishWithData:, but a fetch of a URL whose absolute string is
+// a key in |delays| finishes after the number of seconds that key maps to,
+// which lets tests make some servers slower than others.
++ (KSMockFetcherFactory *)alwaysFinishWithData:(NSData *)data
+                                        delays:(NSDictionary *)delays;
+
 @end
 
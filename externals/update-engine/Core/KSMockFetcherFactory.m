@@ -21,9 +21,14 @@
   id delegate_;
   SEL finishedSelector_;
   SEL failedWithErrorSelector_;
+  NSTimeInterval delay_;
 }
 - (id)initWithURLRequest:(NSURLRequest *)request;
 
+// How long after the fetch begins to "respond".  The default is 0, which
+// responds the next time through the run loop.
+- (void)setDelay:(NSTimeInterval)delay;
+
 // Let's try and look like a GTMHTTPFetcher; at least enough
 // to fool KSUpdateChecker.
 - (BOOL)beginFetchWithDelegate:(id)delegate
@@ -83,6 +88,13 @@
   finishedSelector_ = finishedSEL;
   failedWithErrorSelector_ = networkFailedSEL;
   NSArray *modes = [NSArray arrayWithObject:NSDefaultRunLoopMode];
+  if (delay_ > 0) {
+    [self performSelector:@selector(invoke)
+               withObject:nil
+               afterDelay:delay_
+                  inModes:modes];
+    return YES;
+  }
   [[NSRunLoop currentRunLoop] performSelector:@selector(invoke) target:self
                                      argument:nil
                                         order:0
@@ -90,6 +102,10 @@
   return YES;
 }
 
+- (void)setDelay:(NSTimeInterval)delay {
+  delay_ = delay;
+}
+
 - (NSURLResponse *)response {
   // KSUpdateChecker asks for this but ignores it's value.
   // Let's return something legit-looking so it's happy.
@@ -203,6 +219,13 @@
             arg1:error arg2:nil status:0] autorelease];
 }
 
++ (KSMockFetcherFactory *)alwaysFinishWithData:(NSData *)data
+                                        delays:(NSDictionary *)delays {
+  return [[[KSMockFetcherFactory alloc]
+           initWithClass:[KSMockFetcherFinishWithData class]
+            arg1:data arg2:delays status:0] autorelease];
+}
+
 - (void)dealloc {
   [arg1_ release];
   [arg2_ release];
@@ -211,9 +234,14 @@
 
 - (GTMHTTPFetcher *)createFetcherForRequest:(NSURLRequest *)request {
   if (class_ == [KSMockFetcherFinishWithData class]) {
-    return [[[KSMockFetcherFinishWithData alloc] initWithURLRequest:request
-                                                                  data:arg1_]
-             autorelease];
+    KSMockFetcher *fetcher =
+      [[[KSMockFetcherFinishWithData alloc] initWithURLRequest:request
+                                                          data:arg1_]
+        autorelease];
+    // arg2_, if set, holds the per-URL delays
+    NSNumber *delay = [arg2_ objectForKey:[[request URL] absoluteString]];
+    [fetcher setDelay:[delay doubleValue]];
+    return (GTMHTTPFetcher *)fetcher;
   } else if (class_ == [KSMockFetcherFailWithError class]) {
     return [[[KSMockFetcherFailWithError alloc] initWithURLRequest:request
                                                              error:arg1_]
@@ -70,6 +70,35 @@
   STAssertTrue(strcmp([fetchedData_ bytes], string) == 0, nil);
 }
 
+- (void)testDelayedDataFetcher {
+  const char *string = "Hoff";
+  NSData *data = [NSData dataWithBytes:string length:strlen(string)];
+  NSDictionary *delays =
+    [NSDictionary dictionaryWithObject:[NSNumber numberWithDouble:0.5]
+                                forKey:@"http://slow.google.com"];
+  KSFetcherFactory *factory =
+    [KSMockFetcherFactory alwaysFinishWithData:data delays:delays];
+
+  NSURL *url = [NSURL URLWithString:@"http://slow.google.com"];
+  NSURLRequest *req = [NSURLRequest requestWithURL:url];
+  GDataHTTPFetcher *fetcher = [factory createFetcherForRequest:req];
+
+  [fetcher beginFetchWithDelegate:self
+                didFinishSelector:@selector(fetcher:finishedWithData:)
+                  didFailSelector:@selector(fetcher:failedWithError:)];
+  // Not done in the time an undelayed fetcher takes...
+  NSDate *quick = [NSDate dateWithTimeIntervalSinceNow:0.2];
+  [[NSRunLoop currentRunLoop] runUntilDate:quick];
+  STAssertNil(fetchedData_, nil);
+
+  // ...but done once the delay is up
+  NSDate *later = [NSDate dateWithTimeIntervalSinceNow:0.5];
+  [[NSRunLoop currentRunLoop] runUntilDate:later];
+  STAssertNil(fetchError_, nil);
+  STAssertNotNil(fetchedData_, nil);
+  STAssertTrue(strcmp([fetchedData_ bytes], string) == 0, nil);
+}
+
 - (void)testErrorFetcher {
   NSError *error = [[[NSError alloc] init] autorelease];
   KSFetcherFactory *factory = [KSMockFetcherFactory alwaysFailWithError:error];
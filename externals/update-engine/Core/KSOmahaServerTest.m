@@ -16,12 +16,15 @@
 #import "KSOmahaServer.h"
 #import "KSClientActives.h"
 #import "KSFrameworkStats.h"
+#import "KSPlistCache.h"
 #import "KSStatsCollection.h"
 #import "KSTicketStore.h"
 #import "KSTicketTestBase.h"
 #import "KSUpdateEngine.h"
 #import "KSUpdateEngineParameters.h"
 #import "KSUpdateInfo.h"
+#import "KSUUID.h"
+#import "GTMLogger.h"
 
 #define DEFAULT_BRAND_CODE @"GGLG"
 
@@ -295,6 +298,67 @@ Sample response (but not for the above request):
   STAssertTrue([apps count] == size, nil);
 }
 
+- (void)testManyTicketsSharingPlists {
+  // Not a pass/fail test; logs the time to build a request for many tickets
+  // that read their version and brand from a few plists, with the plists
+  // read from disk and with them cached.
+  const int kPlists = 10;
+  const int kTickets = 1000;
+  NSString *dir = [NSTemporaryDirectory() stringByAppendingPathComponent:
+                   [KSUUID uuidString]];
+  NSFileManager *fm = [NSFileManager defaultManager];
+  STAssertTrue([fm createDirectoryAtPath:dir attributes:nil], nil);
+
+  NSMutableArray *paths = [NSMutableArray array];
+  for (int i = 0; i < kPlists; i++) {
+    NSDictionary *plist = [NSDictionary dictionaryWithObjectsAndKeys:
+                           [NSString stringWithFormat:@"2.%d", i],
+                           @"CFBundleVersion",
+                           @"GGLS", @"KSBrandID",
+                           nil];
+    NSString *path = [dir stringByAppendingPathComponent:
+                      [NSString stringWithFormat:@"Info%d.plist", i]];
+    STAssertTrue([plist writeToFile:path atomically:YES], nil);
+    [paths addObject:path];
+  }
+
+  NSMutableArray *tickets = [NSMutableArray arrayWithCapacity:kTickets];
+  for (int i = 0; i < kTickets; i++) {
+    NSString *path = [paths objectAtIndex:(i % kPlists)];
+    [tickets addObject:[self ticketWithURL:httpURL_
+                                     count:i
+                                   tttoken:nil
+                              creationDate:nil
+                                       tag:nil
+                                 brandPath:path
+                                  brandKey:@"KSBrandID"
+                               versionPath:path
+                                versionKey:@"CFBundleVersion"
+                                   version:nil]];
+  }
+
+  KSPlistCache *cache = [KSPlistCache sharedCache];
+  [cache flush];
+  unsigned int loads = [cache loadCount];
+  NSDate *start = [NSDate date];
+  NSArray *requests = [httpServer_ requestsForTickets:tickets];
+  NSTimeInterval coldTime = -[start timeIntervalSinceNow];
+  STAssertEquals([requests count], (NSUInteger)1, nil);
+
+  // Each plist is read once, not once per ticket and key
+  STAssertEquals([cache loadCount] - loads, (unsigned int)kPlists, nil);
+
+  start = [NSDate date];
+  requests = [httpServer_ requestsForTickets:tickets];
+  NSTimeInterval warmTime = -[start timeIntervalSinceNow];
+  STAssertEquals([cache loadCount] - loads, (unsigned int)kPlists, nil);
+
+  GTMLoggerInfo(@"Request for %d tickets sharing %d plists: %.3fs cold, "
+                @"%.3fs cached", kTickets, kPlists, coldTime, warmTime);
+
+  [fm removeFileAtPath:dir handler:nil];
+}
+
 - (void)testBadTickets {
   // no tickets --> no request!
   NSMutableArray *empty = [NSMutableArray array];
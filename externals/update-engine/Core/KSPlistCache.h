@@ -0,0 +1,54 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#import <Foundation/Foundation.h>
+
+// KSPlistCache
+//
+// A process-wide cache of the dictionary plists that tickets read their
+// version, tag and brand from. Many tickets usually point at the same few
+// files (an app's Info.plist, say), so rather than parse a file for every
+// ticket and every key, each file is parsed once and kept until it changes.
+//
+// Each lookup stats the file, and the file is read again if its inode, size
+// or modification time differ from when it was cached. If several threads
+// ask for a file that isn't cached, only one of them reads it; the rest wait
+// for its result.
+//
+// Files bigger than 5MB, and files that aren't dictionary plists, are never
+// returned.
+//
+// All methods are thread safe.
+@interface KSPlistCache : NSObject {
+ @private
+  NSCondition *lock_;            // Guards the ivars below.
+  NSMutableDictionary *entries_;  // Standardized path -> KSPlistCacheEntry
+  unsigned int loadCount_;
+}
+
+// Returns the cache that KSTicket uses.
++ (KSPlistCache *)sharedCache;
+
+// Returns the dictionary plist at |path|, which may start with a tilde, or
+// nil if there isn't one.
+- (NSDictionary *)plistForPath:(NSString *)path;
+
+// Forgets every cached plist.
+- (void)flush;
+
+// The number of times a plist has been read from disk, for tests and
+// benchmarks.
+- (unsigned int)loadCount;
+
+@end
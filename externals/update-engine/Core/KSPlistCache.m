@@ -0,0 +1,184 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#import "KSPlistCache.h"
+#import <sys/stat.h>
+
+// When reading a plist file pointed to by a tag, brandcode, or version
+// path, don't bother reading files over this size.  Chances are
+// someone is trying to feed us a bad file and forcing a crash.  The
+// largest plist found on my Leopard system was 4 megs.
+#define MAX_DATA_FILE_SIZE (5 * 1024 * 1024)
+
+// The cache is emptied when it reaches this many files, so a process
+// that sees a lot of different paths doesn't keep every one.
+#define MAX_CACHED_FILES 256
+
+
+// One file's plist, or the promise of one while it's being read.
+@interface KSPlistCacheEntry : NSObject {
+ @public
+  NSString *stamp_;    // Identifies the version of the file that was read.
+  NSDictionary *plist_;  // nil if the file isn't a dictionary plist.
+  BOOL loading_;       // YES until plist_ is set.
+}
+@end
+
+@implementation KSPlistCacheEntry
+
+- (void)dealloc {
+  [stamp_ release];
+  [plist_ release];
+  [super dealloc];
+}
+
+@end
+
+
+@interface KSPlistCache (PrivateMethods)
+
+// Returns the dictionary plist in the file at |path|, or nil.
+- (NSDictionary *)loadPlistAtPath:(NSString *)path;
+
+@end
+
+
+@implementation KSPlistCache
+
++ (KSPlistCache *)sharedCache {
+  static KSPlistCache *sSharedCache = nil;
+  @synchronized ([KSPlistCache class]) {
+    if (sSharedCache == nil) {
+      sSharedCache = [[KSPlistCache alloc] init];
+    }
+  }
+  return sSharedCache;
+}
+
+- (id)init {
+  if ((self = [super init])) {
+    lock_ = [[NSCondition alloc] init];
+    entries_ = [[NSMutableDictionary alloc] init];
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [lock_ release];
+  [entries_ release];
+  [super dealloc];
+}
+
+- (NSDictionary *)plistForPath:(NSString *)path {
+  NSString *fullPath = [path stringByStandardizingPath];
+  if ([fullPath length] == 0) return nil;
+
+  struct stat sb;
+  if (stat([fullPath fileSystemRepresentation], &sb) != 0) return nil;
+  if (!S_ISREG(sb.st_mode) || sb.st_size > MAX_DATA_FILE_SIZE) return nil;
+  NSString *stamp = [NSString stringWithFormat:@"%llu:%lld:%ld.%09ld",
+                     (unsigned long long)sb.st_ino, (long long)sb.st_size,
+                     (long)sb.st_mtimespec.tv_sec,
+                     (long)sb.st_mtimespec.tv_nsec];
+
+  KSPlistCacheEntry *entry = nil;
+  [lock_ lock];
+  while (YES) {
+    entry = [entries_ objectForKey:fullPath];
+    if (entry == nil || ![entry->stamp_ isEqualToString:stamp]) {
+      // Nobody has this version; we'll read it
+      entry = nil;
+      break;
+    }
+    if (!entry->loading_) break;
+    // Somebody else is reading this version; wait for them
+    [lock_ wait];
+  }
+
+  if (entry) {
+    NSDictionary *plist = [[entry->plist_ retain] autorelease];
+    [lock_ unlock];
+    return plist;
+  }
+
+  if ([entries_ count] >= MAX_CACHED_FILES) {
+    // Keep the entries that threads are waiting on
+    NSEnumerator *keyEnum = [[entries_ allKeys] objectEnumerator];
+    NSString *key;
+    while ((key = [keyEnum nextObject])) {
+      KSPlistCacheEntry *old = [entries_ objectForKey:key];
+      if (!old->loading_) [entries_ removeObjectForKey:key];
+    }
+  }
+  entry = [[[KSPlistCacheEntry alloc] init] autorelease];
+  entry->stamp_ = [stamp copy];
+  entry->loading_ = YES;
+  [entries_ setObject:entry forKey:fullPath];
+  loadCount_++;
+  [lock_ unlock];
+
+  NSDictionary *plist = [self loadPlistAtPath:fullPath];
+
+  [lock_ lock];
+  entry->plist_ = [plist retain];
+  entry->loading_ = NO;
+  [lock_ broadcast];
+  [lock_ unlock];
+
+  return plist;
+}
+
+- (void)flush {
+  [lock_ lock];
+  // Entries still being read stay, for the threads waiting on them
+  NSEnumerator *keyEnum = [[entries_ allKeys] objectEnumerator];
+  NSString *key;
+  while ((key = [keyEnum nextObject])) {
+    KSPlistCacheEntry *entry = [entries_ objectForKey:key];
+    if (!entry->loading_) [entries_ removeObjectForKey:key];
+  }
+  [lock_ unlock];
+}
+
+- (unsigned int)loadCount {
+  [lock_ lock];
+  unsigned int count = loadCount_;
+  [lock_ unlock];
+  return count;
+}
+
+@end
+
+
+@implementation KSPlistCache (PrivateMethods)
+
+- (NSDictionary *)loadPlistAtPath:(NSString *)path {
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+
+  NSDictionary *plist = nil;
+  NSData *data = [NSData dataWithContentsOfFile:path];
+  if (data && [data length] <= MAX_DATA_FILE_SIZE) {
+    id object = [NSPropertyListSerialization
+                  propertyListFromData:data
+                      mutabilityOption:NSPropertyListImmutable
+                                format:NULL
+                      errorDescription:NULL];
+    if ([object isKindOfClass:[NSDictionary class]]) plist = [object retain];
+  }
+
+  [pool release];
+  return [plist autorelease];
+}
+
+@end
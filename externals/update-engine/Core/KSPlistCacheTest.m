@@ -0,0 +1,148 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#import <SenTestingKit/SenTestingKit.h>
+#import "KSPlistCache.h"
+#import "KSUUID.h"
+
+
+@interface KSPlistCacheTest : SenTestCase {
+ @private
+  NSString *dir_;
+  NSString *path_;
+}
+@end
+
+
+// Asks a cache for a plist, from an NSOperationQueue.
+@interface PlistCacheLookup : NSOperation {
+ @private
+  KSPlistCache *cache_;
+  NSString *path_;
+}
+- (id)initWithCache:(KSPlistCache *)cache path:(NSString *)path;
+@end
+
+@implementation PlistCacheLookup
+
+- (id)initWithCache:(KSPlistCache *)cache path:(NSString *)path {
+  if ((self = [super init])) {
+    cache_ = [cache retain];
+    path_ = [path copy];
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [cache_ release];
+  [path_ release];
+  [super dealloc];
+}
+
+- (void)main {
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  [cache_ plistForPath:path_];
+  [pool release];
+}
+
+@end  // PlistCacheLookup
+
+
+@implementation KSPlistCacheTest
+
+- (void)setUp {
+  dir_ = [[NSTemporaryDirectory() stringByAppendingPathComponent:
+           [KSUUID uuidString]] retain];
+  STAssertTrue([[NSFileManager defaultManager] createDirectoryAtPath:dir_
+                                                          attributes:nil],
+               nil);
+  path_ = [[dir_ stringByAppendingPathComponent:@"Info.plist"] retain];
+  NSDictionary *plist = [NSDictionary dictionaryWithObject:@"1.0"
+                                                    forKey:@"Version"];
+  STAssertTrue([plist writeToFile:path_ atomically:YES], nil);
+}
+
+- (void)tearDown {
+  [[NSFileManager defaultManager] removeFileAtPath:dir_ handler:nil];
+  [dir_ release];
+  [path_ release];
+}
+
+- (void)testSharedCache {
+  KSPlistCache *cache = [KSPlistCache sharedCache];
+  STAssertNotNil(cache, nil);
+  STAssertTrue(cache == [KSPlistCache sharedCache], nil);
+}
+
+- (void)testCaching {
+  KSPlistCache *cache = [[[KSPlistCache alloc] init] autorelease];
+  NSDictionary *plist = [cache plistForPath:path_];
+  STAssertEqualObjects([plist objectForKey:@"Version"], @"1.0", nil);
+  STAssertEquals([cache loadCount], 1U, nil);
+
+  // The same file, however it's named, is only read once
+  STAssertEqualObjects([cache plistForPath:path_], plist, nil);
+  NSString *dotted = [dir_ stringByAppendingPathComponent:@"./Info.plist"];
+  STAssertEqualObjects([cache plistForPath:dotted], plist, nil);
+  STAssertEquals([cache loadCount], 1U, nil);
+
+  // Until it changes
+  NSDictionary *newPlist = [NSDictionary dictionaryWithObject:@"1.0.1"
+                                                       forKey:@"Version"];
+  STAssertTrue([newPlist writeToFile:path_ atomically:YES], nil);
+  STAssertEqualObjects([cache plistForPath:path_], newPlist, nil);
+  STAssertEquals([cache loadCount], 2U, nil);
+
+  // Or the cache is flushed
+  [cache flush];
+  STAssertEqualObjects([cache plistForPath:path_], newPlist, nil);
+  STAssertEquals([cache loadCount], 3U, nil);
+}
+
+- (void)testBadFiles {
+  KSPlistCache *cache = [[[KSPlistCache alloc] init] autorelease];
+  STAssertNil([cache plistForPath:nil], nil);
+  STAssertNil([cache plistForPath:@""], nil);
+  STAssertNil([cache plistForPath:@"/flongwaffle"], nil);
+  STAssertNil([cache plistForPath:dir_], nil);
+  STAssertEquals([cache loadCount], 0U, nil);
+
+  // Files that aren't dictionary plists are remembered as such
+  NSString *path = [dir_ stringByAppendingPathComponent:@"bad.plist"];
+  STAssertTrue([@"not a plist {" writeToFile:path atomically:YES], nil);
+  STAssertNil([cache plistForPath:path], nil);
+  STAssertNil([cache plistForPath:path], nil);
+  STAssertEquals([cache loadCount], 1U, nil);
+
+  NSArray *array = [NSArray arrayWithObject:@"a"];
+  STAssertTrue([array writeToFile:path atomically:YES], nil);
+  STAssertNil([cache plistForPath:path], nil);
+  STAssertEquals([cache loadCount], 2U, nil);
+}
+
+- (void)testConcurrentLookups {
+  KSPlistCache *cache = [[[KSPlistCache alloc] init] autorelease];
+  NSOperationQueue *queue = [[[NSOperationQueue alloc] init] autorelease];
+  [queue setMaxConcurrentOperationCount:8];
+  for (int i = 0; i < 64; i++) {
+    [queue addOperation:
+     [[[PlistCacheLookup alloc] initWithCache:cache path:path_] autorelease]];
+  }
+  [queue waitUntilAllOperationsAreFinished];
+
+  // Only one of them read the file
+  STAssertEquals([cache loadCount], 1U, nil);
+}
+
+@end
@@ -14,6 +14,7 @@
 
 #import <Foundation/Foundation.h>
 #import "KSMultiAction.h"
+#import "KSUpdateInfo.h"
 
 @class KSUpdateEngine, KSActionProcessor;
 
@@ -35,6 +36,12 @@
 // This action always sets its outPipe's contents to be the exact same as its
 // inPipe contents.
 //
+// Updates may also be streamed in with -prefetchUpdates: before this action
+// runs, so that their downloads overlap whatever comes before it (see
+// -[KSCheckAction setPrefetchAction:]). Streamed updates are offered to the
+// delegate when they arrive rather than when this action runs, and this action
+// then finishes once all of the downloads, streamed or not, are done.
+//
 // Sample code to create a checker and a prefetcher connected via a pipe.
 //
 //   KSActionProcessor *ap = ...
@@ -55,6 +62,7 @@
 @interface KSPrefetchAction : KSMultiAction {
  @private
   KSUpdateEngine *engine_;
+  CFMutableSetRef streamedUpdates_;  // KSUpdateInfos, compared by identity
 }
 
 // Returns an autoreleased KSPrefetchAction associated with |engine|
@@ -63,4 +71,20 @@
 // Designated initializer. Returns a KSPrefetchAction associated with |engine|
 - (id)initWithEngine:(KSUpdateEngine *)engine;
 
+// Offers |updates|, an array of KSUpdateInfos, to the engine's delegate for
+// prefetching now, and starts downloading the ones it picks. Should only be
+// called before this action runs. When it does run, only the updates in its
+// inPipe that were not streamed in here are offered to the delegate.
+- (void)prefetchUpdates:(NSArray *)updates;
+
+@end
+
+
+// "Protected" methods that only subclasses should call or override
+@interface KSPrefetchAction (ProtectedMethods)
+
+// Returns the action that downloads |info|'s update, a KSDownloadAction by
+// default.
+- (KSAction *)downloadActionForUpdate:(KSUpdateInfo *)info;
+
 @end
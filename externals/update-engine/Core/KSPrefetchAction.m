@@ -20,6 +20,13 @@
 #import "KSUpdateInfo.h"
 
 
+@interface KSPrefetchAction (PrivateMethods)
+// Asks the engine's delegate which of |updates| to prefetch, and enqueues a
+// download for each of those on our subProcessor.
+- (void)enqueueDownloadsForUpdates:(NSArray *)updates;
+@end
+
+
 @implementation KSPrefetchAction
 
 + (id)actionWithEngine:(KSUpdateEngine *)engine {
@@ -43,6 +50,7 @@
 
 - (void)dealloc {
   [engine_ release];
+  if (streamedUpdates_) CFRelease(streamedUpdates_);
   [super dealloc];
 }
 
@@ -53,10 +61,81 @@
   
   if (availableUpdates == nil) {
     GTMLoggerInfo(@"no updates available.");
+  } else if (streamedUpdates_ == NULL) {
+    [self enqueueDownloadsForUpdates:availableUpdates];
+  } else {
+    // The delegate has already been asked about the updates streamed in
+    NSMutableArray *unstreamed = [NSMutableArray array];
+    NSEnumerator *updateEnumerator = [availableUpdates objectEnumerator];
+    KSUpdateInfo *info = nil;
+    while ((info = [updateEnumerator nextObject])) {
+      if (!CFSetContainsValue(streamedUpdates_, info))
+        [unstreamed addObject:info];
+    }
+    if ([unstreamed count] > 0)
+      [self enqueueDownloadsForUpdates:unstreamed];
+  }
+
+  // Streamed downloads may still be running, or all be done already
+  KSActionProcessor *subProcessor = [self subProcessor];
+  if ([[subProcessor actions] count] == 0 && ![subProcessor isProcessing]) {
+    GTMLoggerInfo(@"No prefetch downloads created.");
     [[self processor] finishedProcessing:self successfully:YES];
     return;
   }
+  
+  [subProcessor startProcessing];
+}
+
+- (void)prefetchUpdates:(NSArray *)updates {
+  if (streamedUpdates_ == NULL) {
+    // Retain the updates, but compare them by identity; dictionaries hash
+    // poorly, and these are the same objects that will come down our inPipe.
+    CFSetCallBacks callbacks = kCFTypeSetCallBacks;
+    callbacks.equal = NULL;
+    callbacks.hash = NULL;
+    streamedUpdates_ = CFSetCreateMutable(NULL, 0, &callbacks);
+  }
+  NSEnumerator *updateEnumerator = [updates objectEnumerator];
+  KSUpdateInfo *info = nil;
+  while ((info = [updateEnumerator nextObject])) {
+    CFSetAddValue(streamedUpdates_, info);
+  }
+  if ([updates count] == 0)
+    return;
+
+  [self enqueueDownloadsForUpdates:updates];
+  if ([[[self subProcessor] actions] count] > 0)
+    [[self subProcessor] startProcessing];
+}
+
+// Overridden from KSMultiAction. Streamed downloads can all finish before we
+// run; -performAction takes care of finishing us in that case.
+- (void)processingDone:(KSActionProcessor *)processor {
+  if ([self isRunning])
+    [super processingDone:processor];
+}
 
+@end
+
+
+@implementation KSPrefetchAction (ProtectedMethods)
+
+- (KSAction *)downloadActionForUpdate:(KSUpdateInfo *)info {
+  NSString *dmgName =
+    [[info productID] stringByAppendingPathExtension:@"dmg"];
+  return [KSDownloadAction actionWithURL:[info codebaseURL]
+                                    size:[[info codeSize] intValue]
+                                    hash:[info codeHash]
+                                    name:dmgName];
+}
+
+@end
+
+
+@implementation KSPrefetchAction (PrivateMethods)
+
+- (void)enqueueDownloadsForUpdates:(NSArray *)updates {
   _GTMDevAssert(engine_ != nil, @"engine_ must not be nil");
   
   // Send the available updates to the delegate to figure out which ones should
@@ -66,42 +145,27 @@
   // Security note:
   // The delegate is untrusted so we can't trust the product dictionaries that
   // we get back. So, we use the returned product dictionaries to filter our
-  // original list of |availableUpdates| to the ones the delegate requested.
+  // original list of |updates| to the ones the delegate requested.
   NSArray *updatesToPrefetch = [engine_ action:self
-                        shouldPrefetchProducts:availableUpdates];
+                        shouldPrefetchProducts:updates];
   
   // Filter our list of available updates to only those that the delegate told
   // us to prefetch.
   NSArray *prefetches =
-    [availableUpdates filteredArrayUsingPredicate:
+    [updates filteredArrayUsingPredicate:
      [NSPredicate predicateWithFormat:
       @"SELF IN %@", updatesToPrefetch]];
   
   // Use -description because it prints nicer than the way CF would format it
   GTMLoggerInfo(@"prefetches=%@", [prefetches description]);
   
-  // Convert each dictionary in |prefetches| into a KSDownloadAction and
+  // Convert each dictionary in |prefetches| into a download action and
   // enqueue it on our subProcessor
   NSEnumerator *prefetchEnumerator = [prefetches objectEnumerator];
   KSUpdateInfo *info = nil;
   while ((info = [prefetchEnumerator nextObject])) {
-    NSString *dmgName =
-    [[info productID] stringByAppendingPathExtension:@"dmg"];
-    KSAction *action =
-    [KSDownloadAction actionWithURL:[info codebaseURL]
-                               size:[[info codeSize] intValue]
-                               hash:[info codeHash]
-                               name:dmgName];
-    [[self subProcessor] enqueueAction:action];
+    [[self subProcessor] enqueueAction:[self downloadActionForUpdate:info]];
   }
-
-  if ([[[self subProcessor] actions] count] == 0) {
-    GTMLoggerInfo(@"No prefetch downloads created.");
-    [[self processor] finishedProcessing:self successfully:YES];
-    return;
-  }
-  
-  [[self subProcessor] startProcessing];
 }
 
 @end
@@ -18,12 +18,120 @@
 #import "KSUpdateInfo.h"
 #import "KSActionPipe.h"
 #import "KSActionProcessor.h"
+#import "KSCheckAction.h"
+#import "KSExistenceChecker.h"
+#import "KSMockFetcherFactory.h"
+#import "KSOutOfBandDataAction.h"
+#import "KSTicket.h"
 
 
 @interface KSPrefetchActionTest : SenTestCase
 @end
 
 
+// How long each server check and each download takes in the streaming tests.
+// One server is ten times slower than the others.
+static const NSTimeInterval kFastCheckTime = 0.1;
+static const NSTimeInterval kSlowCheckTime = 1.0;
+static const NSTimeInterval kDownloadTime = 0.3;
+
+
+// Stands in for a download, finishing after kDownloadTime and noting in
+// |starts| when it started.
+@interface TimedDownloadAction : KSAction {
+  NSString *productID_;
+  NSMutableDictionary *starts_;
+}
+- (id)initWithProductID:(NSString *)productID
+                 starts:(NSMutableDictionary *)starts;
+@end
+
+@implementation TimedDownloadAction
+
+- (id)initWithProductID:(NSString *)productID
+                 starts:(NSMutableDictionary *)starts {
+  if ((self = [super init])) {
+    productID_ = [productID copy];
+    starts_ = [starts retain];
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [productID_ release];
+  [starts_ release];
+  [super dealloc];
+}
+
+- (void)performAction {
+  [starts_ setObject:[NSDate date] forKey:productID_];
+  [self performSelector:@selector(finish) withObject:nil
+             afterDelay:kDownloadTime];
+}
+
+- (void)terminateAction {
+  [NSObject cancelPreviousPerformRequestsWithTarget:self];
+}
+
+- (void)finish {
+  [[self processor] finishedProcessing:self successfully:YES];
+}
+
+@end
+
+
+// Prefetches with TimedDownloadActions.
+@interface TimedPrefetchAction : KSPrefetchAction {
+  NSMutableDictionary *starts_;  // productID -> NSDate
+}
+- (NSDictionary *)downloadStarts;
+@end
+
+@implementation TimedPrefetchAction
+
+- (id)initWithEngine:(KSUpdateEngine *)engine {
+  if ((self = [super initWithEngine:engine])) {
+    starts_ = [[NSMutableDictionary alloc] init];
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [starts_ release];
+  [super dealloc];
+}
+
+- (NSDictionary *)downloadStarts {
+  return starts_;
+}
+
+- (KSAction *)downloadActionForUpdate:(KSUpdateInfo *)info {
+  return [[[TimedDownloadAction alloc] initWithProductID:[info productID]
+                                                  starts:starts_]
+          autorelease];
+}
+
+@end
+
+
+@interface KSPrefetchActionTest (PrivateMethods)
+// Checks three servers, one of them slow, and prefetches what they return,
+// streaming the updates to the prefetcher if |streaming|. Returns how long
+// it all took, and sets |*updates| to the prefetcher's output and |*starts| to
+// when each product's download started, relative to the start of the check.
+- (NSTimeInterval)checkAndPrefetchStreaming:(BOOL)streaming
+                                    updates:(NSArray **)updates
+                                     starts:(NSDictionary **)starts;
+// As above, but if |stopTime| is positive, stops the processor that long
+// after the start and then waits out the slow check and a couple of downloads,
+// so |*starts| shows any download that started after the stop.
+- (NSTimeInterval)checkAndPrefetchStreaming:(BOOL)streaming
+                                  stopAfter:(NSTimeInterval)stopTime
+                                    updates:(NSArray **)updates
+                                     starts:(NSDictionary **)starts;
+@end
+
+
 static NSString *const kTicketStorePath = @"/tmp/KSPrefetchActionTest.ticketstore";
 
 
@@ -166,6 +274,111 @@ shouldPrefetchProducts:(NSArray *)products {
   STAssertEquals([action subActionsProcessed], 0, nil);
 }
 
+- (void)testStreamedPrefetching {
+  KSUpdateEngine *engine = [KSUpdateEngine engineWithDelegate:self];
+  KSPrefetchAction *action = [TimedPrefetchAction actionWithEngine:engine];
+  STAssertNotNil(action, nil);
+
+  NSDictionary *allow1 =
+    [NSDictionary dictionaryWithObjectsAndKeys:
+     @"allow1", kServerProductID,
+     [NSURL URLWithString:@"a://b"], kServerCodebaseURL,
+     [NSNumber numberWithInt:1], kServerCodeSize,
+     @"zzz", kServerCodeHash,
+     nil];
+  NSDictionary *deny1 =
+    [NSDictionary dictionaryWithObjectsAndKeys:
+     @"deny1", kServerProductID,
+     [NSURL URLWithString:@"a://b"], kServerCodebaseURL,
+     [NSNumber numberWithInt:1], kServerCodeSize,
+     @"vvv", kServerCodeHash,
+     nil];
+  NSDictionary *allow2 =
+    [NSDictionary dictionaryWithObjectsAndKeys:
+     @"allow2", kServerProductID,
+     [NSURL URLWithString:@"a://b"], kServerCodebaseURL,
+     [NSNumber numberWithInt:2], kServerCodeSize,
+     @"xxx", kServerCodeHash,
+     nil];
+
+  // Downloads start as soon as updates are streamed in, and only for the
+  // updates the delegate allows
+  [action prefetchUpdates:[NSArray arrayWithObjects:allow1, deny1, nil]];
+  NSDictionary *starts = [(TimedPrefetchAction *)action downloadStarts];
+  STAssertNotNil([starts objectForKey:@"allow1"], nil);
+  STAssertNil([starts objectForKey:@"deny1"], nil);
+
+  // Only the update that wasn't streamed in is looked at when it runs, and it
+  // waits for the streamed download to finish
+  KSActionPipe *pipe = [KSActionPipe pipe];
+  NSArray *all = [NSArray arrayWithObjects:allow1, deny1, allow2, nil];
+  [pipe setContents:all];
+  [action setInPipe:pipe];
+
+  KSActionProcessor *ap = [[[KSActionProcessor alloc] init] autorelease];
+  [ap enqueueAction:action];
+  [ap startProcessing];
+  [self loopUntilDone:ap];
+
+  STAssertEquals([starts count], (NSUInteger)2, nil);
+  STAssertNotNil([starts objectForKey:@"allow2"], nil);
+  STAssertEqualObjects([[action outPipe] contents], all, nil);
+}
+
+- (void)testStreamingFromCheckTiming {
+  // Not just pass/fail, also logs how much sooner streaming gets done.
+  NSArray *batchUpdates = nil;
+  NSDictionary *batchStarts = nil;
+  NSTimeInterval batchTime = [self checkAndPrefetchStreaming:NO
+                                                     updates:&batchUpdates
+                                                      starts:&batchStarts];
+  NSArray *streamedUpdates = nil;
+  NSDictionary *streamedStarts = nil;
+  NSTimeInterval streamedTime =
+    [self checkAndPrefetchStreaming:YES
+                            updates:&streamedUpdates
+                             starts:&streamedStarts];
+  GTMLoggerInfo(@"check and prefetch: %.2fs in batch, %.2fs streamed",
+                batchTime, streamedTime);
+
+  // Same updates either way, and the delegate still decides what's fetched
+  STAssertEquals([batchUpdates count], (NSUInteger)4, nil);
+  STAssertEqualObjects(streamedUpdates, batchUpdates, nil);
+  STAssertEquals([batchStarts count], (NSUInteger)3, nil);
+  STAssertEquals([streamedStarts count], (NSUInteger)3, nil);
+  STAssertNil([streamedStarts objectForKey:@"deny1"], nil);
+
+  // In a batch, nothing downloads until the slow server has answered; when
+  // streaming, the quick servers' updates download while it's still going.
+  NSString *productID = nil;
+  NSEnumerator *productEnumerator = [batchStarts keyEnumerator];
+  while ((productID = [productEnumerator nextObject])) {
+    STAssertTrue([[batchStarts objectForKey:productID] doubleValue] >=
+                 kSlowCheckTime, productID);
+  }
+  STAssertTrue([[streamedStarts objectForKey:@"allow1"] doubleValue] <
+               kSlowCheckTime, nil);
+  STAssertTrue([[streamedStarts objectForKey:@"allow2"] doubleValue] <
+               kSlowCheckTime, nil);
+  STAssertTrue(streamedTime < batchTime, nil);
+}
+
+- (void)testStoppingDuringStreamedCheck {
+  // Stop once the first streamed download has started, while the slow server
+  // is still being checked and the second download is waiting its turn.
+  NSTimeInterval stopTime = kFastCheckTime + kDownloadTime / 2;
+  NSDictionary *starts = nil;
+  NSArray *updates = nil;
+  [self checkAndPrefetchStreaming:YES
+                        stopAfter:stopTime
+                          updates:&updates
+                           starts:&starts];
+
+  STAssertEquals([starts count], (NSUInteger)1, nil);
+  STAssertNotNil([starts objectForKey:@"allow1"], nil);
+  STAssertNil([starts objectForKey:@"allow2"], nil);
+}
+
 - (void)testNoUpdates {
   KSUpdateEngine *engine = [KSUpdateEngine engineWithDelegate:self];
   STAssertNotNil(engine, nil);
@@ -187,3 +400,109 @@ shouldPrefetchProducts:(NSArray *)products {
 }
 
 @end
+
+
+@implementation KSPrefetchActionTest (PrivateMethods)
+
+- (NSTimeInterval)checkAndPrefetchStreaming:(BOOL)streaming
+                                    updates:(NSArray **)updates
+                                     starts:(NSDictionary **)starts {
+  return [self checkAndPrefetchStreaming:streaming
+                               stopAfter:0
+                                 updates:updates
+                                  starts:starts];
+}
+
+- (NSTimeInterval)checkAndPrefetchStreaming:(BOOL)streaming
+                                  stopAfter:(NSTimeInterval)stopTime
+                                    updates:(NSArray **)updates
+                                     starts:(NSDictionary **)starts {
+  KSExistenceChecker *xc = [KSPathExistenceChecker checkerWithPath:@"/"];
+  NSString *fast1 = @"http://fast1.example.com/rules";
+  NSString *fast2 = @"http://fast2.example.com/rules";
+  NSString *slow = @"http://slow.example.com/rules";
+  NSArray *products = [NSArray arrayWithObjects:
+                       @"allow1", @"deny1", @"allow2", @"allow3", nil];
+  NSArray *urls = [NSArray arrayWithObjects:fast1, fast1, fast2, slow, nil];
+
+  // Every server returns the same rules, and each one's tickets pick out
+  // their own products' updates.
+  NSMutableArray *tickets = [NSMutableArray array];
+  NSMutableArray *rules = [NSMutableArray array];
+  for (NSUInteger i = 0; i < [products count]; i++) {
+    NSString *productID = [products objectAtIndex:i];
+    NSURL *url = [NSURL URLWithString:[urls objectAtIndex:i]];
+    [tickets addObject:[KSTicket ticketWithProductID:productID
+                                             version:@"1"
+                                    existenceChecker:xc
+                                           serverURL:url]];
+    NSString *codebase =
+      [NSString stringWithFormat:@"https://example.com/%@.dmg", productID];
+    [rules addObject:[NSDictionary dictionaryWithObjectsAndKeys:
+                      productID, @"ProductID",
+                      @"TRUEPREDICATE", @"Predicate",
+                      codebase, @"Codebase",
+                      @"somehash=", @"Hash",
+                      @"1234", @"Size",
+                      nil]];
+  }
+  NSDictionary *plist = [NSDictionary dictionaryWithObject:rules
+                                                    forKey:@"Rules"];
+  NSPropertyListFormat format = NSPropertyListXMLFormat_v1_0;
+  NSData *data = [NSPropertyListSerialization dataFromPropertyList:plist
+                                                            format:format
+                                                  errorDescription:NULL];
+  STAssertNotNil(data, nil);
+  NSDictionary *delays = [NSDictionary dictionaryWithObjectsAndKeys:
+                          [NSNumber numberWithDouble:kFastCheckTime], fast1,
+                          [NSNumber numberWithDouble:kFastCheckTime], fast2,
+                          [NSNumber numberWithDouble:kSlowCheckTime], slow,
+                          nil];
+
+  // Check, pass on the out-of-band data and prefetch, like KSUpdateEngine
+  KSUpdateEngine *engine = [KSUpdateEngine engineWithDelegate:self];
+  KSCheckAction *check = [KSCheckAction actionWithTickets:tickets
+                                                   params:nil
+                                                   engine:engine];
+  [check setFetcherFactory:[KSMockFetcherFactory alwaysFinishWithData:data
+                                                               delays:delays]];
+  KSAction *oob = [KSOutOfBandDataAction actionWithEngine:engine];
+  TimedPrefetchAction *prefetch = [TimedPrefetchAction actionWithEngine:engine];
+  if (streaming) [check setPrefetchAction:prefetch];
+  [KSActionPipe bondFrom:check to:oob];
+  [KSActionPipe bondFrom:oob to:prefetch];
+
+  KSActionProcessor *ap = [[[KSActionProcessor alloc] init] autorelease];
+  [ap enqueueAction:check];
+  [ap enqueueAction:oob];
+  [ap enqueueAction:prefetch];
+  NSDate *start = [NSDate date];
+  [ap startProcessing];
+  if (stopTime > 0) {
+    NSDate *stop = [start addTimeInterval:stopTime];
+    [[NSRunLoop currentRunLoop] runUntilDate:stop];
+    [ap stopProcessing];
+    NSDate *later = [NSDate dateWithTimeIntervalSinceNow:
+                     kSlowCheckTime + 2 * kDownloadTime];
+    [[NSRunLoop currentRunLoop] runUntilDate:later];
+  } else {
+    [self loopUntilDone:ap];
+  }
+  NSTimeInterval elapsed = -[start timeIntervalSinceNow];
+
+  *updates = [[prefetch outPipe] contents];
+  NSMutableDictionary *relativeStarts = [NSMutableDictionary dictionary];
+  NSDictionary *downloadStarts = [prefetch downloadStarts];
+  NSEnumerator *productEnumerator = [downloadStarts keyEnumerator];
+  NSString *productID = nil;
+  while ((productID = [productEnumerator nextObject])) {
+    NSDate *date = [downloadStarts objectForKey:productID];
+    NSNumber *offset =
+      [NSNumber numberWithDouble:[date timeIntervalSinceDate:start]];
+    [relativeStarts setObject:offset forKey:productID];
+  }
+  *starts = relativeStarts;
+  return elapsed;
+}
+
+@end
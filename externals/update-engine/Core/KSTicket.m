@@ -14,12 +14,7 @@
 
 #import "KSTicket.h"
 #import "KSExistenceChecker.h"
-
-// When reading a plist file pointed to by a tag, brandcode, or version
-// path, don't bother reading files over this size.  Chances are
-// someone is trying to feed us a bad file and forcing a crash.  The
-// largest plist found on my Leopard system was 4 megs.
-#define MAX_DATA_FILE_SIZE (5 * 1024 * 1024)
+#import "KSPlistCache.h"
 
 // If we are getting the tag, brandcode, or version from a path/tag
 // combination, make sure that the tag itself isn't unreasonably huge.
@@ -359,34 +354,10 @@
                    versionPathString];
 }
 
+// Tickets often share a plist (and each ticket reads it for its version, tag
+// and brand), so they all go through the shared cache.
 - (id)plistForPath:(NSString *)path {
-  NSString *fullPath = [path stringByStandardizingPath];
-
-  // Make sure it exists.
-  NSFileManager *fm = [NSFileManager defaultManager];
-  if (![fm fileExistsAtPath:fullPath]) return nil;
-
-  // Make sure file is not too big.
-  NSDictionary *fileAttrs = [fm attributesOfItemAtPath:fullPath error:nil];
-  NSNumber *sizeNumber = [fileAttrs valueForKey:NSFileSize];
-  if (sizeNumber == nil) return nil;
-
-  long fileSize = [sizeNumber longValue];
-  if (fileSize > MAX_DATA_FILE_SIZE) return nil;
-
-  // Use NSPropertyListSerialization to read the file.
-  NSData *data = [NSData dataWithContentsOfFile:fullPath];
-  if (data == nil) return nil;
-
-  id plist = [NSPropertyListSerialization
-               propertyListFromData:data
-                   mutabilityOption:NSPropertyListImmutable
-                             format:NULL
-                   errorDescription:NULL];
-
-  if (![plist isKindOfClass:[NSDictionary class]]) return nil;
-
-  return plist;
+  return [[KSPlistCache sharedCache] plistForPath:path];
 }
 
 - (NSString *)productID {
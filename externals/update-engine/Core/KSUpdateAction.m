@@ -93,5 +93,12 @@
   return [[self returnCode] intValue] == KS_INSTALL_WANTS_REBOOT;
 }
 
+- (NSDictionary *)traceArguments {
+  return [NSDictionary dictionaryWithObjectsAndKeys:
+          [updateInfo_ productID], @"productID",
+          [self returnCode], @"returnCode",
+          nil];
+}
+
 @end
 
@@ -158,6 +158,13 @@
           [self class], self, server_, tickets_];
 }
 
+- (NSDictionary *)traceArguments {
+  return [NSDictionary dictionaryWithObjectsAndKeys:
+          [NSNumber numberWithUnsignedInt:[tickets_ count]], @"tickets",
+          [[server_ url] absoluteString], @"url",
+          nil];
+}
+
 @end  // KSUpdateCheckAction
 
 
@@ -68,6 +68,7 @@
   BOOL wasSuccessful_;
   id delegate_;  // weak
   NSMutableDictionary *stats_;  // ProductID -> dictionary of stats.
+  NSString *tracePath_;  // Where to write the trace of the current run.
 }
 
 // Returns the path to the default ticket store if one was set. If one was not
@@ -155,7 +156,9 @@
 // NSString), whose value is a dictionary of data provided by the
 // class.  The contents of the value dictionary varies by server class
 // (if provided at all).  If there is no OOB data provided by server
-// classes, this method is not called.
+// classes, this method is not called.  It is called once every server
+// has been checked, so with kUpdateEngineStreamingPrefetch set it may come
+// after -engine:shouldPrefetchProducts:.
 //
 // Optional.
 - (void)engine:(KSUpdateEngine *)engine hasOutOfBandData:(NSDictionary *)oob;
@@ -199,6 +202,13 @@
 //   nil      = Don't prefetch anything (same as empty array)
 //   products = Prefetch all of the products (this is the default)
 //
+// Normally this is called once per update run, with every available update,
+// after -engine:hasOutOfBandData:. With the kUpdateEngineStreamingPrefetch
+// param set, it is instead called once for each server that returned updates,
+// with just that server's updates, as soon as that server has been checked;
+// so it may be called several times per run, and before
+// -engine:hasOutOfBandData:.
+//
 // Optional - if not implemented, the return value is |products|.
 - (NSArray *)engine:(KSUpdateEngine *)engine
   shouldPrefetchProducts:(NSArray *)products;
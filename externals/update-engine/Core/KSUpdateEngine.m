@@ -26,6 +26,7 @@
 #import "KSPromptAction.h"
 #import "KSSilentUpdateAction.h"
 #import "KSTicketStore.h"
+#import "KSTrace.h"
 #import "KSUpdateEngineParameters.h"
 #import "GTMLogger.h"
 #import "GTMNSString+FindFolder.h"
@@ -100,6 +101,9 @@ static NSString *gDefaultTicketStorePath = nil;
   [processor_ setDelegate:nil];
   [processor_ release];
   [stats_ release];
+  // Don't leave a trace running that nobody will stop
+  if (tracePath_) [KSTrace stopTracing];
+  [tracePath_ release];
   [super dealloc];
 }
 
@@ -193,6 +197,19 @@ static NSString *gDefaultTicketStorePath = nil;
 
 - (void)processingStopped:(KSActionProcessor *)processor {
   GTMLoggerInfo(@"processor=%@, wasSuccesful_=%d", processor, wasSuccessful_);
+  if (KSTraceIsEnabled()) {
+    NSNumber *success = [NSNumber numberWithBool:wasSuccessful_];
+    [KSTrace endSpanForObject:self
+                    arguments:[NSDictionary dictionaryWithObject:success
+                                                          forKey:@"success"]];
+  }
+  if (tracePath_) {
+    NSData *trace = [KSTrace stopTracing];
+    if (![trace writeToFile:tracePath_ atomically:YES])
+      GTMLoggerError(@"Failed to write trace to %@", tracePath_);
+    [tracePath_ release];
+    tracePath_ = nil;
+  }
   @try {
     if ([delegate_ respondsToSelector:@selector(engineFinished:wasSuccess:)])
       [delegate_ engineFinished:self wasSuccess:wasSuccessful_];
@@ -372,13 +389,19 @@ static NSString *gDefaultTicketStorePath = nil;
 
   // Build a KSMultiAction pipeline:
 
-  KSAction *check    = [KSCheckAction actionWithTickets:tickets
-                                                 params:params
-                                                 engine:self];
-  KSAction *oob      = [KSOutOfBandDataAction actionWithEngine:self];
-  KSAction *prefetch = [KSPrefetchAction actionWithEngine:self];
-  KSAction *silent   = [KSSilentUpdateAction actionWithEngine:self];
-  KSAction *prompt   = [KSPromptAction actionWithEngine:self];
+  KSCheckAction *check       = [KSCheckAction actionWithTickets:tickets
+                                                         params:params
+                                                         engine:self];
+  KSAction *oob              = [KSOutOfBandDataAction actionWithEngine:self];
+  KSPrefetchAction *prefetch = [KSPrefetchAction actionWithEngine:self];
+  KSAction *silent           = [KSSilentUpdateAction actionWithEngine:self];
+  KSAction *prompt           = [KSPromptAction actionWithEngine:self];
+
+  // Start prefetching each server's updates as soon as they come in, if asked
+  // to. The prefetch action still runs in its place below, and waits for the
+  // downloads to finish.
+  if ([[params_ objectForKey:kUpdateEngineStreamingPrefetch] boolValue])
+    [check setPrefetchAction:prefetch];
 
   [KSActionPipe bondFrom:check to:oob];
   [KSActionPipe bondFrom:oob to:prefetch];
@@ -391,6 +414,16 @@ static NSString *gDefaultTicketStorePath = nil;
   [processor_ enqueueAction:silent];
   [processor_ enqueueAction:prompt];
 
+  // Trace this run if asked to, unless something else is already tracing
+  NSString *tracePath = [params_ objectForKey:kUpdateEngineTracePath];
+  if (tracePath && !KSTraceIsEnabled()) {
+    [KSTrace startTracing];
+    [tracePath_ autorelease];
+    tracePath_ = [tracePath copy];
+  }
+  if (KSTraceIsEnabled())
+    [KSTrace beginSpanForObject:self name:@"KSUpdateEngine" parent:nil];
+
   [processor_ startProcessing];
 }
 
@@ -37,6 +37,16 @@
 // information returned by the server on a previous run.  KSOmahaServer
 // stores its secondsSinceMidnight value here.
 #define kUpdateEngineServerInfoKey          @"ServerInfo"
+// Path of a file to write a KSTrace of each update run to, as Chrome
+// trace-event JSON.  Ignored if something else is already tracing.
+#define kUpdateEngineTracePath              @"TracePath"
+// BOOL in NSNumber.  If YES, each server's updates are offered for
+// prefetching as soon as its check finishes, instead of once every server
+// has been checked.  See -[KSCheckAction setPrefetchAction:].  The
+// delegate's -engine:shouldPrefetchProducts: is then called once for each
+// server with updates, and before -engine:hasOutOfBandData:, which still
+// comes once every server has been checked.
+#define kUpdateEngineStreamingPrefetch      @"StreamingPrefetch"
 
 // Product stat dictionary keys.
 #define kUpdateEngineProductStatsActive  @"Active"  // BOOL in NSNumber
@@ -20,7 +20,7 @@
 
 // UECatalogDownloadAction takes a catalog of image url strings from the
 // action pipe, and then downloads each of the images using its own
-// action processor.
+// parallel action processor.
 //
 @interface UECatalogDownloadAction : KSAction {
  @private
@@ -16,7 +16,7 @@
 
 // Update Engine action classes.
 #import "KSActionPipe.h"
-#import "KSActionProcessor.h"
+#import "KSParallelActionProcessor.h"
 
 // Action sample classes.
 #import "UEImageDownloadAction.h"
@@ -39,8 +39,9 @@
                 [imageURLStrings count]);
 
   // We're going to run each image download as a distinct action in
-  // our own action processor.
-  actionProcessor_ = [[KSActionProcessor alloc] initWithDelegate:self];
+  // our own action processor.  The downloads don't depend on each other,
+  // so a parallel processor can fetch several images at once.
+  actionProcessor_ = [[KSParallelActionProcessor alloc] initWithDelegate:self];
 
   // Walk the url strings, make an URL, make a new image download action,
   // then add it to the queue.
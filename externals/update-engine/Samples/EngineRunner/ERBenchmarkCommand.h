@@ -0,0 +1,53 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#import "ERCommand.h"
+
+@class GTMHTTPServer;
+
+// ERBenchmarkCommand times a full -updateAllProducts run against a local
+// server, for increasing numbers of tickets.  For each count it makes that
+// many tickets in a memory ticket store, all pointing at a GTMHTTPServer
+// running in this process, which serves a rule plist with an update for
+// every ticket, and the payload those rules point at.  The engine then
+// checks, prefetches and installs as usual, with a command runner that
+// doesn't run anything.  Each run prints a line with the wall time, the
+// change in the number and size of live malloc blocks for each stage, and
+// the peak resident size of the process so far.
+//
+// The install stage mounts the payload and runs its .engine_install script
+// like any other install, so it needs a real payload disk image whose
+// script succeeds, such as Core/TestResources/Test-SUCCESS.dmg.  Without
+// one, a synthetic payload is served and the run stops after prefetching.
+//
+// Optional arguments:
+//   counts : Comma-separated ticket counts (default 1,10,100,1000,10000)
+//   payload : Path to the disk image to serve as every product's update
+//   stages : Last stage to run: check, prefetch or install
+//
+@interface ERBenchmarkCommand : ERCommand {
+ @private
+  GTMHTTPServer *server_;
+  NSData *rules_;       // The rule plist being served.
+  NSData *payload_;     // The update being served.
+  int lastStage_;       // Index of the last stage to run.
+  int stage_;           // Index of the stage that's running.
+  NSDate *stageStart_;  // When the running stage started.
+  size_t stageBlocks_;  // Live malloc blocks when the stage started.
+  size_t stageBytes_;   // Live malloc bytes when the stage started.
+  NSMutableString *report_;  // The current run's stage figures.
+  int failures_;        // Number of products that failed to install.
+}
+
+@end  // ERBenchmarkCommand
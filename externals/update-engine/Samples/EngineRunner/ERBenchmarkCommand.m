@@ -0,0 +1,423 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#import "ERBenchmarkCommand.h"
+
+#import <malloc/malloc.h>
+#import <sys/resource.h>
+
+#import "GTMBase64.h"
+#import "GTMHTTPServer.h"
+#import "GTMLogger.h"
+#import "KSDownloadAction.h"
+#import "KSUpdateEngine.h"
+#import "NSData+Hash.h"
+
+
+// The stages of a run, in order.  Making the tickets isn't part of the
+// engine, but a big ticket store isn't free either.
+enum {
+  kStageNone = -1,
+  kStageTickets,
+  kStageCheck,
+  kStagePrefetch,
+  kStageInstall,
+};
+
+static const char *kStageNames[] = {
+  "tickets", "check", "prefetch", "install"
+};
+
+static NSString *const kDefaultCounts = @"1,10,100,1000,10000";
+
+// Size of the payload served when no disk image is given.
+static const int kSyntheticPayloadSize = 64 * 1024;
+
+
+// A command runner that doesn't run anything, so the benchmark measures
+// the engine rather than the payload's pre- and postinstall scripts.
+@interface ERNoOpCommandRunner : NSObject <KSCommandRunner>
+@end
+
+@implementation ERNoOpCommandRunner
+
+- (int)runCommand:(NSString *)path
+         withArgs:(NSArray *)args
+      environment:(NSDictionary *)env
+           output:(NSString **)output
+         stdError:(NSString **)stderror {
+  if (output) *output = @"";
+  if (stderror) *stderror = @"";
+  return 0;
+}
+
+- (int)runCommand:(NSString *)path
+         withArgs:(NSArray *)args
+      environment:(NSDictionary *)env
+           output:(NSString **)output {
+  return [self runCommand:path
+                 withArgs:args
+              environment:env
+                   output:output
+                 stdError:NULL];
+}
+
+@end  // ERNoOpCommandRunner
+
+
+@interface ERBenchmarkCommand (PrivateMethods)
+
+// Runs the engine over |count| tickets and prints the results.
+- (BOOL)runWithCount:(int)count;
+
+// Returns the product ID of the |index|th ticket.
+- (NSString *)productIDForIndex:(int)index;
+
+// Removes any downloads left by an earlier run, which would otherwise let
+// the prefetch skip its downloads.
+- (void)removeDownloadsForCount:(int)count;
+
+// Stage bookkeeping.
+- (void)startStage:(int)stage;
+- (void)finishStage;
+
+@end  // PrivateMethods
+
+
+// Returns the number and total size of the live malloc blocks in all zones.
+static void GetMallocStatistics(size_t *blocks, size_t *bytes) {
+  malloc_statistics_t stats;
+  malloc_zone_statistics(NULL, &stats);
+  *blocks = stats.blocks_in_use;
+  *bytes = stats.size_in_use;
+}
+
+
+@implementation ERBenchmarkCommand
+
+- (void)dealloc {
+  [server_ stop];
+  [server_ release];
+  [rules_ release];
+  [payload_ release];
+  [stageStart_ release];
+  [report_ release];
+  [super dealloc];
+}  // dealloc
+
+
+- (NSString *)name {
+  return @"benchmark";
+}  // name
+
+
+- (NSString *)blurb {
+  return @"Time updates of many products from a local server";
+}  // blurb
+
+
+- (NSDictionary *)optionalArguments {
+  return [NSDictionary dictionaryWithObjectsAndKeys:
+                       @"Comma-separated ticket counts", @"counts",
+                       @"Disk image to serve as the update", @"payload",
+                       @"Last stage to run (check, prefetch, install)",
+                       @"stages",
+                       nil];
+
+}  // optionalArguments
+
+
+- (BOOL)runWithArguments:(NSDictionary *)args {
+  NSString *counts = [args objectForKey:@"counts"];
+  if (counts == nil) counts = kDefaultCounts;
+  stage_ = kStageNone;
+
+  // Without a real disk image there's nothing to install.
+  NSString *payloadPath = [args objectForKey:@"payload"];
+  if (payloadPath) {
+    payload_ = [[NSData alloc] initWithContentsOfFile:payloadPath];
+    if (payload_ == nil) {
+      fprintf(stderr, "Could not read payload %s\n",
+              [payloadPath fileSystemRepresentation]);
+      return NO;
+    }
+    lastStage_ = kStageInstall;
+  } else {
+    NSMutableData *payload =
+      [NSMutableData dataWithLength:kSyntheticPayloadSize];
+    unsigned char *bytes = [payload mutableBytes];
+    for (int i = 0; i < kSyntheticPayloadSize; i++) {
+      bytes[i] = (unsigned char)i;
+    }
+    payload_ = [payload copy];
+    lastStage_ = kStagePrefetch;
+  }
+
+  NSString *stages = [args objectForKey:@"stages"];
+  if (stages) {
+    int stage;
+    for (stage = kStageCheck; stage <= kStageInstall; stage++) {
+      if (strcmp([stages UTF8String], kStageNames[stage]) == 0) break;
+    }
+    if (stage > kStageInstall) {
+      fprintf(stderr, "Unknown stage '%s'\n", [stages UTF8String]);
+      return NO;
+    }
+    if (stage > lastStage_) {
+      fprintf(stderr, "Can't install without a payload\n");
+      return NO;
+    }
+    lastStage_ = stage;
+  }
+
+  // Every ticket uses the same server URL, so the check makes one fetch for
+  // a rule plist with |count| rules, as it would for a product line sharing
+  // a server.
+  server_ = [[GTMHTTPServer alloc] initWithDelegate:self];
+  [server_ setLocalhostOnly:YES];
+  NSError *error = nil;
+  if (![server_ start:&error]) {
+    fprintf(stderr, "Could not start the server: %s\n",
+            [[error description] UTF8String]);
+    return NO;
+  }
+
+  fprintf(stdout, "Serving on port %d, running to %s\n",
+          [server_ port], kStageNames[lastStage_]);
+
+  BOOL success = YES;
+  NSEnumerator *countEnumerator =
+    [[counts componentsSeparatedByString:@","] objectEnumerator];
+  NSString *countString;
+  while ((countString = [countEnumerator nextObject])) {
+    int count = [countString intValue];
+    if (count < 1) continue;
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    if (![self runWithCount:count]) success = NO;
+    [pool release];
+  }
+
+  [server_ stop];
+  return success;
+
+}  // runWithArguments
+
+@end  // ERBenchmarkCommand
+
+
+@implementation ERBenchmarkCommand (PrivateMethods)
+
+- (BOOL)runWithCount:(int)count {
+  NSString *base = [NSString stringWithFormat:@"http://localhost:%d",
+                             [server_ port]];
+  NSURL *serverURL =
+    [NSURL URLWithString:[base stringByAppendingString:@"/rules.plist"]];
+  NSString *hash = [GTMBase64 stringByEncodingData:[payload_ SHA1Hash]];
+  NSString *size = [NSString stringWithFormat:@"%lu",
+                             (unsigned long)[payload_ length]];
+
+  // The server's rules are made up front, since they're not the client's
+  // work.  Each rule points at its own URL so that no download is shared.
+  NSMutableArray *rules = [NSMutableArray arrayWithCapacity:count];
+  for (int i = 0; i < count; i++) {
+    NSString *productID = [self productIDForIndex:i];
+    NSString *codebase =
+      [NSString stringWithFormat:@"%@/payload/%@.dmg", base, productID];
+    [rules addObject:[NSDictionary dictionaryWithObjectsAndKeys:
+                      productID, @"ProductID",
+                      @"Ticket.version != '2.0'", @"Predicate",
+                      codebase, @"Codebase",
+                      hash, @"Hash",
+                      size, @"Size",
+                      nil]];
+  }
+  [rules_ release];
+  rules_ = [[NSPropertyListSerialization
+             dataFromPropertyList:[NSDictionary dictionaryWithObject:rules
+                                                              forKey:@"Rules"]
+                           format:NSPropertyListXMLFormat_v1_0
+                 errorDescription:NULL] retain];
+
+  [self removeDownloadsForCount:count];
+
+  [report_ release];
+  report_ = [[NSMutableString alloc] init];
+  failures_ = 0;
+  NSDate *runStart = [NSDate date];
+
+  [self startStage:kStageTickets];
+  KSTicketStore *ticketStore = [[[KSMemoryTicketStore alloc] init] autorelease];
+  KSExistenceChecker *existenceChecker = [KSExistenceChecker trueChecker];
+  for (int i = 0; i < count; i++) {
+    KSTicket *ticket =
+      [KSTicket ticketWithProductID:[self productIDForIndex:i]
+                            version:@"1.0"
+                   existenceChecker:existenceChecker
+                          serverURL:serverURL];
+    [ticketStore storeTicket:ticket];
+  }
+  [self finishStage];
+
+  [self startStage:kStageCheck];
+  KSUpdateEngine *vroom = [KSUpdateEngine engineWithTicketStore:ticketStore
+                                                       delegate:self];
+  [vroom updateAllProducts];
+
+  // Spin in short slices so that the stage times aren't rounded up to the
+  // next second.  The server and the fetches are run from this run loop.
+  while ([vroom isUpdating]) {
+    NSDate *spin = [NSDate dateWithTimeIntervalSinceNow:0.1];
+    [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:spin];
+  }
+  [self finishStage];
+
+  // ru_maxrss is the peak for the whole process; running the counts in
+  // increasing order makes it the peak for the largest run so far.
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+
+  fprintf(stdout, "%d tickets: %.3fs total,%s peak RSS %.1f MB",
+          count, -[runStart timeIntervalSinceNow], [report_ UTF8String],
+          usage.ru_maxrss / (1024.0 * 1024.0));
+  if (failures_ > 0) {
+    fprintf(stdout, ", %d failed", failures_);
+  }
+  fprintf(stdout, "\n");
+
+  [self removeDownloadsForCount:count];
+
+  return failures_ == 0;
+
+}  // runWithCount
+
+
+- (NSString *)productIDForIndex:(int)index {
+  return [NSString stringWithFormat:@"com.google.UpdateEngine.Benchmark%d",
+                   index];
+}  // productIDForIndex
+
+
+- (void)removeDownloadsForCount:(int)count {
+  NSString *downloads = [KSDownloadAction defaultDownloadDirectory];
+  NSFileManager *fm = [NSFileManager defaultManager];
+  for (int i = 0; i < count; i++) {
+    NSString *name =
+      [[self productIDForIndex:i] stringByAppendingPathExtension:@"dmg"];
+    [fm removeItemAtPath:[downloads stringByAppendingPathComponent:name]
+                   error:NULL];
+  }
+}  // removeDownloadsForCount
+
+
+- (void)startStage:(int)stage {
+  stage_ = stage;
+  [stageStart_ release];
+  stageStart_ = [[NSDate alloc] init];
+  GetMallocStatistics(&stageBlocks_, &stageBytes_);
+}  // startStage
+
+
+- (void)finishStage {
+  if (stage_ == kStageNone) return;
+
+  size_t blocks, bytes;
+  GetMallocStatistics(&blocks, &bytes);
+  [report_ appendFormat:@" %s %.3fs (%+ld blocks, %+ld KB),",
+           kStageNames[stage_], -[stageStart_ timeIntervalSinceNow],
+           (long)(blocks - stageBlocks_), (long)(bytes - stageBytes_) / 1024];
+  stage_ = kStageNone;
+}  // finishStage
+
+@end  // PrivateMethods
+
+
+@implementation ERBenchmarkCommand (GTMHTTPServerDelegateMethods)
+
+- (GTMHTTPResponseMessage *)httpServer:(GTMHTTPServer *)server
+                         handleRequest:(GTMHTTPRequestMessage *)request {
+  NSString *path = [[request URL] path];
+
+  if ([path isEqualToString:@"/rules.plist"]) {
+    return [GTMHTTPResponseMessage responseWithBody:rules_
+                                        contentType:@"text/xml"
+                                         statusCode:200];
+  }
+  if ([path hasPrefix:@"/payload/"]) {
+    return [GTMHTTPResponseMessage
+             responseWithBody:payload_
+                  contentType:@"application/octet-stream"
+                   statusCode:200];
+  }
+  return [GTMHTTPResponseMessage emptyResponseWithCode:404];
+
+}  // handleRequest
+
+@end  // GTMHTTPServerDelegateMethods
+
+
+@implementation ERBenchmarkCommand (UpdateEngineDelegateMethods)
+
+// The check is over once the engine asks about prefetching.
+- (NSArray *)engine:(KSUpdateEngine *)engine
+  shouldPrefetchProducts:(NSArray *)products {
+  [self finishStage];
+
+  if (lastStage_ == kStageCheck) {
+    [engine stopAndReset];
+    return nil;
+  }
+  if ([products count] == 0) return nil;
+
+  [self startStage:kStagePrefetch];
+  return products;
+
+}  // shouldPrefetchProducts
+
+
+// The prefetch is over once the engine asks about silent updates.
+- (NSArray *)engine:(KSUpdateEngine *)engine
+  shouldSilentlyUpdateProducts:(NSArray *)products {
+  [self finishStage];
+
+  if (lastStage_ == kStagePrefetch || [products count] == 0) return nil;
+
+  [self startStage:kStageInstall];
+  return products;
+
+}  // shouldSilentlyUpdateProducts
+
+
+- (id<KSCommandRunner>)commandRunnerForEngine:(KSUpdateEngine *)engine {
+  return [[[ERNoOpCommandRunner alloc] init] autorelease];
+}  // commandRunnerForEngine
+
+
+// Everything that was going to be installed was installed silently.
+- (NSArray *)engine:(KSUpdateEngine *)engine
+  shouldUpdateProducts:(NSArray *)products {
+  return nil;
+}  // shouldUpdateProducts
+
+
+- (void)engine:(KSUpdateEngine *)engine
+      finished:(KSUpdateInfo *)updateInfo
+    wasSuccess:(BOOL)wasSuccess
+   wantsReboot:(BOOL)wantsReboot {
+  if (!wasSuccess) {
+    GTMLoggerError(@"benchmark update of %@ failed", [updateInfo productID]);
+    failures_++;
+  }
+}  // finished
+
+@end  // UpdateEngineDelegateMethods
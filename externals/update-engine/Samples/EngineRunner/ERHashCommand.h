@@ -0,0 +1,31 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#import "ERCommand.h"
+
+// ERHashCommand prints the size and base64 encoded SHA-1 hash of files, for
+// the Size and Hash keys of a rule plist.  It does the same job as
+// kshash.sh, but reads each file just once, a chunk at a time, and hashes
+// several files at once, so it keeps up with big batches of big payloads.
+// Each file gets a line with its size, its hash, optionally its SHA-256
+// hash, and its path, separated by tabs, in the order the files were given.
+//
+// Optional arguments (at least one of file and files is needed):
+//   file : Path of a file to hash
+//   files : Path of a file listing files to hash, one per line, or - for stdin
+//   jobs : Number of files to hash at once (default: one per processor)
+//   sha256 : YES to also print each file's SHA-256 hash
+//
+@interface ERHashCommand : ERCommand
+@end  // ERHashCommand
@@ -0,0 +1,237 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#import "ERHashCommand.h"
+
+#import "GTMBase64.h"
+#import "NSData+Hash.h"
+
+
+// Hashes one file, and holds the line to print for it.
+@interface ERHashOperation : NSOperation {
+ @private
+  NSString *path_;
+  BOOL wantSHA256_;
+  NSCondition *done_;  // Shared by all the operations; signaled after main.
+  BOOL isDone_;        // Guarded by done_.
+  NSString *line_;     // nil if the file couldn't be read.
+}
+
+- (id)initWithPath:(NSString *)path
+        wantSHA256:(BOOL)wantSHA256
+              done:(NSCondition *)done;
+
+- (NSString *)path;
+
+// Blocks until the file has been hashed, then returns its line.
+- (NSString *)waitForLine;
+
+@end  // ERHashOperation
+
+
+@implementation ERHashOperation
+
+- (id)initWithPath:(NSString *)path
+        wantSHA256:(BOOL)wantSHA256
+              done:(NSCondition *)done {
+  if ((self = [super init])) {
+    path_ = [path copy];
+    wantSHA256_ = wantSHA256;
+    done_ = [done retain];
+  }
+  return self;
+}  // initWithPath
+
+
+- (void)dealloc {
+  [path_ release];
+  [done_ release];
+  [line_ release];
+  [super dealloc];
+}  // dealloc
+
+
+- (NSString *)path {
+  return path_;
+}  // path
+
+
+- (NSString *)waitForLine {
+  [done_ lock];
+  while (!isDone_) {
+    [done_ wait];
+  }
+  [done_ unlock];
+  return line_;
+}  // waitForLine
+
+
+- (void)main {
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+
+  NSData *sha1 = nil;
+  NSData *sha256 = nil;
+  unsigned long long size = 0;
+  if ([NSData getSHA1Hash:&sha1
+               SHA256Hash:(wantSHA256_ ? &sha256 : NULL)
+                     size:&size
+             ofFileAtPath:path_]) {
+    NSMutableString *line =
+      [NSMutableString stringWithFormat:@"%llu\t%@", size,
+                       [GTMBase64 stringByEncodingData:sha1]];
+    if (sha256) {
+      [line appendFormat:@"\t%@", [GTMBase64 stringByEncodingData:sha256]];
+    }
+    [line appendFormat:@"\t%@\n", path_];
+    line_ = [line copy];
+  }
+
+  [done_ lock];
+  isDone_ = YES;
+  [done_ broadcast];
+  [done_ unlock];
+
+  [pool release];
+}  // main
+
+@end  // ERHashOperation
+
+
+@interface ERHashCommand (PrivateMethods)
+
+// Returns the paths named by the file and files arguments, or nil if the
+// list of files can't be read.
+- (NSArray *)pathsFromArguments:(NSDictionary *)args;
+
+@end  // PrivateMethods
+
+
+@implementation ERHashCommand
+
+- (NSString *)name {
+  return @"hash";
+}  // name
+
+
+- (NSString *)blurb {
+  return @"Print the sizes and hashes of files, for rule plists";
+}  // blurb
+
+
+- (NSDictionary *)optionalArguments {
+  return [NSDictionary dictionaryWithObjectsAndKeys:
+                       @"Path of a file to hash", @"file",
+                       @"File listing files to hash, or - for stdin", @"files",
+                       @"Number of files to hash at once", @"jobs",
+                       @"YES to also print SHA-256 hashes", @"sha256",
+                       nil];
+
+}  // optionalArguments
+
+
+- (BOOL)runWithArguments:(NSDictionary *)args {
+  NSArray *paths = [self pathsFromArguments:args];
+  if (paths == nil) return NO;
+  if ([paths count] == 0) {
+    fprintf(stderr, "No files to hash; use -file or -files\n");
+    return NO;
+  }
+
+  int jobs = [[args objectForKey:@"jobs"] intValue];
+  if (jobs <= 0) {
+    jobs = [[NSProcessInfo processInfo] activeProcessorCount];
+  }
+  BOOL wantSHA256 = [[args objectForKey:@"sha256"] boolValue];
+
+  NSOperationQueue *queue = [[[NSOperationQueue alloc] init] autorelease];
+  [queue setMaxConcurrentOperationCount:jobs];
+
+  NSCondition *done = [[[NSCondition alloc] init] autorelease];
+  NSMutableArray *operations = [NSMutableArray array];
+  NSEnumerator *pathEnumerator = [paths objectEnumerator];
+  NSString *path;
+  while ((path = [pathEnumerator nextObject])) {
+    ERHashOperation *operation =
+      [[[ERHashOperation alloc] initWithPath:path
+                                  wantSHA256:wantSHA256
+                                        done:done] autorelease];
+    [operations addObject:operation];
+    [queue addOperation:operation];
+  }
+
+  // Print each file's line as soon as it and every file before it are done,
+  // so output keeps the input order without waiting for the whole batch.
+  BOOL success = YES;
+  NSEnumerator *operationEnumerator = [operations objectEnumerator];
+  ERHashOperation *operation;
+  while ((operation = [operationEnumerator nextObject])) {
+    NSString *line = [operation waitForLine];
+    if (line) {
+      fputs([line UTF8String], stdout);
+    } else {
+      fprintf(stderr, "Could not read %s\n", [[operation path] UTF8String]);
+      success = NO;
+    }
+  }
+  fflush(stdout);
+
+  return success;
+
+}  // runWithArguments
+
+@end  // ERHashCommand
+
+
+@implementation ERHashCommand (PrivateMethods)
+
+- (NSArray *)pathsFromArguments:(NSDictionary *)args {
+  NSMutableArray *paths = [NSMutableArray array];
+
+  NSString *file = [args objectForKey:@"file"];
+  if (file) [paths addObject:file];
+
+  NSString *listPath = [args objectForKey:@"files"];
+  if (listPath) {
+    NSData *listData;
+    if ([listPath isEqualToString:@"-"]) {
+      NSFileHandle *stdinHandle = [NSFileHandle fileHandleWithStandardInput];
+      listData = [stdinHandle readDataToEndOfFile];
+    } else {
+      listData = [NSData dataWithContentsOfFile:listPath];
+    }
+    NSString *list = nil;
+    if (listData) {
+      list = [[[NSString alloc] initWithData:listData
+                                    encoding:NSUTF8StringEncoding]
+               autorelease];
+    }
+    if (list == nil) {
+      fprintf(stderr, "Could not read the list of files in %s\n",
+              [listPath UTF8String]);
+      return nil;
+    }
+
+    NSEnumerator *lineEnumerator =
+      [[list componentsSeparatedByString:@"\n"] objectEnumerator];
+    NSString *line;
+    while ((line = [lineEnumerator nextObject])) {
+      if ([line length] > 0) [paths addObject:line];
+    }
+  }
+
+  return paths;
+
+}  // pathsFromArguments
+
+@end  // PrivateMethods
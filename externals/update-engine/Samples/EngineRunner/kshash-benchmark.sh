@@ -0,0 +1,58 @@
+#!/bin/bash
+# Copyright 2011 Google Inc.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# This script times kshash.sh against "EngineRunner hash" on a batch of
+# generated files, and checks that they agree on every hash.
+
+PATH=/bin:/usr/bin; export PATH
+
+if [ $# -lt 1 ]; then
+  echo "Usage: kshash-benchmark.sh path/to/EngineRunner [count] [size-in-KB]"
+  exit 1
+fi
+
+enginerunner=$1
+count=${2:-200}
+size=${3:-1024}
+kshash=$(dirname "$0")/kshash.sh
+
+dir=$(mktemp -d /tmp/kshash-benchmark.XXXXXX) || exit 1
+trap 'rm -rf "$dir"' EXIT
+
+echo "Making $count files of ${size}KB in $dir"
+mkdir "$dir/files"
+for ((i = 0; i < count; i++)); do
+  dd if=/dev/urandom of="$dir/files/$i.dmg" bs=1024 count=$size 2>/dev/null
+done
+ls "$dir"/files/*.dmg > "$dir/list"
+
+echo "kshash.sh:"
+time "$kshash" $(cat "$dir/list") > "$dir/kshash.out"
+
+echo "EngineRunner hash:"
+time "$enginerunner" hash -files "$dir/list" > "$dir/enginerunner.out"
+
+echo "EngineRunner hash -sha256 YES:"
+time "$enginerunner" hash -files "$dir/list" -sha256 YES > /dev/null
+
+awk -F'\t' '{print $2}' "$dir/kshash.out" | sort > "$dir/kshash.hashes"
+awk -F'\t' '{print $2}' "$dir/enginerunner.out" | sort \
+  > "$dir/enginerunner.hashes"
+if cmp -s "$dir/kshash.hashes" "$dir/enginerunner.hashes"; then
+  echo "Hashes match"
+else
+  echo "Hashes differ"
+  exit 1
+fi
@@ -29,11 +29,13 @@ that it supports:
     $ EngineRunner
     EngineRunner supports these commands:
         add : Add a new ticket to a ticket store
+        benchmark : Time updates of many products from a local server
         change : Change attributes of a ticket
         delete : Delete a ticket from the store
         dryrun : See if an update is needed, but don't install it
         dryrunticket : See available updates in a ticket store but don't
                        install any
+        hash : Print the sizes and hashes of files, for rule plists
         list : Lists all of the tickets in a ticket store
         run : Update a single product
         runticket : Update all of the products in a ticket store
@@ -116,6 +118,22 @@ Or supply a productID to just update one product:
                        -productid com.google.bork
     finished update of com.google.bork:  Success
 
+To see how the engine copes with many products, use 'benchmark'.  It
+serves rules for each count of tickets from a server inside EngineRunner,
+updates them all, and reports the time and memory used by each stage:
+
+    $ EngineRunner benchmark -counts 1,100,1000
+          -payload Core/TestResources/Test-SUCCESS.dmg
+    Serving on port 50123, running to install
+    1 tickets: 0.412s total, tickets 0.000s (+12 blocks, +1 KB), ...
+
+To fill in the Size and Hash of each update in a rule plist, use 'hash'.
+It hashes several files at once, and prints their lines in the order the
+files were given (kshash-benchmark.sh times it against kshash.sh):
+
+    $ ls /tmp/updates/*.dmg | EngineRunner hash -files - -sha256 YES
+    1187218  TTMlKrdnSKrZHPbVHXdlxCKxTGw=  zHqW...  /tmp/updates/a.dmg
+
 _Logging and Output_
 
 EngineRunner uses the GTMLogger ring buffer for controlling update
@@ -150,10 +168,12 @@ ERCommand and add it to the command runner.
 
 // Command classes.
 #import "ERAddTicketCommand.h"
+#import "ERBenchmarkCommand.h"
 #import "ERChangeTicketCommand.h"
 #import "ERDeleteTicketCommand.h"
 #import "ERDryRunCommand.h"
 #import "ERDryRunTicketCommand.h"
+#import "ERHashCommand.h"
 #import "ERListTicketsCommand.h"
 #import "ERRunUpdateCommand.h"
 #import "ERRunUpdateTicketCommand.h"
@@ -186,6 +206,8 @@ int main(int argc, const char *argv[]) {
   [runner registerCommand:[ERDryRunCommand command]];
   [runner registerCommand:[ERDryRunTicketCommand command]];
   [runner registerCommand:[ERSelfUpdateCommand command]];
+  [runner registerCommand:[ERBenchmarkCommand command]];
+  [runner registerCommand:[ERHashCommand command]];
 
   // First see if the user neglected to give us any arguments, an obvious
   // cry for help.
@@ -21,10 +21,14 @@
 #import "GDataFeedBase.h"
 
 #import "GDataBaseElements.h"
+#import "GDataXMLInputStream.h"
 
+// feeds with fewer entries are posted as XMLData rather than streamed
+static const NSUInteger kGDataMinimumStreamedFeedEntries = 50;
 
 @interface GDataFeedBase (PrivateMethods)
 - (void)setupFromXMLElement:(NSXMLElement *)root;
+- (BOOL)getEntriesXMLHead:(NSData **)outHead tail:(NSData **)outTail;
 @end
 
 @implementation GDataFeedBase
@@ -285,7 +289,7 @@ shouldIgnoreUnknowns:(BOOL)shouldIgnoreUnknowns {
 }
 #endif
 
-- (NSXMLElement *)XMLElement {
+- (NSXMLElement *)XMLElementWithoutEntries {
 
   NSXMLElement *element = [self XMLElementWithExtensionsAndDefaultName:@"feed"];
 
@@ -293,11 +297,122 @@ shouldIgnoreUnknowns:(BOOL)shouldIgnoreUnknowns {
     [element addChild:[[self generator] XMLElement]];
   }
 
+  return element;
+}
+
+- (NSXMLElement *)XMLElement {
+
+  NSXMLElement *element = [self XMLElementWithoutEntries];
+
   [self addToElement:element XMLElementsForArray:[self entries]];
 
   return element;
 }
 
+// returns the offset of the last occurrence of the bytes of target in data,
+// or NSNotFound
+static NSUInteger LastOffsetOfDataInData(NSData *target, NSData *data) {
+  const char *bytes = [data bytes];
+  const char *targetBytes = [target bytes];
+  NSUInteger length = [data length];
+  NSUInteger targetLength = [target length];
+
+  if (targetLength == 0 || targetLength > length) return NSNotFound;
+
+  for (NSUInteger offset = length - targetLength + 1; offset > 0; offset--) {
+    if (memcmp(bytes + offset - 1, targetBytes, targetLength) == 0) {
+      return offset - 1;
+    }
+  }
+  return NSNotFound;
+}
+
+// The feed's document is generated without a tree for the whole feed, which
+// for large batch feeds takes several times the memory of the XML itself.
+//
+// The feed element is generated with a placeholder text node where the
+// entries belong, since they're its last children, and the document bytes
+// before and after the placeholder are returned as the head and tail. Each
+// entry is then generated and serialized on its own, between them.
+- (BOOL)getEntriesXMLHead:(NSData **)outHead tail:(NSData **)outTail {
+
+  // subclasses which generate their own XML are left to the superclass
+  IMP feedIMP = [GDataFeedBase instanceMethodForSelector:@selector(XMLElement)];
+  IMP selfIMP = [[self class] instanceMethodForSelector:@selector(XMLElement)];
+  if ([[self entries] count] == 0 || feedIMP != selfIMP) {
+    return NO;
+  }
+
+  NSString *const kPlaceholder = @"GDataFeedBaseEntriesPlaceholder";
+
+  NSXMLElement *element = [self XMLElementWithoutEntries];
+  [element addChild:[NSXMLNode textWithStringValue:kPlaceholder]];
+
+  NSData *feedData = [[self XMLDocumentWithRootElement:element] XMLData];
+  NSData *placeholderData = [kPlaceholder dataUsingEncoding:NSUTF8StringEncoding];
+
+  NSUInteger placeholderOffset = LastOffsetOfDataInData(placeholderData, feedData);
+  if (placeholderOffset == NSNotFound) {
+    GDATA_DEBUG_LOG(@"GDataFeedBase: missing entries placeholder");
+    return NO;
+  }
+
+  NSUInteger tailOffset = placeholderOffset + [placeholderData length];
+  NSRange headRange = NSMakeRange(0, placeholderOffset);
+  NSRange tailRange = NSMakeRange(tailOffset, [feedData length] - tailOffset);
+
+  *outHead = [feedData subdataWithRange:headRange];
+  *outTail = [feedData subdataWithRange:tailRange];
+  return YES;
+}
+
+- (NSData *)XMLData {
+
+  NSData *head = nil;
+  NSData *tail = nil;
+  if (![self getEntriesXMLHead:&head tail:&tail]) {
+    return [super XMLData];
+  }
+
+  NSMutableData *result = [NSMutableData dataWithData:head];
+
+  for (GDataEntryBase *entry in [self entries]) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+
+    [result appendData:[GDataXMLInputStream XMLDataForObject:entry]];
+
+    [pool release];
+  }
+
+  [result appendData:tail];
+  return result;
+}
+
+// Feeds with many entries are posted as a stream, so serialization overlaps
+// the upload and only one entry's XML is in memory at a time.  Smaller feeds
+// are posted as XMLData, since measuring a stream's length generates each
+// entry's XML twice, and plain data survives http redirects.
+- (BOOL)generateXMLInputStream:(NSInputStream **)outInputStream
+                        length:(unsigned long long *)outLength {
+
+  NSArray *entries = [self entries];
+
+  NSData *head = nil;
+  NSData *tail = nil;
+  if ([entries count] < kGDataMinimumStreamedFeedEntries
+      || ![self getEntriesXMLHead:&head tail:&tail]) {
+    return [super generateXMLInputStream:outInputStream
+                                  length:outLength];
+  }
+
+  GDataXMLInputStream *stream = [GDataXMLInputStream streamWithHead:head
+                                                            objects:entries
+                                                               tail:tail];
+  *outInputStream = stream;
+  *outLength = [stream streamLength];
+  return YES;
+}
+
 
 #pragma mark -
 
@@ -251,6 +251,25 @@ typedef struct GDataDescriptionRecord {
   // copied by copyWithZone:
   id userData_;
   NSMutableDictionary *userProperties_;
+
+  // hash of the content compared by isEqual:, valid until the next mutation
+  // of any GDataObject
+  NSUInteger cachedHash_;
+  int32_t cachedHashGeneration_;
+  BOOL hasCachedHash_;
+
+  // number of copies of parent objects which share this object as an
+  // extension in addition to its original owner; a shared object is
+  // copied before an owner hands it out
+  volatile int32_t sharingCount_;
+
+  // set when this object's extensions have been shared with a copy
+  BOOL hasSharedExtensions_;
+
+  // set once this object has been handed to or out of a parent's extension
+  // accessors, so it may be held and modified outside its parent; copies of
+  // the parent get their own copy of it rather than sharing it
+  BOOL isExposed_;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -270,6 +289,10 @@ typedef struct GDataDescriptionRecord {
 
 - (NSXMLDocument *)XMLDocument; // returns this XMLElement wrapped in an NSXMLDocument
 
+// UTF-8 XML for this object as a document, as from [[self XMLDocument] XMLData];
+// subclasses may generate it without building a tree for the whole object
+- (NSData *)XMLData;
+
 // setters/getters
 
 // namespaces here are a dictionary mapping prefix to URI; they are not
@@ -372,6 +395,11 @@ typedef struct GDataDescriptionRecord {
                             length:(unsigned long long *)outLength
                            headers:(NSDictionary **)outHeaders;
 
+// XML stream: returns NO for objects other than large feeds, which may stream
+// the XML of their document, generating each entry's XML as it is read
+- (BOOL)generateXMLInputStream:(NSInputStream **)outInputStream
+                        length:(unsigned long long *)outLength;
+
 - (NSString *)uploadMIMEType;
 - (NSData *)uploadData;
 - (NSFileHandle *)uploadFileHandle;
@@ -574,6 +602,9 @@ forCategoryWithScheme:(NSString *)scheme
 // subclasses start their -XMLElement method by calling this
 - (NSXMLElement *)XMLElementWithExtensionsAndDefaultName:(NSString *)defaultName;
 
+// wraps an element in a UTF-8 version 1.0 document, as XMLDocument does
+- (NSXMLDocument *)XMLDocumentWithRootElement:(NSXMLElement *)element;
+
 // adding attributes
 - (NSXMLNode *)addToElement:(NSXMLElement *)element
      attributeValueIfNonNil:(NSString *)val
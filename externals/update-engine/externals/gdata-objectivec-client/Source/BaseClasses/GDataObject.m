@@ -27,6 +27,8 @@
 #import "GDataEntryBase.h"
 #import "GDataCategory.h"
 
+#import <libkern/OSAtomic.h>
+
 static inline NSMutableDictionary *GDataCreateStaticDictionary(void) {
   NSMutableDictionary *dict = [[NSMutableDictionary alloc] init];
   Class cls = NSClassFromString(@"NSGarbageCollector");
@@ -90,10 +92,26 @@ static NSString* const kChildXMLDeclarationMarker = @" __childXML";
 
 - (BOOL)hasChildXMLElementsEqualToChildXMLElementsOf:(GDataObject *)other;
 
+// hash of the same content that isEqual: compares
+- (NSUInteger)computeHash;
+
 // dictionary of all extensions actually found in the XML element
 - (void)setExtensions:(NSDictionary *)extensions;
 - (NSDictionary *)extensions;
 
+// copy-on-write sharing of extensions between an object and its copies
+- (NSMutableDictionary *)extensionsSharedWithCopy;
+- (id)extensionSharedWithCopy:(id)obj;
+- (id)unsharedExtensionForClass:(Class)theClass;
+- (void)relinquishSharedExtension:(id)objOrArray;
+- (void)adoptUnsharedCopy:(GDataObject *)objCopy
+                ofExtension:(GDataObject *)obj;
+- (void)setHasSharedExtensions:(BOOL)flag;
+- (void)addSharingOwner;
+- (BOOL)removeSharingOwner;
+- (void)exposeExtension:(id)objOrArray;
+- (void)setIsExposed;
+
 // cache of arrays of extensions that may be found in this class and in
 // subclasses of this class.
 - (void)setExtensionDeclarationsCache:(NSDictionary *)decls;
@@ -119,6 +137,39 @@ static NSString* const kChildXMLDeclarationMarker = @" __childXML";
                             fromMap:(NSDictionary *)map;
 @end
 
+// Hashes are cached, tagged with a process-wide generation count which is
+// advanced by every change to content that isEqual: compares. A per-object
+// dirty flag would not do, since an object's hash covers its extensions,
+// and those may be changed without their parent hearing about it.
+//
+// Until some object has cached its hash, mutations don't touch the counter,
+// so parsing and building objects costs nothing extra.
+static volatile int32_t gHashGeneration = 0;
+static volatile BOOL gHasCachedHashes = NO;
+
+static inline void InvalidateCachedHashes(void) {
+  if (gHasCachedHashes) {
+    OSAtomicIncrement32Barrier(&gHashGeneration);
+  }
+}
+
+// An object shared by copies of its parent (see extensionsSharedWithCopy)
+// must not be modified in place; this catches objects reached other than
+// through the extension accessors, such as through -parent
+#define GDATA_DEBUG_ASSERT_NOT_SHARED() \
+  GDATA_DEBUG_ASSERT(sharingCount_ == 0, \
+    @"%@ %p is shared with copies of its parent; fetch it from the" \
+    " parent again before modifying it", [self class], self)
+
+// spreads the bits of a hash so sums of hashes of different fields don't
+// cancel out
+static inline NSUInteger MixHash(NSUInteger hash) {
+  hash ^= hash >> 16;
+  hash *= 0x45d9f3b;
+  hash ^= hash >> 16;
+  return hash;
+}
+
 @implementation GDataObject
 
 // The qualified name map avoids the need to regenerate qualified
@@ -295,12 +346,74 @@ static NSMutableDictionary *gQualifiedNameMap = nil;
 }
 
 // By definition, for two objects to potentially be considered equal,
-// they must have the same hash value.  The hash is mostly ignored,
-// but removeObjectsInArray: in Leopard does seem to check the hash,
-// and NSObject's default hash method just returns the instance pointer.
-// We'll define hash here for all of our GDataObjects.
+// they must have the same hash value.  NSSet and NSDictionary rely on the
+// hash to avoid calling isEqual: on every member, so it's derived from the
+// content that isEqual: compares.
+//
+// Subclasses that add comparisons to isEqual: needn't override this, as
+// objects they consider equal are also equal here.
 - (NSUInteger)hash {
-  return (NSUInteger) (void *) [GDataObject class];
+  // set before reading the generation so a mutation made while we compute
+  // advances it
+  gHasCachedHashes = YES;
+  OSMemoryBarrier();
+
+  int32_t generation = gHashGeneration;
+  if (hasCachedHash_ && cachedHashGeneration_ == generation) {
+    return cachedHash_;
+  }
+
+  cachedHash_ = [self computeHash];
+  cachedHashGeneration_ = generation;
+  hasCachedHash_ = YES;
+  return cachedHash_;
+}
+
+- (NSUInteger)computeHash {
+  NSUInteger hash = 0;
+
+  // extensions, in no particular order; arrays of them are ordered
+  for (Class extensionClass in extensions_) {
+    id objOrArray = [extensions_ objectForKey:extensionClass];
+    NSUInteger valueHash;
+    if ([objOrArray isKindOfClass:[NSArray class]]) {
+      valueHash = [objOrArray count];
+      for (id obj in objOrArray) {
+        valueHash = valueHash * 31 + [obj hash];
+      }
+    } else {
+      valueHash = [objOrArray hash];
+    }
+    hash += MixHash((NSUInteger) (void *) extensionClass ^ valueHash);
+  }
+
+  // attributes, skipping those isEqual: ignores
+  NSArray *attributesToIgnore = [self attributesIgnoredForEquality];
+  if ([attributesToIgnore count] == 0) {
+    for (NSString *attrKey in attributes_) {
+      NSString *value = [attributes_ objectForKey:attrKey];
+      hash += MixHash([attrKey hash] * 31 + [value hash]);
+    }
+  } else {
+    for (NSString *attrKey in [self attributeDeclarations]) {
+      if (![attributesToIgnore containsObject:attrKey]) {
+        NSString *value = [attributes_ objectForKey:attrKey];
+        if (value != nil) {
+          hash += MixHash([attrKey hash] * 31 + [value hash]);
+        }
+      }
+    }
+  }
+
+  if ([self hasDeclaredContentValue]) {
+    hash = hash * 31 + [[self contentStringValue] hash];
+  }
+
+  if ([self hasDeclaredChildXMLElements]) {
+    hash = hash * 31 + [[self childXMLElements] count];
+  }
+
+  return hash;
 }
 
 - (id)copyWithZone:(NSZone *)zone {
@@ -313,9 +426,11 @@ static NSMutableDictionary *gQualifiedNameMap = nil;
     [GDataUtilities mutableDictionaryWithCopiesOfObjectsInDictionary:[self namespaces]];
   [newObject setNamespaces:namespaces];
 
-  NSDictionary *extensions =
-    [GDataUtilities mutableDictionaryWithCopiesOfArraysInDictionary:[self extensions]];
+  // extensions aren't copied until an owner fetches them; see
+  // extensionsSharedWithCopy
+  NSDictionary *extensions = [self extensionsSharedWithCopy];
   [newObject setExtensions:extensions];
+  [newObject setHasSharedExtensions:(extensions != nil)];
 
   NSDictionary *attributes =
     [GDataUtilities mutableDictionaryWithCopiesOfObjectsInDictionary:[self attributes]];
@@ -361,6 +476,12 @@ static NSMutableDictionary *gQualifiedNameMap = nil;
 }
 
 - (void)dealloc {
+  if (hasSharedExtensions_) {
+    for (Class theClass in extensions_) {
+      [self relinquishSharedExtension:[extensions_ objectForKey:theClass]];
+    }
+  }
+
   [elementName_ release];
   [namespaces_ release];
   [extensionDeclarationsCache_ release];
@@ -389,12 +510,20 @@ static NSMutableDictionary *gQualifiedNameMap = nil;
 
 - (NSXMLDocument *)XMLDocument {
   NSXMLElement *element = [self XMLElement];
+  return [self XMLDocumentWithRootElement:element];
+}
+
+- (NSXMLDocument *)XMLDocumentWithRootElement:(NSXMLElement *)element {
   NSXMLDocument *doc = [[[NSXMLDocument alloc] initWithRootElement:(id)element] autorelease];
   [doc setVersion:@"1.0"];
   [doc setCharacterEncoding:@"UTF-8"];
   return doc;
 }
 
+- (NSData *)XMLData {
+  return [[self XMLDocument] XMLData];
+}
+
 - (BOOL)generateContentInputStream:(NSInputStream **)outInputStream
                             length:(unsigned long long *)outLength
                            headers:(NSDictionary **)outHeaders {
@@ -403,6 +532,13 @@ static NSMutableDictionary *gQualifiedNameMap = nil;
   return NO;
 }
 
+- (BOOL)generateXMLInputStream:(NSInputStream **)outInputStream
+                        length:(unsigned long long *)outLength {
+  // subclasses may return a stream of this object's XML document for
+  // uploading, instead of the XMLData
+  return NO;
+}
+
 - (NSString *)uploadMIMEType {
   // subclasses may return the type of data to be uploaded
   return nil;
@@ -522,6 +658,9 @@ static NSMutableDictionary *gQualifiedNameMap = nil;
 }
 
 - (void)setAttributes:(NSDictionary *)dict {
+  InvalidateCachedHashes();
+  GDATA_DEBUG_ASSERT_NOT_SHARED();
+
   [attributes_ autorelease];
   attributes_ = [dict mutableCopy];
 }
@@ -531,14 +670,189 @@ static NSMutableDictionary *gQualifiedNameMap = nil;
 }
 
 - (void)setExtensions:(NSDictionary *)extensions {
+  InvalidateCachedHashes();
+  GDATA_DEBUG_ASSERT_NOT_SHARED();
+
+  for (Class theClass in extensions_) {
+    [self relinquishSharedExtension:[extensions_ objectForKey:theClass]];
+  }
+
   [extensions_ autorelease];
   extensions_ = [extensions mutableCopy];
 }
 
 - (NSDictionary *)extensions {
+  // the objects here may be shared with copies of this object, so this is
+  // only for reading; use objectForExtensionClass: to get an object that
+  // may be modified
   return extensions_;
 }
 
+// Copying an object doesn't copy its extensions' subtrees. Instead, the copy
+// gets its own dictionary and arrays holding the same child GDataObjects, and
+// each child counts its additional owners. When an owner fetches a child that
+// is still shared, via objectForExtensionClass: or objectsForExtensionClass:,
+// the owner gives up its share and replaces the child with a copy of its own,
+// which in turn shares its children. The last owner keeps the original.
+//
+// Only children that no caller can be holding are shared. A child handed out
+// by those accessors, or passed in to the extension setters, is marked as
+// exposed, and copies get their own copy of it at once, so that modifying it
+// later changes only its parent. Since a child can't be fetched from without
+// first being fetched itself, the descendants of an unexposed child are
+// unexposed too, so it doesn't matter which owner of a shared child makes the
+// copy.
+//
+// Reading extensions for comparing, hashing, or generating XML doesn't
+// unshare them, so copies which are posted or compared without being
+// modified never copy their subtrees at all.
+- (NSMutableDictionary *)extensionsSharedWithCopy {
+  if ([extensions_ count] == 0) return nil;
+
+  hasSharedExtensions_ = YES;
+
+  NSMutableDictionary *dict;
+  dict = [NSMutableDictionary dictionaryWithCapacity:[extensions_ count]];
+
+  for (Class theClass in extensions_) {
+    id objOrArray = [extensions_ objectForKey:theClass];
+
+    if ([objOrArray isKindOfClass:[NSArray class]]) {
+      NSMutableArray *array;
+      array = [NSMutableArray arrayWithCapacity:[objOrArray count]];
+      for (id obj in objOrArray) {
+        [array addObject:[self extensionSharedWithCopy:obj]];
+      }
+      [dict setObject:array forKey:theClass];
+    } else {
+      [dict setObject:[self extensionSharedWithCopy:objOrArray]
+               forKey:theClass];
+    }
+  }
+  return dict;
+}
+
+- (id)extensionSharedWithCopy:(id)obj {
+  if ([obj isKindOfClass:[GDataObject class]]
+      && !((GDataObject *)obj)->isExposed_) {
+    [obj addSharingOwner];
+    return obj;
+  }
+
+  // attribute extensions are too small to be worth sharing, and exposed
+  // objects may be modified through references held outside their parent
+  return [[obj copy] autorelease];
+}
+
+- (id)unsharedExtensionForClass:(Class)theClass {
+  id objOrArray = [extensions_ objectForKey:theClass];
+  if (!hasSharedExtensions_) return objOrArray;
+
+  if ([objOrArray isKindOfClass:[NSArray class]]) {
+    NSMutableArray *newArray = nil;
+    NSUInteger idx = 0;
+
+    for (id obj in objOrArray) {
+      if ([obj isKindOfClass:[GDataObject class]]
+          && [obj removeSharingOwner]) {
+
+        if (newArray == nil) {
+          newArray = [NSMutableArray arrayWithArray:objOrArray];
+        }
+        id objCopy = [obj copy];
+        [self adoptUnsharedCopy:objCopy ofExtension:obj];
+        [newArray replaceObjectAtIndex:idx withObject:objCopy];
+        [objCopy release];
+      }
+      ++idx;
+    }
+
+    if (newArray) {
+      [extensions_ setObject:newArray forKey:theClass];
+      objOrArray = newArray;
+    }
+  } else if ([objOrArray isKindOfClass:[GDataObject class]]
+             && [objOrArray removeSharingOwner]) {
+
+    id objCopy = [objOrArray copy];
+    [self adoptUnsharedCopy:objCopy ofExtension:objOrArray];
+    [extensions_ setObject:objCopy forKey:theClass];
+    [objCopy release];
+    objOrArray = objCopy;
+  }
+  return objOrArray;
+}
+
+// the shared original stays with the other owners, so as in
+// relinquishSharedExtension: its weak parent reference mustn't be left
+// pointing at this object; this object's copy takes its place as the child
+- (void)adoptUnsharedCopy:(GDataObject *)objCopy
+                ofExtension:(GDataObject *)obj {
+  if ([obj parent] == self) {
+    [obj setParent:nil];
+  }
+  [objCopy setParent:self];
+}
+
+// called when this object drops extensions, to give up its shares of them
+- (void)relinquishSharedExtension:(id)objOrArray {
+  if (!hasSharedExtensions_) return;
+
+  NSArray *array = objOrArray;
+  if (![objOrArray isKindOfClass:[NSArray class]]) {
+    if (objOrArray == nil) return;
+    array = [NSArray arrayWithObject:objOrArray];
+  }
+
+  for (id obj in array) {
+    if ([obj isKindOfClass:[GDataObject class]]
+        && [obj removeSharingOwner]
+        && [obj parent] == self) {
+      // other owners still hold the object; don't leave its weak parent
+      // reference pointing at this object, as copies' children don't have
+      // a parent either
+      [obj setParent:nil];
+    }
+  }
+}
+
+- (void)setHasSharedExtensions:(BOOL)flag {
+  hasSharedExtensions_ = flag;
+}
+
+- (void)addSharingOwner {
+  OSAtomicIncrement32Barrier(&sharingCount_);
+}
+
+// marks objects handed to or out of the extension accessors
+- (void)exposeExtension:(id)objOrArray {
+  if ([objOrArray isKindOfClass:[NSArray class]]) {
+    for (id obj in objOrArray) {
+      if ([obj isKindOfClass:[GDataObject class]]) {
+        [obj setIsExposed];
+      }
+    }
+  } else if ([objOrArray isKindOfClass:[GDataObject class]]) {
+    [objOrArray setIsExposed];
+  }
+}
+
+- (void)setIsExposed {
+  isExposed_ = YES;
+}
+
+// returns YES if the caller gave up its share of this object and so must
+// make its own copy, or NO if the caller is the sole owner
+- (BOOL)removeSharingOwner {
+  int32_t count;
+  while ((count = sharingCount_) > 0) {
+    if (OSAtomicCompareAndSwap32Barrier(count, count - 1, &sharingCount_)) {
+      return YES;
+    }
+  }
+  return NO;
+}
+
 - (void)setExtensionDeclarationsCache:(NSDictionary *)decls {
   [extensionDeclarationsCache_ autorelease];
   extensionDeclarationsCache_ = [decls mutableCopy];
@@ -1791,9 +2105,11 @@ objectDescriptionIfNonNil:(id)obj
 // this is typically called by the getter methods of subclasses
 
 - (NSArray *)objectsForExtensionClass:(Class)theClass {
-  id obj = [extensions_ objectForKey:theClass];
+  id obj = [self unsharedExtensionForClass:theClass];
   if (obj == nil) return nil;
 
+  [self exposeExtension:obj];
+
   if ([obj isKindOfClass:[NSArray class]]) {
     return obj;
   }
@@ -1807,16 +2123,18 @@ objectDescriptionIfNonNil:(id)obj
 // this is typically called by the getter methods of subclasses
 
 - (id)objectForExtensionClass:(Class)theClass {
-  id obj = [extensions_ objectForKey:theClass];
+  id obj = [self unsharedExtensionForClass:theClass];
 
   if ([obj isKindOfClass:[NSArray class]]) {
     if ([(NSArray *)obj count] > 0) {
-      return [obj objectAtIndex:0];
+      obj = [obj objectAtIndex:0];
+    } else {
+      // an empty array
+      return nil;
     }
-    // an empty array
-    return nil;
   }
 
+  [self exposeExtension:obj];
   return obj;
 }
 
@@ -1878,15 +2196,21 @@ objectDescriptionIfNonNil:(id)obj
   GDATA_DEBUG_ASSERT(objects == nil || [objects isKindOfClass:[NSArray class]],
                      @"array expected");
 
+  InvalidateCachedHashes();
+  GDATA_DEBUG_ASSERT_NOT_SHARED();
+
   if (extensions_ == nil && objects != nil) {
     extensions_ = [[NSMutableDictionary alloc] init];
   }
 
+  [self relinquishSharedExtension:[extensions_ objectForKey:theClass]];
+
   if (objects) {
     // be sure each object has an element name so we can generate XML for it
     for (GDataObject *obj in objects) {
       [self ensureObject:obj hasXMLNameForExtensionClass:theClass];
     }
+    [self exposeExtension:objects];
     [extensions_ setObject:objects forKey:theClass];
   } else {
     [extensions_ removeObjectForKey:theClass];
@@ -1901,12 +2225,18 @@ objectDescriptionIfNonNil:(id)obj
 
   GDATA_DEBUG_ASSERT(![object isKindOfClass:[NSArray class]], @"array unexpected");
 
+  InvalidateCachedHashes();
+  GDATA_DEBUG_ASSERT_NOT_SHARED();
+
   if (extensions_ == nil && object != nil) {
     extensions_ = [[NSMutableDictionary alloc] init];
   }
 
+  [self relinquishSharedExtension:[extensions_ objectForKey:theClass]];
+
   if (object) {
     [self ensureObject:object hasXMLNameForExtensionClass:theClass];
+    [self exposeExtension:object];
     [extensions_ setObject:object forKey:theClass];
   } else {
     [extensions_ removeObjectForKey:theClass];
@@ -1921,6 +2251,9 @@ objectDescriptionIfNonNil:(id)obj
 
   if (newObj == nil) return;
 
+  InvalidateCachedHashes();
+  GDATA_DEBUG_ASSERT_NOT_SHARED();
+
   id previousObjOrArray = [extensions_ objectForKey:theClass];
   if (previousObjOrArray) {
 
@@ -1928,11 +2261,13 @@ objectDescriptionIfNonNil:(id)obj
 
       // add to the existing array
       [self ensureObject:newObj hasXMLNameForExtensionClass:theClass];
+      [self exposeExtension:newObj];
       [previousObjOrArray addObject:newObj];
 
     } else {
 
       // create an array with the previous object and the new object
+      [self exposeExtension:newObj];
       NSMutableArray *array = [NSMutableArray arrayWithObjects:
                                previousObjOrArray, newObj, nil];
       [extensions_ setObject:array forKey:theClass];
@@ -1949,15 +2284,26 @@ objectDescriptionIfNonNil:(id)obj
 // this is typically called by removeObject methods of subclasses
 
 - (void)removeObject:(id)object forExtensionClass:(Class)theClass {
+  InvalidateCachedHashes();
+  GDATA_DEBUG_ASSERT_NOT_SHARED();
+
   id previousObjOrArray = [extensions_ objectForKey:theClass];
   if ([previousObjOrArray isKindOfClass:[NSArray class]]) {
 
     // remove from the array
+    if (hasSharedExtensions_) {
+      for (id obj in previousObjOrArray) {
+        if ([obj isEqual:object]) {
+          [self relinquishSharedExtension:obj];
+        }
+      }
+    }
     [(NSMutableArray *)previousObjOrArray removeObject:object];
 
   } else if ([(GDataObject *)object isEqual:previousObjOrArray]) {
 
     // no array, so remove if it matches the sole object
+    [self relinquishSharedExtension:previousObjOrArray];
     [extensions_ removeObjectForKey:theClass];
   }
 }
@@ -2206,6 +2552,9 @@ objectDescriptionIfNonNil:(id)obj
   GDATA_DEBUG_ASSERT([[self attributeDeclarations] containsObject:name],
             @"%@ setting undeclared attribute: %@", [self class], name);
 
+  InvalidateCachedHashes();
+  GDATA_DEBUG_ASSERT_NOT_SHARED();
+
   if (attributes_ == nil) {
     attributes_ = [[NSMutableDictionary alloc] init];
   }
@@ -2340,6 +2689,9 @@ objectDescriptionIfNonNil:(id)obj
   GDATA_ASSERT([self hasDeclaredContentValue], @"%@ setting undeclared content value",
                [self class]);
 
+  InvalidateCachedHashes();
+  GDATA_DEBUG_ASSERT_NOT_SHARED();
+
   [contentValue_ autorelease];
   contentValue_ = [str copy];
 }
@@ -2408,6 +2760,9 @@ objectDescriptionIfNonNil:(id)obj
   GDATA_DEBUG_ASSERT([self hasDeclaredChildXMLElements],
                      @"%@ setting undeclared XML values", [self class]);
 
+  InvalidateCachedHashes();
+  GDATA_DEBUG_ASSERT_NOT_SHARED();
+
   [childXMLElements_ release];
   childXMLElements_ = [array mutableCopy];
 }
@@ -2416,6 +2771,9 @@ objectDescriptionIfNonNil:(id)obj
   GDATA_DEBUG_ASSERT([self hasDeclaredChildXMLElements],
                      @"%@ adding undeclared XML values", [self class]);
 
+  InvalidateCachedHashes();
+  GDATA_DEBUG_ASSERT_NOT_SHARED();
+
   if (childXMLElements_ == nil) {
     childXMLElements_ = [[NSMutableArray alloc] init];
   }
@@ -2737,7 +3095,9 @@ forCategoryWithScheme:(NSString *)scheme
 }
 
 - (NSUInteger)hash {
-  return (NSUInteger) (void *) [GDataExtensionDeclaration class];
+  return MixHash((NSUInteger) (void *) parentClass_)
+    ^ ((NSUInteger) (void *) childClass_)
+    ^ (NSUInteger) isAttribute_;
 }
 
 @end
@@ -2795,10 +3155,13 @@ forCategoryWithScheme:(NSString *)scheme
 }
 
 - (NSUInteger)hash {
-  return (NSUInteger) (void *) [GDataAttribute class];
+  return [[self stringValue] hash];
 }
 
 - (void)setStringValue:(NSString *)str {
+  // objects holding this attribute may have cached a hash including it
+  InvalidateCachedHashes();
+
   [value_ autorelease];
   value_ = [str copy];
 }
@@ -40,6 +40,7 @@ static NSString* const kFetcherFinishedSelectorKey     = @"_finishedSelector";
 static NSString* const kFetcherCompletionHandlerKey    = @"_completionHandler";
 static NSString* const kFetcherTicketKey               = @"_ticket";
 static NSString* const kFetcherStreamDataKey           = @"_streamData";
+static NSString* const kFetcherXMLStreamKey            = @"_XMLStream";
 static NSString* const kFetcherParsedObjectKey         = @"_parsedObject";
 static NSString* const kFetcherParseErrorKey           = @"_parseError";
 static NSString* const kFetcherCallbackThreadKey       = @"_callbackThread";
@@ -454,6 +455,7 @@ totalBytesExpectedToSend:(NSInteger)totalBytesExpected;
   NSFileHandle *uploadFileHandle = nil;
   BOOL shouldUploadDataChunked = ([self serviceUploadChunkSize] > 0);
   BOOL isUploadingDataChunked = NO;
+  BOOL isStreamingXML = NO;
 
   NSMutableDictionary *uploadProperties = nil;
   if (objectToPost) {
@@ -499,10 +501,21 @@ totalBytesExpectedToSend:(NSInteger)totalBytesExpected;
       contentHeaders = [objectToPost performSelector:@selector(contentHeaders)];
       contentLength = 0;
 
+    } else if (!isUploadingDataChunked
+               && (!shouldReportUploadProgress || doesSupportSentData)
+               && [objectToPost generateXMLInputStream:&contentInputStream
+                                                length:&contentLength]) {
+      // the object's XML is generated as the fetcher reads the stream, so
+      // a large feed is never in memory whole; since a read stream can't be
+      // posted again, retries post a copy of it
+      [uploadProperties setObject:contentInputStream
+                           forKey:kFetcherXMLStreamKey];
+      isStreamingXML = YES;
+
     } else {
       // we're sending either just XML, or XML now with chunked upload data
       // later
-      xmlData = [[objectToPost XMLDocument] XMLData];
+      xmlData = [objectToPost XMLData];
       contentLength = [xmlData length];
 
       if (!shouldReportUploadProgress
@@ -631,7 +644,7 @@ totalBytesExpectedToSend:(NSInteger)totalBytesExpected;
   [fetcher setRetryEnabled:[ticket isRetryEnabled]];
   [fetcher setMaxRetryInterval:[ticket maxRetryInterval]];
 
-  if ([ticket retrySelector]) {
+  if ([ticket retrySelector] || isStreamingXML) {
     [fetcher setRetrySelector:@selector(objectFetcher:willRetry:forError:)];
   }
 
@@ -1193,6 +1206,14 @@ totalBytesExpectedToSend:(NSInteger)totalBytesExpected {
                                 willRetry:willRetry
                                     error:error];
   }
+
+  // a streamed XML body has been read, so post an unread copy of it
+  NSInputStream *xmlStream = [fetcher propertyForKey:kFetcherXMLStreamKey];
+  if (willRetry && xmlStream != nil) {
+    xmlStream = [[xmlStream copy] autorelease];
+    [fetcher setPostStream:xmlStream];
+    [fetcher setProperty:xmlStream forKey:kFetcherXMLStreamKey];
+  }
   return willRetry;
 }
 
@@ -45,3 +45,5 @@
 
 #import "GDataServiceGoogleSpreadsheet.h"
 #import "GDataQuerySpreadsheet.h"
+
+#import "GDataSpreadsheetCellGrid.h"
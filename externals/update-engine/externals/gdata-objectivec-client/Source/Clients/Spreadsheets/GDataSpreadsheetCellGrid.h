@@ -0,0 +1,131 @@
+/* Copyright (c) 2011 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//
+//  GDataSpreadsheetCellGrid.h
+//
+
+#if !GDATA_REQUIRE_SERVICE_INCLUDES || GDATA_INCLUDE_SPREADSHEET_SERVICE
+
+#import "GDataFeedSpreadsheetCell.h"
+#import "GDataServiceGoogleSpreadsheet.h"
+
+// GDataSpreadsheetCellGrid keeps the cells of a worksheet in a dense grid,
+// tracking which cells have been edited, and sends the edited cells back to
+// the server as batch update feeds.
+//
+// The grid is made from a fetched cell feed.  Fetch the feed with the
+// query's shouldReturnEmpty set so that empty cells have their edit links
+// and ETags, too; cells missing from the feed are updated using their
+// cell IDs.
+//
+// Rows and columns are numbered from 1, as in the cell feed.
+//
+// Updating splits the edited cells into batch feeds of cellsPerBatch cells
+// (default 500) and fetches up to maxConcurrentBatches (default 4) of them
+// at a time.  Cells the server updated become clean.  Cells the server
+// rejected stay dirty, and their batch status is available from
+// failureStatusForCellAtRow:column: until they're next updated.  Cells
+// edited while their batch is in progress remain dirty for the next update.
+//
+// The finished selector has a signature like
+//
+//   - (void)cellGrid:(GDataSpreadsheetCellGrid *)grid
+//     finishedUpdatingWithError:(NSError *)error;
+//
+// The error is the first batch fetch failure, if any; after a fetch fails,
+// no further batches are started.
+
+@interface GDataSpreadsheetCellGrid : NSObject {
+  NSInteger rowCount_;
+  NSInteger columnCount_;
+
+  // cell IDs are the feed ID followed by /R<row>C<column>
+  NSString *feedIdentifier_;
+  NSURL *batchFeedURL_;
+  NSString *serviceVersion_;
+
+  // row-major arrays of rowCount_ * columnCount_ items
+  NSString **inputStrings_;
+  NSString **resultStrings_;
+  NSString **editHrefs_;
+  NSString **ETags_;
+  unsigned char *cellStates_;
+
+  NSUInteger dirtyCellCount_;
+  NSMutableDictionary *failureStatuses_; // cell index number to batch status
+
+  NSUInteger cellsPerBatch_;
+  NSUInteger maxConcurrentBatches_;
+
+  // update in progress
+  GDataServiceGoogleSpreadsheet *service_;
+  id delegate_;
+  SEL finishedSel_;
+  NSMutableArray *unsentBatches_;  // index sets of cells
+  NSMutableArray *runningTickets_;
+  NSError *updateError_;
+}
+
++ (GDataSpreadsheetCellGrid *)cellGridWithFeed:(GDataFeedSpreadsheetCell *)feed;
+
+- (id)initWithFeed:(GDataFeedSpreadsheetCell *)feed;
+
+- (NSInteger)rowCount;
+- (NSInteger)columnCount;
+
+// the batch URL from the feed's batch link, unless set
+- (NSURL *)batchFeedURL;
+- (void)setBatchFeedURL:(NSURL *)url;
+
+// accessors for cells; getters return nil for cells outside the grid
+- (NSString *)inputStringAtRow:(NSInteger)row column:(NSInteger)column;
+- (NSString *)resultStringAtRow:(NSInteger)row column:(NSInteger)column;
+
+// setting a cell's input string marks it dirty
+- (void)setInputString:(NSString *)str
+                 atRow:(NSInteger)row
+                column:(NSInteger)column;
+
+- (BOOL)isCellDirtyAtRow:(NSInteger)row column:(NSInteger)column;
+- (NSUInteger)dirtyCellCount;
+
+- (GDataBatchStatus *)failureStatusForCellAtRow:(NSInteger)row
+                                         column:(NSInteger)column;
+- (NSUInteger)failedCellCount;
+
+- (NSUInteger)cellsPerBatch;
+- (void)setCellsPerBatch:(NSUInteger)count;
+
+- (NSUInteger)maxConcurrentBatches;
+- (void)setMaxConcurrentBatches:(NSUInteger)count;
+
+// batch update feeds for the current dirty cells, as they would be sent
+- (NSArray *)batchFeedsForDirtyCells;
+
+// returns NO if an update is already in progress or no cells are dirty
+- (BOOL)updateDirtyCellsWithService:(GDataServiceGoogleSpreadsheet *)service
+                           delegate:(id)delegate
+                  didFinishSelector:(SEL)finishedSelector;
+
+- (BOOL)isUpdating;
+
+// cancels batches in progress; their cells stay dirty, and the finished
+// selector is not called
+- (void)stopUpdating;
+
+@end
+
+#endif // !GDATA_REQUIRE_SERVICE_INCLUDES || GDATA_INCLUDE_SPREADSHEET_SERVICE
@@ -0,0 +1,496 @@
+/* Copyright (c) 2011 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//
+//  GDataSpreadsheetCellGrid.m
+//
+
+#if !GDATA_REQUIRE_SERVICE_INCLUDES || GDATA_INCLUDE_SPREADSHEET_SERVICE
+
+#import "GDataSpreadsheetCellGrid.h"
+#import "GDataEntrySpreadsheetCell.h"
+#import "GDataSpreadsheetCell.h"
+
+// cell states
+enum {
+  kCellClean = 0,
+  kCellDirty,
+  kCellSending   // dirty, and in a batch being fetched
+};
+
+static NSString *const kCellIndexesPropertyKey = @"GDataSpreadsheetCellGridIndexes";
+
+static const NSUInteger kDefaultCellsPerBatch = 500;
+static const NSUInteger kDefaultMaxConcurrentBatches = 4;
+
+@interface GDataSpreadsheetCellGrid (PrivateMethods)
+- (NSUInteger)cellIndexForRow:(NSInteger)row column:(NSInteger)column;
+- (NSMutableArray *)dirtyCellIndexBatches;
+- (GDataFeedSpreadsheetCell *)batchFeedForCellIndexes:(NSIndexSet *)indexes
+                                          onlyIfDirty:(BOOL)onlyIfDirty
+                                         sentIndexes:(NSMutableIndexSet *)sentIndexes;
+- (void)startBatches;
+- (void)finishUpdate;
+@end
+
+static void SetString(NSString **array, NSUInteger index, NSString *str) {
+  if (array[index] != str) {
+    [array[index] release];
+    array[index] = [str copy];
+  }
+}
+
+@implementation GDataSpreadsheetCellGrid
+
++ (GDataSpreadsheetCellGrid *)cellGridWithFeed:(GDataFeedSpreadsheetCell *)feed {
+  return [[[self alloc] initWithFeed:feed] autorelease];
+}
+
+- (id)initWithFeed:(GDataFeedSpreadsheetCell *)feed {
+  self = [super init];
+  if (self) {
+    rowCount_ = MAX([feed rowCount], 0);
+    columnCount_ = MAX([feed columnCount], 0);
+
+    feedIdentifier_ = [[feed identifier] copy];
+    batchFeedURL_ = [[[feed batchLink] URL] retain];
+    serviceVersion_ = [[feed serviceVersion] copy];
+
+    NSUInteger numberOfCells = (NSUInteger) (rowCount_ * columnCount_);
+    inputStrings_ = calloc(numberOfCells, sizeof(NSString *));
+    resultStrings_ = calloc(numberOfCells, sizeof(NSString *));
+    editHrefs_ = calloc(numberOfCells, sizeof(NSString *));
+    ETags_ = calloc(numberOfCells, sizeof(NSString *));
+    cellStates_ = calloc(numberOfCells, sizeof(unsigned char));
+
+    failureStatuses_ = [[NSMutableDictionary alloc] init];
+    cellsPerBatch_ = kDefaultCellsPerBatch;
+    maxConcurrentBatches_ = kDefaultMaxConcurrentBatches;
+
+    if (numberOfCells > 0
+        && (inputStrings_ == NULL || resultStrings_ == NULL
+            || editHrefs_ == NULL || ETags_ == NULL || cellStates_ == NULL)) {
+      [self release];
+      return nil;
+    }
+
+    for (GDataEntrySpreadsheetCell *entry in [feed entries]) {
+      GDataSpreadsheetCell *cell = [entry cell];
+      NSUInteger index = [self cellIndexForRow:[cell row]
+                                        column:[cell column]];
+      if (index == NSNotFound) continue;
+
+      SetString(inputStrings_, index, [cell inputString]);
+      SetString(resultStrings_, index, [cell resultString]);
+      SetString(editHrefs_, index, [[entry editLink] href]);
+      SetString(ETags_, index, [entry ETag]);
+    }
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [self stopUpdating];
+
+  NSUInteger numberOfCells = (NSUInteger) (rowCount_ * columnCount_);
+  for (NSUInteger idx = 0; idx < numberOfCells; idx++) {
+    if (inputStrings_) [inputStrings_[idx] release];
+    if (resultStrings_) [resultStrings_[idx] release];
+    if (editHrefs_) [editHrefs_[idx] release];
+    if (ETags_) [ETags_[idx] release];
+  }
+  free(inputStrings_);
+  free(resultStrings_);
+  free(editHrefs_);
+  free(ETags_);
+  free(cellStates_);
+
+  [feedIdentifier_ release];
+  [batchFeedURL_ release];
+  [serviceVersion_ release];
+  [failureStatuses_ release];
+  [updateError_ release];
+  [super dealloc];
+}
+
+- (NSString *)description {
+  return [NSString stringWithFormat:@"%@ %p: {rows:%ld cols:%ld dirty:%lu}",
+          [self class], self, (long) rowCount_, (long) columnCount_,
+          (unsigned long) dirtyCellCount_];
+}
+
+#pragma mark -
+
+- (NSUInteger)cellIndexForRow:(NSInteger)row column:(NSInteger)column {
+  if (row < 1 || row > rowCount_ || column < 1 || column > columnCount_) {
+    return NSNotFound;
+  }
+  return (NSUInteger) ((row - 1) * columnCount_ + (column - 1));
+}
+
+- (NSInteger)rowCount {
+  return rowCount_;
+}
+
+- (NSInteger)columnCount {
+  return columnCount_;
+}
+
+- (NSURL *)batchFeedURL {
+  return batchFeedURL_;
+}
+
+- (void)setBatchFeedURL:(NSURL *)url {
+  [batchFeedURL_ autorelease];
+  batchFeedURL_ = [url retain];
+}
+
+- (NSString *)inputStringAtRow:(NSInteger)row column:(NSInteger)column {
+  NSUInteger index = [self cellIndexForRow:row column:column];
+  if (index == NSNotFound) return nil;
+
+  return inputStrings_[index];
+}
+
+- (NSString *)resultStringAtRow:(NSInteger)row column:(NSInteger)column {
+  NSUInteger index = [self cellIndexForRow:row column:column];
+  if (index == NSNotFound) return nil;
+
+  return resultStrings_[index];
+}
+
+- (void)setInputString:(NSString *)str
+                 atRow:(NSInteger)row
+                column:(NSInteger)column {
+  NSUInteger index = [self cellIndexForRow:row column:column];
+  GDATA_ASSERT(index != NSNotFound, @"cell R%ldC%ld outside the grid",
+               (long) row, (long) column);
+  if (index == NSNotFound) return;
+
+  SetString(inputStrings_, index, str);
+
+  // a cell in a batch being fetched becomes dirty again, so the result of
+  // that batch won't mark it clean
+  if (cellStates_[index] != kCellDirty) {
+    if (cellStates_[index] == kCellClean) dirtyCellCount_++;
+    cellStates_[index] = kCellDirty;
+  }
+}
+
+- (BOOL)isCellDirtyAtRow:(NSInteger)row column:(NSInteger)column {
+  NSUInteger index = [self cellIndexForRow:row column:column];
+  if (index == NSNotFound) return NO;
+
+  return (cellStates_[index] != kCellClean);
+}
+
+- (NSUInteger)dirtyCellCount {
+  return dirtyCellCount_;
+}
+
+- (GDataBatchStatus *)failureStatusForCellAtRow:(NSInteger)row
+                                         column:(NSInteger)column {
+  NSUInteger index = [self cellIndexForRow:row column:column];
+  if (index == NSNotFound) return nil;
+
+  return [failureStatuses_ objectForKey:[NSNumber numberWithUnsignedInteger:index]];
+}
+
+- (NSUInteger)failedCellCount {
+  return [failureStatuses_ count];
+}
+
+- (NSUInteger)cellsPerBatch {
+  return cellsPerBatch_;
+}
+
+- (void)setCellsPerBatch:(NSUInteger)count {
+  cellsPerBatch_ = MAX(count, 1U);
+}
+
+- (NSUInteger)maxConcurrentBatches {
+  return maxConcurrentBatches_;
+}
+
+- (void)setMaxConcurrentBatches:(NSUInteger)count {
+  maxConcurrentBatches_ = MAX(count, 1U);
+}
+
+#pragma mark Batch feeds
+
+// dirtyCellIndexBatches returns an array of index sets of up to cellsPerBatch_
+// dirty cells, in row-major order
+- (NSMutableArray *)dirtyCellIndexBatches {
+  NSMutableArray *batches = [NSMutableArray array];
+  NSMutableIndexSet *batch = nil;
+
+  NSUInteger numberOfCells = (NSUInteger) (rowCount_ * columnCount_);
+  for (NSUInteger idx = 0; idx < numberOfCells; idx++) {
+    if (cellStates_[idx] != kCellDirty) continue;
+
+    if (batch == nil) {
+      batch = [NSMutableIndexSet indexSet];
+      [batches addObject:batch];
+    }
+    [batch addIndex:idx];
+    if ([batch count] == cellsPerBatch_) batch = nil;
+  }
+  return batches;
+}
+
+- (GDataFeedSpreadsheetCell *)batchFeedForCellIndexes:(NSIndexSet *)indexes
+                                          onlyIfDirty:(BOOL)onlyIfDirty
+                                         sentIndexes:(NSMutableIndexSet *)sentIndexes {
+  GDataFeedSpreadsheetCell *batchFeed = [GDataFeedSpreadsheetCell spreadsheetCellFeed];
+  if (serviceVersion_) [batchFeed setServiceVersion:serviceVersion_];
+
+  GDataBatchOperation *op;
+  op = [GDataBatchOperation batchOperationWithType:kGDataBatchOperationUpdate];
+  [batchFeed setBatchOperation:op];
+
+  NSMutableArray *entries = [NSMutableArray arrayWithCapacity:[indexes count]];
+
+  NSUInteger idx = [indexes firstIndex];
+  while (idx != NSNotFound) {
+    if (!onlyIfDirty || cellStates_[idx] == kCellDirty) {
+      NSInteger row = (NSInteger) (idx / columnCount_) + 1;
+      NSInteger column = (NSInteger) (idx % columnCount_) + 1;
+
+      // the input string alone updates the cell; the server computes the
+      // numeric value and result
+      GDataSpreadsheetCell *cell;
+      cell = [GDataSpreadsheetCell cellWithRow:row
+                                        column:column
+                                   inputString:inputStrings_[idx]
+                                  numericValue:nil
+                                  resultString:nil];
+
+      GDataEntrySpreadsheetCell *entry;
+      entry = [GDataEntrySpreadsheetCell spreadsheetCellEntryWithCell:cell];
+
+      NSString *cellID = [NSString stringWithFormat:@"%@/R%ldC%ld",
+                          feedIdentifier_, (long) row, (long) column];
+      [entry setIdentifier:cellID];
+
+      NSString *editHref = editHrefs_[idx];
+      if (editHref == nil) editHref = cellID;
+      [entry addLink:[GDataLink linkWithRel:@"edit"
+                                       type:kGDataLinkTypeAtom
+                                       href:editHref]];
+
+      if (ETags_[idx]) [entry setETag:ETags_[idx]];
+
+      // the batch ID is the cell's index in the grid
+      NSString *batchID = [NSString stringWithFormat:@"%lu", (unsigned long) idx];
+      [entry setBatchIDWithString:batchID];
+
+      [entries addObject:entry];
+      [sentIndexes addIndex:idx];
+    }
+    idx = [indexes indexGreaterThanIndex:idx];
+  }
+
+  [batchFeed setEntries:entries];
+  return batchFeed;
+}
+
+- (NSArray *)batchFeedsForDirtyCells {
+  NSMutableArray *feeds = [NSMutableArray array];
+  for (NSIndexSet *indexes in [self dirtyCellIndexBatches]) {
+    GDataFeedSpreadsheetCell *feed = [self batchFeedForCellIndexes:indexes
+                                                       onlyIfDirty:NO
+                                                       sentIndexes:nil];
+    [feeds addObject:feed];
+  }
+  return feeds;
+}
+
+#pragma mark Updating
+
+- (BOOL)updateDirtyCellsWithService:(GDataServiceGoogleSpreadsheet *)service
+                           delegate:(id)delegate
+                  didFinishSelector:(SEL)finishedSelector {
+
+  GTMAssertSelectorNilOrImplementedWithArgs(delegate, finishedSelector,
+      @encode(GDataSpreadsheetCellGrid *), @encode(NSError *), 0);
+
+  if ([self isUpdating] || dirtyCellCount_ == 0) return NO;
+
+  GDATA_ASSERT(batchFeedURL_ != nil, @"cell grid lacks a batch feed URL");
+  if (batchFeedURL_ == nil) return NO;
+
+  service_ = [service retain];
+  delegate_ = [delegate retain];
+  finishedSel_ = finishedSelector;
+
+  [updateError_ release];
+  updateError_ = nil;
+
+  // the batches are made up front, but each batch feed is built when it's
+  // sent, so it carries the latest input strings
+  unsentBatches_ = [[self dirtyCellIndexBatches] retain];
+  runningTickets_ = [[NSMutableArray alloc] init];
+
+  [self startBatches];
+  return YES;
+}
+
+- (BOOL)isUpdating {
+  return (runningTickets_ != nil);
+}
+
+- (void)startBatches {
+  while ([runningTickets_ count] < maxConcurrentBatches_
+         && [unsentBatches_ count] > 0
+         && updateError_ == nil) {
+
+    NSIndexSet *indexes = [[[unsentBatches_ objectAtIndex:0] retain] autorelease];
+    [unsentBatches_ removeObjectAtIndex:0];
+
+    // cells edited again since the update began are still dirty, and ones
+    // already sent in another batch are skipped
+    NSMutableIndexSet *sentIndexes = [NSMutableIndexSet indexSet];
+    GDataFeedSpreadsheetCell *batchFeed = [self batchFeedForCellIndexes:indexes
+                                                            onlyIfDirty:YES
+                                                            sentIndexes:sentIndexes];
+    if ([sentIndexes count] == 0) continue;
+
+    SEL sel = @selector(ticket:finishedWithBatchFeed:error:);
+    GDataServiceTicket *ticket = [service_ fetchFeedWithBatchFeed:batchFeed
+                                                  forBatchFeedURL:batchFeedURL_
+                                                         delegate:self
+                                                didFinishSelector:sel];
+    if (ticket == nil) break;
+
+    NSUInteger idx = [sentIndexes firstIndex];
+    while (idx != NSNotFound) {
+      cellStates_[idx] = kCellSending;
+      idx = [sentIndexes indexGreaterThanIndex:idx];
+    }
+
+    [ticket setProperty:sentIndexes forKey:kCellIndexesPropertyKey];
+    [runningTickets_ addObject:ticket];
+  }
+
+  if ([runningTickets_ count] == 0) {
+    [self finishUpdate];
+  }
+}
+
+- (void)ticket:(GDataServiceTicket *)ticket
+finishedWithBatchFeed:(GDataFeedSpreadsheetCell *)feed
+         error:(NSError *)error {
+
+  NSIndexSet *sentIndexes = [ticket propertyForKey:kCellIndexesPropertyKey];
+
+  if (error == nil) {
+    for (GDataEntrySpreadsheetCell *entry in [feed entries]) {
+      NSString *batchID = [[entry batchID] stringValue];
+      if (batchID == nil) continue;
+
+      NSUInteger idx = (NSUInteger) [batchID longLongValue];
+      if (![sentIndexes containsIndex:idx]) continue;
+
+      NSNumber *indexNum = [NSNumber numberWithUnsignedInteger:idx];
+      GDataBatchStatus *status = [entry batchStatus];
+      NSInteger code = [[status code] integerValue];
+
+      if (code >= 200 && code < 300) {
+        [failureStatuses_ removeObjectForKey:indexNum];
+
+        // the server's cell has the computed result and a new edit link
+        GDataSpreadsheetCell *cell = [entry cell];
+        if (cell) SetString(resultStrings_, idx, [cell resultString]);
+
+        NSString *editHref = [[entry editLink] href];
+        if (editHref) SetString(editHrefs_, idx, editHref);
+
+        NSString *etag = [entry ETag];
+        if (etag) SetString(ETags_, idx, etag);
+
+        // leave cells edited during the fetch dirty
+        if (cellStates_[idx] == kCellSending) {
+          cellStates_[idx] = kCellClean;
+          dirtyCellCount_--;
+        }
+      } else if (status) {
+        [failureStatuses_ setObject:status forKey:indexNum];
+      }
+    }
+  } else if (updateError_ == nil) {
+    updateError_ = [error retain];
+  }
+
+  // cells that weren't updated, including any missing from the response,
+  // are dirty again
+  NSUInteger idx = [sentIndexes firstIndex];
+  while (idx != NSNotFound) {
+    if (cellStates_[idx] == kCellSending) cellStates_[idx] = kCellDirty;
+    idx = [sentIndexes indexGreaterThanIndex:idx];
+  }
+
+  [[ticket retain] autorelease];
+  [runningTickets_ removeObjectIdenticalTo:ticket];
+
+  [self startBatches];
+}
+
+- (void)finishUpdate {
+  id delegate = [delegate_ autorelease];
+  SEL sel = finishedSel_;
+  NSError *error = [[updateError_ retain] autorelease];
+
+  [service_ release];
+  service_ = nil;
+  delegate_ = nil;
+  finishedSel_ = NULL;
+
+  [unsentBatches_ release];
+  unsentBatches_ = nil;
+  [runningTickets_ release];
+  runningTickets_ = nil;
+
+  if (sel) {
+    [delegate performSelector:sel withObject:self withObject:error];
+  }
+}
+
+- (void)stopUpdating {
+  for (GDataServiceTicket *ticket in runningTickets_) {
+    [ticket cancelTicket];
+
+    NSIndexSet *sentIndexes = [ticket propertyForKey:kCellIndexesPropertyKey];
+    NSUInteger idx = [sentIndexes firstIndex];
+    while (idx != NSNotFound) {
+      if (cellStates_[idx] == kCellSending) cellStates_[idx] = kCellDirty;
+      idx = [sentIndexes indexGreaterThanIndex:idx];
+    }
+  }
+
+  [service_ release];
+  service_ = nil;
+  [delegate_ release];
+  delegate_ = nil;
+  finishedSel_ = NULL;
+
+  [unsentBatches_ release];
+  unsentBatches_ = nil;
+  [runningTickets_ release];
+  runningTickets_ = nil;
+}
+
+@end
+
+#endif // !GDATA_REQUIRE_SERVICE_INCLUDES || GDATA_INCLUDE_SPREADSHEET_SERVICE
@@ -25,6 +25,7 @@
   NSInteger offsetSeconds_; // may be NSUndefinedDateComponent
   BOOL isUniversalTime_; // preserves "Z"
   NSTimeZone *timeZone_; // specific time zone by name, if known
+  NSDate *date_; // cached result of -date, cleared when any field changes
 }
 
 // Note: Nil can be passed for time zone arguments when the time zone is not
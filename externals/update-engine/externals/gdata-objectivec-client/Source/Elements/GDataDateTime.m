@@ -19,6 +19,144 @@
 
 #import "GDataDateTime.h"
 
+// Fields of an RFC 3339 string, before they are turned into date components
+// and an offset
+typedef struct {
+  NSInteger year;
+  NSInteger month;
+  NSInteger day;
+  NSInteger hour;
+  NSInteger minute;
+  NSInteger second;
+  char sign; // 0 when there is no offset, otherwise 'Z', '+' or '-'
+  NSInteger offsetHour;
+  NSInteger offsetMinute;
+} GDataRFC3339Fields;
+
+// Strings no longer than this are tried with the byte-level parser
+static const CFIndex kMaxFastRFC3339Length = 40;
+
+// Feeds only use a handful of offsets, so the time zones for them are made
+// once and shared
+static NSTimeZone *gUniversalTimeZone = nil;
+static NSMutableDictionary *gOffsetTimeZones = nil;
+
+static NSTimeZone *UniversalTimeZone(void) {
+  @synchronized([GDataDateTime class]) {
+    if (gUniversalTimeZone == nil) {
+      gUniversalTimeZone = [[NSTimeZone timeZoneWithName:@"Universal"] retain];
+    }
+  }
+  return gUniversalTimeZone;
+}
+
+static NSTimeZone *TimeZoneForOffsetSeconds(NSInteger offsetSeconds) {
+  NSTimeZone *tz;
+  @synchronized([GDataDateTime class]) {
+    if (gOffsetTimeZones == nil) {
+      gOffsetTimeZones = [[NSMutableDictionary alloc] init];
+    }
+    NSNumber *key = [NSNumber numberWithLong:(long)offsetSeconds];
+    tz = [gOffsetTimeZones objectForKey:key];
+    if (tz == nil) {
+      tz = [NSTimeZone timeZoneForSecondsFromGMT:offsetSeconds];
+      if (tz) {
+        [gOffsetTimeZones setObject:tz forKey:key];
+      }
+    }
+  }
+  return tz;
+}
+
+// Reads exactly |count| decimal digits
+static inline BOOL ScanFixedDigits(const char *str, int count,
+                                   NSInteger *value) {
+  NSInteger result = 0;
+  for (int idx = 0; idx < count; idx++) {
+    char c = str[idx];
+    if (c < '0' || c > '9') return NO;
+    result = result * 10 + (c - '0');
+  }
+  *value = result;
+  return YES;
+}
+
+// Parses the common fixed-width forms
+//   yyyy-mm-dd
+//   yyyy-mm-ddThh:mm:ss[.fffff][Z|+hh:mm|-hh:mm]
+// returning NO for anything else so the caller can fall back on NSScanner.
+//
+// Fractions longer than five digits are left to NSScanner, since their float
+// value may round up to the next second.
+static BOOL ParseRFC3339Bytes(const char *str, CFIndex len,
+                              GDataRFC3339Fields *fields) {
+  fields->hour = NSUndefinedDateComponent;
+  fields->minute = NSUndefinedDateComponent;
+  fields->second = NSUndefinedDateComponent;
+  fields->sign = 0;
+  fields->offsetHour = 0;
+  fields->offsetMinute = 0;
+
+  if (len < 10
+      || !ScanFixedDigits(str, 4, &fields->year) || str[4] != '-'
+      || !ScanFixedDigits(str + 5, 2, &fields->month) || str[7] != '-'
+      || !ScanFixedDigits(str + 8, 2, &fields->day)) {
+    return NO;
+  }
+  if (len == 10) return YES;
+
+  char t = str[10];
+  if ((t != 'T' && t != 't' && t != ' ')
+      || len < 19
+      || !ScanFixedDigits(str + 11, 2, &fields->hour) || str[13] != ':'
+      || !ScanFixedDigits(str + 14, 2, &fields->minute) || str[16] != ':'
+      || !ScanFixedDigits(str + 17, 2, &fields->second)) {
+    return NO;
+  }
+
+  CFIndex pos = 19;
+  if (pos < len && str[pos] == '.') {
+    CFIndex fractionStart = ++pos;
+    while (pos < len && str[pos] >= '0' && str[pos] <= '9') pos++;
+
+    CFIndex fractionDigits = pos - fractionStart;
+    if (fractionDigits < 1 || fractionDigits > 5) return NO;
+  }
+
+  if (pos == len) return YES;
+
+  char sign = str[pos];
+  if (sign == 'Z' || sign == 'z') {
+    fields->sign = 'Z';
+    return (pos + 1 == len);
+  }
+  if ((sign != '+' && sign != '-')
+      || len - pos != 6
+      || !ScanFixedDigits(str + pos + 1, 2, &fields->offsetHour)
+      || str[pos + 3] != ':'
+      || !ScanFixedDigits(str + pos + 4, 2, &fields->offsetMinute)) {
+    return NO;
+  }
+  fields->sign = sign;
+  return YES;
+}
+
+// Days from 1970-01-01 to the given proleptic Gregorian date; days past the
+// end of the month carry into the next month, as with NSCalendar
+static long long DaysFromCivil(long long year, NSInteger month, NSInteger day) {
+  year -= (month <= 2);
+  long long era = (year >= 0 ? year : year - 399) / 400;
+  long long yearOfEra = year - era * 400;
+  long long dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+  long long dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100
+    + dayOfYear;
+  return era * 146097 + dayOfEra - 719468;
+}
+
+@interface GDataDateTime (PrivateMethods)
+- (void)clearCachedDate;
+- (NSDate *)computeDate;
+@end
 
 @implementation GDataDateTime
 
@@ -52,6 +190,7 @@
 - (void)dealloc {
   [dateComponents_ release];
   [timeZone_ release];
+  [date_ release];
   [super dealloc];
 }
 
@@ -120,20 +259,22 @@
   }
 
   if ([self isUniversalTime]) {
-    NSTimeZone *ztz = [NSTimeZone timeZoneWithName:@"Universal"];
+    NSTimeZone *ztz = UniversalTimeZone();
     return ztz;
   }
 
   NSInteger offsetSeconds = [self offsetSeconds];
 
   if (offsetSeconds != NSUndefinedDateComponent) {
-    NSTimeZone *tz = [NSTimeZone timeZoneForSecondsFromGMT:offsetSeconds];
+    NSTimeZone *tz = TimeZoneForOffsetSeconds(offsetSeconds);
     return tz;
   }
   return nil;
 }
 
 - (void)setTimeZone:(NSTimeZone *)timeZone {
+  [self clearCachedDate];
+
   [timeZone_ release];
   timeZone_ = [timeZone retain];
 
@@ -146,6 +287,8 @@
 }
 
 - (void)setTimeZone:(NSTimeZone *)timeZone withOffsetSeconds:(NSInteger)val {
+  [self clearCachedDate];
+
   [timeZone_ release];
   timeZone_ = [timeZone retain];
 
@@ -162,8 +305,58 @@
 }
 
 - (NSDate *)date {
-  NSCalendar *cal = [self calendar];
+  if (date_ == nil) {
+    date_ = [[self computeDate] retain];
+  }
+  return date_;
+}
+
+- (void)clearCachedDate {
+  [date_ release];
+  date_ = nil;
+}
+
+- (NSDate *)computeDate {
   NSDateComponents *dateComponents = [self dateComponents];
+  NSInteger year = [dateComponents year];
+  NSInteger month = [dateComponents month];
+  NSInteger day = [dateComponents day];
+  BOOL hasTime = [self hasTime];
+  NSInteger offset = [self isUniversalTime] ? 0 : [self offsetSeconds];
+
+  // NSCalendar is only needed when a named time zone may have daylight
+  // saving rules, the offset is unknown and the system zone applies, or the
+  // date falls outside the range where the Gregorian calendar is proleptic
+  // and the arithmetic below matches it
+  BOOL isFixedOffset = (!hasTime
+                        || (offset != NSUndefinedDateComponent
+                            && (timeZone_ == nil
+                                || timeZone_ == UniversalTimeZone()
+                                || timeZone_ == TimeZoneForOffsetSeconds(offset))));
+  if (isFixedOffset
+      && year >= 1600 && year <= 9999
+      && month >= 1 && month <= 12
+      && day >= 1 && day <= 31) {
+
+    long long seconds = DaysFromCivil(year, month, day) * 86400LL;
+    if (hasTime) {
+      NSInteger hour = [dateComponents hour];
+      NSInteger minute = [dateComponents minute];
+      NSInteger second = [dateComponents second];
+      if (hour >= 0 && hour <= 24
+          && minute >= 0 && minute <= 59
+          && second >= 0 && second <= 60) {
+        seconds += hour * 3600LL + minute * 60LL + second - offset;
+        return [NSDate dateWithTimeIntervalSince1970:(NSTimeInterval)seconds];
+      }
+    } else {
+      // noon GMT, as below
+      seconds += 12 * 3600LL;
+      return [NSDate dateWithTimeIntervalSince1970:(NSTimeInterval)seconds];
+    }
+  }
+
+  NSCalendar *cal = [self calendar];
 
   if (![self hasTime]) {
     // we're not keeping track of a time, but NSDate always is based on
@@ -186,7 +379,7 @@
     [noonDateComponents setSecond:0];
     dateComponents = noonDateComponents;
 
-    NSTimeZone *gmt = [NSTimeZone timeZoneWithName:@"Universal"];
+    NSTimeZone *gmt = UniversalTimeZone();
     [cal setTimeZone:gmt];
   }
 
@@ -202,41 +395,48 @@
   NSDateComponents *dateComponents = [self dateComponents];
   NSInteger offset = [self offsetSeconds];
 
-  NSString *timeString = @""; // timeString like "T15:10:46-08:00"
+  // formatted with snprintf into a stack buffer, since this is called for
+  // every date element when generating XML
+  char buffer[256];
 
-  if ([self hasTime]) {
+  // full dateString like "2006-11-17T15:10:46-08:00"
+  int len = snprintf(buffer, sizeof(buffer), "%04ld-%02ld-%02ld",
+    (long)[dateComponents year], (long)[dateComponents month],
+    (long)[dateComponents day]);
 
-    NSString *timeOffsetString; // timeOffsetString like "-08:00"
+  if ([self hasTime]) {
+    // timeString like "T15:10:46-08:00"
+    len += snprintf(buffer + len, sizeof(buffer) - len, "T%02ld:%02ld:%02ld",
+      (long)[dateComponents hour], (long)[dateComponents minute],
+      (long)[dateComponents second]);
 
+    // timeOffsetString like "-08:00"
     if ([self isUniversalTime]) {
-     timeOffsetString = @"Z";
+      len += snprintf(buffer + len, sizeof(buffer) - len, "Z");
     } else if (offset == NSUndefinedDateComponent) {
       // unknown offset is rendered as -00:00 per
       // http://www.ietf.org/rfc/rfc3339.txt section 4.3
-      timeOffsetString = @"-00:00";
+      len += snprintf(buffer + len, sizeof(buffer) - len, "-00:00");
     } else {
-      NSString *sign = @"+";
+      char sign = '+';
       if (offset < 0) {
-        sign = @"-";
+        sign = '-';
         offset = -offset;
       }
-      timeOffsetString = [NSString stringWithFormat:@"%@%02ld:%02ld",
-        sign, (long)(offset/(60*60)) % 24, (long)(offset / 60) % 60];
+      len += snprintf(buffer + len, sizeof(buffer) - len, "%c%02ld:%02ld",
+        sign, (long)(offset/(60*60)) % 24, (long)(offset / 60) % 60);
     }
-    timeString = [NSString stringWithFormat:@"T%02ld:%02ld:%02ld%@",
-      (long)[dateComponents hour], (long)[dateComponents minute],
-      (long)[dateComponents second], timeOffsetString];
   }
 
-  // full dateString like "2006-11-17T15:10:46-08:00"
-  NSString *dateString = [NSString stringWithFormat:@"%04ld-%02ld-%02ld%@",
-    (long)[dateComponents year], (long)[dateComponents month],
-    (long)[dateComponents day], timeString];
-
+  NSString *dateString = [[[NSString alloc] initWithBytes:buffer
+                                                   length:len
+                                                 encoding:NSASCIIStringEncoding] autorelease];
   return dateString;
 }
 
 - (void)setFromDate:(NSDate *)date timeZone:(NSTimeZone *)tz {
+  [self clearCachedDate];
+
   NSCalendar *cal = [[[NSCalendar alloc] initWithCalendarIdentifier:NSGregorianCalendar] autorelease];
   if (tz) {
     [cal setTimeZone:tz];
@@ -256,7 +456,7 @@
   if (tz) {
     offset = [tz secondsFromGMTForDate:date];
 
-    if (offset == 0 && [tz isEqualToTimeZone:[NSTimeZone timeZoneWithName:@"Universal"]]) {
+    if (offset == 0 && [tz isEqualToTimeZone:UniversalTimeZone()]) {
       [self setIsUniversalTime:YES];
     }
   }
@@ -271,7 +471,8 @@ static inline BOOL ScanInteger(NSScanner *scanner, NSInteger *targetInteger) {
   return [scanner scanInteger:targetInteger];
 }
 
-- (void)setFromRFC3339String:(NSString *)str {
+// Lenient parsing for anything the byte-level parser does not accept
+static void ScanRFC3339String(NSString *str, GDataRFC3339Fields *fields) {
 
   NSInteger year = NSUndefinedDateComponent;
   NSInteger month = NSUndefinedDateComponent;
@@ -286,10 +487,19 @@ static inline BOOL ScanInteger(NSScanner *scanner, NSInteger *targetInteger) {
 
   NSScanner* scanner = [NSScanner scannerWithString:str];
 
-  NSCharacterSet* dashSet = [NSCharacterSet characterSetWithCharactersInString:@"-"];
-  NSCharacterSet* tSet = [NSCharacterSet characterSetWithCharactersInString:@"Tt "];
-  NSCharacterSet* colonSet = [NSCharacterSet characterSetWithCharactersInString:@":"];
-  NSCharacterSet* plusMinusZSet = [NSCharacterSet characterSetWithCharactersInString:@"+-zZ"];
+  static NSCharacterSet* dashSet = nil;
+  static NSCharacterSet* tSet = nil;
+  static NSCharacterSet* colonSet = nil;
+  static NSCharacterSet* plusMinusZSet = nil;
+
+  @synchronized([GDataDateTime class]) {
+    if (dashSet == nil) {
+      dashSet = [[NSCharacterSet characterSetWithCharactersInString:@"-"] retain];
+      tSet = [[NSCharacterSet characterSetWithCharactersInString:@"Tt "] retain];
+      colonSet = [[NSCharacterSet characterSetWithCharactersInString:@":"] retain];
+      plusMinusZSet = [[NSCharacterSet characterSetWithCharactersInString:@"+-zZ"] retain];
+    }
+  }
 
   // for example, scan 2006-11-17T15:10:46-08:00
   //                or 2006-11-17T15:10:46Z
@@ -313,15 +523,54 @@ static inline BOOL ScanInteger(NSScanner *scanner, NSInteger *targetInteger) {
       ScanInteger(scanner, &offsetMinute)) {
   }
 
-  NSDateComponents *dateComponents = [[[NSDateComponents alloc] init] autorelease];
-  [dateComponents setYear:year];
-  [dateComponents setMonth:month];
-  [dateComponents setDay:day];
-  [dateComponents setHour:hour];
-  [dateComponents setMinute:minute];
-
   if (secFloat < -1.0f || secFloat > -1.0f) sec = (NSInteger)secFloat;
-  [dateComponents setSecond:sec];
+
+  fields->year = year;
+  fields->month = month;
+  fields->day = day;
+  fields->hour = hour;
+  fields->minute = minute;
+  fields->second = sec;
+  fields->offsetHour = offsetHour;
+  fields->offsetMinute = offsetMinute;
+
+  if (sign == nil) {
+    fields->sign = 0;
+  } else if ([sign caseInsensitiveCompare:@"Z"] == NSOrderedSame) {
+    fields->sign = 'Z';
+  } else if ([sign isEqual:@"-"]) {
+    fields->sign = '-';
+  } else {
+    fields->sign = '+';
+  }
+}
+
+- (void)setFromRFC3339String:(NSString *)str {
+
+  GDataRFC3339Fields fields;
+
+  // feeds carry several timestamps per entry, nearly always in the
+  // fixed-width form, so try that on the raw bytes before using NSScanner
+  char bytes[kMaxFastRFC3339Length];
+  CFIndex len = (CFIndex) [str length];
+  CFIndex usedLen = 0;
+  BOOL didParse = (len <= kMaxFastRFC3339Length
+                   && CFStringGetBytes((CFStringRef)str, CFRangeMake(0, len),
+                                       kCFStringEncodingASCII, 0, false,
+                                       (UInt8 *)bytes, sizeof(bytes),
+                                       &usedLen) == len
+                   && ParseRFC3339Bytes(bytes, usedLen, &fields));
+  if (!didParse) {
+    ScanRFC3339String(str, &fields);
+  }
+
+  NSDateComponents *dateComponents = [[[NSDateComponents alloc] init] autorelease];
+  [dateComponents setYear:fields.year];
+  [dateComponents setMonth:fields.month];
+  [dateComponents setDay:fields.day];
+  [dateComponents setHour:fields.hour];
+  [dateComponents setMinute:fields.minute];
+  [dateComponents setSecond:fields.second];
 
   [self setDateComponents:dateComponents];
 
@@ -332,16 +581,16 @@ static inline BOOL ScanInteger(NSScanner *scanner, NSInteger *targetInteger) {
   NSInteger totalOffset = NSUndefinedDateComponent;
   [self setIsUniversalTime:NO];
 
-  if ([sign caseInsensitiveCompare:@"Z"] == NSOrderedSame) {
+  if (fields.sign == 'Z') {
 
     [self setIsUniversalTime:YES];
     totalOffset = 0;
 
-  } else if (sign != nil) {
+  } else if (fields.sign != 0) {
 
-    totalOffset = (60 * offsetMinute) + (60 * 60 * offsetHour);
+    totalOffset = (60 * fields.offsetMinute) + (60 * 60 * fields.offsetHour);
 
-    if ([sign isEqual:@"-"]) {
+    if (fields.sign == '-') {
 
       if (totalOffset == 0) {
         // special case: offset of -0.00 means undefined offset
@@ -368,20 +617,27 @@ static inline BOOL ScanInteger(NSScanner *scanner, NSInteger *targetInteger) {
 
   // we'll set time values to zero or NSUndefinedDateComponent as appropriate
   BOOL hadTime = [self hasTime];
-
-  if (shouldHaveTime && !hadTime) {
-    [dateComponents_ setHour:0];
-    [dateComponents_ setMinute:0];
-    [dateComponents_ setSecond:0];
-    offsetSeconds_ = NSUndefinedDateComponent;
-    isUniversalTime_ = NO;
-
-  } else if (hadTime && !shouldHaveTime) {
-    [dateComponents_ setHour:NSUndefinedDateComponent];
-    [dateComponents_ setMinute:NSUndefinedDateComponent];
-    [dateComponents_ setSecond:NSUndefinedDateComponent];
-    offsetSeconds_ = NSUndefinedDateComponent;
-    isUniversalTime_ = NO;
+  if (shouldHaveTime == hadTime) return;
+
+  // copies share our date components, so change a new instance rather than
+  // the current one
+  NSDateComponents *oldComponents = [self dateComponents];
+  NSDateComponents *newComponents = [[[NSDateComponents alloc] init] autorelease];
+  [newComponents setEra:[oldComponents era]];
+  [newComponents setYear:[oldComponents year]];
+  [newComponents setMonth:[oldComponents month]];
+  [newComponents setDay:[oldComponents day]];
+
+  NSInteger timeValue = (shouldHaveTime ? 0 : NSUndefinedDateComponent);
+  [newComponents setHour:timeValue];
+  [newComponents setMinute:timeValue];
+  [newComponents setSecond:timeValue];
+
+  [self setDateComponents:newComponents];
+  offsetSeconds_ = NSUndefinedDateComponent;
+  isUniversalTime_ = NO;
+
+  if (!shouldHaveTime) {
     [self setTimeZone:nil];
   }
 }
@@ -391,6 +647,7 @@ static inline BOOL ScanInteger(NSScanner *scanner, NSInteger *targetInteger) {
 }
 
 - (void)setOffsetSeconds:(NSInteger)val {
+  [self clearCachedDate];
   offsetSeconds_ = val;
 }
 
@@ -399,6 +656,7 @@ static inline BOOL ScanInteger(NSScanner *scanner, NSInteger *targetInteger) {
 }
 
 - (void)setIsUniversalTime:(BOOL)flag {
+  [self clearCachedDate];
   isUniversalTime_ = flag;
 }
 
@@ -407,6 +665,8 @@ static inline BOOL ScanInteger(NSScanner *scanner, NSInteger *targetInteger) {
 }
 
 - (void)setDateComponents:(NSDateComponents *)dateComponents {
+  [self clearCachedDate];
+
   [dateComponents_ autorelease];
   dateComponents_ = [dateComponents retain]; // NSDateComponents doesn't implement NSCopying in 10.4
 }
@@ -29,6 +29,7 @@
 #import "GDataDateTime.h"
 #import "GDataProgressMonitorInputStream.h"
 #import "GDataGatherInputStream.h"
+#import "GDataXMLInputStream.h"
 #import "GDataMIMEDocument.h"
 #import "GDataServerError.h"
 
@@ -543,6 +543,7 @@
   #define GDataWho                                _GDATA_NS_SYMBOL(GDataWho)
   #define GDataWorksheetName                      _GDATA_NS_SYMBOL(GDataWorksheetName)
   #define GDataWritersCanInvite                   _GDATA_NS_SYMBOL(GDataWritersCanInvite)
+  #define GDataXMLInputStream                     _GDATA_NS_SYMBOL(GDataXMLInputStream)
   #define GDataYouTubeAboutMe                     _GDATA_NS_SYMBOL(GDataYouTubeAboutMe)
   #define GDataYouTubeAccessControl               _GDATA_NS_SYMBOL(GDataYouTubeAccessControl)
   #define GDataYouTubeAge                         _GDATA_NS_SYMBOL(GDataYouTubeAge)
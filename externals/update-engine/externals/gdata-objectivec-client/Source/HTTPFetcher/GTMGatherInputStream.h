@@ -22,8 +22,15 @@
 // each NSData in turn as the read method is called.  You should not alter the
 // underlying set of NSData objects until all read operations on this input
 // stream have completed.
+//
+// Besides the usual read method, the stream's bytes may be taken without
+// copying, either a segment at a time with getBuffer:length:, or as an iovec
+// list for handing to writev() on a socket.  Segments may be NSData objects,
+// including mapped ones, or ranges of files made with
+// dataWithFileDescriptor:offset:length:.
 
 #import <Foundation/Foundation.h>
+#import <sys/uio.h>
 
 #if defined(GTL_TARGET_NAMESPACE)
   // we need NSInteger for the 10.4 SDK, or we're using target namespace macros
@@ -42,8 +49,10 @@
 @interface GTMGatherInputStream : NSInputStream GTM_NSSTREAM_DELEGATE {
 
   NSArray* dataArray_;   // NSDatas that should be "gathered" and streamed.
+  NSUInteger arrayCount_;       // Number of NSDatas in the array.
   NSUInteger arrayIndex_;       // Index in the array of the current NSData.
   long long dataOffset_; // Offset in the current NSData we are processing.
+  NSError *streamError_;        // Error reading a file segment, if any.
 
   __weak id delegate_;          // stream delegate, defaults to self
 
@@ -59,4 +68,28 @@
 
 - (id)initWithArray:(NSArray *)dataArray;
 
+// A segment for the data array holding length bytes of the file at offset.
+// The stream reads the file with pread() rather than mapping it, unless the
+// segment's bytes are asked for directly; then the range is mapped read-only.
+// The descriptor must stay open until the stream is closed.
++ (NSData *)dataWithFileDescriptor:(int)fd
+                            offset:(unsigned long long)offset
+                            length:(NSUInteger)length;
+
+// getBuffer:length: returns the unread bytes of the current segment.  As with
+// CFReadStreamGetBuffer(), the returned bytes count as read, and remain valid
+// until the stream is closed.
+
+// Fills vectors with up to maxCount ranges of the unread bytes, without
+// counting them as read, and returns the number of vectors filled.  After
+// sending the bytes, call skipBytes: with the number actually sent.
+- (int)getIOVectors:(struct iovec *)vectors maxCount:(int)maxCount;
+
+// Counts the next length bytes as read, as after a partial writev().
+- (void)skipBytes:(unsigned long long)length;
+
+// Sends as much of the unread bytes as a single writev() call to fd accepts,
+// and returns the number of bytes sent, or -1 with errno set.
+- (NSInteger)writeToFileDescriptor:(int)fd;
+
 @end
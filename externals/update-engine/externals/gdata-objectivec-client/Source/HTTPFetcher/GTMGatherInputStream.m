@@ -15,16 +15,132 @@
 
 #import "GTMGatherInputStream.h"
 
+#include <sys/mman.h>
+#include <limits.h>
+#include <unistd.h>
+
+// GTMGatherFileData is a range of a file, read with pread() by the stream,
+// and mapped only if its bytes are asked for directly
+@interface GTMGatherFileData : NSData {
+  int fd_;
+  unsigned long long offset_;
+  NSUInteger length_;
+
+  void *mapping_;          // page-aligned start of the mapping, if mapped
+  size_t mappingLength_;
+  NSUInteger mappingSkip_; // bytes from the mapping's start to the range's
+}
+- (id)initWithFileDescriptor:(int)fd
+                      offset:(unsigned long long)offset
+                      length:(NSUInteger)length;
+- (BOOL)readBytes:(uint8_t *)buffer range:(NSRange)range;
+@end
+
+@implementation GTMGatherFileData
+
+- (id)initWithFileDescriptor:(int)fd
+                      offset:(unsigned long long)offset
+                      length:(NSUInteger)length {
+  self = [super init];
+  if (self) {
+    fd_ = fd;
+    offset_ = offset;
+    length_ = length;
+  }
+  return self;
+}
+
+- (void)unmap {
+  if (mapping_) {
+    munmap(mapping_, mappingLength_);
+    mapping_ = NULL;
+  }
+}
+
+- (void)finalize {
+  [self unmap];
+  [super finalize];
+}
+
+- (void)dealloc {
+  [self unmap];
+  [super dealloc];
+}
+
+- (const void *)bytes {
+  if (length_ == 0) return "";
+
+  if (mapping_ == NULL) {
+    // mappings must start on a page boundary
+    unsigned long long pageSize = (unsigned long long) getpagesize();
+    mappingSkip_ = (NSUInteger) (offset_ % pageSize);
+    mappingLength_ = mappingSkip_ + length_;
+
+    void *mapping = mmap(NULL, mappingLength_, PROT_READ, MAP_PRIVATE, fd_,
+                         (off_t) (offset_ - mappingSkip_));
+    if (mapping == MAP_FAILED) {
+      [NSException raise:NSFileHandleOperationException
+                  format:@"cannot map file descriptor %d: %s", fd_,
+                         strerror(errno)];
+    }
+    mapping_ = mapping;
+  }
+  return (const char *)mapping_ + mappingSkip_;
+}
+
+- (NSUInteger)length {
+  return length_;
+}
+
+// reads the range of the segment into buffer, from the mapping if there is
+// one, and returns NO with errno set on failure
+- (BOOL)readBytes:(uint8_t *)buffer range:(NSRange)range {
+  if (mapping_) {
+    memcpy(buffer, (const char *)mapping_ + mappingSkip_ + range.location,
+           range.length);
+    return YES;
+  }
+
+  NSUInteger bytesRead = 0;
+  while (bytesRead < range.length) {
+    off_t fileOffset = (off_t) (offset_ + range.location + bytesRead);
+    ssize_t numRead = pread(fd_, buffer + bytesRead,
+                            range.length - bytesRead, fileOffset);
+    if (numRead < 0) {
+      if (errno == EINTR) continue;
+      return NO;
+    }
+    if (numRead == 0) {
+      // the file is shorter than the segment
+      errno = EIO;
+      return NO;
+    }
+    bytesRead += (NSUInteger) numRead;
+  }
+  return YES;
+}
+
+@end
+
 @implementation GTMGatherInputStream
 
 + (NSInputStream *)streamWithArray:(NSArray *)dataArray {
   return [[[self alloc] initWithArray:dataArray] autorelease];
 }
 
++ (NSData *)dataWithFileDescriptor:(int)fd
+                            offset:(unsigned long long)offset
+                            length:(NSUInteger)length {
+  return [[[GTMGatherFileData alloc] initWithFileDescriptor:fd
+                                                     offset:offset
+                                                     length:length] autorelease];
+}
+
 - (id)initWithArray:(NSArray *)dataArray {
   self = [super init];
   if (self) {
     dataArray_ = [dataArray retain];
+    arrayCount_ = [dataArray count];
     arrayIndex_ = 0;
     dataOffset_ = 0;
 
@@ -45,6 +161,7 @@
 
 - (void)dealloc {
   [dataArray_ release];
+  [streamError_ release];
   [dummyStream_ release];
   [dummyData_ release];
 
@@ -57,7 +174,7 @@
   NSUInteger bytesRemaining = len;
 
   // read bytes from the currently-indexed array
-  while ((bytesRemaining > 0) && (arrayIndex_ < [dataArray_ count])) {
+  while ((bytesRemaining > 0) && (arrayIndex_ < arrayCount_)) {
 
     NSData* data = [dataArray_ objectAtIndex:arrayIndex_];
 
@@ -67,7 +184,21 @@
     NSUInteger bytesToCopy = MIN(bytesRemaining, dataBytesLeft);
     NSRange range = NSMakeRange((NSUInteger) dataOffset_, bytesToCopy);
 
-    [data getBytes:(buffer + bytesRead) range:range];
+    if ([data isKindOfClass:[GTMGatherFileData class]]) {
+      // file segments are read directly into the caller's buffer
+      BOOL didRead = [(GTMGatherFileData *)data readBytes:(buffer + bytesRead)
+                                                    range:range];
+      if (!didRead) {
+        [streamError_ release];
+        streamError_ = [[NSError alloc] initWithDomain:NSPOSIXErrorDomain
+                                                  code:errno
+                                              userInfo:nil];
+        // report the bytes read so far; the next read will fail again
+        return (bytesRead > 0 ? (NSInteger) bytesRead : -1);
+      }
+    } else {
+      [data getBytes:(buffer + bytesRead) range:range];
+    }
 
     bytesRead += bytesToCopy;
     dataOffset_ += bytesToCopy;
@@ -89,8 +220,102 @@
   return bytesRead;
 }
 
+// moves past empty segments, so the current segment, if any, has unread bytes
+- (void)skipEmptySegments {
+  while ((arrayIndex_ < arrayCount_)
+         && ([[dataArray_ objectAtIndex:arrayIndex_] length] == 0)) {
+    arrayIndex_++;
+  }
+}
+
 - (BOOL)getBuffer:(uint8_t **)buffer length:(NSUInteger *)len {
-  return NO;  // We don't support this style of reading.
+  [self skipEmptySegments];
+  if (arrayIndex_ >= arrayCount_) return NO;
+
+  NSData* data = [dataArray_ objectAtIndex:arrayIndex_];
+  const uint8_t *bytes;
+  @try {
+    bytes = [data bytes];
+  }
+  @catch (NSException *exception) {
+    // a file segment which can't be mapped must be read instead
+    return NO;
+  }
+
+  *buffer = (uint8_t *) bytes + dataOffset_;
+  *len = [data length] - (NSUInteger) dataOffset_;
+
+  // the returned bytes count as read
+  dataOffset_ = 0;
+  arrayIndex_++;
+  return YES;
+}
+
+- (int)getIOVectors:(struct iovec *)vectors maxCount:(int)maxCount {
+  int count = 0;
+  NSUInteger index = arrayIndex_;
+  NSUInteger offset = (NSUInteger) dataOffset_;
+
+  while ((count < maxCount) && (index < arrayCount_)) {
+    NSData* data = [dataArray_ objectAtIndex:index];
+    NSUInteger dataLen = [data length];
+
+    if (offset < dataLen) {
+      const char *bytes;
+      @try {
+        bytes = [data bytes];
+      }
+      @catch (NSException *exception) {
+        // stop at a file segment which can't be mapped
+        break;
+      }
+      vectors[count].iov_base = (void *) (bytes + offset);
+      vectors[count].iov_len = dataLen - offset;
+      count++;
+    }
+    offset = 0;
+    index++;
+  }
+  return count;
+}
+
+- (void)skipBytes:(unsigned long long)length {
+  while ((length > 0) && (arrayIndex_ < arrayCount_)) {
+    NSData* data = [dataArray_ objectAtIndex:arrayIndex_];
+    unsigned long long dataBytesLeft = [data length] - dataOffset_;
+
+    if (length < dataBytesLeft) {
+      dataOffset_ += length;
+      return;
+    }
+    length -= dataBytesLeft;
+    dataOffset_ = 0;
+    arrayIndex_++;
+  }
+}
+
+- (NSInteger)writeToFileDescriptor:(int)fd {
+  struct iovec vectors[IOV_MAX];
+  int count = [self getIOVectors:vectors maxCount:IOV_MAX];
+  if (count == 0) {
+    [self skipEmptySegments];
+    if (arrayIndex_ < arrayCount_) {
+      // the next segment couldn't be mapped
+      errno = EIO;
+      return -1;
+    }
+    return 0;
+  }
+
+  ssize_t numWritten;
+  do {
+    numWritten = writev(fd, vectors, count);
+  } while (numWritten < 0 && errno == EINTR);
+
+  if (numWritten > 0) {
+    [self skipBytes:(unsigned long long) numWritten];
+  }
+  return numWritten;
 }
 
 - (BOOL)hasBytesAvailable {
@@ -114,6 +339,7 @@
   // so we'll free up the data array right away
   [dataArray_ release];
   dataArray_ = nil;
+  arrayCount_ = 0;
 }
 
 - (void)stream:(NSStream *)theStream handleEvent:(NSStreamEvent)streamEvent {
@@ -153,9 +379,11 @@
 }
 
 - (NSStreamStatus)streamStatus {
+  if (streamError_) return NSStreamStatusError;
   return [dummyStream_ streamStatus];
 }
 - (NSError *)streamError {
+  if (streamError_) return streamError_;
   return [dummyStream_ streamError];
 }
 
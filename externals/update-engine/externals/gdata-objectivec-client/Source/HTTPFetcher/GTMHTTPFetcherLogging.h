@@ -49,9 +49,51 @@
 //   [fetcher setCommentWithFormat:@"retrieve item %@", itemName];
 //
 // Projects may define STRIP_GTM_FETCH_LOGGING to remove logging code.
+//
+// Binary logging
+//
+// The html logs are meant for debugging; writing them and pretty-printing
+// XML with xmllint takes time on each fetch's completion.  To leave logging
+// on in shipping apps, call
+//
+//   [GTMHTTPFetcher setBinaryLoggingEnabled:YES];
+//
+// along with setLoggingEnabled:.  Each fetch then appends one compact record
+// to the file binaryLogPath, holding the raw request and response headers and
+// the start of the bodies.  Records are written by a background thread;
+// while more than binaryLoggingMaxQueuedBytes of records are waiting, new
+// ones are dropped and counted in the log.  Upload streams are not captured,
+// and the fetcher's log property is not set.
+//
+// The GTMHTTPFetchLogViewer tool in Source/Tools prints the records of a
+// binary log, pretty-printing XML bodies.
 
 #if !STRIP_GTM_FETCH_LOGGING
 
+// Binary log format.  The file begins with the 8 bytes of
+// kGTMHTTPFetchLogMagic.  Each record is then, little-endian, a uint32 count
+// of the record's remaining bytes, a uint64 time in milliseconds since 1970,
+// a uint32 fetch number and an int32 status code, followed by fields.  Each
+// field is a uint8 type, a uint32 length, and that many bytes.  Strings are
+// UTF-8, headers are "Key: value" lines, and length fields are uint64s.
+#define kGTMHTTPFetchLogMagic "GTMFLOG1"
+
+enum {
+  kGTMHTTPFetchLogFieldComment = 1,
+  kGTMHTTPFetchLogFieldMethod = 2,
+  kGTMHTTPFetchLogFieldURL = 3,
+  kGTMHTTPFetchLogFieldRequestHeaders = 4,
+  kGTMHTTPFetchLogFieldRequestBody = 5,        // at most maxBodyBytes
+  kGTMHTTPFetchLogFieldRequestBodyLength = 6,
+  kGTMHTTPFetchLogFieldResponseURL = 7,
+  kGTMHTTPFetchLogFieldResponseMIMEType = 8,
+  kGTMHTTPFetchLogFieldResponseHeaders = 9,
+  kGTMHTTPFetchLogFieldResponseBody = 10,      // at most maxBodyBytes
+  kGTMHTTPFetchLogFieldResponseBodyLength = 11,
+  kGTMHTTPFetchLogFieldError = 12,
+  kGTMHTTPFetchLogFieldDroppedRecords = 13     // uint32 count
+};
+
 @interface GTMHTTPFetcher (GTMHTTPFetcherLogging)
 
 // Note: the default logs directory is ~/Desktop/GTMHTTPDebugLogs; it will be
@@ -77,6 +119,23 @@
 + (void)setLoggingDateStamp:(NSString *)str;
 + (NSString *)loggingDateStamp;
 
+// binary logging, described above; the defaults are 4MB of queued records
+// and 64K of each body
++ (void)setBinaryLoggingEnabled:(BOOL)flag;
++ (BOOL)isBinaryLoggingEnabled;
+
++ (void)setBinaryLoggingMaxQueuedBytes:(NSUInteger)maxBytes;
++ (NSUInteger)binaryLoggingMaxQueuedBytes;
+
++ (void)setBinaryLoggingMaxBodyBytes:(NSUInteger)maxBytes;
++ (NSUInteger)binaryLoggingMaxBodyBytes;
+
+// the file in the logging directory receiving this run's binary log
++ (NSString *)binaryLogPath;
+
+// waits until the queued records have been written, such as before exiting
++ (void)flushBinaryLog;
+
 // internal; called by fetcher
 - (void)logFetchWithError:(NSError *)error;
 - (BOOL)logCapturePostStream;
@@ -16,7 +16,10 @@
 #if !STRIP_GTM_FETCH_LOGGING
 
 #include <sys/stat.h>
+#include <fcntl.h>
 #include <unistd.h>
+#include <libkern/OSAtomic.h>
+#include <libkern/OSByteOrder.h>
 
 #import "GTMHTTPFetcherLogging.h"
 
@@ -41,9 +44,12 @@
 - (id)objectWithString:(NSString*)jsonrep error:(NSError**)error;
 @end
 
+@class GTMHTTPFetchLogWriter;
+
 @interface GTMHTTPFetcher (GTMHTTPFetcherLoggingInternal)
 + (NSString *)headersStringForDictionary:(NSDictionary *)dict
                              alignColons:(BOOL)shouldAlignColons;
++ (NSString *)rawHeadersStringForDictionary:(NSDictionary *)dict;
 
 - (void)inputStream:(GTMProgressMonitorInputStream *)stream
      readIntoBuffer:(void *)buffer
@@ -59,6 +65,168 @@
 + (NSString *)snipSubtringOfString:(NSString *)originalStr
                 betweenStartString:(NSString *)startStr
                          endString:(NSString *)endStr;
+
++ (GTMHTTPFetchLogWriter *)binaryLogWriter;
+- (void)logFetchBinaryWithError:(NSError *)error;
+@end
+
+// GTMHTTPFetchLogWriter appends binary log records to a file from its own
+// thread, so fetches only pay for building their records
+@interface GTMHTTPFetchLogWriter : NSObject {
+  int fd_;
+  NSCondition *condition_;
+  NSMutableArray *queue_;     // records waiting for the writer thread
+  NSUInteger queuedBytes_;    // bytes of records queued or being written
+  NSUInteger droppedCount_;   // records dropped since the last write
+  BOOL isWriting_;
+}
+- (id)initWithPath:(NSString *)path;
+- (void)enqueueRecord:(NSData *)record maxQueuedBytes:(NSUInteger)maxBytes;
+- (void)flush;
+@end
+
+static void AppendUInt32(NSMutableData *data, uint32_t value) {
+  value = OSSwapHostToLittleInt32(value);
+  [data appendBytes:&value length:sizeof(value)];
+}
+
+static void AppendUInt64(NSMutableData *data, uint64_t value) {
+  value = OSSwapHostToLittleInt64(value);
+  [data appendBytes:&value length:sizeof(value)];
+}
+
+static void AppendField(NSMutableData *record, uint8_t type,
+                        const void *bytes, NSUInteger length) {
+  [record appendBytes:&type length:1];
+  AppendUInt32(record, (uint32_t) length);
+  [record appendBytes:bytes length:length];
+}
+
+static void AppendStringField(NSMutableData *record, uint8_t type,
+                              NSString *str) {
+  if (str == nil) return;
+  const char *utf8 = [str UTF8String];
+  AppendField(record, type, utf8, strlen(utf8));
+}
+
+static void AppendLengthField(NSMutableData *record, uint8_t type,
+                              unsigned long long length) {
+  uint64_t value = OSSwapHostToLittleInt64(length);
+  AppendField(record, type, &value, sizeof(value));
+}
+
+@implementation GTMHTTPFetchLogWriter
+
+- (id)initWithPath:(NSString *)path {
+  self = [super init];
+  if (self) {
+    fd_ = open([path fileSystemRepresentation],
+               O_WRONLY | O_CREAT | O_APPEND, S_IRUSR | S_IWUSR);
+    if (fd_ < 0) {
+      NSLog(@"GTMHTTPFetcher cannot open binary log %@ (%s)",
+            path, strerror(errno));
+      [self release];
+      return nil;
+    }
+
+    struct stat fileStat;
+    if (fstat(fd_, &fileStat) == 0 && fileStat.st_size == 0) {
+      const char *magic = kGTMHTTPFetchLogMagic;
+      (void) write(fd_, magic, strlen(magic));
+    }
+
+    condition_ = [[NSCondition alloc] init];
+    queue_ = [[NSMutableArray alloc] init];
+
+    // the thread retains the writer, which lasts for the rest of the run
+    [NSThread detachNewThreadSelector:@selector(writeRecords)
+                             toTarget:self
+                           withObject:nil];
+  }
+  return self;
+}
+
+- (void)enqueueRecord:(NSData *)record maxQueuedBytes:(NSUInteger)maxBytes {
+  [condition_ lock];
+  NSUInteger length = [record length];
+  if (queuedBytes_ + length > maxBytes) {
+    // the writer is falling behind; rather than grow, drop the record
+    droppedCount_++;
+  } else {
+    [queue_ addObject:record];
+    queuedBytes_ += length;
+  }
+  [condition_ signal];
+  [condition_ unlock];
+}
+
+- (void)flush {
+  [condition_ lock];
+  while ([queue_ count] > 0 || droppedCount_ > 0 || isWriting_) {
+    [condition_ wait];
+  }
+  [condition_ unlock];
+}
+
+- (void)writeBytes:(const void *)bytes length:(NSUInteger)length {
+  while (length > 0) {
+    ssize_t numWritten = write(fd_, bytes, length);
+    if (numWritten < 0) {
+      if (errno == EINTR) continue;
+      return;
+    }
+    bytes = (const char *)bytes + numWritten;
+    length -= (NSUInteger) numWritten;
+  }
+}
+
+- (void)writeRecords {
+  while (1) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+
+    [condition_ lock];
+    while ([queue_ count] == 0 && droppedCount_ == 0) {
+      [condition_ wait];
+    }
+    NSArray *records = [[queue_ copy] autorelease];
+    [queue_ removeAllObjects];
+    NSUInteger droppedCount = droppedCount_;
+    droppedCount_ = 0;
+    isWriting_ = YES;
+    [condition_ unlock];
+
+    if (droppedCount > 0) {
+      // note the dropped records in a record of their own
+      NSMutableData *fields = [NSMutableData data];
+      uint32_t count = OSSwapHostToLittleInt32((uint32_t) droppedCount);
+      AppendField(fields, kGTMHTTPFetchLogFieldDroppedRecords,
+                  &count, sizeof(count));
+
+      NSMutableData *record = [NSMutableData data];
+      AppendUInt32(record, (uint32_t) (16 + [fields length]));
+      AppendUInt64(record, (uint64_t) ([[NSDate date] timeIntervalSince1970] * 1000));
+      AppendUInt32(record, 0);
+      AppendUInt32(record, 0);
+      [record appendData:fields];
+      [self writeBytes:[record bytes] length:[record length]];
+    }
+
+    NSUInteger writtenBytes = 0;
+    for (NSData *record in records) {
+      [self writeBytes:[record bytes] length:[record length]];
+      writtenBytes += [record length];
+    }
+
+    [condition_ lock];
+    queuedBytes_ -= writtenBytes;
+    isWriting_ = NO;
+    [condition_ broadcast];
+    [condition_ unlock];
+
+    [pool drain];
+  }
+}
+
 @end
 
 @implementation GTMHTTPFetcher (GTMHTTPFetcherLogging)
@@ -69,6 +237,11 @@ static BOOL gIsLoggingToFile = YES;
 static NSString *gLoggingDirectoryPath = nil;
 static NSString *gLoggingDateStamp = nil;
 static NSString* gLoggingProcessName = nil;
+static BOOL gIsBinaryLogging = NO;
+static NSUInteger gBinaryLogMaxQueuedBytes = 4 * 1024 * 1024;
+static NSUInteger gBinaryLogMaxBodyBytes = 64 * 1024;
+static GTMHTTPFetchLogWriter *gBinaryLogWriter = nil;
+static BOOL gHasBinaryLogWriterFailed = NO;
 
 + (void)setLoggingDirectory:(NSString *)path {
   [gLoggingDirectoryPath autorelease];
@@ -175,6 +348,56 @@ static NSString* gLoggingProcessName = nil;
   return gLoggingDateStamp;
 }
 
++ (void)setBinaryLoggingEnabled:(BOOL)flag {
+  gIsBinaryLogging = flag;
+}
+
++ (BOOL)isBinaryLoggingEnabled {
+  return gIsBinaryLogging;
+}
+
++ (void)setBinaryLoggingMaxQueuedBytes:(NSUInteger)maxBytes {
+  gBinaryLogMaxQueuedBytes = maxBytes;
+}
+
++ (NSUInteger)binaryLoggingMaxQueuedBytes {
+  return gBinaryLogMaxQueuedBytes;
+}
+
++ (void)setBinaryLoggingMaxBodyBytes:(NSUInteger)maxBytes {
+  gBinaryLogMaxBodyBytes = maxBytes;
+}
+
++ (NSUInteger)binaryLoggingMaxBodyBytes {
+  return gBinaryLogMaxBodyBytes;
+}
+
++ (NSString *)binaryLogPath {
+  // one binary log per run, alongside the runs' html log directories, like
+  //   SyncProto_log_10-16_01-56-58PM.gtmfetchlog
+  NSString *fileName = [NSString stringWithFormat:@"%@_log_%@.gtmfetchlog",
+                        [self loggingProcessName], [self loggingDateStamp]];
+  return [[self loggingDirectory] stringByAppendingPathComponent:fileName];
+}
+
++ (GTMHTTPFetchLogWriter *)binaryLogWriter {
+  @synchronized([GTMHTTPFetcher class]) {
+    if (gBinaryLogWriter == nil && !gHasBinaryLogWriterFailed) {
+      gBinaryLogWriter = [[GTMHTTPFetchLogWriter alloc] initWithPath:[self binaryLogPath]];
+      gHasBinaryLogWriterFailed = (gBinaryLogWriter == nil);
+    }
+  }
+  return gBinaryLogWriter;
+}
+
++ (void)flushBinaryLog {
+  GTMHTTPFetchLogWriter *writer = nil;
+  @synchronized([GTMHTTPFetcher class]) {
+    writer = gBinaryLogWriter;
+  }
+  [writer flush];
+}
+
 
 // formattedStringFromData returns a prettyprinted string for XML or JSON input,
 // and a plain string for other input data
@@ -290,7 +513,11 @@ static NSString* gLoggingProcessName = nil;
   // if logging is enabled, it needs a buffer to accumulate data from any
   // NSInputStream used for uploading.  Logging will wrap the input
   // stream with a stream that lets us keep a copy the data being read.
-  if ([GTMHTTPFetcher isLoggingEnabled] && postStream_ != nil) {
+  //
+  // binary logging skips this, rather than make a second copy of the upload
+  if ([GTMHTTPFetcher isLoggingEnabled]
+      && ![GTMHTTPFetcher isBinaryLoggingEnabled]
+      && postStream_ != nil) {
     loggedStreamData_ = [[NSMutableData alloc] init];
 
     BOOL didCapture = [self logCapturePostStream];
@@ -403,6 +630,11 @@ static NSString* gLoggingProcessName = nil;
 
   if (![[self class] isLoggingEnabled]) return;
 
+  if (gIsBinaryLogging) {
+    [self logFetchBinaryWithError:error];
+    return;
+  }
+
   // TODO: (grobbins)  add Javascript to display response data formatted in hex
 
   NSString *parentDir = [[self class] loggingDirectory];
@@ -894,6 +1126,117 @@ static NSString* gLoggingProcessName = nil;
   }
 }
 
+// logFetchBinaryWithError queues a binary log record of the fetch; the
+// record holds raw data, leaving formatting to the log viewer
+- (void)logFetchBinaryWithError:(NSError *)error {
+  if (!gIsLoggingToFile) return;
+
+  GTMHTTPFetchLogWriter *writer = [[self class] binaryLogWriter];
+  if (writer == nil) return;
+
+  static int32_t zBinaryCounter = 0;
+  uint32_t fetchNumber = (uint32_t) OSAtomicIncrement32(&zBinaryCounter);
+
+  NSURLRequest *request = [self mutableRequest];
+  NSURLResponse *response = [self response];
+  NSDictionary *requestHeaders = [request allHTTPHeaderFields];
+  NSDictionary *responseHeaders = [self responseHeaders];
+  NSUInteger maxBodyBytes = gBinaryLogMaxBodyBytes;
+
+  NSMutableData *fields = [NSMutableData dataWithCapacity:1024];
+
+  AppendStringField(fields, kGTMHTTPFetchLogFieldComment, [self comment]);
+  AppendStringField(fields, kGTMHTTPFetchLogFieldMethod, [request HTTPMethod]);
+  AppendStringField(fields, kGTMHTTPFetchLogFieldURL,
+                    [[request URL] absoluteString]);
+  if ([requestHeaders count] > 0) {
+    AppendStringField(fields, kGTMHTTPFetchLogFieldRequestHeaders,
+                      [[self class] rawHeadersStringForDictionary:requestHeaders]);
+  }
+
+  // the request body, omitting any ClientLogin password or OAuth 2 secrets
+  NSData *postData = postData_;
+  NSUInteger postDataLength = [postData length];
+  if (postDataLength > 0) {
+    AppendLengthField(fields, kGTMHTTPFetchLogFieldRequestBodyLength,
+                      postDataLength);
+
+    NSData *bodyData = [postData subdataWithRange:NSMakeRange(0,
+                                   MIN(postDataLength, maxBodyBytes))];
+    NSString *postType = [requestHeaders valueForKey:@"Content-Type"];
+    if ([postType hasPrefix:@"application/x-www-form-urlencoded"]) {
+      NSString *postStr = [[[NSString alloc] initWithData:bodyData
+                                                 encoding:NSUTF8StringEncoding] autorelease];
+      postStr = [[self class] snipSubtringOfString:postStr
+                                betweenStartString:@"client_secret="
+                                         endString:@"&"];
+      postStr = [[self class] snipSubtringOfString:postStr
+                                betweenStartString:@"refresh_token="
+                                         endString:@"&"];
+      postStr = [[self class] snipSubtringOfString:postStr
+                                betweenStartString:@"&Passwd="
+                                         endString:@"&"];
+      bodyData = [postStr dataUsingEncoding:NSUTF8StringEncoding];
+    }
+    AppendField(fields, kGTMHTTPFetchLogFieldRequestBody,
+                [bodyData bytes], [bodyData length]);
+  }
+
+  if (response) {
+    NSURL *responseURL = [response URL];
+    if (responseURL && ![responseURL isEqual:[request URL]]) {
+      AppendStringField(fields, kGTMHTTPFetchLogFieldResponseURL,
+                        [responseURL absoluteString]);
+    }
+    AppendStringField(fields, kGTMHTTPFetchLogFieldResponseMIMEType,
+                      [response MIMEType]);
+    if ([responseHeaders count] > 0) {
+      AppendStringField(fields, kGTMHTTPFetchLogFieldResponseHeaders,
+                        [[self class] rawHeadersStringForDictionary:responseHeaders]);
+    }
+  }
+
+  unsigned long long responseDataLength;
+  if (downloadFileHandle_) {
+    responseDataLength = [downloadFileHandle_ offsetInFile];
+  } else {
+    responseDataLength = [downloadedData_ length];
+  }
+  if (responseDataLength > 0) {
+    AppendLengthField(fields, kGTMHTTPFetchLogFieldResponseBodyLength,
+                      responseDataLength);
+
+    NSUInteger length = MIN([downloadedData_ length], maxBodyBytes);
+    const void *bytes = [downloadedData_ bytes];
+
+    // for security and privacy, omit OAuth 2 token endpoint responses
+    NSData *tokenKey = [NSData dataWithBytes:"\"refresh_token\"" length:15];
+    if (length > 0
+        && [downloadedData_ rangeOfData:tokenKey
+                                options:0
+                                  range:NSMakeRange(0, length)].location != NSNotFound) {
+      bytes = "<<token response omitted>>";
+      length = strlen(bytes);
+    }
+    if (length > 0) {
+      AppendField(fields, kGTMHTTPFetchLogFieldResponseBody, bytes, length);
+    }
+  }
+
+  if (error) {
+    AppendStringField(fields, kGTMHTTPFetchLogFieldError, [error description]);
+  }
+
+  NSMutableData *record = [NSMutableData dataWithCapacity:20 + [fields length]];
+  AppendUInt32(record, (uint32_t) (16 + [fields length]));
+  AppendUInt64(record, (uint64_t) ([[NSDate date] timeIntervalSince1970] * 1000));
+  AppendUInt32(record, fetchNumber);
+  AppendUInt32(record, (uint32_t) [self statusCode]);
+  [record appendData:fields];
+
+  [writer enqueueRecord:record maxQueuedBytes:gBinaryLogMaxQueuedBytes];
+}
+
 - (BOOL)logCapturePostStream {
   // This is called when beginning a fetch.  The caller should have already
   // verified that logging is enabled, and should have allocated
@@ -1037,6 +1380,22 @@ static NSString* gLoggingProcessName = nil;
   return str;
 }
 
+// rawHeadersStringForDictionary makes unpadded, unsorted "Key: value" lines
+// for binary logs, omitting any OAuth 1 token
++ (NSString *)rawHeadersStringForDictionary:(NSDictionary *)dict {
+  NSMutableString *str = [NSMutableString string];
+  for (NSString *key in dict) {
+    NSString *value = [dict objectForKey:key];
+    if ([key isEqual:@"Authorization"]) {
+      value = [[self class] snipSubtringOfString:value
+                              betweenStartString:@"oauth_token=\""
+                                       endString:@"\""];
+    }
+    [str appendFormat:@"%@: %@\n", key, value];
+  }
+  return str;
+}
+
 @end
 
 #endif // !STRIP_GTM_FETCH_LOGGING
@@ -35,6 +35,16 @@
 //
 // Chunk fetchers are discarded as soon as they have completed.
 //
+// Chunks are not copied from the upload data. A file handle's file is mapped
+// into memory when possible, and each chunk is a view of the upload data or
+// of the mapped file. While a chunk is being sent, the next chunk's pages of
+// the mapped file are read ahead.
+//
+// If maxChunkSize is larger than chunkSize, the size of each chunk after the
+// first adapts to the measured upload throughput, in multiples of chunkSize
+// up to maxChunkSize, so that slow connections still see frequent progress
+// and fast connections need fewer round trips.
+//
 
 #pragma once
 
@@ -63,8 +73,18 @@
   NSInteger uploadFileHandleLength_;
   NSString *uploadMIMEType_;
   NSUInteger chunkSize_;
+  NSUInteger maxChunkSize_;
   BOOL isPaused_;
 
+  // read-only mapping of the upload file, if it could be mapped
+  NSData *uploadFileMappedData_;
+  BOOL hasAttemptedFileMapping_;
+
+  // the time the current chunk started, and the measured upload rate
+  NSTimeInterval chunkStartTime_;
+  NSUInteger chunkStartOffset_;
+  double uploadBytesPerSecond_;
+
   // we keep the latest offset into the upload data just for
   // progress reporting
   NSUInteger currentOffset_;
@@ -100,6 +120,11 @@
 @property (retain) NSFileHandle *uploadFileHandle;
 @property (copy) NSString *uploadMIMEType;
 @property (assign) NSUInteger chunkSize;
+
+// the largest chunk size the fetcher may adapt to; by default, this equals
+// chunkSize and all chunks are the same size
+@property (assign) NSUInteger maxChunkSize;
+
 @property (assign) NSUInteger currentOffset;
 
 // the fetcher for the current data chunk, if any
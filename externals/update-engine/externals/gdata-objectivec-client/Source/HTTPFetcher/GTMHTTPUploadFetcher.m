@@ -20,10 +20,122 @@
 #if (!GDATA_REQUIRE_SERVICE_INCLUDES && !GTL_REQUIRE_SERVICE_INCLUDES) \
   || GDATA_INCLUDE_DOCS_SERVICE || GDATA_INCLUDE_YOUTUBE_SERVICE || GDATA_INCLUDE_PHOTOS_SERVICE
 
+#include <sys/mman.h>
+
 #import "GTMHTTPUploadFetcher.h"
 
 static NSUInteger const kQueryServerForOffset = NSUIntegerMax;
 
+// when adapting chunk sizes, aim for chunks taking this long to send
+static NSTimeInterval const kTargetChunkInterval = 5.0;
+
+// GTMUploadMappedFileData owns a read-only mapping of an upload file
+@interface GTMUploadMappedFileData : NSData {
+  void *bytes_;
+  NSUInteger length_;
+}
+- (id)initWithFileDescriptor:(int)fd length:(NSUInteger)length;
+- (void)readAheadRange:(NSRange)range;
+@end
+
+// GTMUploadSubdata is a range of another data object, which it retains,
+// so chunks need not be copied from the upload data
+@interface GTMUploadSubdata : NSData {
+  NSData *parentData_;
+  NSRange range_;
+}
+- (id)initWithData:(NSData *)data range:(NSRange)range;
+@end
+
+@implementation GTMUploadMappedFileData
+
+- (id)initWithFileDescriptor:(int)fd length:(NSUInteger)length {
+  self = [super init];
+  if (self) {
+    void *bytes = MAP_FAILED;
+    if (length > 0) {
+      bytes = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    if (bytes == MAP_FAILED) {
+      [self release];
+      return nil;
+    }
+    bytes_ = bytes;
+    length_ = length;
+  }
+  return self;
+}
+
+- (void)unmap {
+  if (bytes_) {
+    munmap(bytes_, length_);
+    bytes_ = NULL;
+  }
+}
+
+- (void)finalize {
+  [self unmap];
+  [super finalize];
+}
+
+- (void)dealloc {
+  [self unmap];
+  [super dealloc];
+}
+
+- (const void *)bytes {
+  return bytes_;
+}
+
+- (NSUInteger)length {
+  return length_;
+}
+
+- (void)readAheadRange:(NSRange)range {
+  // ask the kernel to start paging in the range, from the page containing
+  // its start
+  if (range.location >= length_) return;
+
+  NSUInteger pageSize = (NSUInteger) getpagesize();
+  NSUInteger start = range.location - (range.location % pageSize);
+  NSUInteger end = MIN(NSMaxRange(range), length_);
+
+  posix_madvise((char *)bytes_ + start, end - start, POSIX_MADV_WILLNEED);
+}
+
+@end
+
+@implementation GTMUploadSubdata
+
+- (id)initWithData:(NSData *)data range:(NSRange)range {
+  self = [super init];
+  if (self) {
+    parentData_ = [data retain];
+    range_ = range;
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [parentData_ release];
+  [super dealloc];
+}
+
+- (const void *)bytes {
+  return (const char *)[parentData_ bytes] + range_.location;
+}
+
+- (NSUInteger)length {
+  return range_.length;
+}
+
+- (id)copyWithZone:(NSZone *)zone {
+  // immutable, like the parent data
+  return [self retain];
+}
+
+@end
+
 @interface GTMHTTPFetcher (ProtectedMethods)
 - (void)releaseCallbacks;
 - (void)connectionDidFinishLoading:(NSURLConnection *)connection;
@@ -45,6 +157,8 @@ totalBytesExpectedToSend:(NSInteger)totalBytesExpected;
 - (void)reportProgressManually;
 
 - (NSUInteger)fullUploadLength;
+- (NSUInteger)nextChunkSize;
+- (void)updateUploadRateForOffset:(NSUInteger)newOffset;
 
 -(BOOL)chunkFetcher:(GTMHTTPFetcher *)chunkFetcher
           willRetry:(BOOL)willRetry
@@ -144,6 +258,7 @@ totalBytesExpectedToSend:(NSInteger)totalBytesExpected;
   [locationURL_ release];
   [uploadData_ release];
   [uploadFileHandle_ release];
+  [uploadFileMappedData_ release];
   [uploadMIMEType_ release];
   [responseHeaders_ release];
   [super dealloc];
@@ -163,13 +278,34 @@ totalBytesExpectedToSend:(NSInteger)totalBytesExpected;
   }
 }
 
+- (GTMUploadMappedFileData *)uploadFileMappedData {
+  if (uploadFileHandle_ != nil && !hasAttemptedFileMapping_) {
+    // first time through, try to map the file; pipes and sockets can't
+    // be mapped, so those will be read in chunks
+    hasAttemptedFileMapping_ = YES;
+
+    int fd = [uploadFileHandle_ fileDescriptor];
+    NSUInteger fileLength = [self fullUploadLength];
+    uploadFileMappedData_ = [[GTMUploadMappedFileData alloc] initWithFileDescriptor:fd
+                                                                             length:fileLength];
+  }
+  return (GTMUploadMappedFileData *) uploadFileMappedData_;
+}
+
 - (NSData *)uploadSubdataWithOffset:(NSUInteger)offset
                              length:(NSUInteger)length {
   NSData *resultData = nil;
 
-  if (uploadData_) {
+  // chunks are views of the upload data or of the mapped file, not copies
+  NSData *fullData = uploadData_;
+  if (fullData == nil) {
+    fullData = [self uploadFileMappedData];
+  }
+
+  if (fullData) {
     NSRange range = NSMakeRange(offset, length);
-    resultData = [uploadData_ subdataWithRange:range];
+    resultData = [[[GTMUploadSubdata alloc] initWithData:fullData
+                                                   range:range] autorelease];
   } else {
     @try {
       [uploadFileHandle_ seekToFileOffset:offset];
@@ -352,7 +488,7 @@ totalBytesExpectedToSend:totalBytesExpectedToWrite];
 - (void)uploadNextChunkWithOffset:(NSUInteger)offset
                 fetcherProperties:(NSDictionary *)props {
   // upload another chunk
-  NSUInteger chunkSize = [self chunkSize];
+  NSUInteger chunkSize = [self nextChunkSize];
 
   NSString *rangeStr, *lengthStr;
   NSData *chunkData;
@@ -397,6 +533,15 @@ totalBytesExpectedToSend:totalBytesExpectedToWrite];
   // track the current offset for progress reporting
   [self setCurrentOffset:offset];
 
+  // note when this chunk began for measuring the upload rate; queries
+  // for the offset send no data and so don't count
+  if ([chunkData length] > 0) {
+    chunkStartTime_ = [NSDate timeIntervalSinceReferenceDate];
+    chunkStartOffset_ = offset;
+  } else {
+    chunkStartTime_ = 0;
+  }
+
   //
   // make the request for fetching
   //
@@ -472,9 +617,54 @@ totalBytesExpectedToSend:totalBytesExpectedToWrite];
   } else {
     // hang on to the fetcher in case we need to cancel it
     [self setChunkFetcher:chunkFetcher];
+
+    // while this chunk is sent, have the next one's file pages read in
+    NSUInteger nextOffset = offset + [chunkData length];
+    if (nextOffset < dataLen && [chunkData length] > 0) {
+      NSRange nextRange = NSMakeRange(nextOffset,
+                                      MIN([self nextChunkSize], dataLen - nextOffset));
+      [[self uploadFileMappedData] readAheadRange:nextRange];
+    }
   }
 }
 
+- (NSUInteger)nextChunkSize {
+  NSUInteger chunkSize = [self chunkSize];
+  NSUInteger maxChunkSize = [self maxChunkSize];
+
+  if (maxChunkSize <= chunkSize || uploadBytesPerSecond_ <= 0) {
+    return chunkSize;
+  }
+
+  // size chunks to take about kTargetChunkInterval to send at the measured
+  // rate, in multiples of the client's chunk size
+  double targetSize = uploadBytesPerSecond_ * kTargetChunkInterval;
+  if (targetSize >= (double) maxChunkSize) {
+    targetSize = (double) maxChunkSize;
+  }
+
+  NSUInteger multiple = (NSUInteger) (targetSize / (double) chunkSize);
+  if (multiple < 1) multiple = 1;
+
+  return multiple * chunkSize;
+}
+
+- (void)updateUploadRateForOffset:(NSUInteger)newOffset {
+  // measure the rate from the bytes the server acknowledges for the chunk
+  // just completed, smoothing with previous measurements
+  if (chunkStartTime_ <= 0 || newOffset <= chunkStartOffset_) return;
+
+  NSTimeInterval elapsed = [NSDate timeIntervalSinceReferenceDate] - chunkStartTime_;
+  if (elapsed <= 0) return;
+
+  double rate = (double)(newOffset - chunkStartOffset_) / elapsed;
+  if (uploadBytesPerSecond_ > 0) {
+    rate = (rate + uploadBytesPerSecond_) / 2.0;
+  }
+  uploadBytesPerSecond_ = rate;
+  chunkStartTime_ = 0;
+}
+
 - (void)reportProgressManually {
   // reportProgressManually should be called only when there's no
   // NSURLConnection support for sent data callbacks
@@ -567,6 +757,8 @@ totalBytesExpectedToSend:0];
     }
   }
 
+  [self updateUploadRateForOffset:newOffset];
+
   [self setCurrentOffset:newOffset];
 
   if (needsManualProgress_) {
@@ -634,6 +826,9 @@ totalBytesExpectedToSend:0];
     // we don't know what our actual offset is anymore, but the server
     // will tell us
     [self setCurrentOffset:0];
+
+    // the failed chunk shouldn't count when measuring the upload rate
+    chunkStartTime_ = 0;
   }
 
   return willRetry;
@@ -720,6 +915,7 @@ totalBytesExpectedToSend:(NSInteger)totalBytesExpected {
 @synthesize uploadFileHandle = uploadFileHandle_;
 @synthesize uploadMIMEType = uploadMIMEType_;
 @synthesize chunkSize = chunkSize_;
+@dynamic maxChunkSize;
 @synthesize currentOffset = currentOffset_;
 @synthesize chunkFetcher = chunkFetcher_;
 
@@ -778,6 +974,14 @@ totalBytesExpectedToSend:(NSInteger)totalBytesExpected {
   delegateSentDataSEL_ = theSelector;
 }
 
+- (NSUInteger)maxChunkSize {
+  return MAX(maxChunkSize_, chunkSize_);
+}
+
+- (void)setMaxChunkSize:(NSUInteger)val {
+  maxChunkSize_ = val;
+}
+
 - (GTMHTTPFetcher *)activeFetcher {
   if (chunkFetcher_) {
     return chunkFetcher_;
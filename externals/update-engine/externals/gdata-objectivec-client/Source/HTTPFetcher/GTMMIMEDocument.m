@@ -17,13 +17,13 @@
 #import "GTMMIMEDocument.h"
 #import "GTMGatherInputStream.h"
 
-// memsrch
+// ScanStreamForBoundary
 //
-// Helper routine to search for the existence of a set of bytes (needle) within
-// a presumed larger set of bytes (haystack).
+// Helper routine to find, in one pass over a stream, whether a base boundary
+// string occurs, and the set of "_%08lx" suffixes following its occurrences.
 //
-static BOOL memsrch(const unsigned char* needle, NSUInteger needle_len,
-                    const unsigned char* haystack, NSUInteger haystack_len);
+static BOOL ScanStreamForBoundary(NSInputStream *stream, NSData *baseData,
+                                  NSMutableSet *suffixes);
 
 @interface GTMMIMEPart : NSObject {
   NSData* headerData_;  // Header content including the ending "\r\n".
@@ -32,7 +32,6 @@ static BOOL memsrch(const unsigned char* needle, NSUInteger needle_len,
 
 + (GTMMIMEPart *)partWithHeaders:(NSDictionary *)headers body:(NSData *)body;
 - (id)initWithHeaders:(NSDictionary *)headers body:(NSData *)body;
-- (BOOL)containsBytes:(const unsigned char *)bytes length:(NSUInteger)length;
 - (NSData *)header;
 - (NSData *)body;
 - (NSUInteger)length;
@@ -96,18 +95,6 @@ static BOOL memsrch(const unsigned char* needle, NSUInteger needle_len,
   [super dealloc];
 }
 
-// Returns true if the parts contents contain the given set of bytes.
-//
-// NOTE: We assume that the 'bytes' we are checking for do not contain "\r\n",
-// so we don't need to check the concatenation of the header and body bytes.
-- (BOOL)containsBytes:(const unsigned char*)bytes length:(NSUInteger)length {
-
-  // This uses custom memsrch() rather than strcpy because the encoded data may
-  // contain null values.
-  return memsrch(bytes, length, [headerData_ bytes], [headerData_ length]) ||
-         memsrch(bytes, length, [bodyData_ bytes],   [bodyData_ length]);
-}
-
 - (NSData *)header {
   return headerData_;
 }
@@ -174,39 +161,52 @@ static BOOL memsrch(const unsigned char* needle, NSUInteger needle_len,
   // use an easily-readable boundary string
   NSString *const kBaseBoundary = @"END_OF_PART";
 
-  NSMutableString *boundary = [NSMutableString stringWithString:kBaseBoundary];
-
-  // if the boundary isn't unique, append random numbers, up to 10 attempts;
-  // if that's still not unique, use a random number sequence instead,
-  // and call it good
-  BOOL didCollide = NO;
+  // Alternate boundaries are the base with a random "_%08lx" suffix, so one
+  // pass over the parts finding the base boundary and the suffixes following
+  // it tells us which alternates collide, without rescanning the parts for
+  // each guess.
+  //
+  // The parts are scanned as a stream, so bodies of mapped files are read
+  // through a small buffer rather than brought into memory together. A
+  // separator between parts keeps a boundary from being found across the
+  // end of one part and the start of the next, as the parts are never
+  // adjacent in the document.
+  NSData *separatorData = [@"\r\n" dataUsingEncoding:NSUTF8StringEncoding];
+  NSMutableArray *dataArray = [NSMutableArray arrayWithCapacity:3 * [parts_ count]];
+  for (GTMMIMEPart *part in parts_) {
+    [dataArray addObject:[part header]];
+    [dataArray addObject:[part body]];
+    [dataArray addObject:separatorData];
+  }
 
-  const int maxTries = 10;  // Arbitrarily chosen maximum attempts.
-  for (int tries = 0; tries < maxTries; ++tries) {
+  NSInputStream *stream = [GTMGatherInputStream streamWithArray:dataArray];
+  NSData *baseData = [kBaseBoundary dataUsingEncoding:NSUTF8StringEncoding];
+  NSMutableSet *usedSuffixes = [NSMutableSet set];
 
-    NSData *data = [boundary dataUsingEncoding:NSUTF8StringEncoding];
-    const void *dataBytes = [data bytes];
-    NSUInteger dataLen = [data length];
+  BOOL didCollide = ScanStreamForBoundary(stream, baseData, usedSuffixes);
+  if (!didCollide) return kBaseBoundary;
 
-    for (GTMMIMEPart *part in parts_) {
-      didCollide = [part containsBytes:dataBytes length:dataLen];
-      if (didCollide) break;
+  // the base isn't unique, so append random numbers, up to 10 attempts in
+  // all; if that's still not unique, use a random number sequence instead,
+  // and call it good
+  const int maxTries = 10;  // Arbitrarily chosen maximum attempts.
+  for (int tries = 1; tries < maxTries; ++tries) {
+    u_int32_t suffix = [self random];
+    NSNumber *suffixNum = [NSNumber numberWithUnsignedInt:suffix];
+    if (![usedSuffixes containsObject:suffixNum]) {
+      return [NSString stringWithFormat:@"%@_%08lx", kBaseBoundary,
+              (unsigned long) suffix];
     }
-
-    if (!didCollide) break; // we're fine, no more attempts needed
-
-    // try again with a random number appended
-    boundary = [NSString stringWithFormat:@"%@_%08lx", kBaseBoundary,
-                [self random]];
   }
 
-  if (didCollide) {
-    // fallback... two random numbers
-    boundary = [NSString stringWithFormat:@"%08lx_tedborg_%08lx",
-                                          [self random], [self random]];
-  }
+  // the alternates used to be checked after drawing each one, so one more
+  // was drawn after the last failed check; draw it too, so a given seed
+  // still yields the same fallback
+  (void) [self random];
 
-  return boundary;
+  // fallback... two random numbers
+  return [NSString stringWithFormat:@"%08lx_tedborg_%08lx",
+          (unsigned long) [self random], (unsigned long) [self random]];
 }
 
 - (void)generateInputStream:(NSInputStream **)outStream
@@ -254,28 +254,83 @@ static BOOL memsrch(const unsigned char* needle, NSUInteger needle_len,
 @end
 
 
-// memsrch - Return YES if needle is found in haystack, else NO.
-static BOOL memsrch(const unsigned char* needle, NSUInteger needleLen,
-                    const unsigned char* haystack, NSUInteger haystackLen) {
-
-  // This is a simple approach.  We start off by assuming that both memchr() and
-  // memcmp are implemented efficiently on the given platform.  We search for an
-  // instance of the first char of our needle in the haystack.  If the remaining
-  // size could fit our needle, then we memcmp to see if it occurs at this point
-  // in the haystack.  If not, we move on to search for the first char again,
-  // starting from the next character in the haystack.
-  const unsigned char* ptr = haystack;
-  NSUInteger remain = haystackLen;
-  while ((ptr = memchr(ptr, needle[0], remain)) != 0) {
-    remain = haystackLen - (ptr - haystack);
-    if (remain < needleLen) {
-      return NO;
+// ScanStreamForBoundary - Return YES if baseData is found in the stream, and
+// add to suffixes the value of each "_%08lx" following an occurrence.
+static BOOL ScanStreamForBoundary(NSInputStream *stream, NSData *baseData,
+                                  NSMutableSet *suffixes) {
+
+  const unsigned char *base = [baseData bytes];
+  const NSUInteger baseLen = [baseData length];
+
+  // an occurrence is examined once the buffer holds the base and a suffix
+  // ("_" and 8 hex digits) after it, so the bytes which could begin an
+  // occurrence still lacking its suffix are carried over to the next read
+  const NSUInteger kSuffixLen = 9;
+  const NSUInteger matchLen = baseLen + kSuffixLen;
+  const NSUInteger carryLen = matchLen - 1;
+  const NSUInteger kBufferSize = 64 * 1024;
+
+  NSMutableData *bufferData = [NSMutableData dataWithLength:kBufferSize + carryLen];
+  unsigned char *buffer = [bufferData mutableBytes];
+  NSUInteger filled = 0;
+  BOOL didFind = NO;
+  BOOL isAtEnd = NO;
+
+  [stream open];
+  while (!isAtEnd) {
+    NSInteger numRead = [stream read:(buffer + filled) maxLength:kBufferSize];
+    if (numRead > 0) {
+      filled += (NSUInteger) numRead;
+    } else {
+      isAtEnd = YES;
+    }
+
+    // examine occurrences starting before the carried-over tail, or all of
+    // them at the end of the stream
+    NSUInteger searchEnd = filled;
+    if (!isAtEnd) {
+      searchEnd = (filled > carryLen ? filled - carryLen : 0);
     }
-    if (memcmp(ptr, needle, needleLen) == 0) {
-      return YES;
+
+    // search for the first byte of the base with memchr, and compare the
+    // rest at each candidate; the data may contain null values
+    const unsigned char *ptr = buffer;
+    const unsigned char *end = buffer + searchEnd;
+    while (ptr < end
+           && (ptr = memchr(ptr, base[0], (size_t)(end - ptr))) != NULL) {
+
+      NSUInteger remain = filled - (NSUInteger)(ptr - buffer);
+      if (remain >= baseLen && memcmp(ptr, base, baseLen) == 0) {
+        didFind = YES;
+
+        // note the suffix, if it's "_" and 8 lowercase hex digits
+        if (remain >= matchLen && ptr[baseLen] == '_') {
+          u_int32_t value = 0;
+          NSUInteger idx;
+          for (idx = baseLen + 1; idx < matchLen; idx++) {
+            unsigned char c = ptr[idx];
+            if (c >= '0' && c <= '9') {
+              value = (value << 4) | (u_int32_t)(c - '0');
+            } else if (c >= 'a' && c <= 'f') {
+              value = (value << 4) | (u_int32_t)(c - 'a' + 10);
+            } else {
+              break;
+            }
+          }
+          if (idx == matchLen) {
+            [suffixes addObject:[NSNumber numberWithUnsignedInt:value]];
+          }
+        }
+      }
+      ptr++;
     }
-    ptr++;
-    remain--;
+
+    // move the unexamined tail to the start of the buffer
+    NSUInteger tailLen = filled - searchEnd;
+    memmove(buffer, buffer + searchEnd, tailLen);
+    filled = tailLen;
   }
-  return NO;
+  [stream close];
+
+  return didFind;
 }
@@ -17,6 +17,10 @@
 
 #import "GTMGatherInputStream.h"
 
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
 @interface GTMGatherInputStreamTest : SenTestCase
 @end
 
@@ -139,4 +143,167 @@
                       testMethod:_cmd];
 }
 
+// Read a file segment alongside NSData segments.
+- (void)testGatherStreamWithFileSegment {
+  NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:
+                    @"GTMGatherInputStreamTestFile"];
+  [[@"xxhow are youxx" dataUsingEncoding:NSUTF8StringEncoding]
+     writeToFile:path atomically:NO];
+  int fd = open([path fileSystemRepresentation], O_RDONLY);
+  STAssertTrue(fd >= 0, @"cannot open %@", path);
+
+  NSMutableArray* array = [NSMutableArray array];
+  [array addObject:[NSData dataWithBytes:"hello " length:6]];
+  [array addObject:[GTMGatherInputStream dataWithFileDescriptor:fd
+                                                          offset:2
+                                                          length:11]];
+  [array addObject:[NSData dataWithBytes:"?" length:1]];
+
+  NSInputStream* input = [GTMGatherInputStream streamWithArray:array];
+  [self doReadTestForInputStream:input
+                  expectedString:@"hello how are you?"
+                 usingSmallReads:YES
+                      testMethod:_cmd];
+
+  // the file segment's bytes are also available directly
+  NSData *fileData = [array objectAtIndex:1];
+  STAssertEquals(memcmp([fileData bytes], "how are you", 11), 0,
+                 @"bad mapped bytes");
+
+  close(fd);
+  [[NSFileManager defaultManager] removeItemAtPath:path error:NULL];
+}
+
+// Take the bytes a segment at a time, without copying.
+- (void)testGatherStreamGetBuffer {
+  NSMutableArray* array = [NSMutableArray array];
+  [array addObject:[NSData dataWithBytes:"hel" length:3]];
+  [array addObject:[NSData dataWithBytes:"" length:0]];
+  [array addObject:[NSData dataWithBytes:"lo how are you?" length:15]];
+
+  NSInputStream* input = [GTMGatherInputStream streamWithArray:array];
+  [input open];
+
+  // read partway into the first segment, then take the rest directly
+  uint8_t byte;
+  STAssertEquals([input read:&byte maxLength:1], (NSInteger) 1, @"bad read");
+
+  NSMutableData *result = [NSMutableData dataWithBytes:&byte length:1];
+  uint8_t *buffer;
+  NSUInteger length;
+  while ([input getBuffer:&buffer length:&length]) {
+    STAssertTrue(length > 0, @"empty buffer");
+    [result appendBytes:buffer length:length];
+  }
+  [input close];
+
+  NSString *resultStr = [[[NSString alloc] initWithData:result
+                                               encoding:NSUTF8StringEncoding] autorelease];
+  STAssertEqualObjects(resultStr, @"hello how are you?", @"bad buffers");
+}
+
+// Send the bytes with writev through a socket pair, a few vectors at a time.
+- (void)testGatherStreamIOVectors {
+  NSMutableArray* array = [NSMutableArray array];
+  [array addObject:[NSData dataWithBytes:"h" length:1]];
+  [array addObject:[NSData dataWithBytes:"ello" length:4]];
+  [array addObject:[NSData dataWithBytes:"" length:0]];
+  [array addObject:[NSData dataWithBytes:" how are you?" length:13]];
+
+  GTMGatherInputStream* input =
+    (GTMGatherInputStream *) [GTMGatherInputStream streamWithArray:array];
+  [input open];
+
+  struct iovec vectors[2];
+  int count = [input getIOVectors:vectors maxCount:2];
+  STAssertEquals(count, 2, @"bad vector count");
+  STAssertEquals((NSUInteger) vectors[1].iov_len, (NSUInteger) 4,
+                 @"bad vector length");
+
+  // a partial send leaves the stream partway into a segment
+  [input skipBytes:3];
+  count = [input getIOVectors:vectors maxCount:2];
+  STAssertEquals(count, 2, @"bad vector count");
+  STAssertEquals(memcmp(vectors[0].iov_base, "lo", 2), 0, @"bad vector");
+
+  int sockets[2];
+  STAssertEquals(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets), 0,
+                 @"cannot make sockets");
+
+  NSInteger numWritten = [input writeToFileDescriptor:sockets[0]];
+  STAssertEquals(numWritten, (NSInteger) 15, @"bad write length");
+  STAssertEquals([input writeToFileDescriptor:sockets[0]], (NSInteger) 0,
+                 @"write past end");
+  [input close];
+
+  char buffer[32];
+  ssize_t numRead = read(sockets[1], buffer, sizeof(buffer));
+  STAssertEquals((NSInteger) numRead, (NSInteger) 15, @"bad read length");
+  STAssertEquals(memcmp(buffer, "lo how are you?", 15), 0, @"bad read");
+
+  close(sockets[0]);
+  close(sockets[1]);
+}
+
+// time reading and sending a body both with read:maxLength: and with writev,
+// logging the throughput of each
+- (void)logThroughputForArray:(NSArray *)array label:(NSString *)label {
+  unsigned long long totalLength = 0;
+  for (NSData *data in array) {
+    totalLength += [data length];
+  }
+
+  // read into a 64K buffer, as NSURLConnection does
+  NSInputStream* input = [GTMGatherInputStream streamWithArray:array];
+  NSMutableData *bufferData = [NSMutableData dataWithLength:64 * 1024];
+  unsigned long long bytesRead = 0;
+
+  NSDate *start = [NSDate date];
+  [input open];
+  NSInteger numRead;
+  while ((numRead = [input read:[bufferData mutableBytes]
+                      maxLength:[bufferData length]]) > 0) {
+    bytesRead += numRead;
+  }
+  [input close];
+  NSTimeInterval readTime = -[start timeIntervalSinceNow];
+  STAssertEquals(bytesRead, totalLength, @"bad read length (%@)", label);
+
+  // send to /dev/null without copying
+  int fd = open("/dev/null", O_WRONLY);
+  GTMGatherInputStream* gather =
+    (GTMGatherInputStream *) [GTMGatherInputStream streamWithArray:array];
+  unsigned long long bytesWritten = 0;
+
+  start = [NSDate date];
+  [gather open];
+  NSInteger numWritten;
+  while ((numWritten = [gather writeToFileDescriptor:fd]) > 0) {
+    bytesWritten += numWritten;
+  }
+  [gather close];
+  NSTimeInterval writeTime = -[start timeIntervalSinceNow];
+  close(fd);
+  STAssertEquals(bytesWritten, totalLength, @"bad write length (%@)", label);
+
+  double megabytes = totalLength / (1024.0 * 1024.0);
+  NSLog(@"%@, %.0fMB: read %.0fMB/s, writev %.0fMB/s", label, megabytes,
+        megabytes / readTime, megabytes / writeTime);
+}
+
+- (void)testGatherStreamThroughputManySmallParts {
+  NSData *part = [NSMutableData dataWithLength:100];
+  NSMutableArray *array = [NSMutableArray array];
+  for (int idx = 0; idx < 20000; idx++) {
+    [array addObject:part];
+  }
+  [self logThroughputForArray:array label:@"20000 100-byte parts"];
+}
+
+- (void)testGatherStreamThroughputFewHugeParts {
+  NSData *part = [NSMutableData dataWithLength:64 * 1024 * 1024];
+  NSArray *array = [NSArray arrayWithObjects:part, part, part, part, nil];
+  [self logThroughputForArray:array label:@"4 64MB parts"];
+}
+
 @end
@@ -25,6 +25,12 @@
 @interface GTMHTTPFetcherTestServer : NSObject {
   NSString *docRoot_;
   GTMHTTPServer *server_;
+
+  // bytes received so far for resumable uploads, keyed by upload path
+  NSMutableDictionary *uploadedData_;
+
+  // number of access tokens issued by the token endpoint
+  NSUInteger tokenRequestCount_;
 }
 
 // Any url that isn't a specific server request (login, etc.), will be fetched
@@ -39,4 +45,14 @@
 // utilities for users
 - (NSURL *)localURLForFile:(NSString *)name;     // http://localhost:port/filename
 - (NSString *)localPathForFile:(NSString *)name; // docRoot/filename
+
+// bytes received for a resumable upload begun with a "disconnectAt=offset"
+// query parameter; the server drops the connection the first time a chunk
+// crosses that offset, after keeping the bytes before it
+- (NSData *)uploadedDataForPath:(NSString *)path; // /filename.upload
+
+// requests for a path ending in ".token" get a JSON OAuth 2 token response
+// with a new access token, "token_1", "token_2", and so on; an
+// "expiresIn=seconds" query parameter sets the token's expires_in value
+- (NSUInteger)tokenRequestCount;
 @end
@@ -33,6 +33,7 @@
   self = [super init];
   if (self) {
     docRoot_ = [docRoot copy];
+    uploadedData_ = [[NSMutableDictionary alloc] init];
     server_ = [[GTMHTTPServer alloc] initWithDelegate:self];
     NSError *error = nil;
     if ((docRoot == nil) || (![server_ start:&error])) {
@@ -67,6 +68,7 @@
 
 - (void)dealloc {
   [self stopServer];
+  [uploadedData_ release];
   [super dealloc];
 }
 
@@ -134,6 +136,10 @@
     NSString *pathWithoutLoc = [path stringByDeletingPathExtension];
     NSString *fullLocation = [NSString stringWithFormat:@"http://%@%@.upload",
                               host, pathWithoutLoc];
+    if ([query length] > 0) {
+      // keep parameters like disconnectAt for the chunk requests
+      fullLocation = [fullLocation stringByAppendingFormat:@"?%@", query];
+    }
 
     [responseHeaders setValue:fullLocation forKey:@"Location"];
     resultStatus = 200;
@@ -151,7 +157,69 @@
     //  Content-Range: bytes * /135681
     NSScanner *crScanner = [NSScanner scannerWithString:contentRange];
     long long totalToUpload = 0;
-    if ([crScanner scanString:@"bytes */" intoString:NULL]
+
+    NSString *disconnectAtStr = [self valueForParameter:@"disconnectAt"
+                                                  query:query];
+    if (disconnectAtStr) {
+      // keep the bytes actually received, so resuming can be checked
+      NSMutableData *uploaded = [uploadedData_ objectForKey:path];
+      if (uploaded == nil) {
+        uploaded = [NSMutableData data];
+        [uploadedData_ setObject:uploaded forKey:path];
+      }
+      long long uploadedLength = (long long) [uploaded length];
+
+      if ([crScanner scanString:@"bytes */" intoString:NULL]) {
+        // a query for where to resume; report what we really have
+        if (uploadedLength > 0) {
+          NSString *range = [NSString stringWithFormat:@"bytes=0-%lld",
+                             uploadedLength - 1];
+          [responseHeaders setValue:range forKey:@"Range"];
+        }
+        resultStatus = 308;
+        goto SendResponse;
+      }
+
+      long long rangeLow = 0;
+      long long rangeHigh = 0;
+      if ([crScanner scanString:@"bytes " intoString:nil]
+          && [crScanner scanLongLong:&rangeLow]
+          && [crScanner scanString:@"-" intoString:NULL]
+          && [crScanner scanLongLong:&rangeHigh]
+          && [crScanner scanString:@"/" intoString:NULL]
+          && [crScanner scanLongLong:&totalToUpload]) {
+
+        NSData *body = [request body];
+        if (rangeLow != uploadedLength
+            || (long long) [body length] != rangeHigh - rangeLow + 1) {
+          // the chunk doesn't continue from the bytes we have
+          resultStatus = 400;
+          goto SendResponse;
+        }
+
+        long long disconnectAt = [disconnectAtStr longLongValue];
+        if (rangeLow < disconnectAt && disconnectAt <= rangeHigh) {
+          // keep the bytes before the disconnect offset, and drop the
+          // connection without responding
+          [uploaded appendBytes:[body bytes]
+                         length:(NSUInteger)(disconnectAt - rangeLow)];
+          return nil;
+        }
+
+        [uploaded appendData:body];
+
+        if ((rangeHigh + 1) < totalToUpload) {
+          NSString *range = [NSString stringWithFormat:@"bytes=0-%lld",
+                             rangeHigh];
+          [responseHeaders setValue:range forKey:@"Range"];
+          resultStatus = 308;
+          goto SendResponse;
+        }
+      }
+      // the final chunk; return the requested resource at the path
+      path = [path stringByDeletingPathExtension];
+      query = nil;
+    } else if ([crScanner scanString:@"bytes */" intoString:NULL]
         && [crScanner scanLongLong:&totalToUpload]) {
       // this is a query for where to resume; we'll arbitrarily resume at
       // half the total length of the upload
@@ -187,6 +255,24 @@
     }
   }
 
+  if ([[path pathExtension] isEqual:@"token"]) {
+    // OAuth 2 token endpoint
+    NSString *expiresIn = [self valueForParameter:@"expiresIn" query:query];
+    if (expiresIn == nil) expiresIn = @"3600";
+
+    NSUInteger tokenNumber;
+    @synchronized(self) {
+      tokenNumber = ++tokenRequestCount_;
+    }
+    NSString *tokenJSON = [NSString stringWithFormat:
+                           @"{\"access_token\":\"token_%lu\","
+                           @"\"expires_in\":%@,\"token_type\":\"Bearer\"}",
+                           (unsigned long) tokenNumber, expiresIn];
+    data = [tokenJSON dataUsingEncoding:NSUTF8StringEncoding];
+    resultStatus = 200;
+    goto SendResponse;
+  }
+
   // if there's an "auth=foo" query parameter, then the value of the
   // Authorization header should be "foo"
   NSString *authStr = [self valueForParameter:@"oauth" query:query];
@@ -353,6 +439,16 @@ SendResponse:
   return [NSURL URLWithString:urlString];
 }
 
+- (NSUInteger)tokenRequestCount {
+  @synchronized(self) {
+    return tokenRequestCount_;
+  }
+}
+
+- (NSData *)uploadedDataForPath:(NSString *)path {
+  return [uploadedData_ objectForKey:path];
+}
+
 - (NSString *)localPathForFile:(NSString *)name {
   // we exclude parameters
   NSRange range = [name rangeOfString:@"?"];
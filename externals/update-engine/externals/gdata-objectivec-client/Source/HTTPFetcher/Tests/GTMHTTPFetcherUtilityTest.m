@@ -18,6 +18,8 @@
 #import "GTMHTTPFetcher.h"
 #import "GTMHTTPFetcherLogging.h"
 
+#include <libkern/OSByteOrder.h>
+
 @interface GTMHTTPFetcherUtilityTest : SenTestCase
 @end
 
@@ -84,4 +86,91 @@
   STAssertEqualObjects(result, expected, @"realistic snip failure");
 }
 
+// time logging a number of fetches, each with a request body and response
+- (NSTimeInterval)timeLoggingFetches:(NSUInteger)numberOfFetches {
+  NSURL *url = [NSURL URLWithString:@"http://www.example.com/feeds/default"];
+  NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL:url];
+  [request setValue:@"application/atom+xml" forHTTPHeaderField:@"Content-Type"];
+  [request setValue:@"GoogleLogin auth=abc" forHTTPHeaderField:@"Authorization"];
+
+  NSMutableString *body = [NSMutableString stringWithString:
+                           @"<?xml version='1.0'?><feed>"];
+  for (int idx = 0; idx < 100; idx++) {
+    [body appendFormat:@"<entry><title>Entry %d</title></entry>", idx];
+  }
+  [body appendString:@"</feed>"];
+  NSData *postData = [body dataUsingEncoding:NSUTF8StringEncoding];
+
+  NSURLResponse *response =
+    [[[NSURLResponse alloc] initWithURL:url
+                               MIMEType:@"application/atom+xml"
+                  expectedContentLength:0
+                       textEncodingName:nil] autorelease];
+
+  NSDate *start = [NSDate date];
+  for (NSUInteger idx = 0; idx < numberOfFetches; idx++) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+
+    GTMHTTPFetcher *fetcher = [GTMHTTPFetcher fetcherWithRequest:request];
+    [fetcher setPostData:postData];
+    [fetcher setResponse:response];
+    [fetcher setComment:@"logging overhead"];
+    [fetcher logFetchWithError:nil];
+
+    [pool drain];
+  }
+  return -[start timeIntervalSinceNow];
+}
+
+- (void)testLoggingOverhead {
+  NSString *logsDir = [NSTemporaryDirectory() stringByAppendingPathComponent:
+                       @"GTMHTTPFetcherUtilityTestLogs"];
+  [[NSFileManager defaultManager] createDirectoryAtPath:logsDir
+                            withIntermediateDirectories:YES
+                                             attributes:nil
+                                                  error:NULL];
+  [GTMHTTPFetcher setLoggingDirectory:logsDir];
+  [GTMHTTPFetcher setLoggingDateStamp:@"overhead"];
+
+  const NSUInteger kFetches = 200;
+
+  [GTMHTTPFetcher setLoggingEnabled:NO];
+  NSTimeInterval offTime = [self timeLoggingFetches:kFetches];
+
+  [GTMHTTPFetcher setLoggingEnabled:YES];
+  NSTimeInterval htmlTime = [self timeLoggingFetches:kFetches];
+
+  [GTMHTTPFetcher setBinaryLoggingEnabled:YES];
+  NSTimeInterval binaryTime = [self timeLoggingFetches:kFetches];
+  [GTMHTTPFetcher flushBinaryLog];
+
+  [GTMHTTPFetcher setBinaryLoggingEnabled:NO];
+  [GTMHTTPFetcher setLoggingEnabled:NO];
+
+  // the binary log should hold the magic bytes and a record per fetch
+  NSData *logData = [NSData dataWithContentsOfFile:[GTMHTTPFetcher binaryLogPath]];
+  const char *magic = kGTMHTTPFetchLogMagic;
+  STAssertTrue([logData length] > strlen(magic)
+               && memcmp([logData bytes], magic, strlen(magic)) == 0,
+               @"bad binary log");
+
+  NSUInteger numberOfRecords = 0;
+  const unsigned char *bytes = [logData bytes];
+  NSUInteger offset = strlen(magic);
+  while (offset + 4 <= [logData length]) {
+    offset += 4 + OSReadLittleInt32(bytes, offset);
+    numberOfRecords++;
+  }
+  STAssertEquals(offset, [logData length], @"partial binary log record");
+  STAssertEquals(numberOfRecords, kFetches, @"bad binary log record count");
+
+  NSLog(@"per-fetch logging time: off %.1fus, html %.1fus, binary %.1fus",
+        offTime * 1000000 / kFetches, htmlTime * 1000000 / kFetches,
+        binaryTime * 1000000 / kFetches);
+
+  [[NSFileManager defaultManager] removeItemAtPath:logsDir error:NULL];
+  [GTMHTTPFetcher setLoggingDirectory:nil];
+  [GTMHTTPFetcher setLoggingDateStamp:nil];
+}
+
 @end
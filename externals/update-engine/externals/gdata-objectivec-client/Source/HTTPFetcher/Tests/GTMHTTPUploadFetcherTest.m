@@ -29,6 +29,7 @@
   GTMHTTPFetchHistory *fetchHistory_;
   
   GTMHTTPFetcher *fetcher_;
+  NSData *fetchedData_;
   NSError *fetcherError_;
   unsigned long long lastProgressDeliveredCount_;
   unsigned long long lastProgressTotalCount_;
@@ -80,6 +81,12 @@ static NSString *const kValidFileName = @"gettysburgaddress.txt";
 - (void)tearDown {
   [testServer_ release];
   testServer_ = nil;
+
+  [fetchedData_ release];
+  fetchedData_ = nil;
+
+  [fetcherError_ release];
+  fetcherError_ = nil;
   
   isServerRunning_ = NO;
 }
@@ -141,15 +148,23 @@ static NSString *const kValidFileName = @"gettysburgaddress.txt";
 }
 */
 
-- (void)waitForFetch {
+- (void)uploadFetcher:(GTMHTTPFetcher *)fetcher
+     finishedWithData:(NSData *)data
+                error:(NSError *)error {
+  [fetchedData_ release];
+  fetchedData_ = [data retain];
 
-  int fetchCounter = gFetchCounter;
+  [fetcherError_ release];
+  fetcherError_ = [error retain];
+}
+
+- (void)waitForFetch {
 
   // Give time for the fetch to happen, but give up if
   // 10 seconds elapse with no response
   NSDate* giveUpDate = [NSDate dateWithTimeIntervalSinceNow:10.0];
 
-  while ((!fetchedObject_ && !fetcherError_)
+  while ((!fetchedData_ && !fetcherError_)
          && [giveUpDate timeIntervalSinceNow] > 0) {
 
     NSDate *stopDate = [NSDate dateWithTimeIntervalSinceNow:0.001];
@@ -173,6 +188,63 @@ static NSString *const kValidFileName = @"gettysburgaddress.txt";
   return data;
 }
 
+- (void)testChunkedUploadResumingAfterDisconnect {
+
+  if (!isServerRunning_) return;
+
+  NSData *bigData = [self generatedUploadDataWithLength:199000];
+
+  NSString *tempDir = NSTemporaryDirectory();
+  NSString *bigFileName = @"GTMHTTPUploadFetcherTest_BigFile";
+  NSString *bigFilePath = [tempDir stringByAppendingPathComponent:bigFileName];
+  [bigData writeToFile:bigFilePath atomically:NO];
+
+  NSFileHandle *bigFileHandle = [NSFileHandle fileHandleForReadingAtPath:bigFilePath];
+  STAssertNotNil(bigFileHandle, @"cannot open %@", bigFilePath);
+
+  // the server will keep the first 100000 bytes and then drop the connection
+  // during the second 75000-byte chunk; the retry should ask the server
+  // where to resume, and continue from byte 100000 with a 75000-byte chunk
+  // and a final 24000-byte chunk
+  NSString *fileName = @"gettysburgaddress.txt.location?disconnectAt=100000";
+  NSURL *docURL = [self localURLForFileName:fileName];
+  NSURLRequest *request = [NSURLRequest requestWithURL:docURL];
+
+  GTMHTTPUploadFetcher *fetcher;
+  fetcher = [GTMHTTPUploadFetcher uploadFetcherWithRequest:request
+                                          uploadFileHandle:bigFileHandle
+                                            uploadMIMEType:@"text/plain"
+                                                 chunkSize:75000];
+  [fetcher setRetryEnabled:YES];
+  [fetcher setMinRetryInterval:0.1];
+
+  BOOL isFetching = [fetcher beginFetchWithDelegate:self
+                                  didFinishSelector:@selector(uploadFetcher:finishedWithData:error:)];
+  STAssertTrue(isFetching, @"upload fetch failed to start");
+
+  [self waitForFetch];
+
+  STAssertNil(fetcherError_, @"fetcherError_=%@", fetcherError_);
+
+  // the final chunk should have been sent from the resume offset
+  NSURLRequest *finalRequest = [[fetcher activeFetcher] mutableRequest];
+  NSDictionary *reqHdrs = [finalRequest allHTTPHeaderFields];
+  STAssertEqualObjects([reqHdrs objectForKey:@"Content-Range"],
+                       @"bytes 175000-198999/199000", @"range");
+  STAssertEqualObjects([reqHdrs objectForKey:@"Content-Length"],
+                       @"24000", @"content length");
+
+  // the server should have every byte once, in order
+  NSData *uploaded = [testServer_ uploadedDataForPath:@"/gettysburgaddress.txt.upload"];
+  STAssertEqualObjects(uploaded, bigData, @"uploaded bytes differ");
+
+  // the response to the final chunk is the requested document
+  NSData *expectedData = [NSData dataWithContentsOfFile:[self docPathForName:kValidFileName]];
+  STAssertEqualObjects(fetchedData_, expectedData, @"unexpected response");
+
+  [[NSFileManager defaultManager] removeItemAtPath:bigFilePath error:NULL];
+}
+
 static NSString* const kPauseAtKey = @"pauseAt";
 static NSString* const kRetryAtKey = @"retryAt";
 static NSString* const kOriginalURLKey = @"origURL";
@@ -0,0 +1,219 @@
+/* Copyright (c) 2011 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#import <SenTestingKit/SenTestingKit.h>
+
+#import "GTMHTTPFetcherTestServer.h"
+#import "GTMOAuth2Authentication.h"
+
+// The test server's token responses are flat JSON objects, so rather than
+// requiring SBJSON, the tests parse them with this minimal class
+@interface GTMOAuth2TestJSONParser : NSObject
+- (id)objectWithString:(NSString *)str error:(NSError **)error;
+@end
+
+@implementation GTMOAuth2TestJSONParser
+
+- (id)objectWithString:(NSString *)str error:(NSError **)error {
+  NSMutableDictionary *dict = [NSMutableDictionary dictionary];
+  NSScanner *scanner = [NSScanner scannerWithString:str];
+  NSCharacterSet *valueEndSet = [NSCharacterSet characterSetWithCharactersInString:@",}"];
+
+  if (![scanner scanString:@"{" intoString:NULL]) return nil;
+
+  NSString *key;
+  while ([scanner scanString:@"\"" intoString:NULL]
+         && [scanner scanUpToString:@"\"" intoString:&key]
+         && [scanner scanString:@"\"" intoString:NULL]
+         && [scanner scanString:@":" intoString:NULL]) {
+    id value = nil;
+    if ([scanner scanString:@"\"" intoString:NULL]) {
+      NSString *str = @"";
+      [scanner scanUpToString:@"\"" intoString:&str];
+      [scanner scanString:@"\"" intoString:NULL];
+      value = str;
+    } else {
+      NSString *numStr = nil;
+      [scanner scanUpToCharactersFromSet:valueEndSet intoString:&numStr];
+      value = [NSNumber numberWithLongLong:[numStr longLongValue]];
+    }
+    [dict setObject:value forKey:key];
+    [scanner scanString:@"," intoString:NULL];
+  }
+  if (error) *error = nil;
+  return dict;
+}
+
+@end
+
+@interface GTMOAuth2AuthenticationTest : SenTestCase {
+  GTMHTTPFetcherTestServer *testServer_;
+  BOOL isServerRunning_;
+}
+@end
+
+@implementation GTMOAuth2AuthenticationTest
+
+- (void)setUp {
+  NSBundle *testBundle = [NSBundle bundleForClass:[self class]];
+  NSString *docRoot = [testBundle resourcePath];
+
+  testServer_ = [[GTMHTTPFetcherTestServer alloc] initWithDocRoot:docRoot];
+  isServerRunning_ = (testServer_ != nil);
+
+  STAssertTrue(isServerRunning_,
+               @">>> http test server failed to launch; skipping"
+               " OAuth 2 tests\n");
+}
+
+- (void)tearDown {
+  [testServer_ release];
+  testServer_ = nil;
+
+  isServerRunning_ = NO;
+}
+
+- (GTMOAuth2Authentication *)authWithTokenExpiresIn:(int)expiresIn {
+  NSString *tokenFile = [NSString stringWithFormat:@"oauth2.token?expiresIn=%d",
+                         expiresIn];
+  NSURL *tokenURL = [testServer_ localURLForFile:tokenFile];
+
+  GTMOAuth2Authentication *auth;
+  auth = [GTMOAuth2Authentication authenticationWithServiceProvider:@"Test"
+                                                           tokenURL:tokenURL
+                                                        redirectURI:@"http://localhost/"
+                                                           clientID:@"clientID"
+                                                       clientSecret:@"clientSecret"];
+  auth.parserClass = [GTMOAuth2TestJSONParser class];
+  auth.refreshToken = @"refreshToken";
+  return auth;
+}
+
+- (void)testProactiveRefresh {
+  if (!isServerRunning_) return;
+
+  // tokens last 20 seconds and are refreshed 10 seconds ahead of expiration,
+  // leaving each refresh 5 seconds to finish before requests would have to
+  // wait for it; the access token should roll over twice without any request
+  // waiting for the token endpoint.  Rather than expecting the rollovers by
+  // a particular time, the requests go on until they've used three tokens,
+  // with a generous limit for slow machines.
+  GTMOAuth2Authentication *auth = [self authWithTokenExpiresIn:20];
+  auth.proactiveRefreshLeadTime = 10.0;
+  auth.shouldRefreshProactively = YES;
+
+  NSURL *requestURL = [testServer_ localURLForFile:@"gettysburgaddress.txt"];
+
+  // the first request must wait for an access token
+  __block BOOL didFinish = NO;
+  __block NSError *authError = nil;
+  NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL:requestURL];
+  [auth authorizeRequest:request
+       completionHandler:^(NSError *error) {
+         authError = [error retain];
+         didFinish = YES;
+       }];
+
+  NSDate *giveUpDate = [NSDate dateWithTimeIntervalSinceNow:10.0];
+  while (!didFinish && [giveUpDate timeIntervalSinceNow] > 0) {
+    [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+  }
+  STAssertTrue(didFinish, @"first authorization timed out");
+  STAssertNil([authError autorelease], @"first authorization failed");
+  STAssertEqualObjects([request valueForHTTPHeaderField:@"Authorization"],
+                       @"OAuth token_1", @"first access token");
+
+  // later requests should all be authorized before authorizeRequest returns
+  NSMutableSet *usedHeaders = [NSMutableSet set];
+  NSTimeInterval maxLatency = 0;
+  NSUInteger numberOfRequests = 0;
+
+  NSDate *endDate = [NSDate dateWithTimeIntervalSinceNow:60.0];
+  while ([usedHeaders count] < 3 && [endDate timeIntervalSinceNow] > 0) {
+    request = [NSMutableURLRequest requestWithURL:requestURL];
+    didFinish = NO;
+
+    NSDate *startDate = [NSDate date];
+    [auth authorizeRequest:request
+         completionHandler:^(NSError *error) {
+           STAssertNil(error, @"authorization failed");
+           didFinish = YES;
+         }];
+    NSTimeInterval latency = -[startDate timeIntervalSinceNow];
+    maxLatency = MAX(maxLatency, latency);
+    numberOfRequests++;
+
+    STAssertTrue(didFinish, @"request %lu waited for a token refresh",
+                 (unsigned long) numberOfRequests);
+
+    NSString *header = [request valueForHTTPHeaderField:@"Authorization"];
+    STAssertNotNil(header, @"request %lu not authorized",
+                   (unsigned long) numberOfRequests);
+    if (header) [usedHeaders addObject:header];
+
+    // let the refresh timer and token fetches run
+    [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.1]];
+  }
+
+  STAssertTrue([testServer_ tokenRequestCount] >= 3,
+               @"expected two proactive refreshes, token requests: %lu",
+               (unsigned long) [testServer_ tokenRequestCount]);
+  STAssertTrue([usedHeaders count] >= 3,
+               @"expected requests to use three access tokens, used %@",
+               usedHeaders);
+
+  NSLog(@"%lu requests across %lu access tokens, max authorization latency %.3f ms",
+        (unsigned long) numberOfRequests, (unsigned long) [usedHeaders count],
+        maxLatency * 1000.0);
+
+  [auth stopAuthorization];
+}
+
+- (void)testExpiredTokenWaitsForRefresh {
+  if (!isServerRunning_) return;
+
+  // without a proactive refresh, a request arriving after the token has
+  // expired is queued until the refresh finishes
+  GTMOAuth2Authentication *auth = [self authWithTokenExpiresIn:3600];
+  auth.accessToken = @"staleToken";
+  auth.expirationDate = [NSDate dateWithTimeIntervalSinceNow:-1.0];
+
+  NSURL *requestURL = [testServer_ localURLForFile:@"gettysburgaddress.txt"];
+  NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL:requestURL];
+
+  __block BOOL didFinish = NO;
+  [auth authorizeRequest:request
+       completionHandler:^(NSError *error) {
+         STAssertNil(error, @"authorization failed");
+         didFinish = YES;
+       }];
+  STAssertFalse(didFinish, @"expired token authorized the request");
+
+  NSDate *giveUpDate = [NSDate dateWithTimeIntervalSinceNow:10.0];
+  while (!didFinish && [giveUpDate timeIntervalSinceNow] > 0) {
+    [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+  }
+  STAssertTrue(didFinish, @"authorization timed out");
+  STAssertEqualObjects([request valueForHTTPHeaderField:@"Authorization"],
+                       @"OAuth token_1", @"refreshed access token");
+
+  // with a fresh token, authorization completes before returning
+  request = [NSMutableURLRequest requestWithURL:requestURL];
+  STAssertTrue([auth authorizeRequest:request], @"synchronous authorization");
+  STAssertEqualObjects([request valueForHTTPHeaderField:@"Authorization"],
+                       @"OAuth token_1", @"fresh access token");
+}
+
+@end
@@ -55,11 +55,11 @@ NSString and various other objects.
 Objective-C types are mapped to JSON types and back in the following way:
 
 @li NSNull -> Null -> NSNull
-@li NSString -> String -> NSMutableString
+@li NSString -> String -> NSString
 @li NSArray -> Array -> NSMutableArray
 @li NSDictionary -> Object -> NSMutableDictionary
 @li NSNumber (-initWithBool:) -> Boolean -> NSNumber -initWithBool:
-@li NSNumber -> Number -> NSDecimalNumber
+@li NSNumber -> Number -> NSNumber or NSDecimalNumber
 
 In JSON the keys of an object must be strings. NSDictionary keys need
 not be, but attempting to convert an NSDictionary with non-string keys
@@ -68,8 +68,13 @@ into JSON will throw an exception.
 NSNumber instances created with the +numberWithBool: method are
 converted into the JSON boolean "true" and "false" values, and vice
 versa. Any other NSNumber instances are converted to a JSON number the
-way you would expect. JSON numbers turn into NSDecimalNumber instances,
-as we can thus avoid any loss of precision.
+way you would expect. JSON integers that fit in a long long, and
+fractions with at most 15 significant digits, turn into plain NSNumber
+instances; all other numbers turn into NSDecimalNumber instances, as we
+can thus avoid any loss of precision.
+
+Repeated object keys are interned, so parsing many objects with the same
+keys returns the same NSString instance for each key.
 
 Strictly speaking correctly formed JSON text must have <strong>exactly
 one top-level container</strong>. (Either an Array or an Object.) Scalars,
@@ -93,6 +98,13 @@ anything else not in the JSON specification.
     // Used temporarily during scanning/generation
     NSUInteger depth;
     const char *c;
+
+    // Reusable scratch buffer for escaped strings and generated output
+    char *buf;
+    size_t bufSize;
+
+    // Interned object keys, kept for the lifetime of the instance
+    void *keyCache;
 }
 
 /// Whether we are generating human-readable (multiline) JSON
@@ -134,4 +146,26 @@ anything else not in the JSON specification.
            allowScalar:(BOOL)x
     			 error:(NSError**)error;
 
+/// Return UTF-8 JSON representation (or fragment) for the given object
+/**
+ Avoids building an intermediate NSString; use this when the JSON is
+ going to be written to a file or an upload body.
+ */
+- (NSData*)dataWithObject:(id)value
+              allowScalar:(BOOL)x
+                    error:(NSError**)error;
+
+/// Parse UTF-8 JSON data and return the represented object (or scalar)
+- (id)objectWithData:(NSData*)data
+         allowScalar:(BOOL)x
+               error:(NSError**)error;
+
+/// Read UTF-8 JSON from the stream until its end and return the represented object (or scalar)
+/**
+ The stream is opened if it is not already open, and is left open.
+ */
+- (id)objectWithInputStream:(NSInputStream*)stream
+                allowScalar:(BOOL)x
+                      error:(NSError**)error;
+
 @end
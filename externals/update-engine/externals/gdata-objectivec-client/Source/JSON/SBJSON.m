@@ -29,21 +29,29 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #import "SBJSON.h"
 
+#include <float.h>
+#include <math.h>
+#include <xlocale.h>
+
 NSString * SBJSONErrorDomain = @"org.brautaset.JSON.ErrorDomain";
 
 @interface SBJSON (Generator)
 
-- (BOOL)appendValue:(id)fragment into:(NSMutableString*)json error:(NSError**)error;
-- (BOOL)appendArray:(NSArray*)fragment into:(NSMutableString*)json error:(NSError**)error;
-- (BOOL)appendDictionary:(NSDictionary*)fragment into:(NSMutableString*)json error:(NSError**)error;
-- (BOOL)appendString:(NSString*)fragment into:(NSMutableString*)json error:(NSError**)error;
+- (NSMutableData*)generateDataWithObject:(id)value allowScalar:(BOOL)allowScalar error:(NSError**)error;
+
+- (BOOL)appendValue:(id)fragment into:(NSMutableData*)json error:(NSError**)error;
+- (BOOL)appendArray:(NSArray*)fragment into:(NSMutableData*)json error:(NSError**)error;
+- (BOOL)appendDictionary:(NSDictionary*)fragment into:(NSMutableData*)json error:(NSError**)error;
+- (BOOL)appendString:(NSString*)fragment into:(NSMutableData*)json error:(NSError**)error;
 
-- (NSString*)indent;
+- (void)appendIndentInto:(NSMutableData*)json;
 
 @end
 
 @interface SBJSON (Scanner)
 
+- (id)objectWithUTF8String:(const char *)utf8 allowScalar:(BOOL)allowScalar error:(NSError**)error;
+
 - (BOOL)scanValue:(NSObject **)o error:(NSError **)error;
 
 - (BOOL)scanRestOfArray:(NSMutableArray **)o error:(NSError **)error;
@@ -51,23 +59,49 @@ NSString * SBJSONErrorDomain = @"org.brautaset.JSON.ErrorDomain";
 - (BOOL)scanRestOfNull:(NSNull **)o error:(NSError **)error;
 - (BOOL)scanRestOfFalse:(NSNumber **)o error:(NSError **)error;
 - (BOOL)scanRestOfTrue:(NSNumber **)o error:(NSError **)error;
-- (BOOL)scanRestOfString:(NSMutableString **)o error:(NSError **)error;
+- (BOOL)scanRestOfString:(NSString **)o error:(NSError **)error;
+- (BOOL)scanRestOfKey:(NSString **)o error:(NSError **)error;
 
 // Cannot manage without looking at the first digit
 - (BOOL)scanNumber:(NSNumber **)o error:(NSError **)error;
 
 - (BOOL)scanHexQuad:(unichar *)x error:(NSError **)error;
-- (BOOL)scanUnicodeChar:(unichar *)x error:(NSError **)error;
+- (BOOL)scanUnicodeChar:(UTF32Char *)x error:(NSError **)error;
 
 - (BOOL)scanIsAtEnd;
 
 @end
 
+@interface SBJSON (Buffer)
+
+- (BOOL)reserveBuffer:(size_t)size;
+
+@end
+
 #pragma mark Private utilities
 
 #define skipWhitespace(c) while (isspace(*c)) c++
 #define skipDigits(c) while (isdigit(*c)) c++
 
+#define appendLiteral(json, lit) [json appendBytes:lit length:sizeof(lit) - 1]
+
+// Object keys up to this many bytes, without escapes, are interned
+enum {
+    kKeyCacheSize = 256,
+    kKeyCacheMaxLength = 32
+};
+
+typedef struct {
+    NSString *key;  // CFRetained so it stays rooted under GC
+    size_t length;
+    char bytes[kKeyCacheMaxLength];
+} SBJSONCachedKey;
+
+// Size of the chunks read from an NSInputStream
+enum {
+    kStreamChunkSize = 16 * 1024
+};
+
 static NSError *err(int code, NSString *str) {
     NSDictionary *ui = [NSDictionary dictionaryWithObject:str forKey:NSLocalizedDescriptionKey];
     return [NSError errorWithDomain:SBJSONErrorDomain code:code userInfo:ui];
@@ -84,6 +118,30 @@ static NSError *errWithUnderlier(int code, NSError **u, NSString *str) {
     return [NSError errorWithDomain:SBJSONErrorDomain code:code userInfo:ui];
 }
 
+// Writes the UTF-8 encoding of a Unicode scalar value, returning the byte count
+static size_t encodeUTF8(UTF32Char uc, char *out) {
+    if (uc < 0x80) {
+        out[0] = (char)uc;
+        return 1;
+    }
+    if (uc < 0x800) {
+        out[0] = (char)(0xC0 | (uc >> 6));
+        out[1] = (char)(0x80 | (uc & 0x3F));
+        return 2;
+    }
+    if (uc < 0x10000) {
+        out[0] = (char)(0xE0 | (uc >> 12));
+        out[1] = (char)(0x80 | ((uc >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (uc & 0x3F));
+        return 3;
+    }
+    out[0] = (char)(0xF0 | (uc >> 18));
+    out[1] = (char)(0x80 | ((uc >> 12) & 0x3F));
+    out[2] = (char)(0x80 | ((uc >> 6) & 0x3F));
+    out[3] = (char)(0x80 | (uc & 0x3F));
+    return 4;
+}
+
 
 @implementation SBJSON
 
@@ -105,6 +163,50 @@ static char ctrl[0x22];
     return self;
 }
 
+- (void)releaseBuffers {
+    if (keyCache) {
+        SBJSONCachedKey *keys = keyCache;
+        for (int i = 0; i < kKeyCacheSize; i++) {
+            if (keys[i].key)
+                CFRelease((CFStringRef)keys[i].key);
+        }
+        free(keyCache);
+        keyCache = NULL;
+    }
+    free(buf);
+    buf = NULL;
+    bufSize = 0;
+}
+
+- (void)finalize {
+    [self releaseBuffers];
+    [super finalize];
+}
+
+- (void)dealloc {
+    [self releaseBuffers];
+    [super dealloc];
+}
+
+#pragma mark Buffer
+
+- (BOOL)reserveBuffer:(size_t)size {
+    if (size <= bufSize)
+        return YES;
+
+    size_t newSize = bufSize ? bufSize : 256;
+    while (newSize < size)
+        newSize *= 2;
+
+    char *newBuf = realloc(buf, newSize);
+    if (!newBuf)
+        return NO;
+
+    buf = newBuf;
+    bufSize = newSize;
+    return YES;
+}
+
 #pragma mark Generator
 
 
@@ -117,20 +219,23 @@ static char ctrl[0x22];
  @param error used to return an error by reference (pass NULL if this is not desired)
  */
 - (NSString*)stringWithObject:(id)value allowScalar:(BOOL)allowScalar error:(NSError**)error {
-    depth = 0;
-    NSMutableString *json = [NSMutableString stringWithCapacity:128];
-    
-    NSError *err2 = nil;
-    if (!allowScalar && ![value isKindOfClass:[NSDictionary class]] && ![value isKindOfClass:[NSArray class]]) {
-        err2 = err(EFRAGMENT, @"Not valid type for JSON");        
-        
-    } else if ([self appendValue:value into:json error:&err2]) {
-        return json;
-    }
-    
-    if (error)
-        *error = err2;
-    return nil;
+    NSMutableData *json = [self generateDataWithObject:value allowScalar:allowScalar error:error];
+    if (!json)
+        return nil;
+
+    return [[[NSString alloc] initWithData:json encoding:NSUTF8StringEncoding] autorelease];
+}
+
+/**
+ Returns the UTF-8 JSON representation of the passed in value, or nil on error.
+ If nil is returned and @p error is not NULL, @p *error can be interrogated to find the cause of the error.
+ 
+ @param value any instance that can be represented as a JSON fragment
+ @param allowScalar wether to return json fragments for scalar objects
+ @param error used to return an error by reference (pass NULL if this is not desired)
+ */
+- (NSData*)dataWithObject:(id)value allowScalar:(BOOL)allowScalar error:(NSError**)error {
+    return [self generateDataWithObject:value allowScalar:allowScalar error:error];
 }
 
 /**
@@ -155,12 +260,34 @@ static char ctrl[0x22];
     return [self stringWithObject:value allowScalar:NO error:error];
 }
 
+- (NSMutableData*)generateDataWithObject:(id)value allowScalar:(BOOL)allowScalar error:(NSError**)error {
+    depth = 0;
+    NSMutableData *json = [NSMutableData dataWithCapacity:128];
+    
+    NSError *err2 = nil;
+    if (!allowScalar && ![value isKindOfClass:[NSDictionary class]] && ![value isKindOfClass:[NSArray class]]) {
+        err2 = err(EFRAGMENT, @"Not valid type for JSON");        
+        
+    } else if ([self appendValue:value into:json error:&err2]) {
+        return json;
+    }
+    
+    if (error)
+        *error = err2;
+    return nil;
+}
 
-- (NSString*)indent {
-    return [@"\n" stringByPaddingToLength:1 + 2 * depth withString:@" " startingAtIndex:0];
+- (void)appendIndentInto:(NSMutableData*)json {
+    static const char spaces[] = "                                ";
+    [json appendBytes:"\n" length:1];
+    for (NSUInteger n = 2 * depth; n; ) {
+        NSUInteger chunk = MIN(n, sizeof(spaces) - 1);
+        [json appendBytes:spaces length:chunk];
+        n -= chunk;
+    }
 }
 
-- (BOOL)appendValue:(id)fragment into:(NSMutableString*)json error:(NSError**)error {
+- (BOOL)appendValue:(id)fragment into:(NSMutableData*)json error:(NSError**)error {
     if ([fragment isKindOfClass:[NSDictionary class]]) {
         if (![self appendDictionary:fragment into:json error:error])
             return NO;
@@ -174,13 +301,30 @@ static char ctrl[0x22];
             return NO;
 
     } else if ([fragment isKindOfClass:[NSNumber class]]) {
-        if ('c' == *[fragment objCType])
-            [json appendString:[fragment boolValue] ? @"true" : @"false"];
-        else
-            [json appendString:[fragment stringValue]];
+        char type = *[fragment objCType];
+        if ('c' == type) {
+            if ([fragment boolValue])
+                appendLiteral(json, "true");
+            else
+                appendLiteral(json, "false");
+
+        } else if (type && strchr("sSiIlLqQ", type)) {
+            // Integers can be formatted without going through -stringValue
+            char digits[24];
+            int len;
+            if ('Q' == type)
+                len = snprintf(digits, sizeof(digits), "%llu", [fragment unsignedLongLongValue]);
+            else
+                len = snprintf(digits, sizeof(digits), "%lld", [fragment longLongValue]);
+            [json appendBytes:digits length:len];
+
+        } else {
+            const char *str = [[fragment stringValue] UTF8String];
+            [json appendBytes:str length:strlen(str)];
+        }
 
     } else if ([fragment isKindOfClass:[NSNull class]]) {
-        [json appendString:@"null"];
+        appendLiteral(json, "null");
         
     } else {
         *error = err(EUNSUPPORTED, [NSString stringWithFormat:@"JSON serialisation not supported for %@", [fragment class]]);
@@ -189,19 +333,19 @@ static char ctrl[0x22];
     return YES;
 }
 
-- (BOOL)appendArray:(NSArray*)fragment into:(NSMutableString*)json error:(NSError**)error {
-    [json appendString:@"["];
+- (BOOL)appendArray:(NSArray*)fragment into:(NSMutableData*)json error:(NSError**)error {
+    appendLiteral(json, "[");
     depth++;
     
     BOOL addComma = NO;    
     for (id value in fragment) {
         if (addComma)
-            [json appendString:@","];
+            appendLiteral(json, ",");
         else
             addComma = YES;
 
         if ([self humanReadable])
-            [json appendString:[self indent]];
+            [self appendIndentInto:json];
         
         if (![self appendValue:value into:json error:error]) {
             return NO;
@@ -210,16 +354,15 @@ static char ctrl[0x22];
 
     depth--;
     if ([self humanReadable] && [fragment count])
-        [json appendString:[self indent]];
-    [json appendString:@"]"];
+        [self appendIndentInto:json];
+    appendLiteral(json, "]");
     return YES;
 }
 
-- (BOOL)appendDictionary:(NSDictionary*)fragment into:(NSMutableString*)json error:(NSError**)error {
-    [json appendString:@"{"];
+- (BOOL)appendDictionary:(NSDictionary*)fragment into:(NSMutableData*)json error:(NSError**)error {
+    appendLiteral(json, "{");
     depth++;
 
-    NSString *colon = [self humanReadable] ? @" : " : @":";
     BOOL addComma = NO;
     NSArray *keys = [fragment allKeys];
     if (self.sortKeys)
@@ -227,12 +370,12 @@ static char ctrl[0x22];
     
     for (id value in keys) {
         if (addComma)
-            [json appendString:@","];
+            appendLiteral(json, ",");
         else
             addComma = YES;
 
         if ([self humanReadable])
-            [json appendString:[self indent]];
+            [self appendIndentInto:json];
         
         if (![value isKindOfClass:[NSString class]]) {
             *error = err(EUNSUPPORTED, @"JSON object key must be string");
@@ -242,7 +385,10 @@ static char ctrl[0x22];
         if (![self appendString:value into:json error:error])
             return NO;
 
-        [json appendString:colon];
+        if ([self humanReadable])
+            appendLiteral(json, " : ");
+        else
+            appendLiteral(json, ":");
         if (![self appendValue:[fragment objectForKey:value] into:json error:error]) {
             *error = err(EUNSUPPORTED, [NSString stringWithFormat:@"Unsupported value for key %@ in object", value]);
             return NO;
@@ -251,51 +397,65 @@ static char ctrl[0x22];
 
     depth--;
     if ([self humanReadable] && [fragment count])
-        [json appendString:[self indent]];
-    [json appendString:@"}"];
+        [self appendIndentInto:json];
+    appendLiteral(json, "}");
     return YES;    
 }
 
-- (BOOL)appendString:(NSString*)fragment into:(NSMutableString*)json error:(NSError**)error {
+- (BOOL)appendString:(NSString*)fragment into:(NSMutableData*)json error:(NSError**)error {
+    static const char hex[] = "0123456789abcdef";
 
-    static NSMutableCharacterSet *kEscapeChars;
-    if( ! kEscapeChars ) {
-        kEscapeChars = [[NSMutableCharacterSet characterSetWithRange: NSMakeRange(0,32)] retain];
-        [kEscapeChars addCharactersInString: @"\"\\"];
+    // Convert to UTF-8 in the scratch buffer, then copy it out in runs
+    // between the characters that need escaping
+    CFStringRef str = (CFStringRef)fragment;
+    CFIndex length = CFStringGetLength(str);
+    CFIndex maxBytes = CFStringGetMaximumSizeForEncoding(length, kCFStringEncodingUTF8);
+    if (![self reserveBuffer:maxBytes + 1]) {
+        *error = err(EUNSUPPORTED, @"Out of memory serialising string");
+        return NO;
+    }
+
+    CFIndex used = 0;
+    CFIndex converted = CFStringGetBytes(str, CFRangeMake(0, length),
+                                         kCFStringEncodingUTF8, 0, false,
+                                         (UInt8 *)buf, bufSize, &used);
+    if (converted != length) {
+        *error = err(EUNSUPPORTED, @"String is not valid Unicode");
+        return NO;
     }
     
-    [json appendString:@"\""];
-    
-    NSRange esc = [fragment rangeOfCharacterFromSet:kEscapeChars];
-    if ( !esc.length ) {
-        // No special chars -- can just add the raw string:
-        [json appendString:fragment];
-        
-    } else {
-        NSUInteger length = [fragment length];
-        for (NSUInteger i = 0; i < length; i++) {
-            unichar uc = [fragment characterAtIndex:i];
-            switch (uc) {
-                case '"':   [json appendString:@"\\\""];       break;
-                case '\\':  [json appendString:@"\\\\"];       break;
-                case '\t':  [json appendString:@"\\t"];        break;
-                case '\n':  [json appendString:@"\\n"];        break;
-                case '\r':  [json appendString:@"\\r"];        break;
-                case '\b':  [json appendString:@"\\b"];        break;
-                case '\f':  [json appendString:@"\\f"];        break;
-                default:    
-                    if (uc < 0x20) {
-                        [json appendFormat:@"\\u%04x", uc];
-                    } else {
-                        [json appendFormat:@"%C", uc];
-                    }
-                    break;
-                    
+    appendLiteral(json, "\"");
+
+    const char *run = buf;
+    const char *end = buf + used;
+    for (const char *p = buf; p < end; p++) {
+        unsigned char uc = *p;
+        if (uc >= 0x20 && uc != '"' && uc != '\\')
+            continue;
+
+        if (p > run)
+            [json appendBytes:run length:p - run];
+        run = p + 1;
+
+        switch (uc) {
+            case '"':   appendLiteral(json, "\\\"");    break;
+            case '\\':  appendLiteral(json, "\\\\");    break;
+            case '\t':  appendLiteral(json, "\\t");     break;
+            case '\n':  appendLiteral(json, "\\n");     break;
+            case '\r':  appendLiteral(json, "\\r");     break;
+            case '\b':  appendLiteral(json, "\\b");     break;
+            case '\f':  appendLiteral(json, "\\f");     break;
+            default: {
+                char esc[6] = { '\\', 'u', '0', '0', hex[uc >> 4], hex[uc & 0xF] };
+                [json appendBytes:esc length:sizeof(esc)];
+                break;
             }
         }
     }
+    if (end > run)
+        [json appendBytes:run length:end - run];
 
-    [json appendString:@"\""];
+    appendLiteral(json, "\"");
     return YES;
 }
 
@@ -317,32 +477,100 @@ static char ctrl[0x22];
         return nil;
     }
     
-    depth = 0;
-    c = [repr UTF8String];
-    
-    id o;
-    NSError *err2 = nil;
-    if (![self scanValue:&o error:&err2]) {
+    return [self objectWithUTF8String:[repr UTF8String] allowScalar:allowScalar error:error];
+}
+
+/**
+ Returns the object represented by the passed-in UTF-8 data or nil on error. The returned object can be
+ a string, number, boolean, null, array or dictionary.
+ 
+ @param data the json data to parse
+ @param allowScalar whether to return objects for JSON fragments
+ @param error used to return an error by reference (pass NULL if this is not desired)
+ */
+- (id)objectWithData:(NSData*)data allowScalar:(BOOL)allowScalar error:(NSError**)error {
+
+    if (!data) {
         if (error)
-            *error = err2;
+            *error = err(EINPUT, @"Input was 'nil'");
         return nil;
     }
-        
-    // We found some valid JSON. But did it also contain something else?
-    if (![self scanIsAtEnd]) {
+
+    // The scanner needs a terminating NUL, which NSData does not promise.
+    // Copying the bytes is still much cheaper than decoding into an NSString
+    // and encoding back to UTF-8.
+    NSUInteger length = [data length];
+    char *utf8 = malloc(length + 1);
+    if (!utf8) {
         if (error)
-            *error = err(ETRAILGARBAGE, @"Garbage after JSON");
+            *error = err(EINPUT, @"Out of memory copying input");
         return nil;
     }
+    [data getBytes:utf8 length:length];
+    utf8[length] = 0;
 
-    // If we don't allow scalars, check that the object we've found is a valid JSON container.
-    if (!allowScalar && ![o isKindOfClass:[NSDictionary class]] && ![o isKindOfClass:[NSArray class]]) {
+    id o = [self objectWithUTF8String:utf8 allowScalar:allowScalar error:error];
+    free(utf8);
+    return o;
+}
+
+/**
+ Reads the stream to its end and returns the object represented by the UTF-8 JSON it contained,
+ or nil on error. The returned object can be a string, number, boolean, null, array or dictionary.
+ 
+ @param stream the stream to read the json from
+ @param allowScalar whether to return objects for JSON fragments
+ @param error used to return an error by reference (pass NULL if this is not desired)
+ */
+- (id)objectWithInputStream:(NSInputStream*)stream allowScalar:(BOOL)allowScalar error:(NSError**)error {
+
+    if (!stream) {
         if (error)
-            *error = err(EFRAGMENT, @"Valid fragment, but not JSON");
+            *error = err(EINPUT, @"Input was 'nil'");
+        return nil;
+    }
+
+    if ([stream streamStatus] == NSStreamStatusNotOpen)
+        [stream open];
+
+    size_t capacity = kStreamChunkSize;
+    size_t length = 0;
+    char *utf8 = malloc(capacity);
+    while (utf8) {
+        if (capacity - length < kStreamChunkSize + 1) {
+            char *grown = realloc(utf8, capacity * 2);
+            if (!grown) {
+                free(utf8);
+                utf8 = NULL;
+                break;
+            }
+            utf8 = grown;
+            capacity *= 2;
+        }
+
+        NSInteger n = [stream read:(uint8_t *)utf8 + length maxLength:kStreamChunkSize];
+        if (n < 0) {
+            free(utf8);
+            if (error) {
+                NSError *streamError = [stream streamError];
+                *error = errWithUnderlier(EINPUT, streamError ? &streamError : NULL, @"Error reading input stream");
+            }
+            return nil;
+        }
+        if (n == 0)
+            break;
+        length += n;
+    }
+
+    if (!utf8) {
+        if (error)
+            *error = err(EINPUT, @"Out of memory reading input stream");
         return nil;
     }
+    utf8[length] = 0;
 
-    NSAssert1(o, @"Should have a valid object from %@", repr);
+    id o = [self objectWithUTF8String:utf8 allowScalar:allowScalar error:error];
+    free(utf8);
     return o;
 }
 
@@ -368,6 +596,36 @@ static char ctrl[0x22];
     return [self objectWithString:repr allowScalar:NO error:error];
 }
 
+- (id)objectWithUTF8String:(const char *)utf8 allowScalar:(BOOL)allowScalar error:(NSError**)error {
+    depth = 0;
+    c = utf8;
+    
+    id o;
+    NSError *err2 = nil;
+    if (![self scanValue:&o error:&err2]) {
+        if (error)
+            *error = err2;
+        return nil;
+    }
+        
+    // We found some valid JSON. But did it also contain something else?
+    if (![self scanIsAtEnd]) {
+        if (error)
+            *error = err(ETRAILGARBAGE, @"Garbage after JSON");
+        return nil;
+    }
+
+    // If we don't allow scalars, check that the object we've found is a valid JSON container.
+    if (!allowScalar && ![o isKindOfClass:[NSDictionary class]] && ![o isKindOfClass:[NSArray class]]) {
+        if (error)
+            *error = err(EFRAGMENT, @"Valid fragment, but not JSON");
+        return nil;
+    }
+
+    NSAssert1(o, @"Should have a valid object from %s", utf8);
+    return o;
+}
+
 /*
  In contrast to the public methods, it is an error to omit the error parameter here.
  */
@@ -383,7 +641,7 @@ static char ctrl[0x22];
             return [self scanRestOfArray:(NSMutableArray **)o error:error];
             break;
         case '"':
-            return [self scanRestOfString:(NSMutableString **)o error:error];
+            return [self scanRestOfString:(NSString **)o error:error];
             break;
         case 'f':
             return [self scanRestOfFalse:(NSNumber **)o error:error];
@@ -489,6 +747,7 @@ static char ctrl[0x22];
     return NO;
 }
 
+
 - (BOOL)scanRestOfDictionary:(NSMutableDictionary **)o error:(NSError **)error
 {
     if (maxDepth && ++depth > maxDepth) {
@@ -507,7 +766,7 @@ static char ctrl[0x22];
             return YES;
         }    
         
-        if (!(*c == '\"' && c++ && [self scanRestOfString:&k error:error])) {
+        if (!(*c == '\"' && c++ && [self scanRestOfKey:&k error:error])) {
             *error = errWithUnderlier(EPARSE, error, @"Object key string expected");
             return NO;
         }
@@ -541,32 +800,47 @@ static char ctrl[0x22];
     return NO;
 }
 
-- (BOOL)scanRestOfString:(NSMutableString **)o error:(NSError **)error
+- (BOOL)scanRestOfString:(NSString **)o error:(NSError **)error
 {
-    *o = [NSMutableString stringWithCapacity:16];
-    do {
-        // First see if there's a portion we can grab in one go. 
-        // Doing this caused a massive speedup on the long string.
-        size_t len = strcspn(c, ctrl);
-        if (len) {
-            // check for 
-            id t = [[NSString alloc] initWithBytesNoCopy:(char*)c
-                                                  length:len
-                                                encoding:NSUTF8StringEncoding
-                                            freeWhenDone:NO];
-            if (t) {
-                [*o appendString:t];
-                [t release];
-                c += len;
-            }
+    // Most strings have no escapes, so make those straight from the input.
+    size_t len = strcspn(c, ctrl);
+    if (c[len] == '"') {
+        *o = [[[NSString alloc] initWithBytes:c
+                                       length:len
+                                     encoding:NSUTF8StringEncoding] autorelease];
+        if (!*o) {
+            *error = err(EUNICODE, @"Invalid UTF-8 in string");
+            return NO;
+        }
+        c += len + 1;
+        return YES;
+    }
+
+    // Otherwise decode into the scratch buffer and make one string at the end.
+    size_t used = 0;
+    for (;;) {
+        // Room for this run plus the longest UTF-8 sequence an escape can produce
+        if (![self reserveBuffer:used + len + 4]) {
+            *error = err(EPARSE, @"Out of memory while parsing string");
+            return NO;
         }
+        memcpy(buf + used, c, len);
+        used += len;
+        c += len;
         
         if (*c == '"') {
             c++;
+            *o = [[[NSString alloc] initWithBytes:buf
+                                           length:used
+                                         encoding:NSUTF8StringEncoding] autorelease];
+            if (!*o) {
+                *error = err(EUNICODE, @"Invalid UTF-8 in string");
+                return NO;
+            }
             return YES;
             
         } else if (*c == '\\') {
-            unichar uc = *++c;
+            UTF32Char uc = (unsigned char)*++c;
             switch (uc) {
                 case '\\':
                 case '/':
@@ -592,23 +866,69 @@ static char ctrl[0x22];
                     return NO;
                     break;
             }
-            [*o appendFormat:@"%C", uc];
+            used += encodeUTF8(uc, buf + used);
             c++;
             
-        } else if (*c < 0x20) {
+        } else if (*c == 0) {
+            break;
+
+        } else {
             *error = err(ECTRL, [NSString stringWithFormat:@"Unescaped control character '0x%x'", *c]);
             return NO;
-            
-        } else {
-            NSLog(@"should not be able to get here");
         }
-    } while (*c);
+
+        len = strcspn(c, ctrl);
+    }
     
     *error = err(EEOF, @"Unexpected EOF while parsing string");
     return NO;
 }
 
-- (BOOL)scanUnicodeChar:(unichar *)x error:(NSError **)error
+// Object keys repeat across the objects of a response, so short keys without
+// escapes are looked up in a small hash table before making a new string.
+- (BOOL)scanRestOfKey:(NSString **)o error:(NSError **)error
+{
+    size_t len = strcspn(c, ctrl);
+    if (c[len] != '"' || len > kKeyCacheMaxLength)
+        return [self scanRestOfString:o error:error];
+
+    if (!keyCache) {
+        keyCache = calloc(kKeyCacheSize, sizeof(SBJSONCachedKey));
+        if (!keyCache)
+            return [self scanRestOfString:o error:error];
+    }
+
+    // FNV-1a
+    uint32_t hash = 2166136261U;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char)c[i];
+        hash *= 16777619U;
+    }
+
+    SBJSONCachedKey *entry = (SBJSONCachedKey *)keyCache + (hash & (kKeyCacheSize - 1));
+    if (!(entry->key && entry->length == len && !memcmp(entry->bytes, c, len))) {
+        NSString *key = [[NSString alloc] initWithBytes:c
+                                                 length:len
+                                               encoding:NSUTF8StringEncoding];
+        if (!key) {
+            *error = err(EUNICODE, @"Invalid UTF-8 in string");
+            return NO;
+        }
+        if (entry->key)
+            CFRelease((CFStringRef)entry->key);
+        entry->key = (NSString *)CFRetain((CFStringRef)key);
+        [key release];
+        entry->length = len;
+        memcpy(entry->bytes, c, len);
+    }
+
+    // The entry may be replaced by a nested key before the caller is done
+    *o = [[entry->key retain] autorelease];
+    c += len + 1;
+    return YES;
+}
+
+- (BOOL)scanUnicodeChar:(UTF32Char *)x error:(NSError **)error
 {
     unichar hi, lo;
     
@@ -617,6 +937,7 @@ static char ctrl[0x22];
         return NO;        
     }
     
+    *x = hi;
     if (hi >= 0xd800) {     // high surrogate char?
         if (hi < 0xdc00) {  // yes - expect a low char
             
@@ -630,7 +951,7 @@ static char ctrl[0x22];
                 return NO;
             }
             
-            hi = (hi - 0xd800) * 0x400 + (lo - 0xdc00) + 0x10000;
+            *x = (hi - 0xd800) * 0x400 + (lo - 0xdc00) + 0x10000;
             
         } else if (hi < 0xe000) {
             *error = err(EUNICODE, @"Invalid high character in surrogate pair");
@@ -638,7 +959,6 @@ static char ctrl[0x22];
         }
     }
     
-    *x = hi;
     return YES;
 }
 
@@ -665,14 +985,18 @@ static char ctrl[0x22];
 - (BOOL)scanNumber:(NSNumber **)o error:(NSError **)error
 {
     const char *ns = c;
+    BOOL isNegative = NO;
+    BOOL isInteger = YES;
+    size_t digits;
     
     // The logic to test for validity of the number formatting is relicensed
     // from JSON::XS with permission from its author Marc Lehmann.
     // (Available at the CPAN: http://search.cpan.org/dist/JSON-XS/ .)
     
-    if ('-' == *c)
-        c++;
+    if ('-' == *c && c++)
+        isNegative = YES;
     
+    const char *intStart = c;
     if ('0' == *c && c++) {        
         if (isdigit(*c)) {
             *error = err(EPARSENUM, @"Leading 0 disallowed in number");
@@ -686,6 +1010,7 @@ static char ctrl[0x22];
     } else {
         skipDigits(c);
     }
+    digits = c - intStart;
     
     // Fractional part
     if ('.' == *c && c++) {
@@ -694,7 +1019,10 @@ static char ctrl[0x22];
             *error = err(EPARSENUM, @"No digits after decimal point");
             return NO;
         }        
+        const char *fracStart = c;
         skipDigits(c);
+        digits += c - fracStart;
+        isInteger = NO;
     }
     
     // Exponential part
@@ -709,6 +1037,32 @@ static char ctrl[0x22];
             return NO;
         }
         skipDigits(c);
+        isInteger = NO;
+    }
+    
+    // Up to 18 digits always fit in a long long
+    if (isInteger && digits <= 18) {
+        long long value = 0;
+        for (const char *p = intStart; p < c; p++)
+            value = value * 10 + (*p - '0');
+        *o = [NSNumber numberWithLongLong:isNegative ? -value : value];
+        return YES;
+    }
+    
+    // A double holds 15 significant decimal digits exactly, so such numbers
+    // survive the trip through strtod unless they overflow or go subnormal.
+    if (!isInteger && digits <= 15) {
+        char *end;
+        double value = strtod_l(ns, &end, NULL);
+        if (end == c && isfinite(value) && (value == 0 || fabs(value) >= DBL_MIN)) {
+            BOOL isZero = YES;
+            for (const char *p = intStart; p < c && isZero && *p != 'e' && *p != 'E'; p++)
+                isZero = (*p == '0' || *p == '.');
+            if ((value == 0) == isZero) {
+                *o = [NSNumber numberWithDouble:value];
+                return YES;
+            }
+        }
     }
     
     id str = [[NSString alloc] initWithBytesNoCopy:(char*)ns
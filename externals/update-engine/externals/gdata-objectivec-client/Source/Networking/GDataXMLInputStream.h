@@ -0,0 +1,83 @@
+/* Copyright (c) 2011 Google Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+
+// The GDataXMLInputStream is an input stream of an XML document made from
+// a head, the XML elements of an array of objects, and a tail.  Each object's
+// XML is generated only when a read reaches it, and released when the read
+// moves past it, so a large feed can be uploaded without its whole XML ever
+// being in memory.
+//
+// The objects must respond to -XMLElement, as GDataObjects do.  They should
+// not be changed until all read operations on the stream have completed.
+//
+// A stream can be read only once; a copy of the stream is a new, unread
+// stream of the same XML, for posting the XML again on a retry.
+
+#import <Foundation/Foundation.h>
+
+#ifdef GDATA_TARGET_NAMESPACE
+  // we're using target namespace macros
+  #import "GDataDefines.h"
+#endif
+
+// Define <NSStreamDelegate> only for Mac OS X 10.6+ or iPhone OS 4.0+.
+#ifndef GDATA_NSSTREAM_DELEGATE
+ #if (TARGET_OS_MAC && !TARGET_OS_IPHONE && (MAC_OS_X_VERSION_MAX_ALLOWED >= 1060)) || \
+     (TARGET_OS_IPHONE && (__IPHONE_OS_VERSION_MAX_ALLOWED >= 40000))
+  #define GDATA_NSSTREAM_DELEGATE <NSStreamDelegate>
+ #else
+  #define GDATA_NSSTREAM_DELEGATE
+ #endif
+#endif  // !defined(GDATA_NSSTREAM_DELEGATE)
+
+@interface GDataXMLInputStream : NSInputStream GDATA_NSSTREAM_DELEGATE <NSCopying> {
+
+  NSData *head_;           // document bytes before the objects
+  NSArray *objects_;       // objects whose XML elements are streamed
+  NSData *tail_;           // document bytes after the objects
+
+  NSUInteger pieceIndex_;  // 0 for the head, then each object, then the tail
+  NSData *pieceData_;      // bytes of the current piece
+  NSUInteger pieceOffset_; // offset of the next byte to read in pieceData_
+
+  unsigned long long streamLength_; // total length, once measured
+  BOOL hasMeasuredLength_;
+
+  id delegate_;            // WEAK, not retained: stream delegate, defaults to self
+
+  // As in GDataGatherInputStream, a 1-byte dummy stream handles the various
+  // undocumented messages the system sends to an input stream.
+  NSInputStream *dummyStream_;
+  NSData *dummyData_;
+}
+
++ (GDataXMLInputStream *)streamWithHead:(NSData *)head
+                                objects:(NSArray *)objects
+                                   tail:(NSData *)tail;
+
+- (id)initWithHead:(NSData *)head
+           objects:(NSArray *)objects
+              tail:(NSData *)tail;
+
+// The number of bytes the stream will deliver.  The first call generates each
+// object's XML once to measure it, which takes about as long as reading the
+// stream; copies of the stream keep the measured length.
+- (unsigned long long)streamLength;
+
+// Serializes an object's XML element as the stream does, as UTF-8 bytes
++ (NSData *)XMLDataForObject:(id)obj;
+
+@end
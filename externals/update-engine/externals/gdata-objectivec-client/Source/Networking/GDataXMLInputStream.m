@@ -0,0 +1,238 @@
+/* Copyright (c) 2011 Google Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#import "GDataXMLInputStream.h"
+#import "GDataObject.h"
+
+@interface GDataXMLInputStream (PrivateMethods)
+- (NSData *)dataForPieceAtIndex:(NSUInteger)idx;
+@end
+
+@implementation GDataXMLInputStream
+
++ (GDataXMLInputStream *)streamWithHead:(NSData *)head
+                                objects:(NSArray *)objects
+                                   tail:(NSData *)tail {
+  return [[[self alloc] initWithHead:head
+                             objects:objects
+                                tail:tail] autorelease];
+}
+
+- (id)initWithHead:(NSData *)head
+           objects:(NSArray *)objects
+              tail:(NSData *)tail {
+  self = [super init];
+  if (self) {
+    head_ = [head copy];
+    objects_ = [objects copy];
+    tail_ = [tail copy];
+
+    pieceIndex_ = 0;
+    pieceData_ = [head_ retain];
+    pieceOffset_ = 0;
+
+    [self setDelegate:self];  // An NSStream's default delegate should be self.
+
+    dummyData_ = [[NSData alloc] initWithBytes:"x" length:1];
+    dummyStream_ = [[NSInputStream alloc] initWithData:dummyData_];
+  }
+  return self;
+}
+
+- (id)copyWithZone:(NSZone *)zone {
+  GDataXMLInputStream *newStream;
+  newStream = [[[self class] allocWithZone:zone] initWithHead:head_
+                                                      objects:objects_
+                                                         tail:tail_];
+  newStream->streamLength_ = streamLength_;
+  newStream->hasMeasuredLength_ = hasMeasuredLength_;
+  return newStream;
+}
+
+- (void)dealloc {
+  [head_ release];
+  [objects_ release];
+  [tail_ release];
+  [pieceData_ release];
+  [dummyStream_ release];
+  [dummyData_ release];
+
+  [super dealloc];
+}
+
++ (NSData *)XMLDataForObject:(id)obj {
+  NSString *str = [[obj XMLElement] XMLString];
+  NSData *data = [str dataUsingEncoding:NSUTF8StringEncoding];
+
+  // an object without XML is an empty piece, not the end of the stream
+  return (data != nil ? data : [NSData data]);
+}
+
+- (NSData *)dataForPieceAtIndex:(NSUInteger)idx {
+  NSUInteger numberOfObjects = [objects_ count];
+
+  if (idx == 0) return head_;
+  if (idx <= numberOfObjects) {
+    id obj = [objects_ objectAtIndex:(idx - 1)];
+    return [[self class] XMLDataForObject:obj];
+  }
+  if (idx == numberOfObjects + 1) return tail_;
+  return nil;
+}
+
+- (unsigned long long)streamLength {
+  if (!hasMeasuredLength_) {
+    unsigned long long total = [head_ length] + [tail_ length];
+
+    for (id obj in objects_) {
+      NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+      total += [[[self class] XMLDataForObject:obj] length];
+      [pool release];
+    }
+
+    streamLength_ = total;
+    hasMeasuredLength_ = YES;
+  }
+  return streamLength_;
+}
+
+- (NSInteger)read:(uint8_t *)buffer maxLength:(NSUInteger)len {
+
+  NSUInteger bytesRead = 0;
+
+  while (bytesRead < len && pieceData_ != nil) {
+
+    NSUInteger pieceLength = [pieceData_ length];
+    NSUInteger bytesToCopy = MIN(len - bytesRead, pieceLength - pieceOffset_);
+
+    [pieceData_ getBytes:(buffer + bytesRead)
+                   range:NSMakeRange(pieceOffset_, bytesToCopy)];
+    bytesRead += bytesToCopy;
+    pieceOffset_ += bytesToCopy;
+
+    if (pieceOffset_ == pieceLength) {
+      // move on to the next piece, generating an object's XML in its own
+      // pool so the object's XML tree is freed right away
+      NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+
+      [pieceData_ release];
+      pieceData_ = [[self dataForPieceAtIndex:++pieceIndex_] retain];
+      pieceOffset_ = 0;
+
+      [pool release];
+    }
+  }
+
+  if (bytesRead == 0) {
+    // We are at the end our our stream, so we read all of the data on our
+    // dummy input stream to make sure it is in the "fully read" state.
+    uint8_t leftOverBytes[2];
+    (void) [dummyStream_ read:leftOverBytes maxLength:sizeof(leftOverBytes)];
+  }
+
+  return bytesRead;
+}
+
+- (BOOL)getBuffer:(uint8_t **)buffer length:(NSUInteger *)len {
+  return NO;  // We don't support this style of reading.
+}
+
+- (BOOL)hasBytesAvailable {
+  // if we return no, the read never finishes, even if we've already
+  // delivered all the bytes
+  return YES;
+}
+
+#pragma mark -
+
+// Pass other expected messages on to the dummy input stream
+
+- (void)open {
+  [dummyStream_ open];
+}
+
+- (void)close {
+  [dummyStream_ close];
+
+  // the objects are kept for copies of the stream, but the current piece
+  // can be freed now
+  [pieceData_ release];
+  pieceData_ = nil;
+}
+
+- (void)stream:(NSStream *)theStream handleEvent:(NSStreamEvent)streamEvent {
+  if (delegate_ != self) {
+    [delegate_ stream:self handleEvent:streamEvent];
+  }
+}
+
+- (id)delegate {
+  return delegate_;
+}
+
+- (void)setDelegate:(id)delegate {
+  if (delegate == nil) {
+    delegate_ = self;
+    [dummyStream_ setDelegate:nil];
+  } else {
+    delegate_ = delegate;
+    [dummyStream_ setDelegate:self];
+  }
+}
+
+- (id)propertyForKey:(NSString *)key {
+  return [dummyStream_ propertyForKey:key];
+}
+
+- (BOOL)setProperty:(id)property forKey:(NSString *)key {
+  return [dummyStream_ setProperty:property forKey:key];
+}
+
+- (void)scheduleInRunLoop:(NSRunLoop *)aRunLoop forMode:(NSString *)mode {
+  [dummyStream_ scheduleInRunLoop:aRunLoop forMode:mode];
+}
+
+- (void)removeFromRunLoop:(NSRunLoop *)aRunLoop forMode:(NSString *)mode {
+  [dummyStream_ removeFromRunLoop:aRunLoop forMode:mode];
+}
+
+- (NSStreamStatus)streamStatus {
+  return [dummyStream_ streamStatus];
+}
+- (NSError *)streamError {
+  return [dummyStream_ streamError];
+}
+
+#pragma mark -
+
+// We'll forward all unexpected messages to our dummy stream
+
++ (NSMethodSignature*)methodSignatureForSelector:(SEL)selector {
+  return [NSInputStream methodSignatureForSelector:selector];
+}
+
++ (void)forwardInvocation:(NSInvocation*)invocation {
+  [invocation invokeWithTarget:[NSInputStream class]];
+}
+
+- (NSMethodSignature*)methodSignatureForSelector:(SEL)selector {
+  return [dummyStream_ methodSignatureForSelector:(SEL)selector];
+}
+
+- (void)forwardInvocation:(NSInvocation*)invocation {
+  [invocation invokeWithTarget:dummyStream_];
+}
+
+@end
@@ -102,6 +102,17 @@ _EXTERN NSString* const kGTMOAuth2NetworkFound        _INITIALIZE_AS(@"kGTMOAuth
   GTMHTTPFetcher *refreshFetcher_;
   NSMutableArray *authorizationQueue_;
 
+  // the current access token's Authorization header and expiration, read
+  // without locking; replaced ones are kept for a minute, as a reader on
+  // another thread may still hold one
+  id freshToken_;
+  NSMutableArray *retiredFreshTokens_;
+
+  // timer for refreshing the access token before it expires
+  BOOL shouldRefreshProactively_;
+  NSTimeInterval proactiveRefreshLeadTime_;
+  NSTimer *proactiveRefreshTimer_;
+
   id <GTMHTTPFetcherServiceProtocol> fetcherService_;
 
   Class parserClass_;
@@ -164,6 +175,17 @@ _EXTERN NSString* const kGTMOAuth2NetworkFound        _INITIALIZE_AS(@"kGTMOAuth
 // fetchers
 @property (retain) id <GTMHTTPFetcherServiceProtocol> fetcherService;
 
+// Proactive refresh
+//
+// If shouldRefreshProactively is set, the access token is refreshed in the
+// background before it expires, so requests keep being authorized without
+// waiting on the token endpoint.  The refresh begins proactiveRefreshLeadTime
+// seconds (default 60) before expiration, or halfway through the token's
+// lifetime if that's later.  The refresh is scheduled on the run loop of the
+// thread that received the token.
+@property (assign) BOOL shouldRefreshProactively;
+@property (assign) NSTimeInterval proactiveRefreshLeadTime;
+
 // Alternative JSON parsing class; this should implement the
 // GTMOAuth2ParserClass informal protocol. If this property is
 // not set, the class SBJSON must be available in the runtime.
@@ -18,6 +18,8 @@
 #define GTMOAUTH2AUTHENTICATION_DEFINE_GLOBALS 1
 #import "GTMOAuth2Authentication.h"
 
+#include <libkern/OSAtomic.h>
+
 // standard OAuth keys
 static NSString *const kOAuth2AccessTokenKey       = @"access_token";
 static NSString *const kOAuth2RefreshTokenKey      = @"refresh_token";
@@ -42,6 +44,15 @@ static NSString *const kTokenFetchSelectorKey = @"sel";
 
 static NSString *const kRefreshFetchArgsKey = @"requestArgs";
 
+// we'll consider an access token expired if it expires this many seconds
+// from now or earlier
+static const NSTimeInterval kExpirationMargin = 5.0;
+
+// a replaced access token is released this many seconds after it's replaced;
+// unlocked readers only use it for the moment it takes to copy its header
+// into a request, so this is far longer than any of them can still hold it
+static const NSTimeInterval kRetiredFreshTokenLifetime = 60.0;
+
 @interface GTMOAuth2ParserClass : NSObject
 // just enough of SBJSON to be able to parse
 - (id)objectWithString:(NSString*)repr error:(NSError**)error;
@@ -108,6 +119,45 @@ static NSString *const kRefreshFetchArgsKey = @"requestArgs";
 @end
 
 
+// immutable pairing of an access token's Authorization header value with
+// its expiration, so both can be read together without locking
+@interface GTMOAuth2FreshToken : NSObject {
+ @public
+  NSString *headerValue_;
+  CFAbsoluteTime expirationTime_;
+  CFAbsoluteTime retiredTime_;  // set when replaced, under the lock
+}
+- (id)initWithAccessToken:(NSString *)accessToken
+           expirationDate:(NSDate *)expirationDate;
+@end
+
+@implementation GTMOAuth2FreshToken
+
+- (id)initWithAccessToken:(NSString *)accessToken
+           expirationDate:(NSDate *)expirationDate {
+  self = [super init];
+  if (self) {
+    headerValue_ = [[@"OAuth " stringByAppendingString:accessToken] copy];
+    expirationTime_ = CFDateGetAbsoluteTime((CFDateRef) expirationDate);
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [headerValue_ release];
+  [super dealloc];
+}
+
+@end
+
+// target of the proactive refresh timer, which doesn't retain the
+// authentication, so the timer needn't keep it alive
+@interface GTMOAuth2RefreshTimerTarget : NSObject {
+  GTMOAuth2Authentication *auth_;
+}
+- (id)initWithAuthentication:(GTMOAuth2Authentication *)auth;
+@end
+
 @interface GTMOAuth2Authentication ()
 
 @property (retain) NSMutableArray *authorizationQueue;
@@ -118,10 +168,20 @@ static NSString *const kRefreshFetchArgsKey = @"requestArgs";
 
 - (BOOL)authorizeRequestImmediateArgs:(GTMOAuth2AuthorizationArgs *)args;
 
+- (BOOL)authorizeRequestFreshTokenArgs:(GTMOAuth2AuthorizationArgs *)args;
+
+- (void)invokeCallbacksOnThreadForArgs:(GTMOAuth2AuthorizationArgs *)args;
+
 - (BOOL)shouldRefreshAccessToken;
 
 - (void)updateExpirationDate;
 
+- (void)updateFreshToken;
+
+- (void)scheduleProactiveRefresh;
+
+- (void)refreshProactively;
+
 - (NSDictionary *)dictionaryWithJSONData:(NSData *)data;
 
 - (void)tokenFetcher:(GTMHTTPFetcher *)fetcher
@@ -155,13 +215,13 @@ finishedRefreshWithFetcher:(GTMHTTPFetcher *)fetcher
             redirectURI = redirectURI_,
             parameters = parameters_,
             tokenURL = tokenURL_,
-            expirationDate = expirationDate_,
             refreshFetcher = refreshFetcher_,
             fetcherService = fetcherService_,
             parserClass = parserClass_,
             userData = userData_,
             properties = properties_,
-            authorizationQueue = authorizationQueue_;
+            authorizationQueue = authorizationQueue_,
+            proactiveRefreshLeadTime = proactiveRefreshLeadTime_;
 
 // Response parameters
 @dynamic accessToken,
@@ -196,6 +256,9 @@ finishedRefreshWithFetcher:(GTMHTTPFetcher *)fetcher
   if (self) {
     self.authorizationQueue = [NSMutableArray array];
     self.parameters = [NSMutableDictionary dictionary];
+
+    retiredFreshTokens_ = [[NSMutableArray alloc] init];
+    proactiveRefreshLeadTime_ = 60.0;
   }
   return self;
 }
@@ -230,6 +293,11 @@ finishedRefreshWithFetcher:(GTMHTTPFetcher *)fetcher
   self.refreshFetcher = nil;
   self.authorizationQueue = nil;
 
+  [proactiveRefreshTimer_ invalidate];
+  [proactiveRefreshTimer_ release];
+  [freshToken_ release];
+  [retiredFreshTokens_ release];
+
   self.fetcherService = nil;
 
   self.userData = nil;
@@ -364,6 +432,9 @@ finishedRefreshWithFetcher:(GTMHTTPFetcher *)fetcher
 
 // Internal routine common to delegate and block invocations
 - (BOOL)authorizeRequestArgs:(GTMOAuth2AuthorizationArgs *)args {
+  // a fresh access token can authorize the request without locking
+  if ([self authorizeRequestFreshTokenArgs:args]) return YES;
+
   BOOL didAttempt = NO;
 
   @synchronized(authorizationQueue_) {
@@ -437,6 +508,29 @@ finishedRefreshWithFetcher:(GTMHTTPFetcher *)fetcher
     [self.refreshFetcher stopFetching];
     self.refreshFetcher = nil;
   }
+
+  [proactiveRefreshTimer_ invalidate];
+  [proactiveRefreshTimer_ release];
+  proactiveRefreshTimer_ = nil;
+}
+
+- (BOOL)authorizeRequestFreshTokenArgs:(GTMOAuth2AuthorizationArgs *)args {
+  // This authorizes the request only if the access token is well short of
+  // expiring, reading the token without taking the queue lock
+  GTMOAuth2FreshToken *freshToken = freshToken_;
+  OSMemoryBarrier();
+
+  if (freshToken == nil) return NO;
+
+  CFAbsoluteTime timeToExpire = freshToken->expirationTime_ - CFAbsoluteTimeGetCurrent();
+  if (timeToExpire < kExpirationMargin) return NO;
+
+  [args.request setValue:freshToken->headerValue_
+      forHTTPHeaderField:@"Authorization"];
+  args.error = nil;
+
+  [self invokeCallbacksOnThreadForArgs:args];
+  return YES;
 }
 
 - (BOOL)authorizeRequestImmediateArgs:(GTMOAuth2AuthorizationArgs *)args {
@@ -467,6 +561,13 @@ finishedRefreshWithFetcher:(GTMHTTPFetcher *)fetcher
                                  userInfo:userInfo];
   }
 
+  [self invokeCallbacksOnThreadForArgs:args];
+
+  BOOL didAuth = (args.error == nil);
+  return didAuth;
+}
+
+- (void)invokeCallbacksOnThreadForArgs:(GTMOAuth2AuthorizationArgs *)args {
   // Invoke any callbacks on the proper thread
   if (args.delegate || args.completionHandler) {
     NSThread *targetThread = args.thread;
@@ -477,9 +578,6 @@ finishedRefreshWithFetcher:(GTMHTTPFetcher *)fetcher
                withObject:args
             waitUntilDone:isSameThread];
   }
-
-  BOOL didAuth = (args.error == nil);
-  return didAuth;
 }
 
 - (void)invokeCallbackArgs:(GTMOAuth2AuthorizationArgs *)args {
@@ -518,6 +616,8 @@ finishedRefreshWithFetcher:(GTMHTTPFetcher *)fetcher
                                             selector:NULL
                                    completionHandler:nil
                                               thread:[NSThread currentThread]];
+  if ([self authorizeRequestFreshTokenArgs:args]) return YES;
+
   return [self authorizeRequestImmediateArgs:args];
 }
 
@@ -551,7 +651,7 @@ finishedRefreshWithFetcher:(GTMHTTPFetcher *)fetcher
       // or earlier
       NSDate *expirationDate = self.expirationDate;
       NSTimeInterval timeToExpire = [expirationDate timeIntervalSinceNow];
-      if (expirationDate == nil || timeToExpire < 5.0) {
+      if (expirationDate == nil || timeToExpire < kExpirationMargin) {
         // access token has expired, or will in a few seconds
         shouldRefresh = YES;
       }
@@ -560,6 +660,64 @@ finishedRefreshWithFetcher:(GTMHTTPFetcher *)fetcher
   return shouldRefresh;
 }
 
+#pragma mark Proactive Refresh
+
+- (BOOL)shouldRefreshProactively {
+  return shouldRefreshProactively_;
+}
+
+- (void)setShouldRefreshProactively:(BOOL)flag {
+  shouldRefreshProactively_ = flag;
+  [self scheduleProactiveRefresh];
+}
+
+- (void)scheduleProactiveRefresh {
+  // replace any timer for the previous access token
+  [proactiveRefreshTimer_ invalidate];
+  [proactiveRefreshTimer_ release];
+  proactiveRefreshTimer_ = nil;
+
+  NSDate *expirationDate = self.expirationDate;
+  NSTimeInterval lifetime = [self.expiresIn doubleValue];
+  if (!shouldRefreshProactively_
+      || expirationDate == nil
+      || lifetime <= 0
+      || [self.refreshToken length] == 0) {
+    return;
+  }
+
+  // begin the refresh ahead of expiration, but not before the token is
+  // halfway through its lifetime
+  NSTimeInterval leadTime = MIN(self.proactiveRefreshLeadTime, lifetime / 2);
+  NSDate *fireDate = [expirationDate dateByAddingTimeInterval:-leadTime];
+
+  GTMOAuth2RefreshTimerTarget *target;
+  target = [[[GTMOAuth2RefreshTimerTarget alloc] initWithAuthentication:self] autorelease];
+
+  proactiveRefreshTimer_ = [[NSTimer alloc] initWithFireDate:fireDate
+                                                    interval:0
+                                                      target:target
+                                                    selector:@selector(refreshTimerFired:)
+                                                    userInfo:nil
+                                                     repeats:NO];
+  [[NSRunLoop currentRunLoop] addTimer:proactiveRefreshTimer_
+                               forMode:NSRunLoopCommonModes];
+}
+
+- (void)refreshProactively {
+  [proactiveRefreshTimer_ release];
+  proactiveRefreshTimer_ = nil;
+
+  // the current access token remains usable while the refresh is pending
+  @synchronized(authorizationQueue_) {
+    if (self.refreshFetcher == nil && [self.refreshToken length] > 0) {
+      SEL finishedSel = @selector(auth:finishedRefreshWithFetcher:error:);
+      self.refreshFetcher = [self beginTokenFetchWithDelegate:self
+                                            didFinishSelector:finishedSel];
+    }
+  }
+}
+
 #pragma mark Token Fetch
 
 - (NSString *)userAgent {
@@ -792,6 +950,7 @@ finishedRefreshWithFetcher:(GTMHTTPFetcher *)fetcher
 
 - (void)setAccessToken:(NSString *)str {
   [self.parameters setValue:str forKey:kOAuth2AccessTokenKey];
+  [self updateFreshToken];
 }
 
 - (NSString *)refreshToken {
@@ -855,6 +1014,58 @@ finishedRefreshWithFetcher:(GTMHTTPFetcher *)fetcher
     }
   }
   self.expirationDate = date;
+
+  [self scheduleProactiveRefresh];
+}
+
+- (NSDate *)expirationDate {
+  @synchronized(retiredFreshTokens_) {
+    return [[expirationDate_ retain] autorelease];
+  }
+}
+
+- (void)setExpirationDate:(NSDate *)date {
+  @synchronized(retiredFreshTokens_) {
+    [expirationDate_ autorelease];
+    expirationDate_ = [date copy];
+  }
+  [self updateFreshToken];
+}
+
+- (void)updateFreshToken {
+  // publish the access token and expiration for unlocked authorization
+  NSString *accessToken = self.accessToken;
+  NSDate *expirationDate = self.expirationDate;
+
+  GTMOAuth2FreshToken *newToken = nil;
+  if ([accessToken length] > 0 && expirationDate != nil) {
+    newToken = [[GTMOAuth2FreshToken alloc] initWithAccessToken:accessToken
+                                                 expirationDate:expirationDate];
+  }
+
+  @synchronized(retiredFreshTokens_) {
+    GTMOAuth2FreshToken *oldToken = freshToken_;
+
+    // make the new token's contents visible before the pointer to it
+    OSMemoryBarrier();
+    freshToken_ = newToken;
+
+    // release the tokens retired long enough ago that no reader can still
+    // be using them; the oldest are first
+    CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+    NSUInteger numberToRelease = 0;
+    for (GTMOAuth2FreshToken *retiredToken in retiredFreshTokens_) {
+      if (now - retiredToken->retiredTime_ < kRetiredFreshTokenLifetime) break;
+      ++numberToRelease;
+    }
+    [retiredFreshTokens_ removeObjectsInRange:NSMakeRange(0, numberToRelease)];
+
+    if (oldToken) {
+      oldToken->retiredTime_ = now;
+      [retiredFreshTokens_ addObject:oldToken];
+      [oldToken release];
+    }
+  }
 }
 
 //
@@ -1045,4 +1256,22 @@ finishedRefreshWithFetcher:(GTMHTTPFetcher *)fetcher
 
 @end
 
+@implementation GTMOAuth2RefreshTimerTarget
+
+- (id)initWithAuthentication:(GTMOAuth2Authentication *)auth {
+  self = [super init];
+  if (self) {
+    auth_ = auth;
+  }
+  return self;
+}
+
+// the authentication invalidates the timer before going away, so auth_ is
+// still valid when this fires
+- (void)refreshTimerFired:(NSTimer *)timer {
+  [auth_ refreshProactively];
+}
+
+@end
+
 #endif // GTM_INCLUDE_OAUTH2 || (!GTL_REQUIRE_SERVICE_INCLUDES && !GDATA_REQUIRE_SERVICE_INCLUDES)
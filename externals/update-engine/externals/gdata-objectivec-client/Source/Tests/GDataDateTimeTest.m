@@ -114,6 +114,103 @@
   NSTimeZone *testTZ = [dateTime timeZone];
   STAssertEqualObjects(testTZ, denverTZ, @"Time zone changed");
 }
+
+- (void)testRFC3339Variants {
+  // strings in the fixed-width form are parsed from their bytes; the others
+  // go through NSScanner, and both should give the same results
+  struct {
+    NSString *input;
+    NSString *output;
+  } tests[] = {
+    { @"2006-10-14T15:00:00.123Z", @"2006-10-14T15:00:00Z" },
+    { @"2006-10-14t15:00:00z", @"2006-10-14T15:00:00Z" },
+    { @"2006-10-14 15:00:00+05:30", @"2006-10-14T15:00:00+05:30" },
+    { @"2006-10-14T15:00:00-00:00", @"2006-10-14T15:00:00-00:00" },
+    { @"2006-10-14T15:00:00", @"2006-10-14T15:00:00-00:00" },
+    { @"2006-10-14T15:00:00.1234567Z", @"2006-10-14T15:00:00Z" },
+    { @" 2006-10-14T15:00:00Z", @"2006-10-14T15:00:00Z" },
+    { @"2006-10-14T15:00:00+05", @"2006-10-14T15:00:00+05:00" },
+    { nil, nil }
+  };
+
+  for (int idx = 0; tests[idx].input != nil; idx++) {
+    GDataDateTime *dateTime = [GDataDateTime dateTimeWithRFC3339String:tests[idx].input];
+    STAssertEqualObjects([dateTime RFC3339String], tests[idx].output,
+                         @"bad output for %@", tests[idx].input);
+  }
+
+  // the date is computed directly for fixed offsets
+  GDataDateTime *dateTime = [GDataDateTime dateTimeWithRFC3339String:@"2006-10-14T15:00:00+05:30"];
+  STAssertEquals([[dateTime date] timeIntervalSince1970], (NSTimeInterval)1160818200,
+                 @"bad date for offset");
+  STAssertEquals([dateTime offsetSeconds], (NSInteger)(5*60*60 + 30*60),
+                 @"bad offset");
+
+  // the cached date follows changes to the fields
+  [dateTime setOffsetSeconds:0];
+  STAssertEquals([[dateTime date] timeIntervalSince1970], (NSTimeInterval)1160838000,
+                 @"cached date not updated");
+
+  [dateTime setHasTime:NO];
+  STAssertEquals([[dateTime date] timeIntervalSince1970], (NSTimeInterval)1160827200,
+                 @"date without time should be noon GMT");
+
+  // copies share date components, and removing the time from one leaves the
+  // other's components and cached date alone
+  GDataDateTime *original = [GDataDateTime dateTimeWithRFC3339String:@"2006-10-14T15:00:00Z"];
+  GDataDateTime *copy = [[original copy] autorelease];
+  STAssertEquals([[copy date] timeIntervalSince1970], (NSTimeInterval)1160838000,
+                 @"bad copy date");
+  [original setHasTime:NO];
+  STAssertTrue([copy hasTime], @"copy lost its time");
+  STAssertEquals([[copy date] timeIntervalSince1970], (NSTimeInterval)1160838000,
+                 @"copy date changed");
+  STAssertEqualObjects([copy RFC3339String], @"2006-10-14T15:00:00Z",
+                       @"copy string changed");
+  STAssertEqualObjects([original RFC3339String], @"2006-10-14",
+                       @"original string has time");
+
+  // time zones for an offset are shared
+  GDataDateTime *dateTime2 = [GDataDateTime dateTimeWithRFC3339String:@"2007-01-01T00:00:00+05:30"];
+  GDataDateTime *dateTime3 = [GDataDateTime dateTimeWithRFC3339String:@"2008-01-01T00:00:00+05:30"];
+  STAssertTrue([dateTime2 timeZone] == [dateTime3 timeZone], @"time zone not shared");
+}
+
+- (void)testRFC3339Performance {
+  // Not a pass/fail test, logs the timings so regressions in the parser and
+  // formatter show up in the build logs.
+  const NSUInteger kCount = 1000000;
+  NSString *const kStrings[] = {
+    @"2006-11-17T15:10:46-08:00",
+    @"2006-11-17T15:10:46.000Z",
+    @"2006-11-17",
+  };
+
+  NSDate *start = [NSDate date];
+  for (NSUInteger x = 0; x < kCount; x += 10000) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    for (NSUInteger y = 0; y < 10000; y++) {
+      GDataDateTime *dateTime = [GDataDateTime dateTimeWithRFC3339String:kStrings[y % 3]];
+      STAssertNotNil([dateTime date], nil);
+    }
+    [pool release];
+  }
+  NSTimeInterval parseTime = -[start timeIntervalSinceNow];
+
+  GDataDateTime *dateTime = [GDataDateTime dateTimeWithRFC3339String:kStrings[0]];
+  start = [NSDate date];
+  for (NSUInteger x = 0; x < kCount; x += 10000) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    for (NSUInteger y = 0; y < 10000; y++) {
+      STAssertNotNil([dateTime RFC3339String], nil);
+    }
+    [pool release];
+  }
+  NSTimeInterval formatTime = -[start timeIntervalSinceNow];
+
+  NSLog(@"GDataDateTime: %.0f parses/s (with -date), %.0f formats/s",
+        kCount / parseTime, kCount / formatTime);
+}
 @end
 
 //2006-11-20 17:53:23.880 otest[5401] timezone=GMT-0100 (GMT-0100) offset -3600
@@ -1578,6 +1578,72 @@ shouldWrapWithNamespaceAndEntry:(BOOL)shouldWrap {
   STAssertEqualObjects([obj propertyForKey:@"two"], @"2", @"prop 2 problem");
 }
 
+- (void)testHashing {
+  // equal objects must have equal hashes
+  GDataEntryBase *entry1 = [GDataEntryBase entry];
+  [entry1 setIdentifier:@"http://example.com/entry/1"];
+  [entry1 setTitleWithString:@"Entry One"];
+  [entry1 addLink:[GDataLink linkWithRel:@"alternate"
+                                    type:@"text/html"
+                                    href:@"http://example.com/1"]];
+
+  GDataEntryBase *entry2 = [[entry1 copy] autorelease];
+  STAssertEqualObjects(entry1, entry2, @"copy should be equal");
+  STAssertEquals([entry1 hash], [entry2 hash], @"equal entries, unequal hashes");
+
+  // text constructs ignore the type attribute, so their hashes must too
+  GDataTextConstruct *tc1 = [GDataTextConstruct textConstructWithString:@"abc"];
+  GDataTextConstruct *tc2 = [GDataTextConstruct textConstructWithString:@"abc"];
+  [tc2 setType:@"text"];
+  STAssertEqualObjects(tc1, tc2, @"text constructs should be equal");
+  STAssertEquals([tc1 hash], [tc2 hash], @"equal text constructs, unequal hashes");
+
+  // the cached hash follows changes to the object and to its extensions
+  NSUInteger oldHash = [entry2 hash];
+  [[entry2 title] setStringValue:@"Entry Two"];
+  STAssertFalse([entry1 isEqual:entry2], @"entries should differ");
+  STAssertTrue([entry2 hash] != oldHash, @"hash not updated for child change");
+
+  [[entry2 title] setStringValue:@"Entry One"];
+  STAssertEquals([entry2 hash], oldHash, @"hash not restored");
+
+  NSSet *set = [NSSet setWithObject:entry1];
+  STAssertTrue([set containsObject:entry2], @"set lookup failed");
+}
+
+- (void)testHashingPerformance {
+  // Not a pass/fail test, logs the timings of set insertion and lookup so
+  // regressions in hashing show up in the build logs.
+  const NSUInteger kCount = 100000;
+
+  NSMutableArray *entries = [NSMutableArray arrayWithCapacity:kCount];
+  for (NSUInteger idx = 0; idx < kCount; idx++) {
+    GDataEntryBase *entry = [GDataEntryBase entry];
+    NSString *str = [NSString stringWithFormat:@"http://example.com/entry/%lu",
+                     (unsigned long) idx];
+    [entry setIdentifier:str];
+    [entry setTitleWithString:str];
+    [entries addObject:entry];
+  }
+
+  NSDate *start = [NSDate date];
+  NSMutableSet *set = [NSMutableSet setWithCapacity:kCount];
+  for (GDataEntryBase *entry in entries) {
+    [set addObject:entry];
+  }
+  NSTimeInterval insertTime = -[start timeIntervalSinceNow];
+  STAssertEquals([set count], kCount, @"distinct entries were merged");
+
+  start = [NSDate date];
+  for (GDataEntryBase *entry in entries) {
+    STAssertTrue([set containsObject:entry], nil);
+  }
+  NSTimeInterval lookupTime = -[start timeIntervalSinceNow];
+
+  NSLog(@"GDataObject hash: %lu entries, %.3fs to insert, %.3fs to look up",
+        (unsigned long) kCount, insertTime, lookupTime);
+}
+
 
 @end
 
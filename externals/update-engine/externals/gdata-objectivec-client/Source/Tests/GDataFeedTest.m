@@ -17,6 +17,8 @@
 //  GDataFeedTest.m
 //
 
+#import <mach/mach.h>
+
 #import "GData.h"
 
 #import "GDataFeedTest.h"
@@ -26,7 +28,12 @@
 #import "GDataEntryYouTubeVideo.h"
 #import "GDataEntryHealthProfile.h"
 #import "GDataMapConstants.h"
+#import "GDataXMLInputStream.h"
 
+// private methods used to test copy-on-write sharing of extensions
+@interface GDataObject (GDataFeedTestPrivateMethods)
+- (NSDictionary *)extensions;
+@end
 
 @implementation GDataFeedTest
 
@@ -2147,6 +2154,402 @@
   STAssertEqualObjects(titleType, @"text", @"testing an attribute in a detached entry");
 }
 
+- (void)testFeedXMLData {
+
+  // generating a feed's XML an entry at a time should give the same bytes
+  // as generating the whole document
+  NSData *data = [NSData dataWithContentsOfFile:@"Tests/FeedCalendarEventTest1.xml"];
+  STAssertNotNil(data, @"Cannot read feed for XMLData test");
+
+  GDataFeedBase *feed = [[[GDataFeedCalendarEvent alloc] initWithData:data
+                                                       serviceVersion:@"2.1"
+                                                 shouldIgnoreUnknowns:NO] autorelease];
+  STAssertTrue([[feed entries] count] > 0, @"Feed lacks entries");
+
+  NSData *documentData = [[feed XMLDocument] XMLData];
+  NSData *feedData = [feed XMLData];
+  STAssertEqualObjects(feedData, documentData, @"XMLData differs from XMLDocument");
+
+  // a feed without entries
+  GDataFeedBase *emptyFeed = [[[GDataFeedBase alloc] init] autorelease];
+  STAssertEqualObjects([emptyFeed XMLData], [[emptyFeed XMLDocument] XMLData],
+                       @"empty feed XMLData differs");
+}
+
+// returns a batch feed of insert operations with the given number of entries
+static GDataFeedBase *BatchFeedWithEntryCount(NSUInteger numberOfEntries) {
+  GDataFeedBase *feed = [[[GDataFeedBase alloc] init] autorelease];
+  [feed setNamespaces:[GDataEntryBase batchNamespaces]];
+
+  NSMutableArray *entries = [NSMutableArray arrayWithCapacity:numberOfEntries];
+  for (NSUInteger idx = 0; idx < numberOfEntries; idx++) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+
+    NSString *str = [NSString stringWithFormat:@"entry %lu", (unsigned long) idx];
+    GDataEntryBase *entry = [GDataEntryBase entry];
+    [entry setTitleWithString:str];
+    [entry setBatchIDWithString:str];
+    [entry setBatchOperation:[GDataBatchOperation batchOperationWithType:kGDataBatchOperationInsert]];
+    [entries addObject:entry];
+
+    [pool release];
+  }
+  [feed setEntries:entries];
+  return feed;
+}
+
+// reads a stream to its end in small reads, as an uploader would
+static NSData *DataReadFromStream(NSInputStream *stream) {
+  NSMutableData *data = [NSMutableData data];
+  uint8_t buffer[1000];
+  NSInteger numRead;
+
+  [stream open];
+  while ((numRead = [stream read:buffer maxLength:sizeof(buffer)]) > 0) {
+    [data appendBytes:buffer length:numRead];
+  }
+  [stream close];
+  return data;
+}
+
+- (void)testFeedXMLInputStream {
+
+  // small feeds aren't streamed
+  NSInputStream *stream = nil;
+  unsigned long long length = 0;
+  GDataFeedBase *feed = BatchFeedWithEntryCount(10);
+  STAssertFalse([feed generateXMLInputStream:&stream length:&length],
+                @"small feed streamed");
+
+  // a large feed's stream should have the same bytes as its whole document
+  feed = BatchFeedWithEntryCount(200);
+  BOOL didGenerate = [feed generateXMLInputStream:&stream length:&length];
+  STAssertTrue(didGenerate, @"large feed not streamed");
+
+  NSData *documentData = [[feed XMLDocument] XMLData];
+  STAssertEquals(length, (unsigned long long) [documentData length],
+                 @"stream length differs");
+
+  // copy before reading, as the service does for a retry
+  NSInputStream *streamCopy = [[stream copy] autorelease];
+
+  NSData *streamData = DataReadFromStream(stream);
+  STAssertEqualObjects(streamData, documentData, @"stream differs from XMLDocument");
+
+  // reading the stream again gives nothing, but a copy is a fresh stream
+  // with the measured length
+  uint8_t buffer[16];
+  STAssertEquals([stream read:buffer maxLength:sizeof(buffer)], (NSInteger) 0,
+                 @"stream read after its end");
+
+  STAssertEquals([(GDataXMLInputStream *)streamCopy streamLength], length,
+                 @"stream copy length differs");
+  STAssertEqualObjects(DataReadFromStream(streamCopy), documentData,
+                       @"stream copy differs from XMLDocument");
+}
+
+static unsigned long long ResidentBytes(void) {
+  struct task_basic_info info;
+  mach_msg_type_number_t count = TASK_BASIC_INFO_COUNT;
+  kern_return_t kr = task_info(mach_task_self(), TASK_BASIC_INFO,
+                               (task_info_t)&info, &count);
+  return (kr == KERN_SUCCESS) ? info.resident_size : 0;
+}
+
+- (void)testBatchFeedXMLDataPerformance {
+  // Not a pass/fail test, logs the time and peak memory used to post a large
+  // batch feed's XML as a whole document, as XMLData generated an entry at a
+  // time, and as a stream read in upload-sized chunks, so regressions show up
+  // in the build logs.
+  const NSUInteger kNumberOfEntries = 50000;
+
+  GDataFeedBase *feed = BatchFeedWithEntryCount(kNumberOfEntries);
+
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  unsigned long long startBytes = ResidentBytes();
+  NSDate *start = [NSDate date];
+  NSUInteger documentLength = [[[feed XMLDocument] XMLData] length];
+  NSTimeInterval documentTime = -[start timeIntervalSinceNow];
+  unsigned long long documentBytes = ResidentBytes() - startBytes;
+  [pool release];
+
+  pool = [[NSAutoreleasePool alloc] init];
+  startBytes = ResidentBytes();
+  start = [NSDate date];
+  NSUInteger feedLength = [[feed XMLData] length];
+  NSTimeInterval feedTime = -[start timeIntervalSinceNow];
+  unsigned long long feedBytes = ResidentBytes() - startBytes;
+  [pool release];
+
+  STAssertEquals(feedLength, documentLength, @"XMLData length differs");
+
+  // the stream's time includes measuring its length, and its memory is the
+  // peak seen while reading it
+  pool = [[NSAutoreleasePool alloc] init];
+  startBytes = ResidentBytes();
+  start = [NSDate date];
+
+  NSInputStream *stream = nil;
+  unsigned long long streamLength = 0;
+  [feed generateXMLInputStream:&stream length:&streamLength];
+  NSTimeInterval measureTime = -[start timeIntervalSinceNow];
+
+  unsigned long long streamPeakBytes = 0;
+  unsigned long long numberOfBytesRead = 0;
+  uint8_t buffer[32768];
+  NSInteger numRead;
+
+  [stream open];
+  while ((numRead = [stream read:buffer maxLength:sizeof(buffer)]) > 0) {
+    numberOfBytesRead += numRead;
+
+    unsigned long long bytes = ResidentBytes();
+    if (bytes > startBytes + streamPeakBytes) {
+      streamPeakBytes = bytes - startBytes;
+    }
+  }
+  [stream close];
+  NSTimeInterval streamTime = -[start timeIntervalSinceNow];
+  [pool release];
+
+  STAssertEquals(numberOfBytesRead, (unsigned long long) documentLength,
+                 @"stream length differs");
+  STAssertEquals(streamLength, numberOfBytesRead,
+                 @"measured stream length differs");
+
+  NSLog(@"%lu-entry batch feed, %lu bytes: XMLDocument %.2fs +%lluKB resident,"
+        " XMLData %.2fs +%lluKB resident, stream %.2fs (%.2fs measuring)"
+        " +%lluKB peak resident",
+        (unsigned long) kNumberOfEntries, (unsigned long) feedLength,
+        documentTime, documentBytes / 1024, feedTime, feedBytes / 1024,
+        streamTime, measureTime, streamPeakBytes / 1024);
+}
+
+// count the extension objects held by both objects, which copies share until
+// one of the owners fetches them for modifying
+static NSUInteger CountSharedExtensions(GDataObject *obj1, GDataObject *obj2) {
+  NSDictionary *extensions1 = [obj1 extensions];
+  NSDictionary *extensions2 = [obj2 extensions];
+  NSUInteger count = 0;
+
+  for (Class theClass in extensions1) {
+    id objOrArray1 = [extensions1 objectForKey:theClass];
+    id objOrArray2 = [extensions2 objectForKey:theClass];
+    if (objOrArray2 == nil) continue;
+
+    if (![objOrArray1 isKindOfClass:[NSArray class]]) {
+      objOrArray1 = [NSArray arrayWithObject:objOrArray1];
+    }
+    if (![objOrArray2 isKindOfClass:[NSArray class]]) {
+      objOrArray2 = [NSArray arrayWithObject:objOrArray2];
+    }
+
+    for (id obj in objOrArray1) {
+      if ([obj isKindOfClass:[GDataObject class]]
+          && [objOrArray2 indexOfObjectIdenticalTo:obj] != NSNotFound) {
+        ++count;
+      }
+    }
+  }
+  return count;
+}
+
+- (void)testCopyOnWrite {
+
+  NSData *data = [NSData dataWithContentsOfFile:@"Tests/FeedCalendarEventTest1.xml"];
+  STAssertNotNil(data, @"Cannot read feed for copy test");
+
+  GDataFeedCalendarEvent *feed;
+  feed = [[[GDataFeedCalendarEvent alloc] initWithData:data
+                                        serviceVersion:@"2.1"
+                                  shouldIgnoreUnknowns:NO] autorelease];
+  GDataEntryCalendarEvent *entry = [[feed entries] objectAtIndex:0];
+
+  NSUInteger numberOfObjects = CountSharedExtensions(entry, entry);
+  STAssertTrue(numberOfObjects > 2, @"too few extensions: %lu",
+               (unsigned long) numberOfObjects);
+
+  // a new copy allocates none of the entry's child objects
+  GDataEntryCalendarEvent *entryCopy = [[entry copy] autorelease];
+  STAssertEquals(CountSharedExtensions(entry, entryCopy), numberOfObjects,
+                 @"copy should share all extensions");
+  STAssertEqualObjects(entryCopy, entry, @"copy differs");
+  STAssertEqualObjects([[entryCopy XMLElement] XMLString],
+                       [[entry XMLElement] XMLString], @"copy XML differs");
+
+  // replacing an extension in the copy copies nothing else
+  [entryCopy setTitleWithString:@"copy title"];
+  STAssertEquals(CountSharedExtensions(entry, entryCopy), numberOfObjects - 1,
+                 @"setting the title should unshare only the title");
+  STAssertEqualObjects([[entry title] stringValue], @"3 days",
+                       @"original title changed");
+
+  // fetching an extension from the copy gives the copy its own object
+  GDataEntryContent *copyContent = [entryCopy content];
+  STAssertEquals(CountSharedExtensions(entry, entryCopy), numberOfObjects - 2,
+                 @"fetching the content should unshare only the content");
+  STAssertTrue(copyContent != [entry content], @"content still shared");
+
+  [copyContent setStringValue:@"copy content"];
+  STAssertEqualObjects([[entry content] stringValue], @"The description field",
+                       @"original content changed");
+  STAssertEqualObjects([[entryCopy content] stringValue], @"copy content",
+                       @"copy content not changed");
+
+  // modifying the original after copying leaves the copy alone
+  GDataEntryCalendarEvent *secondCopy = [[entry copy] autorelease];
+  [[entry title] setStringValue:@"new title"];
+  STAssertEqualObjects([[secondCopy title] stringValue], @"3 days",
+                       @"copy title changed");
+  STAssertFalse([entry isEqual:secondCopy], @"modified original matches copy");
+
+  // arrays of extensions are unshared too
+  GDataWho *copyWho = [[secondCopy participants] objectAtIndex:0];
+  [copyWho setEmail:@"barney@example.com"];
+  STAssertEqualObjects([[[entry participants] objectAtIndex:0] email],
+                       @"FredFlintstone@gmail.com", @"original who changed");
+
+  // once the other owners have released or unshared an object, the last
+  // owner keeps it rather than allocating a copy
+  GDataEntryCalendarEvent *thirdCopy = [entry copy];
+  GDataEntryCalendarEvent *fourthCopy = [[thirdCopy copy] autorelease];
+  [thirdCopy release];
+
+  GDataTextConstruct *sharedTitle = [[fourthCopy extensions]
+                                     objectForKey:[GDataAtomTitle class]];
+  STAssertTrue([entry title] != sharedTitle, @"original kept shared title");
+  STAssertTrue([fourthCopy title] == sharedTitle, @"last owner copied title");
+
+  // an object fetched before copying stays its parent's own, however the
+  // copy and the parent are used afterwards
+  GDataEntryCalendarEvent *freshEntry = [[feed entries] objectAtIndex:1];
+  GDataTextConstruct *fetchedTitle = [freshEntry title];
+  GDataEntryCalendarEvent *fifthCopy = [[freshEntry copy] autorelease];
+  STAssertTrue([freshEntry title] == fetchedTitle, @"original lost its title");
+  STAssertTrue([[fifthCopy extensions] objectForKey:[GDataAtomTitle class]]
+               != fetchedTitle, @"fetched title shared with copy");
+
+  NSString *originalTitle = [[[fetchedTitle stringValue] copy] autorelease];
+  [fetchedTitle setStringValue:@"changed after copying"];
+  STAssertEqualObjects([[freshEntry title] stringValue],
+                       @"changed after copying", @"original title unchanged");
+  STAssertEqualObjects([[fifthCopy title] stringValue], originalTitle,
+                       @"copy title changed");
+
+  // objects passed in to a parent are its own, too
+  GDataTextConstruct *newTitle = [GDataAtomTitle textConstructWithString:@"a"];
+  [freshEntry setTitle:newTitle];
+  GDataEntryCalendarEvent *sixthCopy = [[freshEntry copy] autorelease];
+  [newTitle setStringValue:@"b"];
+  STAssertEqualObjects([[sixthCopy title] stringValue], @"a",
+                       @"copy title changed with the title passed in");
+
+  // objects still shared when the original goes away don't keep a reference
+  // to it as their parent
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  GDataFeedCalendarEvent *tempFeed;
+  tempFeed = [[GDataFeedCalendarEvent alloc] initWithData:data
+                                           serviceVersion:@"2.1"
+                                     shouldIgnoreUnknowns:NO];
+  GDataEntryCalendarEvent *tempEntry = [[tempFeed entries] objectAtIndex:0];
+  GDataEntryCalendarEvent *survivingCopy = [tempEntry copy];
+  GDataObject *sharedContent = [[survivingCopy extensions]
+                                objectForKey:[GDataAtomContent class]];
+  STAssertTrue([sharedContent parent] == tempEntry, @"unexpected parent");
+  [tempFeed release];
+  [pool release];
+
+  STAssertNil([sharedContent parent], @"parent left dangling");
+  STAssertNotNil([[survivingCopy XMLElement] XMLString], @"no copy XML");
+  [survivingCopy release];
+
+  // nor do objects which the original unshared by taking its own copy
+  pool = [[NSAutoreleasePool alloc] init];
+  tempFeed = [[GDataFeedCalendarEvent alloc] initWithData:data
+                                           serviceVersion:@"2.1"
+                                     shouldIgnoreUnknowns:NO];
+  tempEntry = [[tempFeed entries] objectAtIndex:0];
+  survivingCopy = [tempEntry copy];
+  GDataObject *copyTitle = [[survivingCopy extensions]
+                            objectForKey:[GDataAtomTitle class]];
+  STAssertTrue([copyTitle parent] == tempEntry, @"unexpected parent");
+
+  GDataTextConstruct *unsharedTitle = [tempEntry title];
+  [unsharedTitle setStringValue:@"changed in original"];
+  STAssertTrue(unsharedTitle != copyTitle, @"title still shared");
+  STAssertTrue([unsharedTitle parent] == tempEntry, @"copy lacks parent");
+  STAssertNil([copyTitle parent], @"parent left to the original");
+  [tempFeed release];
+  [pool release];
+
+  NSDictionary *copyExtensions = [survivingCopy extensions];
+  for (Class theClass in copyExtensions) {
+    id objOrArray = [copyExtensions objectForKey:theClass];
+    if (![objOrArray isKindOfClass:[NSArray class]]) {
+      objOrArray = [NSArray arrayWithObject:objOrArray];
+    }
+    for (id obj in objOrArray) {
+      if (![obj isKindOfClass:[GDataObject class]]) continue;
+      GDataObject *parent = [obj parent];
+      STAssertTrue(parent == nil || parent == survivingCopy,
+                   @"%@ has a stale parent", theClass);
+      // walks up the parents
+      (void) [obj completeNamespaces];
+    }
+  }
+  STAssertEqualObjects([[survivingCopy title] stringValue], @"3 days",
+                       @"copy title changed");
+  STAssertNotNil([[survivingCopy XMLElement] XMLString], @"no copy XML");
+  [survivingCopy release];
+}
+
+- (void)testCopyPerformance {
+  // Not a pass/fail test, logs the time to copy a large feed, and to copy a
+  // feed and then change each entry's title, so regressions show up in the
+  // build logs.
+  const NSUInteger kNumberOfEntries = 10000;
+  const int kNumberOfCopies = 10;
+
+  NSData *data = [NSData dataWithContentsOfFile:@"Tests/FeedCalendarEventTest1.xml"];
+  GDataFeedCalendarEvent *sourceFeed;
+  sourceFeed = [[[GDataFeedCalendarEvent alloc] initWithData:data
+                                              serviceVersion:@"2.1"
+                                        shouldIgnoreUnknowns:NO] autorelease];
+  NSArray *sourceEntries = [sourceFeed entries];
+  NSUInteger numberOfSourceEntries = [sourceEntries count];
+
+  NSMutableArray *entries = [NSMutableArray arrayWithCapacity:kNumberOfEntries];
+  for (NSUInteger idx = 0; idx < kNumberOfEntries; idx++) {
+    GDataEntryBase *entry = [sourceEntries objectAtIndex:(idx % numberOfSourceEntries)];
+    [entries addObject:[[entry copy] autorelease]];
+  }
+
+  GDataFeedCalendarEvent *feed = [GDataFeedCalendarEvent calendarEventFeed];
+  [feed setEntries:entries];
+
+  NSDate *start = [NSDate date];
+  for (int copyIdx = 0; copyIdx < kNumberOfCopies; copyIdx++) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    [[feed copy] release];
+    [pool release];
+  }
+  NSTimeInterval copyTime = -[start timeIntervalSinceNow] / kNumberOfCopies;
+
+  start = [NSDate date];
+  for (int copyIdx = 0; copyIdx < kNumberOfCopies; copyIdx++) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    GDataFeedCalendarEvent *feedCopy = [[feed copy] autorelease];
+    for (GDataEntryBase *entry in [feedCopy entries]) {
+      [entry setTitleWithString:@"updated"];
+    }
+    [pool release];
+  }
+  NSTimeInterval updateTime = -[start timeIntervalSinceNow] / kNumberOfCopies;
+
+  NSLog(@"%lu-entry feed: copy %.4fs, copy and retitle entries %.4fs",
+        (unsigned long) kNumberOfEntries, copyTime, updateTime);
+}
+
 @end
 
 ///////////////////////////////////////////////////////////////////////////
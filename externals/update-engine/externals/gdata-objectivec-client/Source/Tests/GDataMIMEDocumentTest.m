@@ -239,4 +239,59 @@
                       testMethod:_cmd];
 }
 
+- (void)testBoundaryConflictAcrossReads {
+  GDataMIMEDocument* doc = [GDataMIMEDocument MIMEDocument];
+
+  // the boundary scan reads the parts 64K at a time; put a conflict with the
+  // first alternate guess so it straddles the end of the first read, after
+  // the part's 2-byte empty header
+  const NSUInteger kReadSize = 64 * 1024;
+  NSMutableData* b1 = [NSMutableData dataWithLength:kReadSize + 1024];
+  memset([b1 mutableBytes], 'x', [b1 length]);
+
+  const char *conflict = "END_OF_PART_00000001";
+  memcpy((char *)[b1 mutableBytes] + kReadSize - 2 - 8,
+         conflict, strlen(conflict));
+
+  [doc addPartWithHeaders:[NSDictionary dictionary] body:b1];
+
+  NSInputStream *stream = nil;
+  NSString *boundary = nil;
+  unsigned long long length = -1;
+
+  [doc seedRandomWith:1];
+  [doc generateInputStream:&stream
+                    length:&length
+                  boundary:&boundary];
+
+  STAssertEqualObjects(boundary, @"END_OF_PART_00000002", @"bad boundary");
+}
+
+- (void)testBoundaryFallback {
+  GDataMIMEDocument* doc = [GDataMIMEDocument MIMEDocument];
+
+  // conflict with the base boundary and all nine alternate guesses, given a
+  // random seed of 1, so the boundary falls back to two random numbers
+  NSMutableString* text = [NSMutableString stringWithString:@"END_OF_PART"];
+  for (int idx = 1; idx <= 9; idx++) {
+    [text appendFormat:@" END_OF_PART_%08x", idx];
+  }
+  NSData* b1 = [text dataUsingEncoding:NSUTF8StringEncoding];
+
+  [doc addPartWithHeaders:[NSDictionary dictionary] body:b1];
+
+  NSInputStream *stream = nil;
+  NSString *boundary = nil;
+  unsigned long long length = -1;
+
+  [doc seedRandomWith:1];
+  [doc generateInputStream:&stream
+                    length:&length
+                  boundary:&boundary];
+
+  // the same fallback as when each guess was checked by rescanning the parts
+  STAssertEqualObjects(boundary, @"0000000b_tedborg_0000000c",
+                       @"bad boundary");
+}
+
 @end
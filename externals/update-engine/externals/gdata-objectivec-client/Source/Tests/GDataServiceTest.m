@@ -47,6 +47,9 @@
 
   NSString *authToken_;
   NSError *authError_;
+
+  BOOL hasCellGridFinished_;
+  NSError *cellGridError_;
 }
 @end
 
@@ -256,6 +259,9 @@ static int kServerPortNumber = 54579;
   [service_ release];
   service_ = nil;
 
+  [cellGridError_ release];
+  cellGridError_ = nil;
+
   [self resetFetchResponse];
 }
 
@@ -289,7 +295,8 @@ static int kServerPortNumber = 54579;
   // testing the URL
   if ([[filePath pathExtension] isEqual:@"auth"] ||
       [[filePath pathExtension] isEqual:@"authsub"] ||
-      [[filePath pathExtension] isEqual:@"location"]) {
+      [[filePath pathExtension] isEqual:@"location"] ||
+      [[filePath pathExtension] isEqual:@"batch"]) {
     filePath = [filePath stringByDeletingPathExtension];
   }
 
@@ -1480,6 +1487,145 @@ hasDeliveredByteCount:(unsigned long long)numberOfBytesRead
   return suggestedWillRetry; // do the retry fetch; it should succeed now
 }
 
+#pragma mark Cell grid tests
+
+- (GDataSpreadsheetCellGrid *)fetchCellGrid {
+  // fetch the cell feed, and make a grid that posts its batches to the test
+  // server
+  NSURL *feedURL = [self fileURLToTestFileName:@"FeedSpreadsheetCellsTest1.xml"];
+  NSURL *batchURL = [self fileURLToTestFileName:@"FeedSpreadsheetCellsTest1.xml.batch"];
+
+  ticket_ = (GDataServiceTicket *)
+    [service_ fetchPublicFeedWithURL:feedURL
+                           feedClass:[GDataFeedSpreadsheetCell class]
+                            delegate:self
+                   didFinishSelector:@selector(ticket:finishedWithObject:error:)];
+  [ticket_ retain];
+
+  [self waitForFetch];
+
+  STAssertNil(fetcherError_, @"fetcherError_=%@", fetcherError_);
+
+  GDataFeedSpreadsheetCell *feed = (GDataFeedSpreadsheetCell *) fetchedObject_;
+  GDataSpreadsheetCellGrid *grid = [GDataSpreadsheetCellGrid cellGridWithFeed:feed];
+  [grid setBatchFeedURL:batchURL];
+
+  [self resetFetchResponse];
+  return grid;
+}
+
+- (void)waitForCellGrid {
+  NSDate* giveUpDate = [NSDate dateWithTimeIntervalSinceNow:30.0];
+
+  while (!hasCellGridFinished_ && [giveUpDate timeIntervalSinceNow] > 0) {
+    NSDate *stopDate = [NSDate dateWithTimeIntervalSinceNow:0.001];
+    [[NSRunLoop currentRunLoop] runUntilDate:stopDate];
+  }
+}
+
+- (void)cellGrid:(GDataSpreadsheetCellGrid *)grid
+finishedUpdatingWithError:(NSError *)error {
+  hasCellGridFinished_ = YES;
+
+  [cellGridError_ release];
+  cellGridError_ = [error retain];
+}
+
+- (void)testCellGrid {
+
+  if (!isServerRunning_) return;
+
+  GDataSpreadsheetCellGrid *grid = [self fetchCellGrid];
+
+  STAssertEquals([grid rowCount], (NSInteger) 100, @"rows");
+  STAssertEquals([grid columnCount], (NSInteger) 20, @"columns");
+  STAssertEqualObjects([grid inputStringAtRow:1 column:1], @"Fred", @"R1C1");
+  STAssertEquals([grid dirtyCellCount], (NSUInteger) 0, @"dirty cells");
+
+  // edit three cells, one of which the server will reject
+  [grid setInputString:@"Wilma" atRow:1 column:1];
+  [grid setInputString:@"conflict" atRow:2 column:3];
+  [grid setInputString:@"=R1C1" atRow:100 column:20];
+  STAssertEquals([grid dirtyCellCount], (NSUInteger) 3, @"dirty cells");
+
+  // the edits split into two batches
+  [grid setCellsPerBatch:2];
+  NSArray *batchFeeds = [grid batchFeedsForDirtyCells];
+  STAssertEquals([batchFeeds count], (NSUInteger) 2, @"batch feeds");
+
+  GDataEntrySpreadsheetCell *entry = [[[batchFeeds objectAtIndex:0] entries] objectAtIndex:0];
+  STAssertEqualObjects([[entry cell] inputString], @"Wilma", @"batch cell");
+  STAssertTrue([[[entry editLink] href] hasSuffix:@"/R1C1/b9ax7"], @"edit link");
+
+  hasCellGridFinished_ = NO;
+  BOOL didStart = [grid updateDirtyCellsWithService:(GDataServiceGoogleSpreadsheet *)service_
+                                           delegate:self
+                                  didFinishSelector:@selector(cellGrid:finishedUpdatingWithError:)];
+  STAssertTrue(didStart, @"update not started");
+  STAssertTrue([grid isUpdating], @"update not in progress");
+
+  [self waitForCellGrid];
+
+  STAssertTrue(hasCellGridFinished_, @"cell grid update timed out");
+  STAssertNil(cellGridError_, @"cellGridError_=%@", cellGridError_);
+  STAssertFalse([grid isUpdating], @"update still in progress");
+
+  // only the rejected cell remains dirty
+  STAssertEquals([grid dirtyCellCount], (NSUInteger) 1, @"dirty cells");
+  STAssertFalse([grid isCellDirtyAtRow:1 column:1], @"R1C1 dirty");
+  STAssertTrue([grid isCellDirtyAtRow:2 column:3], @"R2C3 clean");
+  STAssertEquals([grid failedCellCount], (NSUInteger) 1, @"failed cells");
+
+  GDataBatchStatus *status = [grid failureStatusForCellAtRow:2 column:3];
+  STAssertEqualObjects([status code], [NSNumber numberWithInt:409], @"status");
+  STAssertEqualObjects([grid inputStringAtRow:2 column:3], @"conflict",
+                       @"rejected cell input");
+
+  // with nothing else dirty, a second update sends just the rejected cell
+  STAssertEquals([[grid batchFeedsForDirtyCells] count], (NSUInteger) 1,
+                 @"batch feeds");
+}
+
+- (void)testCellGridThroughput {
+
+  if (!isServerRunning_) return;
+
+  GDataSpreadsheetCellGrid *grid = [self fetchCellGrid];
+
+  NSInteger numberOfRows = [grid rowCount];
+  NSInteger numberOfColumns = [grid columnCount];
+
+  NSUInteger cellsPerBatch[] = { 2000, 250, 100 };
+  for (int test = 0; test < 3; test++) {
+    for (NSInteger row = 1; row <= numberOfRows; row++) {
+      for (NSInteger col = 1; col <= numberOfColumns; col++) {
+        NSString *str = [NSString stringWithFormat:@"%d:%ld", test, (long) (row * col)];
+        [grid setInputString:str atRow:row column:col];
+      }
+    }
+    NSUInteger numberOfCells = [grid dirtyCellCount];
+
+    [grid setCellsPerBatch:cellsPerBatch[test]];
+    hasCellGridFinished_ = NO;
+
+    NSDate *startDate = [NSDate date];
+    [grid updateDirtyCellsWithService:(GDataServiceGoogleSpreadsheet *)service_
+                             delegate:self
+                    didFinishSelector:@selector(cellGrid:finishedUpdatingWithError:)];
+    [self waitForCellGrid];
+    NSTimeInterval elapsed = -[startDate timeIntervalSinceNow];
+
+    STAssertTrue(hasCellGridFinished_, @"cell grid update timed out");
+    STAssertNil(cellGridError_, @"cellGridError_=%@", cellGridError_);
+    STAssertEquals([grid dirtyCellCount], (NSUInteger) 0, @"dirty cells");
+
+    NSLog(@"cell grid: %lu cells in batches of %lu, %u at a time: %.3f s (%.0f cells/s)",
+          (unsigned long) numberOfCells, (unsigned long) cellsPerBatch[test],
+          (unsigned int) [grid maxConcurrentBatches], elapsed,
+          numberOfCells / elapsed);
+  }
+}
+
 #pragma mark Standalone auth tests
 
 - (void)resetAuthResponse {
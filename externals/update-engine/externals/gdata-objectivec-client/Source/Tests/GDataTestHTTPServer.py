@@ -87,6 +87,10 @@ class SimpleServer(BaseHTTPRequestHandler):
   ("thursday") is supplied in a request's "If-Modified-Since" header, the 
   result is 304 (Not Modified).
   
+  POSTs to paths ending in .batch echo the posted batch feed, with a
+  batch:status added to each entry; entries containing the text "conflict"
+  get status 409, others status 200.
+  
   Requests to /accounts/ClientLogin will fail if supplied with a body
   containing Passwd=bad. If they contain logintoken and logincaptcha values,
   those must be logintoken=CapToken&logincaptch=good to succeed.
@@ -210,6 +214,24 @@ class SimpleServer(BaseHTTPRequestHandler):
         else:
           self.path = self.path[:-7] # remove the .upload at the end
     
+    # batch feed testing
+    if self.path.endswith(".batch"):
+      def AddBatchStatus(match):
+        entry = match.group(0)
+        if entry.find("conflict") >= 0:
+          status = "<batch:status code='409' reason='Conflict'/>"
+        else:
+          status = "<batch:status code='200' reason='Success'/>"
+        return entry[:-len("</entry>")] + status + "</entry>"
+      
+      resultString = re.sub("(?s)<entry[ >].*?</entry>", AddBatchStatus,
+        postString)
+      self.send_response(200)
+      self.send_header("Content-type", "application/atom+xml")
+      self.end_headers()
+      self.wfile.write(resultString)
+      return
+    
     overrideHeader = self.headers.getheader("X-HTTP-Method-Override", "")
     httpCommand = self.command
     if httpCommand == "POST" and len(overrideHeader) > 0:
@@ -300,5 +300,148 @@
   [self runXPathTestUsingShim:YES];
 }
 
+- (void)testCompiledXPath {
+  NSError *error = nil;
+  NSString *contactFeedXML = [NSString stringWithContentsOfFile:@"Tests/FeedContactTest1.xml"
+                                                       encoding:NSUTF8StringEncoding
+                                                          error:&error];
+  NSData *data = [contactFeedXML dataUsingEncoding:NSUTF8StringEncoding];
+
+  GDataXMLDocument *xmlDocument;
+  xmlDocument = [[[GDataXMLDocument alloc] initWithData:data
+                                                options:0
+                                                  error:&error] autorelease];
+  STAssertNotNil(xmlDocument, @"could not allocate feed from xml");
+
+  NSDictionary *nsDict = [NSDictionary dictionaryWithObject:kGDataNamespaceAtom
+                                                     forKey:kGDataNamespaceAtomPrefix];
+  GDataXMLXPath *xpath = [GDataXMLXPath XPathWithString:@"atom:entry/atom:link"
+                                             namespaces:nsDict
+                                                  error:&error];
+  STAssertNotNil(xpath, @"XPath compile error: %@", error);
+  STAssertEqualObjects([xpath expression], @"atom:entry/atom:link", @"expression");
+
+  // evaluate from the root element and from the document
+  GDataXMLElement *root = [xmlDocument rootElement];
+  NSArray *nodes = [root nodesForCompiledXPath:xpath error:&error];
+  STAssertEquals((int)[nodes count], 4, @"compiled XPath count");
+  STAssertNil(error, @"XPath error");
+
+  GDataXMLXPath *docXPath = [GDataXMLXPath XPathWithString:@"/atom:feed/atom:entry"
+                                                namespaces:nsDict
+                                                     error:&error];
+  nodes = [xmlDocument nodesForCompiledXPath:docXPath error:&error];
+  STAssertEquals((int)[nodes count], 2, @"compiled XPath count from document");
+
+  // alternate between namespace sources so the document's cached context
+  // has to replace its registered namespaces each time
+  for (int idx = 0; idx < 3; idx++) {
+    nodes = [root nodesForXPath:@"_def_ns:entry/_def_ns:link" error:&error];
+    STAssertEquals((int)[nodes count], 4, @"XPath count for default ns nodes");
+
+    nodes = [root nodesForCompiledXPath:xpath error:&error];
+    STAssertEquals((int)[nodes count], 4, @"compiled XPath count");
+
+    nodes = [root nodesForXPath:@"atom:entry/atom:link" error:&error];
+    STAssertNil(nodes, @"atom prefix should not be registered");
+  }
+
+  // compiled expressions work in nodes without a document, too
+  NSString *feedStr = @"<feed xmlns='http://www.w3.org/2005/Atom'><entry/></feed>";
+  GDataXMLElement *element = [[[GDataXMLElement alloc] initWithXMLString:feedStr
+                                                                   error:&error] autorelease];
+  GDataXMLXPath *entryXPath = [GDataXMLXPath XPathWithString:@"atom:entry"
+                                                  namespaces:nsDict
+                                                       error:&error];
+  nodes = [element nodesForCompiledXPath:entryXPath error:&error];
+  STAssertEquals((int)[nodes count], 1, @"compiled XPath count without a document");
+
+  // illegal expressions fail to compile, with libxml's error code
+  xpath = [GDataXMLXPath XPathWithString:@"" namespaces:nil error:&error];
+  STAssertNil(xpath, @"empty expression compiled");
+  STAssertEquals([error code], 1207, @"error on invalid XPath: %@", error);
+}
+
+- (void)testXPathPerformance {
+  // make a feed document of 100,000 elements, in 25,000 entries
+  const int kNumberOfEntries = 25000;
+
+  NSMutableString *feedXML = [NSMutableString stringWithString:
+    @"<feed xmlns='http://www.w3.org/2005/Atom'>"];
+  for (int idx = 0; idx < kNumberOfEntries; idx++) {
+    [feedXML appendFormat:@"<entry><title>%d</title>"
+     "<link rel='self' href='http://example.com/%d'/>"
+     "<link rel='edit' href='http://example.com/%d/edit'/></entry>",
+     idx, idx, idx];
+  }
+  [feedXML appendString:@"</feed>"];
+
+  NSError *error = nil;
+  GDataXMLDocument *xmlDocument;
+  xmlDocument = [[[GDataXMLDocument alloc] initWithXMLString:feedXML
+                                                     options:0
+                                                       error:&error] autorelease];
+  STAssertNotNil(xmlDocument, @"could not allocate feed from xml");
+
+  NSDictionary *nsDict = [NSDictionary dictionaryWithObject:kGDataNamespaceAtom
+                                                     forKey:kGDataNamespaceAtomPrefix];
+  NSArray *entries = [xmlDocument nodesForXPath:@"atom:feed/atom:entry"
+                                     namespaces:nsDict
+                                          error:&error];
+  STAssertEquals((int)[entries count], kNumberOfEntries, @"entry count");
+
+  NSString *path = @"atom:link[@rel='edit']";
+
+  // evaluate an expression string in each entry
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  NSDate *startDate = [NSDate date];
+  NSUInteger numberOfLinks = 0;
+  for (GDataXMLElement *entry in entries) {
+    NSArray *nodes = [entry nodesForXPath:path
+                               namespaces:nsDict
+                                    error:&error];
+    numberOfLinks += [nodes count];
+  }
+  NSTimeInterval stringTime = -[startDate timeIntervalSinceNow];
+  [pool drain];
+  STAssertEquals(numberOfLinks, (NSUInteger) kNumberOfEntries, @"string XPath links");
+
+  // evaluate a compiled expression in each entry
+  GDataXMLXPath *xpath = [GDataXMLXPath XPathWithString:path
+                                             namespaces:nsDict
+                                                  error:&error];
+  pool = [[NSAutoreleasePool alloc] init];
+  startDate = [NSDate date];
+  numberOfLinks = 0;
+  for (GDataXMLElement *entry in entries) {
+    NSArray *nodes = [entry nodesForCompiledXPath:xpath error:&error];
+    numberOfLinks += [nodes count];
+  }
+  NSTimeInterval compiledTime = -[startDate timeIntervalSinceNow];
+  [pool drain];
+  STAssertEquals(numberOfLinks, (NSUInteger) kNumberOfEntries, @"compiled XPath links");
+
+  // evaluate with a fresh context and compilation for every entry, as
+  // happens for nodes without a GDataXMLDocument
+  pool = [[NSAutoreleasePool alloc] init];
+  startDate = [NSDate date];
+  numberOfLinks = 0;
+  for (int idx = 0; idx < 1000; idx++) {
+    GDataXMLElement *entry = [[[entries objectAtIndex:idx] copy] autorelease];
+    NSArray *nodes = [entry nodesForXPath:path
+                               namespaces:nsDict
+                                    error:&error];
+    numberOfLinks += [nodes count];
+  }
+  NSTimeInterval uncachedTime = -[startDate timeIntervalSinceNow];
+  [pool drain];
+  STAssertEquals(numberOfLinks, (NSUInteger) 1000, @"uncached XPath links");
+
+  NSLog(@"XPath over %d entries: string %.3fs, compiled %.3fs;"
+        " uncached %.1f us per evaluation",
+        kNumberOfEntries, stringTime, compiledTime,
+        uncachedTime * 1000000.0 / 1000);
+}
+
 @end
 
@@ -0,0 +1,433 @@
+/* Copyright (c) 2011 Google Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#define typeof __typeof__ // fixes http://www.brethorsting.com/blog/2006/02/stupid-issue-with-ocunit.html
+
+#import <SenTestingKit/SenTestingKit.h>
+
+#import "SBJSON.h"
+
+@interface SBJSONTest : SenTestCase
+@end
+
+// returns YES if the error or any error underlying it has the given code
+static BOOL ErrorChainHasCode(NSError *error, NSInteger code) {
+  for (; error != nil;
+       error = [[error userInfo] objectForKey:NSUnderlyingErrorKey]) {
+    if ([error code] == code) return YES;
+  }
+  return NO;
+}
+
+// a JSON response shaped like a large GData JSON feed, with the given number
+// of entries
+static NSDictionary *FeedJSONObject(NSUInteger numberOfEntries) {
+  NSMutableArray *entries = [NSMutableArray arrayWithCapacity:numberOfEntries];
+  for (NSUInteger idx = 0; idx < numberOfEntries; idx++) {
+    NSString *entryID = [NSString stringWithFormat:
+                         @"http://www.google.com/calendar/feeds/default/%lu",
+                         (unsigned long) idx];
+    NSString *title = [NSString stringWithFormat:
+                       @"Event \"%lu\"\n\tat caf%C", (unsigned long) idx,
+                       (unichar) 0x00e9];
+    NSDictionary *link = [NSDictionary dictionaryWithObjectsAndKeys:
+                          @"alternate", @"rel",
+                          @"text/html", @"type",
+                          entryID, @"href",
+                          nil];
+    NSDictionary *entry = [NSDictionary dictionaryWithObjectsAndKeys:
+      [NSDictionary dictionaryWithObject:entryID forKey:@"$t"], @"id",
+      [NSDictionary dictionaryWithObject:title forKey:@"$t"], @"title",
+      @"2011-08-23T17:45:07.000Z", @"updated",
+      @"W/\"CUMBRX47eCp7ImA9WxdSFU4.\"", @"gd$etag",
+      [NSArray arrayWithObject:link], @"link",
+      [NSNumber numberWithUnsignedInteger:idx], @"sequence",
+      [NSNumber numberWithDouble:idx / 8.0], @"rating",
+      [NSNumber numberWithBool:(idx % 2)], @"allDay",
+      [NSNull null], @"recurrence",
+      nil];
+    [entries addObject:entry];
+  }
+
+  NSDictionary *feed = [NSDictionary dictionaryWithObjectsAndKeys:
+                        entries, @"entry",
+                        @"1.0", @"version",
+                        nil];
+  return [NSDictionary dictionaryWithObject:feed forKey:@"feed"];
+}
+
+@implementation SBJSONTest
+
+- (void)testParseNumbers {
+  SBJSON *json = [[[SBJSON alloc] init] autorelease];
+  NSError *error = nil;
+  NSArray *array = [json objectWithString:@"[0, -12, 123456789012345678,"
+                    " 1234567890123456789, 1.5, -0.25, 1e3,"
+                    " 0.1234567890123456789]"
+                                    error:&error];
+  STAssertNil(error, @"parse error %@", error);
+  STAssertEquals([array count], (NSUInteger) 8, @"number count");
+
+  // integers of up to 18 digits and short fractions are plain NSNumbers,
+  // no longer NSDecimalNumbers
+  for (NSUInteger idx = 0; idx < 7; idx++) {
+    id num = [array objectAtIndex:idx];
+    STAssertFalse([num isKindOfClass:[NSDecimalNumber class]],
+                  @"decimal number for %@", num);
+  }
+  STAssertEquals([[array objectAtIndex:0] longLongValue], 0LL, @"0");
+  STAssertEquals([[array objectAtIndex:1] longLongValue], -12LL, @"-12");
+  STAssertEquals([[array objectAtIndex:2] longLongValue],
+                 123456789012345678LL, @"18 digits");
+  STAssertEquals([[array objectAtIndex:4] doubleValue], 1.5, @"1.5");
+  STAssertEquals([[array objectAtIndex:5] doubleValue], -0.25, @"-0.25");
+  STAssertEquals([[array objectAtIndex:6] doubleValue], 1000.0, @"1e3");
+
+  // longer numbers are still NSDecimalNumbers, without losing precision
+  id longInteger = [array objectAtIndex:3];
+  STAssertTrue([longInteger isKindOfClass:[NSDecimalNumber class]],
+               @"19 digits not decimal");
+  STAssertEqualObjects([longInteger stringValue], @"1234567890123456789",
+                       @"19 digits");
+
+  id longFraction = [array objectAtIndex:7];
+  STAssertTrue([longFraction isKindOfClass:[NSDecimalNumber class]],
+               @"long fraction not decimal");
+  STAssertEqualObjects([longFraction stringValue], @"0.1234567890123456789",
+                       @"long fraction");
+
+  // malformed numbers
+  NSArray *badNumbers = [NSArray arrayWithObjects:
+                         @"[01]", @"[-]", @"[1.]", @"[1e]", @"[+1]", nil];
+  for (NSString *badNumber in badNumbers) {
+    error = nil;
+    STAssertNil([json objectWithString:badNumber error:&error],
+                @"parsed %@", badNumber);
+    STAssertTrue(ErrorChainHasCode(error, EPARSENUM),
+                 @"%@ error %@", badNumber, error);
+  }
+}
+
+- (void)testParseStrings {
+  SBJSON *json = [[[SBJSON alloc] init] autorelease];
+  NSError *error = nil;
+
+  // every escape, including a surrogate pair
+  NSString *str = [json fragmentWithString:@"\"\\\"\\\\\\/\\b\\f\\n\\r\\t"
+                   "\\u00e9\\ud83d\\ude00\""
+                                     error:&error];
+  NSString *expected = [NSString stringWithFormat:@"\"\\/\b\f\n\r\t%C%C%C",
+                        (unichar) 0x00e9, (unichar) 0xd83d, (unichar) 0xde00];
+  STAssertNil(error, @"parse error %@", error);
+  STAssertEqualObjects(str, expected, @"escapes");
+
+  // unescaped UTF-8, and runs of plain characters around escapes longer
+  // than the parser's initial scratch buffer
+  NSString *longRun = [@"" stringByPaddingToLength:1000
+                                        withString:@"x"
+                                   startingAtIndex:0];
+  NSString *source = [NSString stringWithFormat:@"\"caf%C %@\\n%@\"",
+                      (unichar) 0x00e9, longRun, longRun];
+  str = [json fragmentWithString:source error:&error];
+  expected = [NSString stringWithFormat:@"caf%C %@\n%@",
+              (unichar) 0x00e9, longRun, longRun];
+  STAssertEqualObjects(str, expected, @"long escaped string");
+
+  // bad strings
+  error = nil;
+  STAssertNil([json fragmentWithString:@"\"a\\x\"" error:&error], @"\\x");
+  STAssertEquals([error code], (NSInteger) EESCAPE, @"\\x error %@", error);
+
+  error = nil;
+  STAssertNil([json fragmentWithString:@"\"a\tb\"" error:&error], @"tab");
+  STAssertEquals([error code], (NSInteger) ECTRL, @"tab error %@", error);
+
+  error = nil;
+  STAssertNil([json fragmentWithString:@"\"\\ud83d\"" error:&error],
+              @"lone high surrogate");
+  STAssertTrue(ErrorChainHasCode(error, EUNICODE), @"error %@", error);
+
+  error = nil;
+  STAssertNil([json fragmentWithString:@"\"\\ude00\"" error:&error],
+              @"lone low surrogate");
+  STAssertTrue(ErrorChainHasCode(error, EUNICODE), @"error %@", error);
+
+  error = nil;
+  STAssertNil([json fragmentWithString:@"\"abc" error:&error],
+              @"unterminated");
+  STAssertEquals([error code], (NSInteger) EEOF, @"error %@", error);
+
+  // invalid UTF-8 in data input
+  const char badUTF8[] = "[\"\xff\"]";
+  NSData *data = [NSData dataWithBytes:badUTF8 length:strlen(badUTF8)];
+  error = nil;
+  STAssertNil([json objectWithData:data allowScalar:NO error:&error],
+              @"invalid UTF-8");
+  STAssertTrue(ErrorChainHasCode(error, EUNICODE), @"error %@", error);
+}
+
+- (void)testParseKeysInterned {
+  SBJSON *json = [[[SBJSON alloc] init] autorelease];
+  NSArray *array = [json objectWithString:@"[{\"key\":1,\"other\":2},"
+                    "{\"other\":3,\"key\":4}]"
+                                    error:NULL];
+  STAssertEquals([array count], (NSUInteger) 2, @"object count");
+
+  NSString *key1 = nil;
+  NSString *key2 = nil;
+  for (NSString *key in [array objectAtIndex:0]) {
+    if ([key isEqual:@"key"]) key1 = key;
+  }
+  for (NSString *key in [array objectAtIndex:1]) {
+    if ([key isEqual:@"key"]) key2 = key;
+  }
+  STAssertNotNil(key1, @"missing key");
+  STAssertTrue(key1 == key2, @"repeated key not interned");
+  STAssertEqualObjects([[array objectAtIndex:1] objectForKey:@"key"],
+                       [NSNumber numberWithInt:4], @"value");
+}
+
+- (void)testParseNestingDepth {
+  SBJSON *json = [[[SBJSON alloc] init] autorelease];
+  STAssertEquals([json maxDepth], (NSUInteger) 512, @"default depth");
+
+  [json setMaxDepth:3];
+  NSError *error = nil;
+  STAssertNotNil([json objectWithString:@"[{\"a\":[1]}]" error:&error],
+                 @"depth 3 error %@", error);
+
+  error = nil;
+  STAssertNil([json objectWithString:@"[{\"a\":[[1]]}]" error:&error],
+              @"depth 4 parsed");
+  STAssertTrue(ErrorChainHasCode(error, EDEPTH), @"error %@", error);
+
+  // the depth is reset by each parse, including after a failure
+  error = nil;
+  STAssertNotNil([json objectWithString:@"[[[1]]]" error:&error],
+                 @"depth 3 after failure error %@", error);
+
+  // the default allows 512 levels
+  [json setMaxDepth:512];
+  NSString *open = [@"" stringByPaddingToLength:512
+                                     withString:@"["
+                                startingAtIndex:0];
+  NSString *close = [@"" stringByPaddingToLength:512
+                                      withString:@"]"
+                                 startingAtIndex:0];
+  NSString *deep = [NSString stringWithFormat:@"%@%@", open, close];
+  STAssertNotNil([json objectWithString:deep error:NULL], @"512 levels");
+
+  deep = [NSString stringWithFormat:@"[%@%@]", open, close];
+  error = nil;
+  STAssertNil([json objectWithString:deep error:&error], @"513 levels");
+  STAssertTrue(ErrorChainHasCode(error, EDEPTH), @"error %@", error);
+}
+
+- (void)testParseStructure {
+  SBJSON *json = [[[SBJSON alloc] init] autorelease];
+  NSError *error = nil;
+
+  id obj = [json objectWithString:@" { \"a\" : [ true , false , null ] ,"
+            " \"b\" : { } } "
+                            error:&error];
+  NSDictionary *expected = [NSDictionary dictionaryWithObjectsAndKeys:
+    [NSArray arrayWithObjects:[NSNumber numberWithBool:YES],
+     [NSNumber numberWithBool:NO], [NSNull null], nil], @"a",
+    [NSDictionary dictionary], @"b",
+    nil];
+  STAssertEqualObjects(obj, expected, @"structure, error %@", error);
+
+  // fragments are only allowed when asked for
+  error = nil;
+  STAssertNil([json objectWithString:@"1" error:&error], @"fragment");
+  STAssertEquals([error code], (NSInteger) EFRAGMENT, @"error %@", error);
+  STAssertEqualObjects([json fragmentWithString:@"1" error:NULL],
+                       [NSNumber numberWithInt:1], @"fragment");
+
+  error = nil;
+  STAssertNil([json objectWithString:@"[1,]" error:&error], @"trailing comma");
+  STAssertEquals([error code], (NSInteger) ETRAILCOMMA, @"error %@", error);
+
+  error = nil;
+  STAssertNil([json objectWithString:@"[1] x" error:&error], @"garbage");
+  STAssertEquals([error code], (NSInteger) ETRAILGARBAGE, @"error %@", error);
+
+  error = nil;
+  STAssertNil([json objectWithString:nil error:&error], @"nil input");
+  STAssertEquals([error code], (NSInteger) EINPUT, @"error %@", error);
+}
+
+- (void)testParseDataAndStream {
+  // a document larger than the chunks read from a stream parses the same
+  // from a string, data and a stream
+  SBJSON *json = [[[SBJSON alloc] init] autorelease];
+  NSDictionary *feed = FeedJSONObject(500);
+  NSData *data = [json dataWithObject:feed allowScalar:NO error:NULL];
+  STAssertTrue([data length] > 64 * 1024, @"data too short for test");
+
+  NSString *str = [[[NSString alloc] initWithData:data
+                                         encoding:NSUTF8StringEncoding]
+                   autorelease];
+  id fromString = [json objectWithString:str error:NULL];
+  id fromData = [json objectWithData:data allowScalar:NO error:NULL];
+  NSInputStream *stream = [NSInputStream inputStreamWithData:data];
+  id fromStream = [json objectWithInputStream:stream
+                                  allowScalar:NO
+                                        error:NULL];
+  [stream close];
+
+  STAssertEqualObjects(fromString, feed, @"string parse");
+  STAssertEqualObjects(fromData, feed, @"data parse");
+  STAssertEqualObjects(fromStream, feed, @"stream parse");
+}
+
+- (void)testGenerate {
+  SBJSON *json = [[[SBJSON alloc] init] autorelease];
+  NSError *error = nil;
+
+  // escapes, with non-ASCII characters written as UTF-8
+  NSString *str = [NSString stringWithFormat:@"a\"b\\c/\n\t\r\b\f%C caf%C %C%C",
+                   (unichar) 0x01, (unichar) 0x00e9,
+                   (unichar) 0xd83d, (unichar) 0xde00];
+  NSString *output = [json stringWithFragment:str error:&error];
+  NSString *expected = [NSString stringWithFormat:
+                        @"\"a\\\"b\\\\c/\\n\\t\\r\\b\\f\\u0001 caf%C %C%C\"",
+                        (unichar) 0x00e9, (unichar) 0xd83d, (unichar) 0xde00];
+  STAssertNil(error, @"generate error %@", error);
+  STAssertEqualObjects(output, expected, @"escaped string");
+  STAssertEqualObjects([json fragmentWithString:output error:NULL], str,
+                       @"escaped string round trip");
+
+  // numbers
+  NSArray *numbers = [NSArray arrayWithObjects:
+                      [NSNumber numberWithInt:-7],
+                      [NSNumber numberWithLongLong:LLONG_MIN],
+                      [NSNumber numberWithUnsignedLongLong:ULLONG_MAX],
+                      [NSNumber numberWithDouble:1.5],
+                      [NSNumber numberWithBool:YES],
+                      [NSNumber numberWithBool:NO],
+                      [NSDecimalNumber
+                       decimalNumberWithString:@"0.1234567890123456789"],
+                      [NSNull null],
+                      nil];
+  output = [json stringWithObject:numbers error:&error];
+  STAssertEqualObjects(output, @"[-7,-9223372036854775808,"
+                       "18446744073709551615,1.5,true,false,"
+                       "0.1234567890123456789,null]", @"numbers");
+
+  // sorted, human-readable output
+  NSDictionary *dict = [NSDictionary dictionaryWithObjectsAndKeys:
+    [NSDictionary dictionary], @"b",
+    [NSArray arrayWithObjects:[NSNumber numberWithInt:1],
+     [NSNumber numberWithInt:2], nil], @"a",
+    nil];
+  [json setSortKeys:YES];
+  [json setHumanReadable:YES];
+  output = [json stringWithObject:dict error:&error];
+  STAssertEqualObjects(output, @"{\n  \"a\" : [\n    1,\n    2\n  ],\n"
+                       "  \"b\" : {}\n}", @"human readable");
+  [json setHumanReadable:NO];
+
+  // data output matches string output
+  NSDictionary *feed = FeedJSONObject(10);
+  NSData *data = [json dataWithObject:feed allowScalar:NO error:&error];
+  output = [json stringWithObject:feed error:&error];
+  STAssertEqualObjects(data, [output dataUsingEncoding:NSUTF8StringEncoding],
+                       @"data and string output differ");
+  STAssertEqualObjects([json objectWithData:data allowScalar:NO error:NULL],
+                       feed, @"round trip");
+}
+
+- (void)testGenerateErrors {
+  SBJSON *json = [[[SBJSON alloc] init] autorelease];
+  NSError *error = nil;
+
+  // strings with an unpaired surrogate aren't valid Unicode, so they can't be
+  // written as UTF-8
+  unichar unpaired[] = { 'a', 0xd83d, 'b' };
+  NSString *str = [NSString stringWithCharacters:unpaired length:3];
+  STAssertNil([json stringWithFragment:str error:&error],
+              @"unpaired surrogate");
+  STAssertEquals([error code], (NSInteger) EUNSUPPORTED, @"error %@", error);
+
+  error = nil;
+  NSArray *array = [NSArray arrayWithObject:str];
+  STAssertNil([json dataWithObject:array allowScalar:NO error:&error],
+              @"unpaired surrogate in array");
+  STAssertEquals([error code], (NSInteger) EUNSUPPORTED, @"error %@", error);
+
+  // fragments are only written when asked for
+  error = nil;
+  STAssertNil([json stringWithObject:@"a" error:&error], @"fragment");
+  STAssertEquals([error code], (NSInteger) EFRAGMENT, @"error %@", error);
+
+  // unsupported values and keys
+  error = nil;
+  array = [NSArray arrayWithObject:[NSDate date]];
+  STAssertNil([json stringWithObject:array error:&error], @"date");
+  STAssertEquals([error code], (NSInteger) EUNSUPPORTED, @"error %@", error);
+
+  error = nil;
+  NSNumber *numberKey = [NSNumber numberWithInt:1];
+  NSDictionary *dict = [NSDictionary dictionaryWithObject:@"a"
+                                                   forKey:numberKey];
+  STAssertNil([json stringWithObject:dict error:&error], @"number key");
+  STAssertEquals([error code], (NSInteger) EUNSUPPORTED, @"error %@", error);
+}
+
+- (void)testPerformance {
+  // Not a pass/fail test; logs the parser and writer throughput on a large
+  // feed-shaped response, so regressions show up in the build logs
+  const NSUInteger kNumberOfEntries = 20000;
+  const int kRepetitions = 5;
+
+  SBJSON *json = [[[SBJSON alloc] init] autorelease];
+  NSDictionary *feed = FeedJSONObject(kNumberOfEntries);
+  NSData *data = [json dataWithObject:feed allowScalar:NO error:NULL];
+  NSString *str = [[[NSString alloc] initWithData:data
+                                         encoding:NSUTF8StringEncoding]
+                   autorelease];
+  double megabytes = [data length] / (1024.0 * 1024.0);
+
+  NSTimeInterval times[4] = { 0, 0, 0, 0 };
+  for (int rep = 0; rep < kRepetitions; rep++) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    NSDate *start = [NSDate date];
+    [json objectWithString:str error:NULL];
+    times[0] -= [start timeIntervalSinceNow];
+
+    start = [NSDate date];
+    [json objectWithData:data allowScalar:NO error:NULL];
+    times[1] -= [start timeIntervalSinceNow];
+
+    start = [NSDate date];
+    [json stringWithObject:feed error:NULL];
+    times[2] -= [start timeIntervalSinceNow];
+
+    start = [NSDate date];
+    [json dataWithObject:feed allowScalar:NO error:NULL];
+    times[3] -= [start timeIntervalSinceNow];
+    [pool release];
+  }
+
+  NSLog(@"SBJSON %.1fMB feed: parse string %.1fMB/s, parse data %.1fMB/s, "
+        "write string %.1fMB/s, write data %.1fMB/s", megabytes,
+        megabytes * kRepetitions / times[0],
+        megabytes * kRepetitions / times[1],
+        megabytes * kRepetitions / times[2],
+        megabytes * kRepetitions / times[3]);
+}
+
+@end
@@ -0,0 +1,203 @@
+/* Copyright (c) 2011 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+#include <libkern/OSByteOrder.h>
+
+#import "GTMHTTPFetcherLogging.h"
+
+// This tool prints the records of a binary fetch log written by
+// GTMHTTPFetcher when binary logging is enabled, like
+//
+//   GTMHTTPFetchLogViewer -path ~/Desktop/GTMHTTPDebugLogs/App_log_8-21_01-41-23PM.gtmfetchlog
+//
+// XML bodies are pretty-printed, which the fetcher leaves undone to keep
+// logging cheap.  Add -fetch n to print only fetch number n.
+//
+// The tool needs only Foundation and the HTTPFetcher headers:
+//
+//   cc -framework Foundation -I ../../HTTPFetcher \
+//     -o GTMHTTPFetchLogViewer GTMHTTPFetchLogViewer.m
+
+static void PrintRecord(const unsigned char *bytes, NSUInteger length,
+                        NSInteger onlyFetchNumber);
+static NSString *StringForBody(const unsigned char *bytes, NSUInteger length);
+
+int main(int argc, const char * argv[]) {
+
+  NSAutoreleasePool * pool = [[NSAutoreleasePool alloc] init];
+
+  NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
+  NSString *path = [defaults stringForKey:@"path"];
+  NSString *fetchStr = [defaults stringForKey:@"fetch"];
+  NSInteger onlyFetchNumber = (fetchStr ? [fetchStr integerValue] : -1);
+
+  int result = 1; // failure
+
+  NSData *logData = nil;
+  if (path) {
+    logData = [NSData dataWithContentsOfMappedFile:[path stringByStandardizingPath]];
+  }
+
+  const char *magic = kGTMHTTPFetchLogMagic;
+  const NSUInteger magicLen = strlen(magic);
+
+  if (path == nil) {
+    fprintf(stderr, "usage: GTMHTTPFetchLogViewer -path logfile [-fetch n]\n");
+  } else if (logData == nil) {
+    fprintf(stderr, "cannot read %s\n", [path UTF8String]);
+  } else if ([logData length] < magicLen
+             || memcmp([logData bytes], magic, magicLen) != 0) {
+    fprintf(stderr, "%s is not a binary fetch log\n", [path UTF8String]);
+  } else {
+    const unsigned char *bytes = [logData bytes];
+    NSUInteger logLength = [logData length];
+    NSUInteger offset = magicLen;
+
+    result = 0;
+    while (offset + 4 <= logLength) {
+      uint32_t recordLength = OSReadLittleInt32(bytes, offset);
+      offset += 4;
+      if (recordLength > logLength - offset) {
+        fprintf(stderr, "log ends in a partial record\n");
+        result = 1;
+        break;
+      }
+
+      NSAutoreleasePool *recordPool = [[NSAutoreleasePool alloc] init];
+      PrintRecord(bytes + offset, recordLength, onlyFetchNumber);
+      [recordPool drain];
+
+      offset += recordLength;
+    }
+  }
+
+  [pool drain];
+  return result;
+}
+
+static void PrintRecord(const unsigned char *bytes, NSUInteger length,
+                        NSInteger onlyFetchNumber) {
+  if (length < 16) return;
+
+  uint64_t milliseconds = OSReadLittleInt64(bytes, 0);
+  uint32_t fetchNumber = OSReadLittleInt32(bytes, 8);
+  int32_t status = (int32_t) OSReadLittleInt32(bytes, 12);
+
+  if (onlyFetchNumber >= 0 && (NSInteger) fetchNumber != onlyFetchNumber) {
+    return;
+  }
+
+  NSDate *date = [NSDate dateWithTimeIntervalSince1970:milliseconds / 1000.0];
+  NSMutableString *output = [NSMutableString string];
+  if (fetchNumber > 0) {
+    [output appendFormat:@"#%u  %@\n", fetchNumber, date];
+  } else {
+    [output appendFormat:@"%@\n", date];
+  }
+
+  NSString *method = @"";
+  NSUInteger offset = 16;
+  while (offset + 5 <= length) {
+    uint8_t type = bytes[offset];
+    uint32_t fieldLength = OSReadLittleInt32(bytes, offset + 1);
+    offset += 5;
+    if (fieldLength > length - offset) break;
+
+    const unsigned char *field = bytes + offset;
+    NSString *fieldStr = [[[NSString alloc] initWithBytes:field
+                                                   length:fieldLength
+                                                 encoding:NSUTF8StringEncoding] autorelease];
+    uint64_t fieldValue = 0;
+    if (fieldLength == 8) {
+      fieldValue = OSReadLittleInt64(field, 0);
+    }
+
+    switch (type) {
+      case kGTMHTTPFetchLogFieldComment:
+        [output appendFormat:@"%@\n", fieldStr];
+        break;
+      case kGTMHTTPFetchLogFieldMethod:
+        method = fieldStr;
+        break;
+      case kGTMHTTPFetchLogFieldURL:
+        [output appendFormat:@"Request: %@ %@\n", method, fieldStr];
+        break;
+      case kGTMHTTPFetchLogFieldRequestHeaders:
+        [output appendFormat:@"Request headers:\n%@", fieldStr];
+        break;
+      case kGTMHTTPFetchLogFieldRequestBodyLength:
+        [output appendFormat:@"Request body: (%llu bytes)\n", fieldValue];
+        break;
+      case kGTMHTTPFetchLogFieldRequestBody:
+      case kGTMHTTPFetchLogFieldResponseBody:
+        [output appendFormat:@"%@\n", StringForBody(field, fieldLength)];
+        break;
+      case kGTMHTTPFetchLogFieldResponseURL:
+        [output appendFormat:@"Response URL: %@\n", fieldStr];
+        break;
+      case kGTMHTTPFetchLogFieldResponseMIMEType:
+        [output appendFormat:@"Response: status %d  MIMEType %@\n",
+         (int) status, fieldStr];
+        break;
+      case kGTMHTTPFetchLogFieldResponseHeaders:
+        [output appendFormat:@"Response headers:\n%@", fieldStr];
+        break;
+      case kGTMHTTPFetchLogFieldResponseBodyLength:
+        [output appendFormat:@"Response body: (%llu bytes)\n", fieldValue];
+        break;
+      case kGTMHTTPFetchLogFieldError:
+        [output appendFormat:@"Error: %@\n", fieldStr];
+        break;
+      case kGTMHTTPFetchLogFieldDroppedRecords:
+        if (fieldLength == 4) {
+          [output appendFormat:@"<<%u records dropped>>\n",
+           OSReadLittleInt32(field, 0)];
+        }
+        break;
+      default:
+        // skip fields added by later versions of the fetcher
+        break;
+    }
+    offset += fieldLength;
+  }
+
+  [output appendString:@"-----------------------------------------------------------\n"];
+  fputs([output UTF8String], stdout);
+}
+
+// StringForBody returns pretty-printed XML, other UTF-8 text as is, or the
+// length of binary data
+static NSString *StringForBody(const unsigned char *bytes, NSUInteger length) {
+  NSData *data = [NSData dataWithBytesNoCopy:(void *) bytes
+                                      length:length
+                                freeWhenDone:NO];
+
+  if (length > 5 && strncmp((const char *) bytes, "<?xml", 5) == 0) {
+    NSXMLDocument *doc = [[[NSXMLDocument alloc] initWithData:data
+                                                      options:0
+                                                        error:NULL] autorelease];
+    if (doc) {
+      return [doc XMLStringWithOptions:NSXMLNodePrettyPrint];
+    }
+    // bodies cut off at the logging limit won't parse; show them as text
+  }
+
+  NSString *str = [[[NSString alloc] initWithData:data
+                                         encoding:NSUTF8StringEncoding] autorelease];
+  if (str) return str;
+
+  return [NSString stringWithFormat:@"<<%lu bytes>>", (unsigned long) length];
+}
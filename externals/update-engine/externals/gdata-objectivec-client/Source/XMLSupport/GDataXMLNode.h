@@ -74,7 +74,7 @@ _EXTERN const char* kGDataXMLXPathDefaultNamespacePrefix _INITIALIZE_AS("_def_ns
 //  + (id)nodeConsumingXMLNode:(xmlNodePtr)theXMLNode;
 
 @class NSArray, NSDictionary, NSError, NSString, NSURL;
-@class GDataXMLElement, GDataXMLDocument;
+@class GDataXMLElement, GDataXMLDocument, GDataXMLXPath;
 
 enum {
   GDataXMLInvalidKind = 0,
@@ -157,6 +157,10 @@ typedef NSUInteger GDataXMLNodeKind;
 // be consistenly the same namespace in server responses.
 - (NSArray *)nodesForXPath:(NSString *)xpath error:(NSError **)error;
 
+// Evaluate a precompiled XPath, registering its namespaces (or, if it has
+// none, this node's namespaces, as in nodesForXPath:error:)
+- (NSArray *)nodesForCompiledXPath:(GDataXMLXPath *)xpath error:(NSError **)error;
+
 // access to the underlying libxml node; be sure to release the cached values
 // if you change the underlying tree at all
 - (xmlNodePtr)XMLNode;
@@ -217,5 +221,43 @@ typedef NSUInteger GDataXMLNodeKind;
 // be consistenly the same namespace in server responses.
 - (NSArray *)nodesForXPath:(NSString *)xpath error:(NSError **)error;
 
+- (NSArray *)nodesForCompiledXPath:(GDataXMLXPath *)xpath error:(NSError **)error;
+
 - (NSString *)description;
 @end
+
+// GDataXMLXPath is a compiled XPath expression, for evaluating the same path
+// against many nodes without parsing it each time, like
+//
+//   GDataXMLXPath *xpath = [GDataXMLXPath XPathWithString:@"atom:link"
+//                                              namespaces:nsDict
+//                                                   error:&error];
+//   for (GDataXMLElement *entry in entries) {
+//     NSArray *links = [entry nodesForCompiledXPath:xpath error:&error];
+//     ...
+//   }
+//
+// Each document keeps an XPath context, so evaluations within a document
+// register namespaces only when they differ from the previous evaluation's.
+// Uncompiled XPath strings evaluated in a document are also compiled once
+// and cached by the document.
+@interface GDataXMLXPath : NSObject {
+  NSString *expression_;
+  NSDictionary *namespaces_;
+  xmlXPathCompExprPtr compiledExpression_;
+}
+
+// namespaces may be nil; returns nil if the expression fails to compile
++ (GDataXMLXPath *)XPathWithString:(NSString *)xpath
+                        namespaces:(NSDictionary *)namespaces
+                             error:(NSError **)error;
+
+- (id)initWithString:(NSString *)xpath
+          namespaces:(NSDictionary *)namespaces
+               error:(NSError **)error;
+
+- (NSString *)expression;
+- (NSDictionary *)namespaces;
+
+- (xmlXPathCompExprPtr)compiledExpression;
+@end
@@ -29,6 +29,25 @@ static CFStringRef StringCacheKeyCopyDescriptionCallBack(const void *str);
 static Boolean StringCacheKeyEqualCallBack(const void *str1, const void *str2);
 static CFHashCode StringCacheKeyHashCallBack(const void *str);
 
+// GDataXMLDocument keeps its caches in the xmlDoc's user-defined _private
+// field
+typedef struct {
+  // xmlChar* to NSString
+  CFMutableDictionaryRef stringCache;
+
+  // XPath context reused by evaluations within the document, and the
+  // namespace dictionary registered with it, or nil if the registered
+  // namespaces came from a context node
+  xmlXPathContextPtr xpathContext;
+  NSDictionary *xpathNamespaces;
+
+  // expression string to GDataXMLXPath, for nodesForXPath: calls
+  CFMutableDictionaryRef compiledXPaths;
+} GDataXMLDocPrivate;
+
+// the compiled XPath cache is emptied when it reaches this size
+static const CFIndex kGDataXMLMaxCachedXPaths = 100;
+
 // isEqual: has the fatal flaw that it doesn't deal well with the received
 // being nil. We'll use this utility instead.
 
@@ -134,6 +153,17 @@ static xmlChar *SplitQNameReverse(const xmlChar *qname, xmlChar **prefix) {
 - (BOOL)shouldFreeXMLNode;
 - (void)setShouldFreeXMLNode:(BOOL)flag;
 
+// evaluate either an expression string or a compiled XPath
+- (NSArray *)nodesForXPathString:(NSString *)xpathStr
+                   compiledXPath:(GDataXMLXPath *)compiledXPath
+                      namespaces:(NSDictionary *)namespaces
+                           error:(NSError **)error;
+@end
+
+@interface GDataXMLXPath (PrivateMethods)
+- (id)initWithString:(NSString *)xpath
+          namespaces:(NSDictionary *)namespaces
+  compiledExpression:(xmlXPathCompExprPtr)compExpr;
 @end
 
 @interface GDataXMLElement (PrivateMethods)
@@ -349,7 +379,10 @@ static xmlChar *SplitQNameReverse(const xmlChar *qname, xmlChar **prefix) {
 
     if (xmlNode_->doc != NULL) {
 
-      cacheDict = xmlNode_->doc->_private;
+      GDataXMLDocPrivate *docPrivate = xmlNode_->doc->_private;
+      if (docPrivate) {
+        cacheDict = docPrivate->stringCache;
+      }
 
       if (cacheDict) {
 
@@ -691,6 +724,94 @@ static xmlChar *SplitQNameReverse(const xmlChar *qname, xmlChar **prefix) {
 - (NSArray *)nodesForXPath:(NSString *)xpath
                 namespaces:(NSDictionary *)namespaces
                      error:(NSError **)error {
+  return [self nodesForXPathString:xpath
+                     compiledXPath:nil
+                        namespaces:namespaces
+                             error:error];
+}
+
+- (NSArray *)nodesForCompiledXPath:(GDataXMLXPath *)xpath
+                             error:(NSError **)error {
+  return [self nodesForXPathString:[xpath expression]
+                     compiledXPath:xpath
+                        namespaces:[xpath namespaces]
+                             error:error];
+}
+
+// register the dictionary's prefixes and URIs, or, if namespaces is nil,
+// the namespaces declared on nsNodePtr
+static void RegisterXPathNamespaces(xmlXPathContextPtr xpathCtx,
+                                    NSDictionary *namespaces,
+                                    xmlNodePtr nsNodePtr) {
+  if (namespaces) {
+    // the dictionary keys are prefixes; the values are URIs
+    for (NSString *prefix in namespaces) {
+      NSString *uri = [namespaces objectForKey:prefix];
+
+      xmlChar *prefixChars = (xmlChar *) [prefix UTF8String];
+      xmlChar *uriChars = (xmlChar *) [uri UTF8String];
+      int result = xmlXPathRegisterNs(xpathCtx, prefixChars, uriChars);
+      if (result != 0) {
+#if DEBUG
+        NSCAssert1(result == 0, @"GDataXMLNode XPath namespace %@ issue",
+                  prefix);
+#endif
+      }
+    }
+  } else if (nsNodePtr != NULL) {
+    // step through the namespaces, if any, and register each with the
+    // xpath context
+    for (xmlNsPtr nsPtr = nsNodePtr->ns; nsPtr != NULL; nsPtr = nsPtr->next) {
+
+      // default namespace is nil in the tree, but there's no way to
+      // register a default namespace, so we'll register a fake one,
+      // _def_ns
+      const xmlChar* prefix = nsPtr->prefix;
+      if (prefix == NULL) {
+        prefix = (xmlChar*) kGDataXMLXPathDefaultNamespacePrefix;
+      }
+
+      int result = xmlXPathRegisterNs(xpathCtx, prefix, nsPtr->href);
+      if (result != 0) {
+#if DEBUG
+        NSCAssert1(result == 0, @"GDataXMLNode XPath namespace %s issue",
+                  prefix);
+#endif
+      }
+    }
+  }
+}
+
+// returns YES if the context has exactly the namespaces declared on
+// nsNodePtr registered, so a reused context needn't register them again
+static BOOL AreNodeXPathNamespacesRegistered(xmlXPathContextPtr xpathCtx,
+                                             xmlNodePtr nsNodePtr) {
+  int numberOfNamespaces = 0;
+  if (nsNodePtr != NULL) {
+    for (xmlNsPtr nsPtr = nsNodePtr->ns; nsPtr != NULL; nsPtr = nsPtr->next) {
+      const xmlChar* prefix = nsPtr->prefix;
+      if (prefix == NULL) {
+        prefix = (xmlChar*) kGDataXMLXPathDefaultNamespacePrefix;
+      }
+
+      const xmlChar *registeredURI = xmlXPathNsLookup(xpathCtx, prefix);
+      if (!xmlStrEqual(registeredURI, nsPtr->href)) return NO;
+
+      numberOfNamespaces++;
+    }
+  }
+
+  int numberRegistered = 0;
+  if (xpathCtx->nsHash != NULL) {
+    numberRegistered = xmlHashSize(xpathCtx->nsHash);
+  }
+  return (numberRegistered == numberOfNamespaces);
+}
+
+- (NSArray *)nodesForXPathString:(NSString *)xpathStr
+                   compiledXPath:(GDataXMLXPath *)compiledXPath
+                      namespaces:(NSDictionary *)namespaces
+                           error:(NSError **)error {
 
   NSMutableArray *array = nil;
   NSInteger errorCode = -1;
@@ -721,64 +842,100 @@ static xmlChar *SplitQNameReverse(const xmlChar *qname, xmlChar **prefix) {
 
   if (xmlNode_ != NULL && xmlNode_->doc != NULL) {
 
-    xmlXPathContextPtr xpathCtx = xmlXPathNewContext(xmlNode_->doc);
+    // a GDataXMLDocument's xmlDoc keeps an xpath context and compiled
+    // expressions for reuse; a temporary document's context and expression
+    // last only for this evaluation
+    GDataXMLDocPrivate *docPrivate = xmlNode_->doc->_private;
+
+    xmlXPathContextPtr xpathCtx;
+    if (docPrivate) {
+      if (docPrivate->xpathContext == NULL) {
+        docPrivate->xpathContext = xmlXPathNewContext(xmlNode_->doc);
+      }
+      xpathCtx = docPrivate->xpathContext;
+    } else {
+      xpathCtx = xmlXPathNewContext(xmlNode_->doc);
+    }
+
     if (xpathCtx) {
       // anchor at our current node
       xpathCtx->node = xmlNode_;
+      xmlResetError(&xpathCtx->lastError);
+
+      // without a namespace dictionary, we register the namespaces of this
+      // node, if it's an element, or of this node's root element, if it's
+      // a document
+      xmlNodePtr nsNodePtr = xmlNode_;
+      if (xmlNode_->type == XML_DOCUMENT_NODE) {
+        nsNodePtr = xmlDocGetRootElement((xmlDocPtr) xmlNode_);
+      }
 
-      // if a namespace dictionary was provided, register its contents
-      if (namespaces) {
-        // the dictionary keys are prefixes; the values are URIs
-        for (NSString *prefix in namespaces) {
-          NSString *uri = [namespaces objectForKey:prefix];
-
-          xmlChar *prefixChars = (xmlChar *) [prefix UTF8String];
-          xmlChar *uriChars = (xmlChar *) [uri UTF8String];
-          int result = xmlXPathRegisterNs(xpathCtx, prefixChars, uriChars);
-          if (result != 0) {
-#if DEBUG
-            NSCAssert1(result == 0, @"GDataXMLNode XPath namespace %@ issue",
-                      prefix);
-#endif
-          }
-        }
+      if (docPrivate == NULL) {
+        RegisterXPathNamespaces(xpathCtx, namespaces, nsNodePtr);
       } else {
-        // no namespace dictionary was provided
-        //
-        // register the namespaces of this node, if it's an element, or of
-        // this node's root element, if it's a document
-        xmlNodePtr nsNodePtr = xmlNode_;
-        if (xmlNode_->type == XML_DOCUMENT_NODE) {
-          nsNodePtr = xmlDocGetRootElement((xmlDocPtr) xmlNode_);
+        // a reused context keeps the previous evaluation's namespaces;
+        // replace them only if they differ from the ones needed now
+        BOOL isRegistered;
+        if (namespaces) {
+          isRegistered = AreEqualOrBothNilPrivate(namespaces,
+                                                  docPrivate->xpathNamespaces);
+        } else {
+          isRegistered = (docPrivate->xpathNamespaces == nil
+                          && AreNodeXPathNamespacesRegistered(xpathCtx, nsNodePtr));
         }
 
-        // step through the namespaces, if any, and register each with the
-        // xpath context
-        if (nsNodePtr != NULL) {
-          for (xmlNsPtr nsPtr = nsNodePtr->ns; nsPtr != NULL; nsPtr = nsPtr->next) {
-
-            // default namespace is nil in the tree, but there's no way to
-            // register a default namespace, so we'll register a fake one,
-            // _def_ns
-            const xmlChar* prefix = nsPtr->prefix;
-            if (prefix == NULL) {
-              prefix = (xmlChar*) kGDataXMLXPathDefaultNamespacePrefix;
-            }
+        if (!isRegistered) {
+          xmlXPathRegisteredNsCleanup(xpathCtx);
+          RegisterXPathNamespaces(xpathCtx, namespaces, nsNodePtr);
 
-            int result = xmlXPathRegisterNs(xpathCtx, prefix, nsPtr->href);
-            if (result != 0) {
-#if DEBUG
-              NSCAssert1(result == 0, @"GDataXMLNode XPath namespace %@ issue",
-                        prefix);
-#endif
+          [docPrivate->xpathNamespaces release];
+          docPrivate->xpathNamespaces = [namespaces copy];
+        }
+      }
+
+      // find or compile the expression
+      xmlXPathCompExprPtr compExpr = NULL;
+      xmlXPathCompExprPtr tempCompExpr = NULL;
+
+      if (compiledXPath) {
+        compExpr = [compiledXPath compiledExpression];
+      } else if (docPrivate) {
+        if (docPrivate->compiledXPaths == NULL) {
+          docPrivate->compiledXPaths = CFDictionaryCreateMutable(
+            kCFAllocatorDefault, 0,
+            &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+        }
+
+        GDataXMLXPath *cachedXPath;
+        cachedXPath = (GDataXMLXPath *) CFDictionaryGetValue(docPrivate->compiledXPaths,
+                                                             xpathStr);
+        if (cachedXPath == nil) {
+          // compile with our context so errors appear in its lastError
+          compExpr = xmlXPathCtxtCompile(xpathCtx, GDataGetXMLString(xpathStr));
+          if (compExpr) {
+            cachedXPath = [[[GDataXMLXPath alloc] initWithString:xpathStr
+                                                      namespaces:nil
+                                              compiledExpression:compExpr] autorelease];
+
+            if (CFDictionaryGetCount(docPrivate->compiledXPaths) >= kGDataXMLMaxCachedXPaths) {
+              CFDictionaryRemoveAllValues(docPrivate->compiledXPaths);
             }
+            NSString *key = [[xpathStr copy] autorelease];
+            CFDictionarySetValue(docPrivate->compiledXPaths, key, cachedXPath);
           }
         }
+        compExpr = [cachedXPath compiledExpression];
+      } else {
+        tempCompExpr = xmlXPathCtxtCompile(xpathCtx, GDataGetXMLString(xpathStr));
+        compExpr = tempCompExpr;
       }
 
       // now evaluate the path
-      xmlXPathObjectPtr xpathObj;
-      xpathObj = xmlXPathEval(GDataGetXMLString(xpath), xpathCtx);
+      xmlXPathObjectPtr xpathObj = NULL;
+      if (compExpr) {
+        xpathObj = xmlXPathCompiledEval(compExpr, xpathCtx);
+      }
+
       if (xpathObj) {
 
         // we have some result from the search
@@ -800,7 +957,7 @@ static xmlChar *SplitQNameReverse(const xmlChar *qname, xmlChar **prefix) {
         }
         xmlXPathFreeObject(xpathObj);
       } else {
-        // provide an error for failed evaluation
+        // provide an error for failed compilation or evaluation
         const char *msg = xpathCtx->lastError.str1;
         errorCode = xpathCtx->lastError.code;
         if (msg) {
@@ -810,7 +967,16 @@ static xmlChar *SplitQNameReverse(const xmlChar *qname, xmlChar **prefix) {
         }
       }
 
-      xmlXPathFreeContext(xpathCtx);
+      if (tempCompExpr) {
+        xmlXPathFreeCompExpr(tempCompExpr);
+      }
+
+      if (docPrivate) {
+        // don't leave the cached context pointing into the tree
+        xpathCtx->node = NULL;
+      } else {
+        xmlXPathFreeContext(xpathCtx);
+      }
     }
   } else {
     // not a valid node for using XPath
@@ -1662,6 +1828,9 @@ static xmlChar *SplitQNameReverse(const xmlChar *qname, xmlChar **prefix) {
             @"GDataXMLDocument cache creation problem");
 #endif
 
+  // the XPath caches are created when first needed
+  GDataXMLDocPrivate *docPrivate = calloc(1, sizeof(GDataXMLDocPrivate));
+
   // add a strings cache as private data for the document
   //
   // we'll use plain C pointers (xmlChar*) as the keys, and NSStrings
@@ -1681,8 +1850,10 @@ static xmlChar *SplitQNameReverse(const xmlChar *qname, xmlChar **prefix) {
     kCFAllocatorDefault, capacity,
     &keyCallBacks, &kCFTypeDictionaryValueCallBacks);
 
-  // we'll use the user-defined _private field for our cache
-  xmlDoc_->_private = dict;
+  docPrivate->stringCache = dict;
+
+  // we'll use the user-defined _private field for our caches
+  xmlDoc_->_private = docPrivate;
 }
 
 - (NSString *)description {
@@ -1691,12 +1862,25 @@ static xmlChar *SplitQNameReverse(const xmlChar *qname, xmlChar **prefix) {
 
 - (void)dealloc {
   if (xmlDoc_ != NULL) {
-    // release the strings cache
+    // release the strings and XPath caches
     //
-    // since it's a CF object, were anyone to use this in a GC environment,
-    // this would need to be released in a finalize method, too
-    if (xmlDoc_->_private != NULL) {
-      CFRelease(xmlDoc_->_private);
+    // since they're CF objects, were anyone to use this in a GC environment,
+    // these would need to be released in a finalize method, too
+    GDataXMLDocPrivate *docPrivate = xmlDoc_->_private;
+    if (docPrivate != NULL) {
+      if (docPrivate->stringCache) {
+        CFRelease(docPrivate->stringCache);
+      }
+      if (docPrivate->compiledXPaths) {
+        CFRelease(docPrivate->compiledXPaths);
+      }
+      if (docPrivate->xpathContext) {
+        xmlXPathFreeContext(docPrivate->xpathContext);
+      }
+      [docPrivate->xpathNamespaces release];
+
+      free(docPrivate);
+      xmlDoc_->_private = NULL;
     }
 
     xmlFreeDoc(xmlDoc_);
@@ -1783,6 +1967,111 @@ static xmlChar *SplitQNameReverse(const xmlChar *qname, xmlChar **prefix) {
   return nil;
 }
 
+- (NSArray *)nodesForCompiledXPath:(GDataXMLXPath *)xpath
+                             error:(NSError **)error {
+  if (xmlDoc_ != NULL) {
+    GDataXMLNode *docNode = [GDataXMLElement nodeBorrowingXMLNode:(xmlNodePtr)xmlDoc_];
+    NSArray *array = [docNode nodesForCompiledXPath:xpath
+                                              error:error];
+    return array;
+  }
+  return nil;
+}
+
+@end
+
+@implementation GDataXMLXPath
+
++ (GDataXMLXPath *)XPathWithString:(NSString *)xpath
+                        namespaces:(NSDictionary *)namespaces
+                             error:(NSError **)error {
+  return [[[self alloc] initWithString:xpath
+                            namespaces:namespaces
+                                 error:error] autorelease];
+}
+
+- (id)initWithString:(NSString *)xpath
+          namespaces:(NSDictionary *)namespaces
+               error:(NSError **)error {
+
+  // compiling doesn't need a document, but a context collects the error
+  xmlXPathContextPtr xpathCtx = xmlXPathNewContext(NULL);
+  xmlXPathCompExprPtr compExpr = NULL;
+  NSInteger errorCode = -1;
+  NSDictionary *errorInfo = nil;
+
+  if (xpathCtx) {
+    compExpr = xmlXPathCtxtCompile(xpathCtx, GDataGetXMLString(xpath));
+    if (compExpr == NULL) {
+      const char *msg = xpathCtx->lastError.str1;
+      errorCode = xpathCtx->lastError.code;
+      if (msg) {
+        NSString *errStr = [NSString stringWithUTF8String:msg];
+        errorInfo = [NSDictionary dictionaryWithObject:errStr
+                                                forKey:@"error"];
+      }
+    }
+    xmlXPathFreeContext(xpathCtx);
+  }
+
+  if (compExpr == NULL) {
+    if (error) {
+      *error = [NSError errorWithDomain:@"com.google.GDataXML"
+                                   code:errorCode
+                               userInfo:errorInfo];
+    }
+    [self release];
+    return nil;
+  }
+
+  if (error) *error = nil;
+
+  return [self initWithString:xpath
+                   namespaces:namespaces
+           compiledExpression:compExpr];
+}
+
+// the new instance takes ownership of compExpr
+- (id)initWithString:(NSString *)xpath
+          namespaces:(NSDictionary *)namespaces
+  compiledExpression:(xmlXPathCompExprPtr)compExpr {
+  self = [super init];
+  if (self) {
+    expression_ = [xpath copy];
+    namespaces_ = [namespaces copy];
+    compiledExpression_ = compExpr;
+  } else {
+    xmlXPathFreeCompExpr(compExpr);
+  }
+  return self;
+}
+
+- (void)dealloc {
+  if (compiledExpression_) {
+    xmlXPathFreeCompExpr(compiledExpression_);
+  }
+  [expression_ release];
+  [namespaces_ release];
+  [super dealloc];
+}
+
+- (NSString *)description {
+  return [NSString stringWithFormat:@"%@ %p: %@", [self class], self,
+          expression_];
+}
+
+- (NSString *)expression {
+  return expression_;
+}
+
+- (NSDictionary *)namespaces {
+  return namespaces_;
+}
+
+- (xmlXPathCompExprPtr)compiledExpression {
+  return compiledExpression_;
+}
+
 @end
 
 //